@@ -0,0 +1,62 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "Arduino.h"
+
+#define NEO_GRB     0x52
+#define NEO_KHZ800  0x0000
+
+// WS2812 at 800 kHz: 24 bits of 1.25 us per LED, then the latch
+constexpr uint32_t FAKE_WS2812_LED_US = 30;
+constexpr uint32_t FAKE_WS2812_LATCH_US = 50;
+
+class Adafruit_NeoPixel {
+public:
+  Adafruit_NeoPixel(uint16_t n, int16_t pin, uint16_t type) : mPixels(n) {
+    (void)pin;
+    (void)type;
+  }
+
+  void begin() {
+  }
+
+  void clear() {
+    std::fill(mPixels.begin(), mPixels.end(), 0);
+  }
+
+  uint16_t numPixels() const {
+    return mPixels.size();
+  }
+
+  static uint32_t Color(uint8_t r, uint8_t g, uint8_t b) {
+    return ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+  }
+
+  void setPixelColor(uint16_t i, uint8_t r, uint8_t g, uint8_t b) {
+    setPixelColor(i, Color(r, g, b));
+  }
+
+  void setPixelColor(uint16_t i, uint32_t color) {
+    if (i < mPixels.size()) {
+      mPixels[i] = color;
+    }
+  }
+
+  uint32_t getPixelColor(uint16_t i) const {
+    return i < mPixels.size() ? mPixels[i] : 0;
+  }
+
+  bool canShow() {
+    return true;
+  }
+
+  // Blocking like the real driver, interrupts off for the whole frame
+  void show() {
+    fake_arduino::advanceUs(mPixels.size() * FAKE_WS2812_LED_US + FAKE_WS2812_LATCH_US);
+  }
+
+private:
+  std::vector<uint32_t> mPixels;
+};
@@ -0,0 +1,252 @@
+#pragma once
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <memory>
+
+#include "WString.h"
+
+/*
+ * Minimal Arduino core for the host simulator. Time only moves when the simulator
+ * advances it, the fake LED drivers add the transfer time of each frame and delay()
+ * its duration. Pins only keep their mode and level, the simulator calls the
+ * interrupt and timer handlers, during a delay with advanceHook. Serial is only
+ * printed if the simulator sets an output file.
+ */
+
+typedef uint8_t byte;
+
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+#define F(str) (str)
+
+#define LOW  0
+#define HIGH 1
+
+#define INPUT        0x00
+#define OUTPUT       0x01
+#define INPUT_PULLUP 0x02
+
+#define CHANGE 0x03
+
+#define SERIAL_8N1     0x1c
+#define SERIAL_FULL    0
+#define SERIAL_TX_ONLY 2
+
+// Timer1 of the ESP8266, the simulator calls the handler at the programmed time
+#define TIM_DIV1   0
+#define TIM_DIV16  1
+#define TIM_DIV256 3
+#define TIM_EDGE   0
+#define TIM_SINGLE 0
+#define TIM_LOOP   1
+
+#define FAKE_PIN_MAX 17
+
+namespace fake_arduino {
+  extern uint64_t timeUs;
+  extern uint8_t pinModes[FAKE_PIN_MAX];
+  extern uint8_t pinLevels[FAKE_PIN_MAX];
+  extern void (*interruptHandlers[FAKE_PIN_MAX])();
+  extern void (*timer1Handler)();
+  extern uint32_t timer1Ticks;
+  extern FILE *serialOut;
+  extern void (*advanceHook)(uint64_t toUs);
+
+  // The hook moves the time to toUs, calling the handlers due on the way
+  inline void advanceUs(uint64_t us) {
+    if (advanceHook) {
+      advanceHook(timeUs + us);
+    } else {
+      timeUs += us;
+    }
+  }
+}
+
+inline unsigned long millis() {
+  return fake_arduino::timeUs / 1000;
+}
+
+inline unsigned long micros() {
+  return fake_arduino::timeUs;
+}
+
+inline void delay(unsigned long ms) {
+  fake_arduino::advanceUs(ms * 1000ULL);
+}
+
+inline void delayMicroseconds(unsigned int us) {
+  fake_arduino::advanceUs(us);
+}
+
+inline void yield() {
+}
+
+inline void randomSeed(unsigned long seed) {
+  srand(seed);
+}
+
+inline long random(long max) {
+  return max > 0 ? rand() % max : 0;
+}
+
+inline long random(long min, long max) {
+  return min < max ? min + random(max - min) : min;
+}
+
+// NTP is not simulated, time() is the host clock
+inline void configTime(const char *tz, const char *server1, const char *server2 = nullptr, const char *server3 = nullptr) {
+  (void)tz;
+  (void)server1;
+  (void)server2;
+  (void)server3;
+}
+
+inline void noInterrupts() {
+}
+
+inline void interrupts() {
+}
+
+inline void pinMode(uint8_t pin, uint8_t mode) {
+  fake_arduino::pinModes[pin] = mode;
+  if (mode == INPUT_PULLUP) {
+    fake_arduino::pinLevels[pin] = HIGH;
+  }
+}
+
+inline void digitalWrite(uint8_t pin, uint8_t level) {
+  fake_arduino::pinLevels[pin] = level;
+}
+
+inline int digitalRead(uint8_t pin) {
+  return fake_arduino::pinLevels[pin];
+}
+
+inline uint8_t digitalPinToInterrupt(uint8_t pin) {
+  return pin;
+}
+
+inline void attachInterrupt(uint8_t pin, void (*handler)(), int) {
+  fake_arduino::interruptHandlers[pin] = handler;
+}
+
+inline void detachInterrupt(uint8_t pin) {
+  fake_arduino::interruptHandlers[pin] = nullptr;
+}
+
+inline void timer1_attachInterrupt(void (*handler)()) {
+  fake_arduino::timer1Handler = handler;
+}
+
+inline void timer1_enable(uint8_t divider, uint8_t intType, uint8_t reload) {
+  (void)divider;
+  (void)intType;
+  (void)reload;
+}
+
+inline void timer1_write(uint32_t ticks) {
+  fake_arduino::timer1Ticks = ticks;
+}
+
+class IPAddress {
+public:
+  String toString() const {
+    return "127.0.0.1";
+  }
+};
+
+class HardwareSerial {
+public:
+  void begin(unsigned long baud, int config = SERIAL_8N1, int mode = SERIAL_FULL) {
+    (void)baud;
+    (void)config;
+    (void)mode;
+  }
+
+  size_t write(uint8_t c) {
+    if (fake_arduino::serialOut) {
+      fputc(c, fake_arduino::serialOut);
+    }
+    return 1;
+  }
+
+  size_t print(const char *str) {
+    if (fake_arduino::serialOut) {
+      fputs(str, fake_arduino::serialOut);
+    }
+    return strlen(str);
+  }
+
+  size_t print(const String &str) {
+    return print(str.c_str());
+  }
+
+  size_t print(const IPAddress &ip) {
+    return print(ip.toString());
+  }
+
+  size_t print(char c) {
+    return write(c);
+  }
+
+  size_t print(long value) {
+    return print(String(value));
+  }
+
+  size_t print(unsigned long value) {
+    return print(String(value));
+  }
+
+  size_t print(int value) {
+    return print((long)value);
+  }
+
+  size_t print(unsigned int value) {
+    return print((unsigned long)value);
+  }
+
+  size_t print(unsigned char value) {
+    return print((unsigned long)value);
+  }
+
+  size_t print(double value, int decimals = 2) {
+    return print(String(value, decimals));
+  }
+
+  template<typename T>
+  size_t println(const T &value) {
+    return print(value) + println();
+  }
+
+  size_t println() {
+    return print("\r\n");
+  }
+
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+    va_list args;
+    va_start(args, format);
+    int size = fake_arduino::serialOut ? vfprintf(fake_arduino::serialOut, format, args) : vsnprintf(nullptr, 0, format, args);
+    va_end(args);
+    return size < 0 ? 0 : size;
+  }
+
+  void flush() {
+    if (fake_arduino::serialOut) {
+      fflush(fake_arduino::serialOut);
+    }
+  }
+};
+
+inline HardwareSerial Serial;
+
+#include "Esp.h"
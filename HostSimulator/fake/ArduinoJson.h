@@ -0,0 +1,866 @@
+#pragma once
+
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <limits>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "WString.h"
+
+/*
+ * Subset of the ArduinoJson 6 API used by the firmwares, over a tree of nodes on
+ * the heap. The behavior follows the library (members in insertion order, a missing
+ * member reads as null and is only created on assignment, as<T>() and is<T>()
+ * rules, floats with 9 significant digits, NaN written as null), but not its cost:
+ * the document capacity is not enforced and the timings of JSON code are not the
+ * ones of the library.
+ */
+
+struct JsonNode {
+  enum Type { Null, Bool, Integer, Float, Text, Array, Object };
+
+  Type type = Null;
+  bool boolean = false;
+  int64_t integer = 0;
+  double real = 0;
+  std::string text;
+  std::vector<std::pair<std::string, std::shared_ptr<JsonNode>>> members;
+  std::vector<std::shared_ptr<JsonNode>> items;
+
+  void reset(Type newType) {
+    type = newType;
+    text.clear();
+    members.clear();
+    items.clear();
+  }
+
+  std::shared_ptr<JsonNode> find(const char *key) const {
+    for (const auto &member : members) {
+      if (member.first == key) {
+        return member.second;
+      }
+    }
+    return nullptr;
+  }
+
+  std::shared_ptr<JsonNode> clone() const {
+    auto node = std::make_shared<JsonNode>(*this);
+    for (auto &member : node->members) {
+      member.second = member.second->clone();
+    }
+    for (auto &item : node->items) {
+      item = item->clone();
+    }
+    return node;
+  }
+};
+
+class JsonArray;
+class JsonObject;
+
+class JsonVariant {
+public:
+  // Node type of the as<T>() and is<T>() checks of the subclasses, any for a variant
+  static constexpr JsonNode::Type NODE_TYPE = JsonNode::Null;
+
+  JsonVariant() {
+  }
+
+  JsonVariant(std::shared_ptr<JsonNode> node) : mNode(node) {
+  }
+
+  JsonVariant(const JsonVariant &other) = default;
+
+  // Assigning a variant copies the value, as through a member of a document
+  JsonVariant& operator=(const JsonVariant &other) {
+    set(other);
+    return *this;
+  }
+
+  template<typename T>
+  JsonVariant& operator=(const T &value) {
+    set(value);
+    return *this;
+  }
+
+  JsonVariant operator[](const char *key) const {
+    JsonVariant member(mNode && mNode->type == JsonNode::Object ? mNode->find(key) : nullptr);
+    member.mParent = std::make_shared<JsonVariant>(*this);
+    member.mKey = key;
+    return member;
+  }
+
+  JsonVariant operator[](const String &key) const {
+    return (*this)[key.c_str()];
+  }
+
+  JsonVariant operator[](int index) const {
+    bool found = mNode && mNode->type == JsonNode::Array && index >= 0 && (size_t)index < mNode->items.size();
+    JsonVariant item(found ? mNode->items[index] : nullptr);
+    item.mParent = std::make_shared<JsonVariant>(*this);
+    item.mIndex = index;
+    return item;
+  }
+
+  template<typename T>
+  T as() const {
+    if constexpr (std::is_base_of<JsonVariant, T>::value) {
+      if (std::is_same<T, JsonVariant>::value || (mNode && mNode->type == T::NODE_TYPE)) {
+        return T(mNode);
+      }
+      return T();
+    }
+    else if constexpr (std::is_same<T, const char*>::value || std::is_same<T, char*>::value) {
+      return mNode && mNode->type == JsonNode::Text ? (T)mNode->text.c_str() : nullptr;
+    }
+    else if constexpr (std::is_same<T, String>::value) {
+      const char *str = as<const char*>();
+      return str ? String(str) : String("null");
+    }
+    else if constexpr (std::is_same<T, bool>::value) {
+      if (!mNode) {
+        return false;
+      }
+      switch (mNode->type) {
+        case JsonNode::Bool: return mNode->boolean;
+        case JsonNode::Integer: return mNode->integer != 0;
+        case JsonNode::Float: return mNode->real != 0;
+        default: return false;
+      }
+    }
+    else if constexpr (std::is_floating_point<T>::value) {
+      if (mNode && mNode->type == JsonNode::Integer) {
+        return (T)mNode->integer;
+      }
+      if (mNode && mNode->type == JsonNode::Float) {
+        return (T)mNode->real;
+      }
+      return 0;
+    }
+    else if constexpr (std::is_integral<T>::value) {
+      if (mNode && mNode->type == JsonNode::Integer && isInRange<T>(mNode->integer)) {
+        return (T)mNode->integer;
+      }
+      if (mNode && mNode->type == JsonNode::Float && isInRange<T>(mNode->real)) {
+        return (T)mNode->real;
+      }
+      return 0;
+    }
+    else {
+      static_assert(std::is_integral<T>::value, "Type not supported by the ArduinoJson shim");
+    }
+  }
+
+  template<typename T>
+  bool is() const {
+    if (!mNode) {
+      return false;
+    }
+    if constexpr (std::is_base_of<JsonVariant, T>::value) {
+      return std::is_same<T, JsonVariant>::value || mNode->type == T::NODE_TYPE;
+    }
+    else if constexpr (std::is_same<T, const char*>::value || std::is_same<T, char*>::value ||
+                       std::is_same<T, String>::value) {
+      return mNode->type == JsonNode::Text;
+    }
+    else if constexpr (std::is_same<T, bool>::value) {
+      return mNode->type == JsonNode::Bool;
+    }
+    else if constexpr (std::is_floating_point<T>::value) {
+      return mNode->type == JsonNode::Integer || mNode->type == JsonNode::Float;
+    }
+    else if constexpr (std::is_integral<T>::value) {
+      return mNode->type == JsonNode::Integer && isInRange<T>(mNode->integer);
+    }
+    else {
+      return false;
+    }
+  }
+
+  // const char* name = json["name"]; float value = json["value"];
+  template<typename T, typename = typename std::enable_if<!std::is_base_of<JsonVariant, T>::value>::type>
+  operator T() const {
+    return as<T>();
+  }
+
+  bool isNull() const {
+    return !mNode || mNode->type == JsonNode::Null;
+  }
+
+  bool containsKey(const char *key) const {
+    return mNode && mNode->type == JsonNode::Object && mNode->find(key) != nullptr;
+  }
+
+  size_t size() const {
+    if (!mNode) {
+      return 0;
+    }
+    return mNode->type == JsonNode::Array ? mNode->items.size() :
+           mNode->type == JsonNode::Object ? mNode->members.size() : 0;
+  }
+
+  void set(std::nullptr_t) {
+    resolve().reset(JsonNode::Null);
+  }
+
+  void set(const char *str) {
+    JsonNode &node = resolve();
+    if (str == nullptr) {
+      node.reset(JsonNode::Null);
+      return;
+    }
+    node.reset(JsonNode::Text);
+    node.text = str;
+  }
+
+  void set(const String &str) {
+    set(str.c_str());
+  }
+
+  void set(const JsonVariant &other) {
+    if (other.isNull()) {
+      set(nullptr);
+      return;
+    }
+    std::shared_ptr<JsonNode> copy = other.mNode->clone();
+    resolve() = *copy;
+  }
+
+  template<typename T, typename = typename std::enable_if<std::is_arithmetic<T>::value>::type>
+  void set(T value) {
+    JsonNode &node = resolve();
+    if constexpr (std::is_same<T, bool>::value) {
+      node.reset(JsonNode::Bool);
+      node.boolean = value;
+    }
+    else if constexpr (std::is_integral<T>::value) {
+      node.reset(JsonNode::Integer);
+      node.integer = value;
+    }
+    else {
+      node.reset(JsonNode::Float);
+      node.real = value;
+    }
+  }
+
+  JsonArray createNestedArray(const char *key);
+  JsonArray createNestedArray(const String &key);
+  JsonObject createNestedObject(const char *key);
+  JsonObject createNestedObject(const String &key);
+
+  std::shared_ptr<JsonNode> getNode() const {
+    return mNode;
+  }
+
+protected:
+  template<typename T, typename V>
+  static bool isInRange(V value) {
+    if constexpr (std::is_floating_point<V>::value) {
+      return value >= (V)std::numeric_limits<T>::lowest() && value <= (V)std::numeric_limits<T>::max();
+    }
+    else if constexpr (std::is_signed<T>::value) {
+      return value >= (int64_t)std::numeric_limits<T>::lowest() && value <= (int64_t)std::numeric_limits<T>::max();
+    }
+    else {
+      return value >= 0 && (uint64_t)value <= (uint64_t)std::numeric_limits<T>::max();
+    }
+  }
+
+  // Node of the variant, created with its missing parents on the first write
+  JsonNode& resolve() {
+    if (mNode) {
+      return *mNode;
+    }
+    mNode = std::make_shared<JsonNode>();
+    if (!mParent) {
+      return *mNode;
+    }
+    JsonNode &parent = mParent->resolve();
+    if (mIndex < 0) {
+      if (parent.type != JsonNode::Object) {
+        parent.reset(JsonNode::Object);
+      }
+      parent.members.emplace_back(mKey, mNode);
+    }
+    else {
+      if (parent.type != JsonNode::Array) {
+        parent.reset(JsonNode::Array);
+      }
+      while (parent.items.size() < (size_t)mIndex) {
+        parent.items.push_back(std::make_shared<JsonNode>());
+      }
+      parent.items.push_back(mNode);
+    }
+    return *mNode;
+  }
+
+  std::shared_ptr<JsonNode> mNode;
+  std::shared_ptr<JsonVariant> mParent;
+  std::string mKey;
+  int mIndex = -1;
+};
+
+class JsonArray : public JsonVariant {
+public:
+  static constexpr JsonNode::Type NODE_TYPE = JsonNode::Array;
+
+  class iterator {
+  public:
+    iterator(std::vector<std::shared_ptr<JsonNode>>::const_iterator it) : mIt(it) {
+    }
+
+    JsonVariant operator*() const {
+      return JsonVariant(*mIt);
+    }
+
+    iterator& operator++() {
+      ++mIt;
+      return *this;
+    }
+
+    bool operator!=(const iterator &other) const {
+      return mIt != other.mIt;
+    }
+
+  private:
+    std::vector<std::shared_ptr<JsonNode>>::const_iterator mIt;
+  };
+
+  using JsonVariant::JsonVariant;
+  using JsonVariant::operator=;
+
+  JsonArray() {
+  }
+
+  // Null if the variant is not an array
+  JsonArray(const JsonVariant &variant) : JsonVariant(variant.is<JsonArray>() ? variant.getNode() : nullptr) {
+  }
+
+  iterator begin() const {
+    return mNode ? iterator(mNode->items.begin()) : iterator({});
+  }
+
+  iterator end() const {
+    return mNode ? iterator(mNode->items.end()) : iterator({});
+  }
+
+  template<typename T>
+  bool add(const T &value) {
+    if (!mNode) {
+      return false;
+    }
+    mNode->items.push_back(std::make_shared<JsonNode>());
+    JsonVariant(mNode->items.back()).set(value);
+    return true;
+  }
+
+  JsonArray createNestedArray();
+  JsonObject createNestedObject();
+};
+
+class JsonObject : public JsonVariant {
+public:
+  static constexpr JsonNode::Type NODE_TYPE = JsonNode::Object;
+
+  using JsonVariant::JsonVariant;
+  using JsonVariant::operator=;
+
+  JsonObject() {
+  }
+
+  // Null if the variant is not an object
+  JsonObject(const JsonVariant &variant) : JsonVariant(variant.is<JsonObject>() ? variant.getNode() : nullptr) {
+  }
+};
+
+inline JsonArray JsonVariant::createNestedArray(const char *key) {
+  JsonVariant member = (*this)[key];
+  member.resolve().reset(JsonNode::Array);
+  return JsonArray(member.mNode);
+}
+
+inline JsonArray JsonVariant::createNestedArray(const String &key) {
+  return createNestedArray(key.c_str());
+}
+
+inline JsonObject JsonVariant::createNestedObject(const char *key) {
+  JsonVariant member = (*this)[key];
+  member.resolve().reset(JsonNode::Object);
+  return JsonObject(member.mNode);
+}
+
+inline JsonObject JsonVariant::createNestedObject(const String &key) {
+  return createNestedObject(key.c_str());
+}
+
+inline JsonArray JsonArray::createNestedArray() {
+  if (!mNode) {
+    return JsonArray();
+  }
+  auto node = std::make_shared<JsonNode>();
+  node->type = JsonNode::Array;
+  mNode->items.push_back(node);
+  return JsonArray(node);
+}
+
+inline JsonObject JsonArray::createNestedObject() {
+  if (!mNode) {
+    return JsonObject();
+  }
+  auto node = std::make_shared<JsonNode>();
+  node->type = JsonNode::Object;
+  mNode->items.push_back(node);
+  return JsonObject(node);
+}
+
+class JsonDocument : public JsonVariant {
+public:
+  using JsonVariant::operator=;
+
+  JsonDocument() : JsonVariant(std::make_shared<JsonNode>()) {
+  }
+
+  JsonDocument(const JsonDocument &other) : JsonVariant(other.mNode->clone()) {
+  }
+
+  JsonDocument& operator=(const JsonDocument &other) {
+    mNode = other.mNode->clone();
+    return *this;
+  }
+
+  void clear() {
+    mNode->reset(JsonNode::Null);
+  }
+
+  template<typename T>
+  T to() {
+    mNode->reset(T::NODE_TYPE);
+    return T(mNode);
+  }
+};
+
+template<size_t N>
+class StaticJsonDocument : public JsonDocument {
+public:
+  using JsonDocument::operator=;
+
+  size_t capacity() const {
+    return N;
+  }
+};
+
+class DynamicJsonDocument : public JsonDocument {
+public:
+  using JsonDocument::operator=;
+
+  explicit DynamicJsonDocument(size_t capacity) : mCapacity(capacity) {
+  }
+
+  size_t capacity() const {
+    return mCapacity;
+  }
+
+private:
+  size_t mCapacity;
+};
+
+class DeserializationError {
+public:
+  enum Code { Ok, EmptyInput, IncompleteInput, InvalidInput, NoMemory, TooDeep };
+
+  DeserializationError(Code code = Ok) : mCode(code) {
+  }
+
+  explicit operator bool() const {
+    return mCode != Ok;
+  }
+
+  bool operator==(Code code) const {
+    return mCode == code;
+  }
+
+  bool operator!=(Code code) const {
+    return mCode != code;
+  }
+
+  Code code() const {
+    return mCode;
+  }
+
+  const char* c_str() const {
+    static const char *NAMES[] = {"Ok", "EmptyInput", "IncompleteInput", "InvalidInput", "NoMemory", "TooDeep"};
+    return NAMES[mCode];
+  }
+
+  const char* f_str() const {
+    return c_str();
+  }
+
+private:
+  Code mCode;
+};
+
+namespace fake_json {
+  constexpr uint8_t NESTING_LIMIT = 10;
+
+  inline void writeString(const std::string &str, std::string &out) {
+    out += '"';
+    for (char c : str) {
+      switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default: out += c; break;
+      }
+    }
+    out += '"';
+  }
+
+  inline void write(const JsonNode *node, std::string &out) {
+    char buf[32];
+    switch (node ? node->type : JsonNode::Null) {
+      case JsonNode::Null:
+        out += "null";
+        break;
+      case JsonNode::Bool:
+        out += node->boolean ? "true" : "false";
+        break;
+      case JsonNode::Integer:
+        snprintf(buf, sizeof(buf), "%lld", (long long)node->integer);
+        out += buf;
+        break;
+      case JsonNode::Float:
+        if (!isfinite(node->real)) {
+          out += "null";
+          break;
+        }
+        snprintf(buf, sizeof(buf), "%.9g", node->real);
+        out += buf;
+        break;
+      case JsonNode::Text:
+        writeString(node->text, out);
+        break;
+      case JsonNode::Array:
+        out += '[';
+        for (size_t i = 0; i < node->items.size(); i++) {
+          out += i ? "," : "";
+          write(node->items[i].get(), out);
+        }
+        out += ']';
+        break;
+      case JsonNode::Object:
+        out += '{';
+        for (size_t i = 0; i < node->members.size(); i++) {
+          out += i ? "," : "";
+          writeString(node->members[i].first, out);
+          out += ':';
+          write(node->members[i].second.get(), out);
+        }
+        out += '}';
+        break;
+    }
+  }
+
+  // Parse the first value of the input, the rest is ignored like the library does
+  class Parser {
+  public:
+    Parser(const char *input, size_t size) : mPos(input), mEnd(input + size) {
+    }
+
+    DeserializationError parse(JsonNode &root) {
+      skipSpaces();
+      if (mPos == mEnd) {
+        return DeserializationError::EmptyInput;
+      }
+      return parseValue(root, 0);
+    }
+
+  private:
+    void skipSpaces() {
+      while (mPos < mEnd && isspace((unsigned char)*mPos)) {
+        mPos++;
+      }
+    }
+
+    bool skipWord(const char *word) {
+      size_t size = strlen(word);
+      if ((size_t)(mEnd - mPos) < size || strncmp(mPos, word, size) != 0) {
+        return false;
+      }
+      mPos += size;
+      return true;
+    }
+
+    DeserializationError parseValue(JsonNode &node, uint8_t depth) {
+      skipSpaces();
+      if (mPos == mEnd) {
+        return DeserializationError::IncompleteInput;
+      }
+      switch (*mPos) {
+        case '{':
+          return depth >= NESTING_LIMIT ? DeserializationError::TooDeep : parseObject(node, depth + 1);
+        case '[':
+          return depth >= NESTING_LIMIT ? DeserializationError::TooDeep : parseArray(node, depth + 1);
+        case '"':
+          node.reset(JsonNode::Text);
+          return parseString(node.text);
+        case 't':
+          node.reset(JsonNode::Bool);
+          node.boolean = true;
+          return skipWord("true") ? DeserializationError::Ok : DeserializationError::InvalidInput;
+        case 'f':
+          node.reset(JsonNode::Bool);
+          node.boolean = false;
+          return skipWord("false") ? DeserializationError::Ok : DeserializationError::InvalidInput;
+        case 'n':
+          node.reset(JsonNode::Null);
+          return skipWord("null") ? DeserializationError::Ok : DeserializationError::InvalidInput;
+        default:
+          return parseNumber(node);
+      }
+    }
+
+    DeserializationError parseObject(JsonNode &node, uint8_t depth) {
+      node.reset(JsonNode::Object);
+      mPos++;
+      skipSpaces();
+      if (mPos < mEnd && *mPos == '}') {
+        mPos++;
+        return DeserializationError::Ok;
+      }
+      while (true) {
+        std::string key;
+        skipSpaces();
+        if (mPos == mEnd) {
+          return DeserializationError::IncompleteInput;
+        }
+        if (*mPos != '"') {
+          return DeserializationError::InvalidInput;
+        }
+        DeserializationError error = parseString(key);
+        if (error) {
+          return error;
+        }
+        skipSpaces();
+        if (mPos == mEnd) {
+          return DeserializationError::IncompleteInput;
+        }
+        if (*mPos++ != ':') {
+          return DeserializationError::InvalidInput;
+        }
+        auto value = std::make_shared<JsonNode>();
+        error = parseValue(*value, depth);
+        if (error) {
+          return error;
+        }
+        // A duplicated key keeps the last value
+        bool replaced = false;
+        for (auto &member : node.members) {
+          if (member.first == key) {
+            member.second = value;
+            replaced = true;
+          }
+        }
+        if (!replaced) {
+          node.members.emplace_back(key, value);
+        }
+        if (!parseSeparator('}', error)) {
+          return error;
+        }
+      }
+    }
+
+    DeserializationError parseArray(JsonNode &node, uint8_t depth) {
+      node.reset(JsonNode::Array);
+      mPos++;
+      skipSpaces();
+      if (mPos < mEnd && *mPos == ']') {
+        mPos++;
+        return DeserializationError::Ok;
+      }
+      while (true) {
+        auto value = std::make_shared<JsonNode>();
+        DeserializationError error = parseValue(*value, depth);
+        if (error) {
+          return error;
+        }
+        node.items.push_back(value);
+        if (!parseSeparator(']', error)) {
+          return error;
+        }
+      }
+    }
+
+    // Return false at the end of the container (error is Ok) or on an error
+    bool parseSeparator(char close, DeserializationError &error) {
+      skipSpaces();
+      if (mPos == mEnd) {
+        error = DeserializationError::IncompleteInput;
+        return false;
+      }
+      char c = *mPos++;
+      if (c == ',') {
+        return true;
+      }
+      error = c == close ? DeserializationError::Ok : DeserializationError::InvalidInput;
+      return false;
+    }
+
+    DeserializationError parseString(std::string &str) {
+      mPos++;
+      while (mPos < mEnd && *mPos != '"') {
+        char c = *mPos++;
+        if (c != '\\') {
+          str += c;
+          continue;
+        }
+        if (mPos == mEnd) {
+          return DeserializationError::IncompleteInput;
+        }
+        c = *mPos++;
+        switch (c) {
+          case 'b': str += '\b'; break;
+          case 'f': str += '\f'; break;
+          case 'n': str += '\n'; break;
+          case 'r': str += '\r'; break;
+          case 't': str += '\t'; break;
+          case 'u': {
+            if (mEnd - mPos < 4) {
+              return DeserializationError::IncompleteInput;
+            }
+            unsigned int code = strtoul(std::string(mPos, 4).c_str(), nullptr, 16);
+            mPos += 4;
+            if (code < 0x80) {
+              str += (char)code;
+            }
+            else if (code < 0x800) {
+              str += (char)(0xC0 | (code >> 6));
+              str += (char)(0x80 | (code & 0x3F));
+            }
+            else {
+              str += (char)(0xE0 | (code >> 12));
+              str += (char)(0x80 | ((code >> 6) & 0x3F));
+              str += (char)(0x80 | (code & 0x3F));
+            }
+            break;
+          }
+          default: str += c; break;
+        }
+      }
+      if (mPos == mEnd) {
+        return DeserializationError::IncompleteInput;
+      }
+      mPos++;
+      return DeserializationError::Ok;
+    }
+
+    DeserializationError parseNumber(JsonNode &node) {
+      const char *start = mPos;
+      bool isFloat = false;
+      while (mPos < mEnd && (isdigit((unsigned char)*mPos) || strchr("+-.eE", *mPos))) {
+        isFloat |= *mPos == '.' || *mPos == 'e' || *mPos == 'E';
+        mPos++;
+      }
+      if (mPos == start) {
+        return DeserializationError::InvalidInput;
+      }
+      std::string number(start, mPos);
+      char *end = nullptr;
+      if (!isFloat) {
+        errno = 0;
+        long long value = strtoll(number.c_str(), &end, 10);
+        if (*end == '\0' && errno == 0) {
+          node.reset(JsonNode::Integer);
+          node.integer = value;
+          return DeserializationError::Ok;
+        }
+      }
+      double value = strtod(number.c_str(), &end);
+      if (*end != '\0') {
+        return DeserializationError::InvalidInput;
+      }
+      node.reset(JsonNode::Float);
+      node.real = value;
+      return DeserializationError::Ok;
+    }
+
+    const char *mPos;
+    const char *mEnd;
+  };
+
+  // The input stops at its size or at the first null character
+  inline DeserializationError deserialize(JsonDocument &doc, const char *input, size_t size) {
+    doc.clear();
+    if (input == nullptr) {
+      return DeserializationError::EmptyInput;
+    }
+    const char *nul = (const char*)memchr(input, '\0', size);
+    Parser parser(input, nul ? nul - input : size);
+    DeserializationError error = parser.parse(*doc.getNode());
+    if (error) {
+      doc.clear();
+    }
+    return error;
+  }
+}
+
+inline DeserializationError deserializeJson(JsonDocument &doc, const char *input, size_t size) {
+  return fake_json::deserialize(doc, input, size);
+}
+
+inline DeserializationError deserializeJson(JsonDocument &doc, const uint8_t *input, size_t size) {
+  return fake_json::deserialize(doc, (const char*)input, size);
+}
+
+inline DeserializationError deserializeJson(JsonDocument &doc, const char *input) {
+  return fake_json::deserialize(doc, input, input ? strlen(input) : 0);
+}
+
+inline DeserializationError deserializeJson(JsonDocument &doc, const String &input) {
+  return fake_json::deserialize(doc, input.c_str(), input.size());
+}
+
+// Write at most size - 1 characters and a null character, return the written size
+inline size_t serializeJson(const JsonVariant &json, char *output, size_t size) {
+  std::string out;
+  fake_json::write(json.getNode().get(), out);
+  if (size == 0) {
+    return 0;
+  }
+  size_t written = std::min(out.size(), size - 1);
+  memcpy(output, out.data(), written);
+  output[written] = '\0';
+  return written;
+}
+
+template<size_t N>
+inline size_t serializeJson(const JsonVariant &json, char (&output)[N]) {
+  return serializeJson(json, output, N);
+}
+
+inline size_t serializeJson(const JsonVariant &json, String &output) {
+  std::string out;
+  fake_json::write(json.getNode().get(), out);
+  output = out;
+  return out.size();
+}
+
+inline size_t measureJson(const JsonVariant &json) {
+  std::string out;
+  fake_json::write(json.getNode().get(), out);
+  return out.size();
+}
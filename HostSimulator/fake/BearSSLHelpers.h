@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <openssl/evp.h>
+#include <openssl/rsa.h>
+#include <openssl/x509.h>
+
+/*
+ * BearSSL classes of the OTA signature check over OpenSSL, the same as the OtaUpdate
+ * tools: SHA-256 and RSA PKCS#1 v1.5 verification with a DER public key.
+ */
+namespace BearSSL {
+
+class PublicKey {
+public:
+  PublicKey(const uint8_t *der, size_t size) {
+    mKey = d2i_PUBKEY(nullptr, &der, size);
+  }
+
+  ~PublicKey() {
+    EVP_PKEY_free(mKey);
+  }
+
+  PublicKey(const PublicKey&) = delete;
+  PublicKey& operator=(const PublicKey&) = delete;
+
+  EVP_PKEY* getKey() const {
+    return mKey;
+  }
+
+private:
+  EVP_PKEY *mKey = nullptr;
+};
+
+class HashSHA256 {
+public:
+  HashSHA256() {
+    mCtx = EVP_MD_CTX_new();
+  }
+
+  ~HashSHA256() {
+    EVP_MD_CTX_free(mCtx);
+  }
+
+  HashSHA256(const HashSHA256&) = delete;
+  HashSHA256& operator=(const HashSHA256&) = delete;
+
+  void begin() {
+    EVP_DigestInit_ex(mCtx, EVP_sha256(), nullptr);
+  }
+
+  void add(const void *data, uint32_t size) {
+    EVP_DigestUpdate(mCtx, data, size);
+  }
+
+  void end() {
+    EVP_DigestFinal_ex(mCtx, mHash, nullptr);
+  }
+
+  int len() const {
+    return sizeof(mHash);
+  }
+
+  const void* hash() const {
+    return mHash;
+  }
+
+private:
+  EVP_MD_CTX *mCtx = nullptr;
+  uint8_t mHash[32] = {};
+};
+
+class SigningVerifier {
+public:
+  SigningVerifier(PublicKey *key) : mKey(key) {
+  }
+
+  bool verify(HashSHA256 *hash, const void *signature, uint32_t size) {
+    if (mKey->getKey() == nullptr) {
+      return false;
+    }
+    EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new(mKey->getKey(), nullptr);
+    bool valid = ctx && EVP_PKEY_verify_init(ctx) == 1 &&
+                 EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_PKCS1_PADDING) == 1 &&
+                 EVP_PKEY_CTX_set_signature_md(ctx, EVP_sha256()) == 1 &&
+                 EVP_PKEY_verify(ctx, (const uint8_t*)signature, size, (const uint8_t*)hash->hash(), hash->len()) == 1;
+    EVP_PKEY_CTX_free(ctx);
+    return valid;
+  }
+
+private:
+  PublicKey *mKey;
+};
+
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+/*
+ * Network client, only a receive buffer: the fake HTTP client loads the body of the
+ * response in it, MQTT goes through the fake PubSubClient, which only sets the count
+ * of its messages waiting to be read.
+ */
+class Client {
+public:
+  virtual ~Client() {
+  }
+
+  void setRx(const std::string &data) {
+    mRx = data;
+    mRxPos = 0;
+  }
+
+  int available() const {
+    return mRx.size() - mRxPos + mPending;
+  }
+
+  void setPending(size_t pending) {
+    mPending = pending;
+  }
+
+  size_t readBytes(uint8_t *buf, size_t size) {
+    size_t n = mRx.size() - mRxPos < size ? mRx.size() - mRxPos : size;
+    mRx.copy((char*)buf, n, mRxPos);
+    mRxPos += n;
+    return n;
+  }
+
+  size_t readBytes(char *buf, size_t size) {
+    return readBytes((uint8_t*)buf, size);
+  }
+
+  // Open while there is data to read
+  uint8_t connected() const {
+    return mRxPos < mRx.size();
+  }
+
+  void stop() {
+    setRx("");
+  }
+
+private:
+  std::string mRx;
+  size_t mRxPos = 0;
+  size_t mPending = 0;
+};
@@ -0,0 +1,10 @@
+#pragma once
+
+// Host build, the fake WiFi and MQTT client don't use them
+#define WIFI_SSID           "host"
+#define WIFI_PASSWORD       "host"
+
+#define MQTT_BROKER_HOST    "127.0.0.1"
+#define MQTT_BROKER_PORT    1883
+#define MQTT_USERNAME       "host"
+#define MQTT_PASSWORD       "host"
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * EEPROM emulation of the ESP8266 core, a RAM copy of one flash sector. Erased at
+ * start, the simulator fills it for an old config.
+ */
+class EEPROMClass {
+public:
+  EEPROMClass() {
+    memset(mData, 0xFF, sizeof(mData));
+  }
+
+  void begin(size_t size) {
+    mSize = size < sizeof(mData) ? size : sizeof(mData);
+  }
+
+  uint8_t read(int address) const {
+    return mData[address];
+  }
+
+  void write(int address, uint8_t value) {
+    mData[address] = value;
+  }
+
+  template<typename T>
+  T& get(int address, T &value) const {
+    memcpy(&value, mData + address, sizeof(T));
+    return value;
+  }
+
+  template<typename T>
+  const T& put(int address, const T &value) {
+    memcpy(mData + address, &value, sizeof(T));
+    return value;
+  }
+
+  bool commit() {
+    mCommits++;
+    return true;
+  }
+
+  bool end() {
+    return commit();
+  }
+
+  size_t length() const {
+    return mSize;
+  }
+
+  uint8_t* getDataPtr() {
+    return mData;
+  }
+
+  uint32_t getCommits() const {
+    return mCommits;
+  }
+
+private:
+  uint8_t mData[4096];
+  size_t mSize = 0;
+  uint32_t mCommits = 0;
+};
+
+inline EEPROMClass EEPROM;
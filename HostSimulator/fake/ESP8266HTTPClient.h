@@ -0,0 +1,78 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+#include "Arduino.h"
+#include "ESP8266WiFi.h"
+#include "Updater.h"
+
+/*
+ * HTTP client answering from the files the simulator sets for each URL, the body of
+ * the response is read from the client stream.
+ */
+
+#define HTTP_CODE_OK        200
+#define HTTP_CODE_NOT_FOUND 404
+
+#define HTTPC_ERROR_CONNECTION_FAILED (-1)
+
+namespace fake_http {
+  inline std::map<std::string, std::string> files;
+  inline uint32_t requests = 0;
+}
+
+class HTTPClient {
+public:
+  bool begin(WiFiClient &client, const String &url) {
+    mClient = &client;
+    mUrl = url;
+    return true;
+  }
+
+  int GET() {
+    fake_http::requests++;
+    auto file = fake_http::files.find(mUrl);
+    if (file == fake_http::files.end()) {
+      mClient->setRx("");
+      mSize = -1;
+      return HTTP_CODE_NOT_FOUND;
+    }
+    mClient->setRx(file->second);
+    mSize = file->second.size();
+    return HTTP_CODE_OK;
+  }
+
+  int getSize() const {
+    return mSize;
+  }
+
+  String getString() {
+    String body;
+    uint8_t buf[256];
+    size_t n;
+    while ((n = mClient->readBytes(buf, sizeof(buf))) > 0) {
+      body.append((const char*)buf, n);
+    }
+    return body;
+  }
+
+  WiFiClient* getStreamPtr() {
+    return mClient;
+  }
+
+  static String errorToString(int error) {
+    return error == HTTPC_ERROR_CONNECTION_FAILED ? "connection failed" : "error";
+  }
+
+  void end() {
+    if (mClient) {
+      mClient->stop();
+    }
+  }
+
+private:
+  WiFiClient *mClient = nullptr;
+  String mUrl;
+  int mSize = -1;
+};
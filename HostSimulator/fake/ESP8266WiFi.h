@@ -0,0 +1,98 @@
+#pragma once
+
+#include "Arduino.h"
+#include "Client.h"
+
+/*
+ * WiFi station, connected at once. The RSSI and the sleep mode are kept for the
+ * simulator.
+ */
+
+#define WIFI_STA 1
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_DISCONNECTED = 6,
+} wl_status_t;
+
+typedef enum {
+  WIFI_NONE_SLEEP = 0,
+  WIFI_LIGHT_SLEEP = 1,
+  WIFI_MODEM_SLEEP = 2,
+} WiFiSleepType_t;
+
+class WiFiClient : public Client {
+};
+
+class ESP8266WiFiClass {
+public:
+  bool mode(int mode) {
+    (void)mode;
+    return true;
+  }
+
+  bool hostname(const char *name) {
+    mHostname = name;
+    return true;
+  }
+
+  const char* getHostname() const {
+    return mHostname.c_str();
+  }
+
+  wl_status_t begin(const char *ssid, const char *password) {
+    (void)ssid;
+    (void)password;
+    return WL_CONNECTED;
+  }
+
+  wl_status_t status() const {
+    return mStatus;
+  }
+
+  void setStatus(wl_status_t status) {
+    mStatus = status;
+  }
+
+  IPAddress localIP() const {
+    return IPAddress();
+  }
+
+  String macAddress() const {
+    return "5C:CF:7F:00:00:01";
+  }
+
+  long RSSI() const {
+    return mRssi;
+  }
+
+  void setRssi(long rssi) {
+    mRssi = rssi;
+  }
+
+  bool setSleepMode(WiFiSleepType_t type, uint8_t listenInterval = 0) {
+    mSleepMode = type;
+    mListenInterval = listenInterval;
+    return true;
+  }
+
+  WiFiSleepType_t getSleepMode() const {
+    return mSleepMode;
+  }
+
+  uint8_t getListenInterval() const {
+    return mListenInterval;
+  }
+
+private:
+  String mHostname;
+  wl_status_t mStatus = WL_CONNECTED;
+  long mRssi = -60;
+  WiFiSleepType_t mSleepMode = WIFI_NONE_SLEEP;
+  uint8_t mListenInterval = 0;
+};
+
+inline ESP8266WiFiClass WiFi;
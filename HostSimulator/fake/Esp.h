@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * ESP8266 chip: the RTC user memory, random at power on like the real one, and the
+ * filesystem area of the flash (flash_hal.h), a NOR flash where a write only clears
+ * bits. restart() only counts, the simulator runs setup() again.
+ */
+
+constexpr uint32_t FAKE_FLASH_SECTOR_SIZE = 4096;
+constexpr uint32_t FAKE_FLASH_FS_SIZE = 8 * FAKE_FLASH_SECTOR_SIZE;
+constexpr uint32_t FAKE_RTC_USER_MEMORY_SIZE = 512;
+
+class EspClass {
+public:
+  EspClass() {
+    memset(mFlash, 0xFF, sizeof(mFlash));
+    powerOn();
+  }
+
+  // Power loss, the RTC memory is lost
+  void powerOn() {
+    for (uint32_t i = 0; i < sizeof(mRtc); i++) {
+      mRtc[i] = rand();
+    }
+  }
+
+  void restart() {
+    mRestarts++;
+  }
+
+  uint32_t getRestarts() const {
+    return mRestarts;
+  }
+
+  uint32_t getChipId() const {
+    return 0x123456;
+  }
+
+  uint32_t getFreeHeap() const {
+    return 40000;
+  }
+
+  uint32_t getFlashChipSize() const {
+    return 4 * 1024 * 1024;
+  }
+
+  uint32_t getSketchSize() const {
+    return 512 * 1024;
+  }
+
+  uint32_t getFreeSketchSpace() const {
+    return 1024 * 1024;
+  }
+
+  // The RTC user memory offset is in 4 bytes words
+  bool rtcUserMemoryRead(uint32_t offset, uint32_t *data, size_t size) {
+    if (offset * 4 + size > sizeof(mRtc)) {
+      return false;
+    }
+    memcpy(data, mRtc + offset * 4, size);
+    return true;
+  }
+
+  bool rtcUserMemoryWrite(uint32_t offset, uint32_t *data, size_t size) {
+    if (offset * 4 + size > sizeof(mRtc)) {
+      return false;
+    }
+    memcpy(mRtc + offset * 4, data, size);
+    return true;
+  }
+
+  // Only the filesystem area exists, from address 0
+  bool flashEraseSector(uint32_t sector) {
+    if ((sector + 1) * FAKE_FLASH_SECTOR_SIZE > sizeof(mFlash)) {
+      return false;
+    }
+    memset(mFlash + sector * FAKE_FLASH_SECTOR_SIZE, 0xFF, FAKE_FLASH_SECTOR_SIZE);
+    mFlashErases++;
+    return true;
+  }
+
+  bool flashWrite(uint32_t address, const uint32_t *data, size_t size) {
+    if (address + size > sizeof(mFlash)) {
+      return false;
+    }
+    for (size_t i = 0; i < size; i++) {
+      mFlash[address + i] &= ((const uint8_t*)data)[i];
+    }
+    return true;
+  }
+
+  bool flashRead(uint32_t address, uint32_t *data, size_t size) {
+    if (address + size > sizeof(mFlash)) {
+      return false;
+    }
+    memcpy(data, mFlash + address, size);
+    return true;
+  }
+
+  uint32_t getFlashErases() const {
+    return mFlashErases;
+  }
+
+private:
+  uint8_t mRtc[FAKE_RTC_USER_MEMORY_SIZE];
+  uint8_t mFlash[FAKE_FLASH_FS_SIZE];
+  uint32_t mFlashErases = 0;
+  uint32_t mRestarts = 0;
+};
+
+inline EspClass ESP;
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "Arduino.h"
+
+/*
+ * Subset of NeoPixelBus used by the LedStripLight2 DMA and UART outputs. Show() copies
+ * the pixels to the transfer buffer and returns, the transfer of the frame then runs
+ * in simulated time: CanShow() is false until it ends, and a Show() during it waits
+ * for the end like the real driver.
+ */
+
+// WS2812 at 800 kHz: 24 bits of 1.25 us per LED, then the latch
+constexpr uint32_t FAKE_NEOPIXELBUS_LED_US = 30;
+constexpr uint32_t FAKE_NEOPIXELBUS_LATCH_US = 50;
+
+struct NeoGrbFeature {};
+struct NeoEsp8266Dma800KbpsMethod {};
+struct NeoEsp8266AsyncUart1800KbpsMethod {};
+
+struct RgbColor {
+  RgbColor(uint8_t r, uint8_t g, uint8_t b) : R(r), G(g), B(b) {
+  }
+
+  explicit RgbColor(uint8_t brightness) : R(brightness), G(brightness), B(brightness) {
+  }
+
+  uint8_t R;
+  uint8_t G;
+  uint8_t B;
+};
+
+template<typename T_COLOR_FEATURE, typename T_METHOD>
+class NeoPixelBus {
+public:
+  NeoPixelBus(uint16_t countPixels) : mPixels(countPixels, RgbColor(0)), mTransfer(countPixels, RgbColor(0)) {
+  }
+
+  void Begin() {
+  }
+
+  uint16_t PixelCount() const {
+    return mPixels.size();
+  }
+
+  void ClearTo(RgbColor color) {
+    std::fill(mPixels.begin(), mPixels.end(), color);
+  }
+
+  void SetPixelColor(uint16_t i, RgbColor color) {
+    if (i < mPixels.size()) {
+      mPixels[i] = color;
+    }
+  }
+
+  RgbColor GetPixelColor(uint16_t i) const {
+    return i < mPixels.size() ? mPixels[i] : RgbColor(0);
+  }
+
+  bool CanShow() const {
+    return micros() >= mTransferEndUs;
+  }
+
+  void Show() {
+    unsigned long now = micros();
+    if (now < mTransferEndUs) {
+      fake_arduino::advanceUs(mTransferEndUs - now);
+    }
+    mTransfer = mPixels;
+    mTransferEndUs = micros() + mPixels.size() * FAKE_NEOPIXELBUS_LED_US + FAKE_NEOPIXELBUS_LATCH_US;
+  }
+
+private:
+  std::vector<RgbColor> mPixels;
+  std::vector<RgbColor> mTransfer;
+  unsigned long mTransferEndUs = 0;
+};
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Client.h"
+
+/*
+ * MQTT client with the limits of PubSubClient: a message larger than the buffer
+ * (default 256 bytes, header and topic included) is not sent nor received. Without
+ * broker, connect() succeeds and the published messages are only counted. With the
+ * broker of a simulator (setBroker()), the connection, the messages and the
+ * subscriptions go to it, and it delivers the messages with receive(). A simulator
+ * without broker can also push() messages, received one per loop() like the real
+ * client reads one packet per call.
+ */
+
+#define MQTT_MAX_PACKET_SIZE 256
+#define MQTT_MAX_HEADER_SIZE 5
+
+#define MQTT_CONNECTION_TIMEOUT     -4
+#define MQTT_CONNECTION_LOST        -3
+#define MQTT_CONNECT_FAILED         -2
+#define MQTT_DISCONNECTED           -1
+#define MQTT_CONNECTED               0
+
+#define MQTT_CALLBACK_SIGNATURE std::function<void(char*, uint8_t*, unsigned int)> callback
+
+class PubSubClient;
+
+class FakeMqttBroker {
+public:
+  virtual ~FakeMqttBroker() {
+  }
+
+  // Return false to refuse the connection, as on a timeout
+  virtual bool connect(PubSubClient *client, const char *id, const char *willTopic, const char *willMessage,
+                       bool willRetain) = 0;
+  virtual void disconnect(PubSubClient *client) = 0;
+  virtual void publish(PubSubClient *client, const char *topic, const uint8_t *payload, unsigned int size,
+                       bool retain) = 0;
+  virtual void subscribe(PubSubClient *client, const char *topic) = 0;
+};
+
+class PubSubClient {
+public:
+  PubSubClient() {
+  }
+
+  PubSubClient(Client &client) : mClient(&client) {
+  }
+
+  PubSubClient& setServer(const char *host, uint16_t port) {
+    (void)host;
+    (void)port;
+    return *this;
+  }
+
+  PubSubClient& setCallback(MQTT_CALLBACK_SIGNATURE) {
+    mCallback = callback;
+    return *this;
+  }
+
+  bool setBufferSize(uint16_t size) {
+    mBufferSize = size;
+    return true;
+  }
+
+  uint16_t getBufferSize() const {
+    return mBufferSize;
+  }
+
+  bool connect(const char *id) {
+    return connect(id, nullptr, nullptr);
+  }
+
+  bool connect(const char *id, const char *user, const char *pass) {
+    return connect(id, user, pass, nullptr, 0, false, nullptr);
+  }
+
+  bool connect(const char *id, const char *user, const char *pass, const char *willTopic, uint8_t willQos,
+               bool willRetain, const char *willMessage) {
+    (void)user;
+    (void)pass;
+    (void)willQos;
+    if (mBroker && !mBroker->connect(this, id, willTopic, willMessage, willRetain)) {
+      mState = MQTT_CONNECTION_TIMEOUT;
+      return false;
+    }
+    mState = MQTT_CONNECTED;
+    mConnects++;
+    return true;
+  }
+
+  void disconnect() {
+    if (mBroker && connected()) {
+      mBroker->disconnect(this);
+    }
+    mState = MQTT_DISCONNECTED;
+  }
+
+  bool connected() const {
+    return mState == MQTT_CONNECTED;
+  }
+
+  int state() const {
+    return mState;
+  }
+
+  bool subscribe(const char *topic, uint8_t qos = 0) {
+    (void)qos;
+    if (!connected()) {
+      return false;
+    }
+    if (mBroker) {
+      mBroker->subscribe(this, topic);
+    }
+    return true;
+  }
+
+  bool unsubscribe(const char *topic) {
+    (void)topic;
+    return connected();
+  }
+
+  bool publish(const char *topic, const char *payload, bool retain = false) {
+    return publish(topic, (const uint8_t*)payload, payload ? strlen(payload) : 0, retain);
+  }
+
+  bool publish(const char *topic, const uint8_t *payload, unsigned int size, bool retain = false) {
+    if (!connected() || !fits(topic, size)) {
+      return false;
+    }
+    mPublished++;
+    mPublishedBytes += strlen(topic) + size;
+    if (mBroker) {
+      mBroker->publish(this, topic, payload, size, retain);
+    }
+    return true;
+  }
+
+  bool loop() {
+    if (!connected()) {
+      return false;
+    }
+    if (!mInbound.empty()) {
+      std::pair<std::string, std::string> message = mInbound.front();
+      mInbound.pop_front();
+      setPending();
+      receive(message.first.c_str(), (const uint8_t*)message.second.data(), message.second.size());
+    }
+    return true;
+  }
+
+  // Message waiting in the socket, received by the next loop()
+  void push(const char *topic, const uint8_t *payload, unsigned int size) {
+    mInbound.emplace_back(topic, std::string((const char*)payload, size));
+    setPending();
+  }
+
+  size_t getPending() const {
+    return mInbound.size();
+  }
+
+  void setBroker(FakeMqttBroker *broker) {
+    mBroker = broker;
+  }
+
+  // Connection lost without DISCONNECT, the broker sends the will
+  void drop() {
+    mState = MQTT_CONNECTION_LOST;
+  }
+
+  // Message from the broker, dropped like the real client if larger than the buffer
+  bool receive(const char *topic, const uint8_t *payload, unsigned int size) {
+    if (!connected() || !fits(topic, size) || !mCallback) {
+      return false;
+    }
+    // Topic and payload are in the client buffer, the payload is followed by a spare byte
+    size_t topicSize = strlen(topic) + 1;
+    mBuffer.assign(topicSize + size + 1, 0);
+    memcpy(mBuffer.data(), topic, topicSize);
+    memcpy(mBuffer.data() + topicSize, payload, size);
+    mCallback((char*)mBuffer.data(), mBuffer.data() + topicSize, size);
+    return true;
+  }
+
+  uint32_t getPublished() const {
+    return mPublished;
+  }
+
+  uint64_t getPublishedBytes() const {
+    return mPublishedBytes;
+  }
+
+  uint32_t getConnects() const {
+    return mConnects;
+  }
+
+private:
+  bool fits(const char *topic, unsigned int size) const {
+    return MQTT_MAX_HEADER_SIZE + 2 + strlen(topic) + size <= mBufferSize;
+  }
+
+  // The pushed messages are data waiting in the socket
+  void setPending() {
+    if (mClient) {
+      mClient->setPending(mInbound.size());
+    }
+  }
+
+  Client *mClient = nullptr;
+  std::function<void(char*, uint8_t*, unsigned int)> mCallback;
+  FakeMqttBroker *mBroker = nullptr;
+  std::vector<uint8_t> mBuffer;
+  std::deque<std::pair<std::string, std::string>> mInbound;
+  uint16_t mBufferSize = MQTT_MAX_PACKET_SIZE;
+  int mState = MQTT_DISCONNECTED;
+  uint32_t mPublished = 0;
+  uint64_t mPublishedBytes = 0;
+  uint32_t mConnects = 0;
+};
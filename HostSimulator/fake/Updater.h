@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+/*
+ * Flash update, the written image is kept for the simulator.
+ */
+class UpdaterClass {
+public:
+  bool begin(size_t size) {
+    mImage.clear();
+    mSize = size;
+    mRunning = true;
+    return true;
+  }
+
+  size_t write(const uint8_t *data, size_t size) {
+    if (!mRunning || mImage.size() + size > mSize) {
+      return 0;
+    }
+    mImage.insert(mImage.end(), data, data + size);
+    return size;
+  }
+
+  // Fails if the image is not complete, the update is then aborted
+  bool end(bool evenIfRemaining = false) {
+    if (!mRunning) {
+      return false;
+    }
+    mRunning = false;
+    mDone = evenIfRemaining || mImage.size() == mSize;
+    return mDone;
+  }
+
+  uint8_t getError() const {
+    return mDone ? 0 : 1;
+  }
+
+  bool isDone() const {
+    return mDone;
+  }
+
+  const std::vector<uint8_t>& getImage() const {
+    return mImage;
+  }
+
+private:
+  std::vector<uint8_t> mImage;
+  size_t mSize = 0;
+  bool mRunning = false;
+  bool mDone = false;
+};
+
+inline UpdaterClass Update;
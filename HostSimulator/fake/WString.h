@@ -0,0 +1,162 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+/*
+ * Arduino String over std::string, with the conversions of the ESP8266 core: numbers
+ * in base 10, floats with 2 decimals, a char is a one character string.
+ */
+class String : public std::string {
+public:
+  String() {
+  }
+
+  String(const char *str) : std::string(str ? str : "") {
+  }
+
+  String(const std::string &str) : std::string(str) {
+  }
+
+  explicit String(char c) : std::string(1, c) {
+  }
+
+  explicit String(unsigned char value) : std::string(std::to_string(value)) {
+  }
+
+  explicit String(int value) : std::string(std::to_string(value)) {
+  }
+
+  explicit String(unsigned int value) : std::string(std::to_string(value)) {
+  }
+
+  explicit String(long value) : std::string(std::to_string(value)) {
+  }
+
+  explicit String(unsigned long value) : std::string(std::to_string(value)) {
+  }
+
+  explicit String(float value, unsigned char decimals = 2) {
+    setFloat(value, decimals);
+  }
+
+  explicit String(double value, unsigned char decimals = 2) {
+    setFloat(value, decimals);
+  }
+
+  bool equals(const char *str) const {
+    return compare(str ? str : "") == 0;
+  }
+
+  bool equals(const String &str) const {
+    return compare(str) == 0;
+  }
+
+  bool startsWith(const String &prefix) const {
+    return compare(0, prefix.size(), prefix) == 0;
+  }
+
+  bool endsWith(const String &suffix) const {
+    return size() >= suffix.size() && compare(size() - suffix.size(), suffix.size(), suffix) == 0;
+  }
+
+  int indexOf(const String &str, unsigned int from = 0) const {
+    size_t pos = find(str, from);
+    return pos == npos ? -1 : (int)pos;
+  }
+
+  String substring(unsigned int from, unsigned int to = (unsigned int)-1) const {
+    if (from > size()) {
+      return String();
+    }
+    return String(substr(from, to - from));
+  }
+
+  void replace(const String &find, const String &replace) {
+    if (find.empty()) {
+      return;
+    }
+    size_t pos = 0;
+    while ((pos = std::string::find(find, pos)) != npos) {
+      std::string::replace(pos, find.size(), replace);
+      pos += replace.size();
+    }
+  }
+
+  bool concat(const String &str) {
+    append(str);
+    return true;
+  }
+
+  long toInt() const {
+    return atol(c_str());
+  }
+
+  float toFloat() const {
+    return atof(c_str());
+  }
+
+  bool isEmpty() const {
+    return empty();
+  }
+
+  String& operator+=(const String &str) {
+    append(str);
+    return *this;
+  }
+
+  String& operator+=(const char *str) {
+    append(str ? str : "");
+    return *this;
+  }
+
+  String& operator+=(char c) {
+    push_back(c);
+    return *this;
+  }
+
+  template<typename T>
+  String& operator+=(T value) {
+    append(String(value));
+    return *this;
+  }
+
+private:
+  void setFloat(double value, unsigned char decimals) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+    assign(buf);
+  }
+};
+
+inline String operator+(const String &a, const String &b) {
+  String sum(a);
+  sum += b;
+  return sum;
+}
+
+inline String operator+(const String &a, const char *b) {
+  String sum(a);
+  sum += b;
+  return sum;
+}
+
+inline String operator+(const char *a, const String &b) {
+  String sum(a);
+  sum += b;
+  return sum;
+}
+
+inline String operator+(const String &a, char b) {
+  String sum(a);
+  sum += b;
+  return sum;
+}
+
+template<typename T>
+inline String operator+(const String &a, T b) {
+  String sum(a);
+  sum += String(b);
+  return sum;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "ESP8266WiFi.h"
+
+// TLS is not simulated, the fake HTTP client answers directly
+namespace BearSSL {
+
+class WiFiClientSecure : public WiFiClient {
+public:
+  void setInsecure() {
+  }
+};
+
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+
+#include "Adafruit_NeoPixel.h"
+
+/*
+ * ezWS2812 streams the pixels over SPI: set_pixel() sends `num` LEDs of the same
+ * color from the current position and end_transfer() latches them. LEDs after the
+ * last one sent keep their previous color.
+ */
+class ezWS2812 {
+public:
+  ezWS2812(uint16_t num) : mLatched(num), mStream(num) {
+  }
+
+  void begin() {
+  }
+
+  void set_all(uint8_t r, uint8_t g, uint8_t b, uint8_t brightness = 100) {
+    mCursor = 0;
+    set_pixel(mLatched.size(), r, g, b, brightness, true);
+  }
+
+  void set_pixel(uint16_t num, uint8_t r, uint8_t g, uint8_t b, uint8_t brightness = 100, bool end = true) {
+    uint32_t color = Adafruit_NeoPixel::Color(r * brightness / 100, g * brightness / 100, b * brightness / 100);
+    for (uint16_t i = 0; i < num && mCursor < mStream.size(); i++) {
+      mStream[mCursor++] = color;
+    }
+    fake_arduino::advanceUs(num * FAKE_WS2812_LED_US);
+    if (end) {
+      end_transfer();
+    }
+  }
+
+  void end_transfer() {
+    std::copy(mStream.begin(), mStream.begin() + mCursor, mLatched.begin());
+    mCursor = 0;
+    mShowCount++;
+    fake_arduino::advanceUs(FAKE_WS2812_LATCH_US);
+  }
+
+  // Simulator only
+  uint32_t getPixelColor(uint16_t i) const {
+    return mLatched[i];
+  }
+
+  uint32_t getShowCount() const {
+    return mShowCount;
+  }
+
+private:
+  std::vector<uint32_t> mLatched;
+  std::vector<uint32_t> mStream;
+  uint16_t mCursor = 0;
+  uint32_t mShowCount = 0;
+};
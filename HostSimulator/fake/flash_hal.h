@@ -0,0 +1,7 @@
+#pragma once
+
+#include "Esp.h"
+
+// Filesystem area of the flash layout, the sectors of the fake ESP flash
+#define FS_PHYS_ADDR 0
+#define FS_PHYS_SIZE FAKE_FLASH_FS_SIZE
@@ -0,0 +1,64 @@
+#!/usr/bin/env python3
+
+import argparse
+import re
+
+# Function definition at file scope, the body opening on the same line or the next one
+FUNCTION_RE = re.compile(r"^([A-Za-z_][\w:<>\*& ]*?[\s\*&]+)(\w+)\(([^;{}]*)\)\s*\{")
+KEYWORDS = ("if", "while", "for", "switch", "return")
+SCOPES = ("struct", "class", "enum", "namespace", "union", "typedef")
+
+
+def get_prototypes(lines):
+    """Return the prototypes of the file scope functions and the line of the first one."""
+    prototypes = []
+    first = None
+    depth = 0
+    for i, line in enumerate(lines):
+        if depth == 0 and not line.startswith(SCOPES):
+            # The Arduino builder also accepts the brace on the next line
+            text = line
+            if i + 1 < len(lines) and lines[i + 1].strip() == "{":
+                text = line.rstrip() + " {"
+            m = FUNCTION_RE.match(text)
+            if m and m.group(2) not in KEYWORDS:
+                if first is None:
+                    first = i
+                # Default values are only allowed once, in the prototype they would be twice
+                args = re.sub(r"\s*=\s*[^,]+", "", m.group(3))
+                prototypes.append(f"{m.group(1)}{m.group(2)}({args});")
+        depth += line.count("{") - line.count("}")
+    return prototypes, first
+
+
+def convert(ino, name):
+    """Do what the Arduino builder does before compiling a sketch: include Arduino.h and
+    declare the functions before their first use, with #line to keep the .ino lines in
+    the compiler messages."""
+    lines = ino.replace("\r\n", "\n").split("\n")
+    prototypes, first = get_prototypes(lines)
+    if first is None:
+        first = len(lines)
+    # The prototypes go before a conditional block holding the first function
+    while first > 0 and lines[first - 1].startswith("#if"):
+        first -= 1
+    name = name.replace("\\", "\\\\")
+    out = ["#include <Arduino.h>", f'#line 1 "{name}"']
+    out += lines[:first]
+    out += prototypes
+    out += [f'#line {first + 1} "{name}"']
+    out += lines[first:]
+    return "\n".join(out)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Convert an Arduino sketch to a C++ file for the host build")
+    parser.add_argument("ino", help="Sketch .ino file")
+    parser.add_argument("cpp", help="Generated .cpp file")
+    args = parser.parse_args()
+
+    with open(args.ino, newline="") as f:
+        cpp = convert(f.read(), args.ino)
+
+    with open(args.cpp, "w") as f:
+        f.write(cpp)
@@ -0,0 +1,327 @@
+#include <algorithm>
+#include <getopt.h>
+#include <map>
+#include <memory>
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "ConfigStore.h"
+#include "NvmConfig.h"
+
+// Keys and value sizes of RadiatorController, the energy counters are its checkpoint
+static const struct {
+    uint8_t key;
+    uint8_t size;
+} keys[] = {
+    {CONFIG_KEY_SENSOR_TEMPERATURE_OFFSET, 4},
+    {CONFIG_KEY_SENSOR_HUMIDITY_OFFSET, 4},
+    {CONFIG_KEY_DEVICE_SERIAL_NUMBER, 4},
+    {CONFIG_KEY_ROOM_NAME, CONFIG_ROOM_NAME_SIZE},
+    {CONFIG_KEY_THERMOSTAT_SETPOINT, 4},
+    {CONFIG_KEY_THERMOSTAT_HYSTERESIS, 4},
+    {CONFIG_KEY_RADIATOR_POWER, 2},
+    {CONFIG_KEY_ENERGY_COUNTERS, CONFIG_ENERGY_COUNTERS_SIZE},
+    {CONFIG_KEY_POWER_SAVE_LATENCY, 2},
+};
+constexpr size_t KEY_COUNT = sizeof(keys) / sizeof(keys[0]);
+constexpr size_t ENERGY_KEY_INDEX = 7;
+
+typedef std::map<uint8_t, std::vector<uint8_t>> Values;
+
+// NOR flash: a write only clears bits, an erase sets a whole sector. A power cut stops
+// the operation in progress after the given number of word writes and erases.
+class SimFlash {
+public:
+    SimFlash() {
+        memset(mData, 0xFF, sizeof(mData));
+    }
+
+    uint8_t getSectorCount() const {
+        return CONFIG_STORE_SECTOR_MAX;
+    }
+
+    bool erase(uint8_t sector) {
+        if (!step()) {
+            // Partial erase, some words erased, the others with some bits set
+            for (uint16_t i = 0; i < CONFIG_STORE_SECTOR_SIZE / 4; i++) {
+                mData[sector][i] |= mRng() % 2 ? 0xFFFFFFFF : mRng();
+            }
+            return false;
+        }
+        memset(mData[sector], 0xFF, CONFIG_STORE_SECTOR_SIZE);
+        mErases[sector]++;
+        return true;
+    }
+
+    bool write(uint8_t sector, uint16_t offset, const uint32_t *data, uint16_t size) {
+        for (uint16_t i = 0; i < size / 4; i++) {
+            if (!step()) {
+                // Torn word, only some of its bits cleared
+                mData[sector][offset / 4 + i] &= data[i] | mRng();
+                return false;
+            }
+            mData[sector][offset / 4 + i] &= data[i];
+        }
+        return true;
+    }
+
+    bool read(uint8_t sector, uint16_t offset, uint32_t *data, uint16_t size) {
+        if (mCut) {
+            return false;
+        }
+        memcpy(data, (const uint8_t*)mData[sector] + offset, size);
+        mReadSize += size;
+        return true;
+    }
+
+    // Cut the power after this number of operations, negative for none
+    void setCut(int64_t operations) {
+        mBudget = operations;
+    }
+
+    void powerOn() {
+        mCut = false;
+        mBudget = -1;
+        mReadSize = 0;
+    }
+
+    bool isCut() const {
+        return mCut;
+    }
+
+    uint64_t getOperations() const {
+        return mOperations;
+    }
+
+    uint32_t getReadSize() const {
+        return mReadSize;
+    }
+
+    uint32_t getErases(uint8_t sector) const {
+        return mErases[sector];
+    }
+
+    void save(SimFlash &copy) const {
+        memcpy(copy.mData, mData, sizeof(mData));
+    }
+
+    void restore(const SimFlash &copy) {
+        memcpy(mData, copy.mData, sizeof(mData));
+    }
+
+private:
+    bool step() {
+        if (mCut || mBudget == 0) {
+            mCut = true;
+            return false;
+        }
+        if (mBudget > 0) {
+            mBudget--;
+        }
+        mOperations++;
+        return true;
+    }
+
+    uint32_t mData[CONFIG_STORE_SECTOR_MAX][CONFIG_STORE_SECTOR_SIZE / 4];
+    uint32_t mErases[CONFIG_STORE_SECTOR_MAX] = {};
+    int64_t mBudget = -1;
+    bool mCut = false;
+    uint64_t mOperations = 0;
+    uint32_t mReadSize = 0;
+    std::mt19937 mRng{2};
+};
+
+// Return true if the store holds exactly the values
+static bool check(const ConfigStore<SimFlash> &store, const Values &values) {
+    for (size_t i = 0; i < KEY_COUNT; i++) {
+        auto it = values.find(keys[i].key);
+        uint8_t value[CONFIG_STORE_VALUE_MAX];
+        if (store.has(keys[i].key) != (it != values.end())) {
+            return false;
+        }
+        if (it != values.end() && (!store.get(keys[i].key, value, keys[i].size) ||
+                                   memcmp(value, it->second.data(), keys[i].size) != 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static struct option long_options[] = {
+    {"help",       no_argument,       NULL, 'h'},
+    {"commits",    required_argument, NULL, 'n'},
+    {"cut-rate",   required_argument, NULL, 'r'},
+    {"batch-rate", required_argument, NULL, 'b'},
+    {"seed",       required_argument, NULL, 's'},
+    {NULL, 0, NULL, 0}
+};
+
+void print_help() {
+    printf("\n");
+    printf("NVM config store simulator\n");
+    printf("Usage: config_store_sim [options]\n");
+    printf("Options:\n");
+    printf("  -h, --help                Show this help message\n");
+    printf("  -n, --commits <N>         Commits, mostly energy checkpoints (default: 100000)\n");
+    printf("  -r, --cut-rate <PCT>      Commits with a power cut, in %% (default: 2)\n");
+    printf("  -b, --batch-rate <PCT>    Commits of several settings, in %% (default: 5)\n");
+    printf("  -s, --seed <N>            Random seed (default: 1)\n");
+    printf("Example:\n");
+    printf("  ./config_store_sim --commits 1000000 --cut-rate 5\n");
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t commits = 100000;
+    double cut_rate = 2;
+    double batch_rate = 5;
+    uint32_t seed = 1;
+    int opt_idx = 0;
+    int c;
+
+    // Parse arguments
+    while ((c = getopt_long(argc, argv, "hn:r:b:s:", long_options, &opt_idx)) != -1) {
+        switch (c) {
+            case 'h':
+                print_help();
+                return 0;
+            case 'n':
+                commits = strtoul(optarg, NULL, 10);
+                break;
+            case 'r':
+                cut_rate = atof(optarg);
+                break;
+            case 'b':
+                batch_rate = atof(optarg);
+                break;
+            case 's':
+                seed = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                print_help();
+                fprintf(stderr, "ERROR: Invalid option.\n");
+                return EXIT_FAILURE;
+        }
+    }
+    if (commits == 0) {
+        fprintf(stderr, "ERROR: Invalid commits.\n");
+        return EXIT_FAILURE;
+    }
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    static SimFlash flash;
+    static SimFlash snapshot;
+    std::unique_ptr<ConfigStore<SimFlash>> store(new ConfigStore<SimFlash>(flash));
+    Values values;
+    uint32_t cuts = 0;
+    uint32_t kept = 0;
+    uint32_t dropped = 0;
+    uint32_t read_max = 0;
+    int errors = 0;
+
+    store->begin();
+    store->format();
+
+    for (uint32_t n = 0; n < commits && !errors; n++) {
+        // Migration of all the keys first, then checkpoints and settings
+        Values batch;
+        double r = uniform(rng);
+        for (size_t i = 0; i < KEY_COUNT; i++) {
+            bool staged = n == 0 ||
+                          (r < batch_rate / 100 ? rng() % 2 == 0 :
+                           r < 2 * batch_rate / 100 ? i == rng() % KEY_COUNT : i == ENERGY_KEY_INDEX);
+            if (staged) {
+                std::vector<uint8_t> value(keys[i].size);
+                for (uint8_t &byte : value) {
+                    byte = rng();
+                }
+                batch[keys[i].key] = value;
+            }
+        }
+        if (batch.empty()) {
+            batch[keys[ENERGY_KEY_INDEX].key] = std::vector<uint8_t>(keys[ENERGY_KEY_INDEX].size, n);
+        }
+
+        // Cut at any operation of this commit or just after, counted on a copy first
+        bool cut = uniform(rng) * 100 < cut_rate;
+        if (cut) {
+            ConfigStore<SimFlash> trial(*store);
+            uint64_t start = flash.getOperations();
+            flash.save(snapshot);
+            for (const auto &value : batch) {
+                trial.set(value.first, value.second.data(), value.second.size());
+            }
+            trial.commit();
+            uint64_t operations = flash.getOperations() - start;
+            flash.restore(snapshot);
+            flash.setCut(rng() % (operations + 1));
+        }
+
+        for (const auto &value : batch) {
+            store->set(value.first, value.second.data(), value.second.size());
+        }
+        bool committed = store->commit();
+
+        Values updated = values;
+        for (const auto &value : batch) {
+            updated[value.first] = value.second;
+        }
+        if (!cut && !committed) {
+            fprintf(stderr, "ERROR: Commit %u failed without power cut.\n", n);
+            errors++;
+            break;
+        }
+
+        // Reboot after each cut and from time to time, all or nothing of the batch is kept
+        if (cut || n % 1000 == 999) {
+            cuts += flash.isCut();
+            flash.powerOn();
+            store.reset(new ConfigStore<SimFlash>(flash));
+            if (!store->begin()) {
+                fprintf(stderr, "ERROR: Load failed after commit %u.\n", n);
+                errors++;
+                break;
+            }
+            read_max = std::max(read_max, flash.getReadSize());
+            if (check(*store, updated)) {
+                kept++;
+                values = updated;
+            } else if (cut && check(*store, values)) {
+                dropped++;
+            } else {
+                fprintf(stderr, "ERROR: Values differ after commit %u%s.\n", n, cut ? " cut" : "");
+                errors++;
+            }
+        } else {
+            values = updated;
+        }
+    }
+
+    uint32_t erase_min = UINT32_MAX;
+    uint32_t erase_max = 0;
+    for (uint8_t s = 0; s < CONFIG_STORE_SECTOR_MAX; s++) {
+        erase_min = std::min(erase_min, flash.getErases(s));
+        erase_max = std::max(erase_max, flash.getErases(s));
+    }
+
+    // The EEPROM library erases its single sector on each commit
+    printf("Commits    : %u, %u power cuts, batch kept %u, dropped %u\n", commits, cuts, kept, dropped);
+    printf("Erases     : %u to %u per sector, %u for the EEPROM library, %.0fx its flash lifetime\n",
+           erase_min, erase_max, commits, erase_max ? (double)commits / erase_max : 0);
+    printf("Boot load  : %u bytes read max, %u bound\n", read_max,
+           CONFIG_STORE_SECTOR_MAX * CONFIG_STORE_HEADER_SIZE + CONFIG_STORE_SECTOR_SIZE);
+
+    if (read_max > CONFIG_STORE_SECTOR_MAX * CONFIG_STORE_HEADER_SIZE + CONFIG_STORE_SECTOR_SIZE) {
+        fprintf(stderr, "ERROR: Boot load out of bound.\n");
+        errors++;
+    }
+    if (errors) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
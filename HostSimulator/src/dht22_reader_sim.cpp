@@ -0,0 +1,249 @@
+#include <algorithm>
+#include <deque>
+#include <getopt.h>
+#include <math.h>
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "Arduino.h"
+#include "Dht22Reader.h"
+
+// Same settings as RadiatorController.ino
+#define DHT_PIN 3
+#define DHT_PERIOD_MS 5000
+#define LOOP_DELAY_OLD_MS 500
+
+// Adafruit DHT library read(), interrupts disabled during the frame
+#define DHT_LIB_WAKEUP_US 1000
+#define DHT_LIB_START_LOW_US 1100
+
+struct Edge {
+    uint64_t timeUs;
+    uint8_t level;
+};
+
+struct Options {
+    uint32_t readings = 200;
+    uint32_t jitter_us = 3;
+    double late_rate = 0;
+    uint32_t late_us = 30;
+    uint32_t loop_us = 1000;
+    uint32_t commands = 10000;
+    uint32_t seed = 1;
+};
+
+static std::mt19937 rng;
+static std::deque<Edge> edges;
+
+// DHT22 answer to a start signal released at releaseUs, each duration with +/- jitter
+static uint32_t schedule_frame(uint64_t releaseUs, const uint8_t data[5], const Options &opt) {
+    std::uniform_int_distribution<int> jitter(-(int)opt.jitter_us, opt.jitter_us);
+    uint64_t t = releaseUs + 1;
+    auto add = [&](uint8_t level, uint32_t durationUs) {
+        edges.push_back({ t, level });
+        t += durationUs + jitter(rng);
+    };
+
+    add(HIGH, 30);      // Host release, pulled up
+    add(LOW, 80);       // Response
+    add(HIGH, 80);
+    for (int bit = 0; bit < 40; bit++) {
+        add(LOW, 50);
+        add(HIGH, (data[bit / 8] & (0x80 >> (bit % 8))) ? 70 : 26);
+    }
+    add(LOW, 50);
+    add(HIGH, 0);       // Sensor release
+    return t - releaseUs;
+}
+
+// Move the time forward, calling the interrupt handler on each edge
+static void advance_to(uint64_t timeUs, const Options &opt) {
+    std::uniform_real_distribution<double> uniform(0, 1);
+    while (!edges.empty() && edges.front().timeUs <= timeUs) {
+        Edge edge = edges.front();
+        edges.pop_front();
+        uint64_t latency = 1 + (uniform(rng) * 100 < opt.late_rate ? opt.late_us : 0);
+        fake_arduino::timeUs = std::max(fake_arduino::timeUs, edge.timeUs + latency);
+        fake_arduino::pinLevels[DHT_PIN] = edge.level;
+        if (fake_arduino::interruptHandlers[DHT_PIN]) {
+            fake_arduino::interruptHandlers[DHT_PIN]();
+        }
+    }
+    fake_arduino::timeUs = std::max(fake_arduino::timeUs, timeUs);
+}
+
+static void encode(float temperature, float humidity, uint8_t data[5]) {
+    uint16_t h = lround(humidity * 10);
+    uint16_t t = lround(fabs(temperature) * 10) | (temperature < 0 ? 0x8000 : 0);
+    data[0] = h >> 8;
+    data[1] = h & 0xFF;
+    data[2] = t >> 8;
+    data[3] = t & 0xFF;
+    data[4] = data[0] + data[1] + data[2] + data[3];
+}
+
+// Wait between a command arrival and the next client.loop() call
+static void print_latency(const char *name, const std::vector<uint64_t> &loops, const Options &opt) {
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::vector<uint64_t> latencies;
+    for (uint32_t i = 0; i < opt.commands; i++) {
+        uint64_t arrival = loops.front() + uniform(rng) * (loops.back() - loops.front());
+        auto next = std::lower_bound(loops.begin(), loops.end(), arrival);
+        latencies.push_back(*next - arrival);
+    }
+    std::sort(latencies.begin(), latencies.end());
+    printf("%s : command latency p50 %.1f ms, p99 %.1f ms, max %.1f ms\n", name,
+           latencies[latencies.size() / 2] / 1000., latencies[latencies.size() * 99 / 100] / 1000.,
+           latencies.back() / 1000.);
+}
+
+static struct option long_options[] = {
+    {"help",      no_argument,       NULL, 'h'},
+    {"readings",  required_argument, NULL, 'n'},
+    {"jitter",    required_argument, NULL, 'j'},
+    {"late-rate", required_argument, NULL, 'r'},
+    {"late",      required_argument, NULL, 'l'},
+    {"loop-us",   required_argument, NULL, 'u'},
+    {"seed",      required_argument, NULL, 's'},
+    {NULL, 0, NULL, 0}
+};
+
+void print_help() {
+    printf("\n");
+    printf("RadiatorController DHT22 reader simulator\n");
+    printf("Usage: dht22_reader_sim [options]\n");
+    printf("Options:\n");
+    printf("  -h, --help                Show this help message\n");
+    printf("  -n, --readings <N>        Number of readings, one every 5s (default: 200)\n");
+    printf("  -j, --jitter <US>         Sensor pulse duration jitter (default: 3)\n");
+    printf("  -r, --late-rate <PCT>     Edges with a late interrupt, in %% (default: 0)\n");
+    printf("  -l, --late <US>           Late interrupt delay (default: 30)\n");
+    printf("  -u, --loop-us <US>        Time of client.loop() and the rest of loop() (default: 1000)\n");
+    printf("  -s, --seed <N>            Random seed (default: 1)\n");
+    printf("Example:\n");
+    printf("  ./dht22_reader_sim --readings 1000 --late-rate 1\n");
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    Options opt;
+    int opt_idx = 0;
+    int c;
+
+    // Parse arguments
+    while ((c = getopt_long(argc, argv, "hn:j:r:l:u:s:", long_options, &opt_idx)) != -1) {
+        switch (c) {
+            case 'h':
+                print_help();
+                return 0;
+            case 'n':
+                opt.readings = strtoul(optarg, NULL, 10);
+                break;
+            case 'j':
+                opt.jitter_us = strtoul(optarg, NULL, 10);
+                break;
+            case 'r':
+                opt.late_rate = atof(optarg);
+                break;
+            case 'l':
+                opt.late_us = strtoul(optarg, NULL, 10);
+                break;
+            case 'u':
+                opt.loop_us = strtoul(optarg, NULL, 10);
+                break;
+            case 's':
+                opt.seed = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                print_help();
+                fprintf(stderr, "ERROR: Invalid option.\n");
+                return EXIT_FAILURE;
+        }
+    }
+    if (opt.readings == 0 || opt.loop_us == 0) {
+        fprintf(stderr, "ERROR: Invalid readings or loop time.\n");
+        return EXIT_FAILURE;
+    }
+    rng.seed(opt.seed);
+
+    // Current loop(): reading in background, no delay
+    std::uniform_real_distribution<double> uniform(0, 1);
+    Dht22Reader dht(DHT_PIN);
+    std::vector<uint64_t> loops;
+    uint64_t frames_us = 0;
+    uint32_t readings = 0;
+    uint32_t failed = 0;
+    uint32_t wrong = 0;
+    uint64_t low_start_us = 0;
+    uint8_t prev_mode = INPUT;
+    float temperature = 0;
+    float humidity = 0;
+    unsigned long last_ms = 0;
+
+    fake_arduino::timeUs = 1000000;
+    dht.begin();
+    while (readings < opt.readings) {
+        unsigned long current_ms = millis();
+        if (current_ms - last_ms > DHT_PERIOD_MS) {
+            last_ms = current_ms;
+            dht.start();
+        }
+        if (dht.loop()) {
+            readings++;
+            if (isnan(dht.getTemperature())) {
+                failed++;
+            } else if (fabs(dht.getTemperature() - temperature) > 0.05 || fabs(dht.getHumidity() - humidity) > 0.05) {
+                fprintf(stderr, "Wrong reading: %.1f C %.1f %% instead of %.1f C %.1f %%.\n",
+                        dht.getTemperature(), dht.getHumidity(), temperature, humidity);
+                wrong++;
+            }
+        }
+
+        // The sensor answers once the start signal is released
+        uint8_t mode = fake_arduino::pinModes[DHT_PIN];
+        if (mode == OUTPUT && prev_mode != OUTPUT) {
+            low_start_us = fake_arduino::timeUs;
+        } else if (mode == INPUT_PULLUP && prev_mode == OUTPUT && fake_arduino::timeUs - low_start_us >= 1000) {
+            uint8_t data[5];
+            temperature = round((uniform(rng) * 50 - 10) * 10) / 10;
+            humidity = round(uniform(rng) * 1000) / 10;
+            encode(temperature, humidity, data);
+            frames_us += schedule_frame(fake_arduino::timeUs, data, opt);
+        }
+        prev_mode = mode;
+
+        loops.push_back(fake_arduino::timeUs); // client.loop()
+        advance_to(fake_arduino::timeUs + opt.loop_us, opt);
+    }
+    uint64_t duration_us = fake_arduino::timeUs - 1000000;
+
+    // Loop up to 3.3.1: blocking DHT read every 5s, then delay(500)
+    std::vector<uint64_t> old_loops;
+    uint64_t frame_us = frames_us / opt.readings;
+    uint64_t old_last_us = 0;
+    for (uint64_t t = 0; t <= duration_us + LOOP_DELAY_OLD_MS * 1000; ) {
+        old_loops.push_back(t);
+        t += opt.loop_us;
+        if (t - old_last_us > DHT_PERIOD_MS * 1000ULL) {
+            old_last_us = t;
+            t += DHT_LIB_WAKEUP_US + DHT_LIB_START_LOW_US + frame_us;
+        }
+        t += LOOP_DELAY_OLD_MS * 1000;
+    }
+
+    printf("Readings     : %u, %u failed, %u wrong\n", readings, failed, wrong);
+    printf("Frame        : %.2f ms, interrupts disabled %.2f ms per reading before, 0 now\n",
+           frame_us / 1000., frame_us / 1000.);
+    print_latency("Old loop", old_loops, opt);
+    print_latency("New loop", loops, opt);
+
+    // Without late interrupt, every reading must be decoded
+    if (opt.late_rate == 0 && (wrong || failed)) {
+        fprintf(stderr, "ERROR: Readings not decoded.\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,231 @@
+#include <getopt.h>
+#include <map>
+#include <math.h>
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "Arduino.h"
+#include "ConfigStore.h"
+#include "EnergyMeter.h"
+
+// Same settings as RadiatorController.ino
+#define TIME_ZONE "CET-1CEST,M3.5.0,M10.5.0/3"
+#define ENERGY_CHECKPOINT_PERIOD_MS 300000
+
+// Flash endurance, the settings take less than NVM_SETTINGS_SIZE of a store sector
+#define NVM_ERASE_CYCLES 100000
+#define NVM_SETTINGS_SIZE 256
+
+// Simulation starts on Monday 2024-01-01 at 00:00 local time
+#define SIM_TIME_START 1704063600
+
+struct Options {
+    uint32_t days = 7;
+    uint16_t power_w = 1500;
+    double cut_rate = 0.5;
+    uint32_t seed = 1;
+    bool csv = false;
+};
+
+struct Period {
+    double publishedKWh = 0;  // Last value published for the period
+    uint32_t drops = 0;       // Published values lower than the previous one in the period
+};
+
+// Same day as EnergyMeter
+static uint32_t get_day(time_t now) {
+    struct tm local;
+    localtime_r(&now, &local);
+    return (local.tm_year + 1900) * 1000 + local.tm_yday;
+}
+
+static uint32_t get_heating_seconds(const EnergyCounters &counters) {
+    uint32_t seconds = 0;
+    for (int i = 0; i < PILOT_WIRE_STATE_COUNT; i++) {
+        if (isPilotWireHeating((PilotWireState)i)) {
+            seconds += counters.stateSeconds[i];
+        }
+    }
+    return seconds;
+}
+
+// Pilot wire state changed by Home Assistant every 30 min, mostly comfort and eco
+static PilotWireState random_state(std::mt19937 &rng) {
+    static const PilotWireState states[] = {
+        PILOT_WIRE_STATE_COMFORT, PILOT_WIRE_STATE_COMFORT, PILOT_WIRE_STATE_COMFORT,
+        PILOT_WIRE_STATE_ECO, PILOT_WIRE_STATE_ECO, PILOT_WIRE_STATE_ECO,
+        PILOT_WIRE_STATE_COMFORT_MINUS_1, PILOT_WIRE_STATE_COMFORT_MINUS_2,
+        PILOT_WIRE_STATE_FROST_PROTECTION, PILOT_WIRE_STATE_OFF,
+    };
+    return states[std::uniform_int_distribution<int>(0, 9)(rng)];
+}
+
+static struct option long_options[] = {
+    {"help",     no_argument,       NULL, 'h'},
+    {"days",     required_argument, NULL, 'd'},
+    {"power",    required_argument, NULL, 'p'},
+    {"cut-rate", required_argument, NULL, 'r'},
+    {"seed",     required_argument, NULL, 's'},
+    {"csv",      no_argument,       NULL, 'c'},
+    {NULL, 0, NULL, 0}
+};
+
+void print_help() {
+    printf("\n");
+    printf("RadiatorController energy meter simulator\n");
+    printf("Usage: energy_meter_sim [options]\n");
+    printf("Options:\n");
+    printf("  -h, --help                Show this help message\n");
+    printf("  -d, --days <N>            Simulated duration (default: 7)\n");
+    printf("  -p, --power <W>           Radiator power (default: 1500)\n");
+    printf("  -r, --cut-rate <N>        Power cuts per day, restarting from the NVM checkpoint (default: 0.5)\n");
+    printf("  -s, --seed <N>            Random seed (default: 1)\n");
+    printf("  -c, --csv                 Print each ended day: day, reference kWh, published kWh\n");
+    printf("Example:\n");
+    printf("  ./energy_meter_sim --days 30 --cut-rate 0\n");
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    Options opt;
+    int opt_idx = 0;
+    int c;
+
+    // Parse arguments
+    while ((c = getopt_long(argc, argv, "hd:p:r:s:c", long_options, &opt_idx)) != -1) {
+        switch (c) {
+            case 'h':
+                print_help();
+                return 0;
+            case 'd':
+                opt.days = strtoul(optarg, NULL, 10);
+                break;
+            case 'p':
+                opt.power_w = strtoul(optarg, NULL, 10);
+                break;
+            case 'r':
+                opt.cut_rate = atof(optarg);
+                break;
+            case 's':
+                opt.seed = strtoul(optarg, NULL, 10);
+                break;
+            case 'c':
+                opt.csv = true;
+                break;
+            default:
+                print_help();
+                fprintf(stderr, "ERROR: Invalid option.\n");
+                return EXIT_FAILURE;
+        }
+    }
+    if (opt.days == 0 || opt.power_w == 0) {
+        fprintf(stderr, "ERROR: Invalid duration or power.\n");
+        return EXIT_FAILURE;
+    }
+    setenv("TZ", TIME_ZONE, 1);
+    tzset();
+
+    std::mt19937 rng(opt.seed);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    EnergyMeter meter;
+    EnergyCounters nvm = {};
+    PilotWireState state = PILOT_WIRE_STATE_COMFORT;
+    Period hour, day;
+    std::map<uint32_t, double> day_reference_kwh;
+    uint32_t ended_days = 0;
+    double day_error_max = 0;
+    double lost_kwh = 0;
+    double total_kwh = 0;
+    uint32_t writes = 0;
+    uint32_t cuts = 0;
+    unsigned long millis_ms = 0;
+    unsigned long last_save_ms = 0;
+
+    meter.begin(nvm, opt.power_w);
+    // One loop() per second
+    const time_t end = SIM_TIME_START + opt.days * 86400;
+    for (time_t now = SIM_TIME_START; now < end; now++, millis_ms += 1000) {
+        if ((now - SIM_TIME_START) % 1800 == 0) {
+            state = random_state(rng);
+        }
+
+        // Power cut: the counters restart from the last checkpoint, millis() from 0
+        if (uniform(rng) * 86400 < opt.cut_rate) {
+            lost_kwh += opt.power_w * ((get_heating_seconds(meter.getCounters()) - get_heating_seconds(nvm)) / 3600.) / 1000;
+            meter = EnergyMeter();
+            meter.begin(nvm, opt.power_w);
+            millis_ms = 0;
+            last_save_ms = 0;
+            cuts++;
+        }
+
+        if (meter.update(state, millis_ms, now)) {
+            // Totals of the ended periods published, then the new periods start. After a power
+            // cut, the day restored from the checkpoint can be a previous one.
+            uint32_t ended_day = meter.getCounters().day;
+            if (ended_day != get_day(now)) {
+                double published = meter.getDailyKWh();
+                double error = fabs(published - day_reference_kwh[ended_day]);
+                day_error_max = error > day_error_max ? error : day_error_max;
+                if (opt.csv) {
+                    printf("%u,%.3f,%.3f\n", ended_day, day_reference_kwh[ended_day], published);
+                }
+                ended_days++;
+                day.publishedKWh = 0;
+            }
+            hour.publishedKWh = 0;
+            meter.startPeriods(now);
+        }
+
+        // The reference counts the second after the update, as the meter on the next call
+        if (isPilotWireHeating(state)) {
+            double kwh = opt.power_w / 3600. / 1000;
+            day_reference_kwh[get_day(now)] += kwh;
+            total_kwh += kwh;
+        }
+
+        // Published every 5 min, a lower value is a new cycle for Home Assistant
+        if ((now - SIM_TIME_START) % 300 == 0) {
+            if (meter.getHourlyKWh() < hour.publishedKWh) {
+                hour.drops++;
+            }
+            if (meter.getDailyKWh() < day.publishedKWh) {
+                day.drops++;
+            }
+            hour.publishedKWh = meter.getHourlyKWh();
+            day.publishedKWh = meter.getDailyKWh();
+        }
+
+        if (millis_ms - last_save_ms >= ENERGY_CHECKPOINT_PERIOD_MS) {
+            if (memcmp(&nvm, &meter.getCounters(), sizeof(EnergyCounters)) != 0) {
+                nvm = meter.getCounters();
+                writes++;
+            }
+            last_save_ms = millis_ms;
+        }
+    }
+
+    // Each checkpoint appends the counters and a commit record to the NVM config store
+    double writes_per_day = (double)writes / opt.days;
+    double sector_writes = (double)(CONFIG_STORE_SECTOR_SIZE - CONFIG_STORE_HEADER_SIZE - NVM_SETTINGS_SIZE) /
+                           (4 + sizeof(EnergyCounters) + 8);
+    double erases_per_day = writes_per_day / sector_writes / CONFIG_STORE_SECTOR_MAX;
+    printf("Checkpoint : every %.0f min, %.1f NVM writes/day, %.2f erases/day of each sector, %.0f years for %u erase cycles\n",
+           ENERGY_CHECKPOINT_PERIOD_MS / 60000., writes_per_day, erases_per_day,
+           erases_per_day ? NVM_ERASE_CYCLES / erases_per_day / 365 : 0, NVM_ERASE_CYCLES);
+    printf("Energy     : %.2f kWh heating, %.2f kWh lost by %u power cuts\n", total_kwh, lost_kwh, cuts);
+    printf("Daily      : %u totals published, error max %.3f kWh\n", ended_days, day_error_max);
+    printf("Drops      : %u hourly, %u daily values lower than the previous one of the period\n",
+           hour.drops, day.drops);
+
+    // Without power cut, the published totals are exact to the second
+    if (cuts == 0 && (day_error_max > opt.power_w * 2 / 3600000. || hour.drops || day.drops)) {
+        fprintf(stderr, "ERROR: Energy totals differ from the reference.\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
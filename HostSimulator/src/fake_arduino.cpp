@@ -0,0 +1,12 @@
+#include "Arduino.h"
+
+namespace fake_arduino {
+  uint64_t timeUs = 0;
+  uint8_t pinModes[FAKE_PIN_MAX] = {};
+  uint8_t pinLevels[FAKE_PIN_MAX] = {};
+  void (*interruptHandlers[FAKE_PIN_MAX])() = {};
+  void (*timer1Handler)() = nullptr;
+  uint32_t timer1Ticks = 0;
+  FILE *serialOut = nullptr;
+  void (*advanceHook)(uint64_t toUs) = nullptr;
+}
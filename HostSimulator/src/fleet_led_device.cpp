@@ -0,0 +1,127 @@
+#include <string.h>
+
+#include "fleet_sim.h"
+
+#include "LedMqtt.h"
+#include "OtaUpdater.h"
+
+// Same as LedStripLight2.ino
+#define DEVICE  "LedStripLight2"
+#define VERSION "1.1.0"
+#define LED_NUM 330
+
+class LedDevice : public FleetDevice {
+public:
+    LedDevice(uint32_t id, FakeMqttBroker *broker) : FleetDevice(broker), mMqtt(mClient), mOta(DEVICE, VERSION) {
+        char mac[18];
+        snprintf(mRoomName, sizeof(mRoomName), "led%03u", id);
+        snprintf(mac, sizeof(mac), "5C:CF:7F:01:%02X:%02X", (id >> 8) & 0xFF, id & 0xFF);
+        memset(mScenes, 0xFF, sizeof(mScenes));
+        memset(mAlarms, 0xFF, sizeof(mAlarms));
+        mSerialNumber = id + 1;
+        mMqtt.setup(mRoomName, mSerialNumber, VERSION, mac);
+        char clientId[64];
+        snprintf(clientId, sizeof(clientId), "ESP8266Client-LedStrip-%s-%u", mRoomName, mSerialNumber);
+        mClientId = clientId;
+        mAvailabilityTopic = mMqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_AVAILABILITY);
+
+        // First states of the snapshot as in setup(), one segment on in white
+        mMqtt.publishMessage(mMqtt.getSegmentTopic(0, MQTT_TOPIC_LED_SUFFIX_STATE), STATE_ON);
+        mMqtt.publishMessage(mMqtt.getSegmentTopic(0, MQTT_TOPIC_LED_SUFFIX_RGB), 255, 255, 255);
+        mMqtt.publishMessage(mMqtt.getSegmentTopic(0, MQTT_TOPIC_LED_SUFFIX_EFFECT), LED_EFFECT_NONE);
+        mMqtt.publishMessage(mMqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_TRANSITION), 1.f);
+        mMqtt.publishMessage(mMqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_ALARM), mAlarms);
+        mMqtt.publishMessage(mMqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_SUNRISE), STATE_OFF);
+    }
+
+protected:
+    // mqtt_reconnect() of the sketch once connected
+    void onConnect() override {
+        char logLevelTopic[MQTT_MSG_TOPIC_MAX_SIZE];
+        snprintf(logLevelTopic, sizeof(logLevelTopic), MQTT_TOPIC_LOG_SET, mRoomName, "led");
+        mClient.subscribe(MQTT_TOPIC_HOMEASSISTANT_STATUS);
+        mClient.subscribe(MQTT_TOPIC_OTA_CHECK_UPDATE);
+        mClient.subscribe(mMqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_SUNRISE_SET));
+        mClient.subscribe(mMqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_ALARM_SET));
+        mClient.subscribe(mMqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_SCENE_SET));
+        mClient.subscribe(mMqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_SCENE_UPLOAD));
+        mClient.subscribe(mMqtt.getSegmentTopic(0, MQTT_TOPIC_LED_SUFFIX_STATE_SET));
+        mClient.subscribe(mMqtt.getSegmentTopic(0, MQTT_TOPIC_LED_SUFFIX_RGB_SET));
+        mClient.subscribe(mMqtt.getSegmentTopic(0, MQTT_TOPIC_LED_SUFFIX_EFFECT_SET));
+        mClient.subscribe(mMqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_TRANSITION_SET));
+        mClient.subscribe(mMqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_UPDATE_COMMAND));
+        mClient.subscribe(mMqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_DIAG_PING));
+        mClient.subscribe(mMqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_CONFIG_SET));
+        mClient.subscribe(logLevelTopic);
+        mMqtt.publishMessage(mMqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_AVAILABILITY), MQTT_PAYLOAD_ONLINE, true);
+        mMqtt.clearDiscoveryConfigs();
+        publishDiscovery();
+        publishConfig();
+        mMqtt.publishSnapshot();
+    }
+
+    void loopSnapshot() override {
+        if (mMqtt.isSnapshotDue(millis())) {
+            publishDiscovery();
+            mMqtt.publishSnapshot();
+        }
+    }
+
+    // The Home Assistant and OTA parts of mqtt_callback(), the other commands don't
+    // change the load
+    void callback(char *topic, uint8_t *payload, unsigned int len) override {
+        if (isTopicEqual(topic, MQTT_TOPIC_HOMEASSISTANT_STATUS)) {
+            if (isPayloadEqual<MQTT_PAYLOAD_ONLINE>((char*)payload, len)) {
+                mMqtt.scheduleSnapshot(millis(), random(MQTT_SNAPSHOT_JITTER_MAX_MS));
+            }
+        }
+        else if (isTopicEqual(topic, MQTT_TOPIC_OTA_CHECK_UPDATE)) {
+            StaticJsonDocument<256> json;
+            DeserializationError error = deserializeJson(json, payload, len);
+            if (!error) {
+                const char *url = json["url"];
+                if (mOta.checkUpdate(url) < 0) {
+                    mMqtt.publishMessageUpdateState(VERSION);
+                }
+                else {
+                    mMqtt.publishMessageUpdateState(mOta.getExpectedVersion().c_str());
+                }
+            }
+        }
+    }
+
+private:
+    void publishDiscovery() {
+        mMqtt.publishMessageSwitchSuriseConfig();
+        mMqtt.publishMessageLightConfig(0);
+        mMqtt.publishMessageUpdateConfig();
+        mMqtt.publishMessageSensorRssiConfig();
+        mMqtt.publishMessageNumberTransitionConfig();
+        mMqtt.publishMessageSensorNextAlarmConfig();
+        for (uint8_t id = 0; id < LED_SCENE_MAX; id++) {
+            mMqtt.publishMessageSceneConfig(id, mScenes[id]);
+        }
+    }
+
+    void publishConfig() {
+        StaticJsonDocument<512> json;
+        char payload[512];
+        json["serial_number"] = mSerialNumber;
+        json["room_name"] = mRoomName;
+        JsonArray segments = json.createNestedArray("led_segments");
+        segments.add(LED_NUM);
+        serializeJson(json, payload, sizeof(payload));
+        mMqtt.publishMessage(mMqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_CONFIG), payload, true);
+    }
+
+    LedMqtt mMqtt;
+    OtaUpdater mOta;
+    uint32_t mSerialNumber;
+    char mRoomName[32];
+    LedScene mScenes[LED_SCENE_MAX];
+    SunriseAlarm mAlarms[SUNRISE_ALARM_MAX];
+};
+
+std::unique_ptr<FleetDevice> create_led_device(uint32_t id, FakeMqttBroker *broker) {
+    return std::make_unique<LedDevice>(id, broker);
+}
@@ -0,0 +1,126 @@
+#include <string.h>
+
+#include "fleet_sim.h"
+
+#include "RadiatorMqtt.h"
+// After the Mqtt header as in the sketch, it uses ArduinoJson without including it
+#include "OtaUpdater.h"
+
+// Same as RadiatorController.ino
+#define DEVICE  "RadiatorController"
+#define VERSION "3.3.1"
+#define CONFIG_JSON_SIZE 512
+
+class RadiatorDevice : public FleetDevice {
+public:
+    RadiatorDevice(uint32_t id, FakeMqttBroker *broker) : FleetDevice(broker), mMqtt(mClient), mOta(DEVICE, VERSION) {
+        char mac[18];
+        snprintf(mRoomName, sizeof(mRoomName), "radiator%03u", id);
+        snprintf(mac, sizeof(mac), "5C:CF:7F:02:%02X:%02X", (id >> 8) & 0xFF, id & 0xFF);
+        mSerialNumber = id + 1;
+        mMqtt.setup(mRoomName, mSerialNumber, VERSION, mac);
+        char clientId[64];
+        snprintf(clientId, sizeof(clientId), "ESP8266Client-Radiator-%s-%u", mRoomName, mSerialNumber);
+        mClientId = clientId;
+        mAvailabilityTopic = mMqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_AVAILABILITY);
+
+        // First states of the snapshot as publish_state() in setup(), heating in comfort
+        mMqtt.publishMessage(POWER_ON);
+        mMqtt.publishMessage(MODE_HEAT);
+        mMqtt.publishMessage(PRESET_MODE_COMFORT);
+        mMqtt.publishMessage(mMqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_TARGET_TEMPERATURE), 19.5f);
+    }
+
+protected:
+    // mqtt_reconnect() of the sketch once connected
+    void onConnect() override {
+        mClient.subscribe(MQTT_TOPIC_HOMEASSISTANT_STATUS);
+        mClient.subscribe(MQTT_TOPIC_OTA_CHECK_UPDATE);
+        mClient.subscribe(mMqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_POWER_SET));
+        mClient.subscribe(mMqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_MODE_SET));
+        mClient.subscribe(mMqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_PRESET_MODE_SET));
+        mClient.subscribe(mMqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_FIRMWARE_VERSION_GET));
+        mClient.subscribe(mMqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_SERIAL_NUMBER_GET));
+        mClient.subscribe(mMqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_TEMPERATURE_OFFSET_SET));
+        mClient.subscribe(mMqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_HUMIDITY_OFFSET_SET));
+        mClient.subscribe(mMqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_TARGET_TEMPERATURE_SET));
+        mClient.subscribe(mMqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_THERMOSTAT_HYSTERESIS_SET));
+        mClient.subscribe(mMqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_RADIATOR_POWER_SET));
+        mClient.subscribe(mMqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_POWER_SAVE_LATENCY_SET));
+        mClient.subscribe(mMqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_CONFIG_SET));
+        mClient.subscribe(mMqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_UPDATE_COMMAND));
+        mMqtt.publishMessage(mMqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_AVAILABILITY), MQTT_PAYLOAD_ONLINE, true);
+        mMqtt.clearDiscoveryConfigs();
+        publishDiscovery();
+        publishConfig();
+        mMqtt.publishSnapshot();
+    }
+
+    void loopSnapshot() override {
+        if (mMqtt.isSnapshotDue(millis())) {
+            publishDiscovery();
+            mMqtt.publishSnapshot();
+        }
+    }
+
+    // The Home Assistant and OTA parts of mqtt_callback(), the other commands don't
+    // change the load
+    void callback(char *topic, uint8_t *payload, unsigned int len) override {
+        if (isTopicEqual(topic, MQTT_TOPIC_HOMEASSISTANT_STATUS)) {
+            if (isPayloadEqual<MQTT_PAYLOAD_ONLINE>((char*)payload, len)) {
+                mMqtt.scheduleSnapshot(millis(), random(MQTT_SNAPSHOT_JITTER_MAX_MS));
+            }
+        }
+        else if (isTopicEqual(topic, MQTT_TOPIC_OTA_CHECK_UPDATE)) {
+            StaticJsonDocument<256> json;
+            DeserializationError error = deserializeJson(json, payload, len);
+            if (!error) {
+                const char *url = json["url"];
+                if (mOta.checkUpdate(url) < 0) {
+                    mMqtt.publishMessageUpdateState(VERSION);
+                }
+                else {
+                    mMqtt.publishMessageUpdateState(mOta.getExpectedVersion().c_str());
+                }
+            }
+        }
+    }
+
+private:
+    void publishDiscovery() {
+        mMqtt.publishMessageSwitchConfig();
+        mMqtt.publishMessageClimateConfig();
+        mMqtt.publishMessageUpdateConfig();
+        mMqtt.publishMessageSensorTemperatureConfig();
+        mMqtt.publishMessageSensorHumidityConfig();
+        mMqtt.publishMessageSensorPilotWireJitterConfig();
+        mMqtt.publishMessageSensorEnergyHourlyConfig();
+        mMqtt.publishMessageSensorEnergyDailyConfig();
+        mMqtt.publishMessageSensorIdleConfig();
+    }
+
+    // Default config of a provisioned device
+    void publishConfig() {
+        StaticJsonDocument<CONFIG_JSON_SIZE> json;
+        char payload[CONFIG_JSON_SIZE];
+        json["serial_number"] = mSerialNumber;
+        json["room_name"] = mRoomName;
+        json["temperature_offset"] = 0.f;
+        json["humidity_offset"] = 0.f;
+        json["target_temperature"] = 19.5f;
+        json["thermostat_hysteresis"] = 0.5f;
+        json["radiator_power"] = 0;
+        json["power_save_latency"] = 0;
+        serializeJson(json, payload, sizeof(payload));
+        mMqtt.publishMessage(mMqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_CONFIG), payload, true);
+    }
+
+    RadiatorMqtt mMqtt;
+    OtaUpdater mOta;
+    uint32_t mSerialNumber;
+    char mRoomName[32];
+};
+
+std::unique_ptr<FleetDevice> create_radiator_device(uint32_t id, FakeMqttBroker *broker) {
+    return std::make_unique<RadiatorDevice>(id, broker);
+}
@@ -0,0 +1,741 @@
+#include <algorithm>
+#include <deque>
+#include <getopt.h>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "ESP8266HTTPClient.h"
+#include "fleet_sim.h"
+
+constexpr uint64_t TICK_US = 10000;
+constexpr uint64_t SOCKET_TIMEOUT_US = 15000000;      // PubSubClient MQTT_SOCKET_TIMEOUT
+constexpr uint64_t WILL_DELAY_US = 15000000 * 3 / 2;  // 1.5 x the 15 s keep alive
+constexpr uint64_t HA_DOWN_US = 10000000;             // Home Assistant restart time
+
+// Same as the Mqtt headers of the firmwares
+#define HA_CLIENT_ID    "homeassistant"
+#define HA_BUFFER_SIZE  4096
+#define HA_STATUS_TOPIC "homeassistant/status"
+#define OTA_CHECK_TOPIC "home/ota/check_update"
+#define OTA_SERVER_URL  "https://fleet.local/firmwares.json"
+
+// Released versions, one more than the sketches so the update is found
+static const char FIRMWARES_JSON[] =
+    "{\"Server URL\": \"https://fleet.local/\", \"Firmwares\": ["
+    "{\"Device\": \"LedStripLight2\", \"Chip\": \"ESP8266\", \"Version\": \"1.1.1\", \"File\": \"LedStripLight2-1.1.1.bin\"},"
+    "{\"Device\": \"RadiatorController\", \"Chip\": \"ESP8266\", \"Version\": \"3.3.2\", \"File\": \"RadiatorController-3.3.2.bin\"}]}";
+
+enum PacketType {
+    PACKET_CONNECT,
+    PACKET_SUBSCRIBE,
+    PACKET_PUBLISH,
+    PACKET_TYPE_COUNT,
+};
+
+static const char *packet_names[PACKET_TYPE_COUNT] = {"CONNECT", "SUBSCRIBE", "PUBLISH"};
+
+enum HaMessage {
+    HA_CONFIG,
+    HA_AVAILABILITY,
+    HA_STATE,
+    HA_MESSAGE_COUNT,
+};
+
+static const char *ha_message_names[HA_MESSAGE_COUNT] = {"discovery configs", "availability", "states"};
+
+// Size on the wire: fixed header with the remaining length, then the rest
+static uint32_t packet_size(uint32_t remaining) {
+    uint32_t size = 2 + remaining;
+    for (uint32_t len = remaining; len >= 128; len /= 128) {
+        size++;
+    }
+    return size;
+}
+
+// MQTT topic filter with the + and # wildcards
+static bool topic_match(const char *filter, const char *topic) {
+    while (*filter) {
+        if (*filter == '#') {
+            return true;
+        }
+        if (*filter == '+') {
+            while (*topic && *topic != '/') {
+                topic++;
+            }
+            filter++;
+            continue;
+        }
+        if (*filter != *topic) {
+            return false;
+        }
+        filter++;
+        topic++;
+    }
+    return *topic == '\0';
+}
+
+// Count per second, for the peak rate
+class RateCounter {
+public:
+    void add(uint64_t us, uint32_t count = 1) {
+        uint32_t s = us / 1000000;
+        if (s >= mBins.size()) {
+            mBins.resize(s + 1, 0);
+        }
+        mBins[s] += count;
+        mTotal += count;
+    }
+
+    uint64_t getTotal() const {
+        return mTotal;
+    }
+
+    uint32_t getPeak() const {
+        return mBins.empty() ? 0 : *std::max_element(mBins.begin(), mBins.end());
+    }
+
+private:
+    std::vector<uint32_t> mBins;
+    uint64_t mTotal = 0;
+};
+
+// Counters of a scenario, the times are relative to its start
+struct Stats {
+    RateCounter packets[PACKET_TYPE_COUNT];
+    RateCounter inbound;
+    uint64_t inboundBytes = 0;
+    RateCounter outbound;
+    uint64_t outboundBytes = 0;
+    uint32_t queueMax = 0;
+    uint64_t waitMaxUs = 0;
+    uint32_t refused = 0;
+    RateCounter ha[HA_MESSAGE_COUNT];
+    RateCounter haTotal;
+    RateCounter http;
+};
+
+/*
+ * Broker stand-in: the packets from the clients wait in a single queue served at the
+ * broker rate, then the messages are routed to the subscriptions. A connection
+ * waiting longer than the socket timeout is refused. The will of a client lost
+ * without DISCONNECT is sent after 1.5 x the keep alive, or when the same client ID
+ * connects again (session takeover).
+ */
+class FleetBroker : public FakeMqttBroker {
+public:
+    FleetBroker(double rate, Stats **stats) : mServiceUs(1e6 / rate), mStats(stats) {
+    }
+
+    bool connect(PubSubClient *client, const char *id, const char *willTopic, const char *willMessage,
+                 bool willRetain) override {
+        uint32_t remaining = 10 + 2 + strlen(id);
+        if (willTopic) {
+            remaining += 2 + strlen(willTopic) + 2 + strlen(willMessage);
+        }
+        if (mFreeAtUs > fake_arduino::timeUs + SOCKET_TIMEOUT_US) {
+            stats().refused++;
+            return false;
+        }
+        Packet packet = {PACKET_CONNECT, client, {id, "", false}, {}, 0};
+        auto session = mSessions.find(id);
+        if (session != mSessions.end()) {
+            // Takeover, the will of the previous connection is sent first
+            if (session->second.client && session->second.client != client) {
+                session->second.client->drop();
+                mClientIds.erase(session->second.client);
+            }
+            packet.takeoverWill = session->second.will;
+            mSessions.erase(session);
+        }
+        Session &next = mSessions[id];
+        next.client = client;
+        if (willTopic) {
+            next.will = {willTopic, willMessage, willRetain};
+        }
+        mClientIds[client] = id;
+        enqueue(packet, packet_size(remaining));
+        return true;
+    }
+
+    // Clean disconnection, no will
+    void disconnect(PubSubClient *client) override {
+        auto id = mClientIds.find(client);
+        if (id != mClientIds.end()) {
+            mSessions.erase(id->second);
+            mClientIds.erase(id);
+        }
+        removeClient(client);
+    }
+
+    void publish(PubSubClient *client, const char *topic, const uint8_t *payload, unsigned int size,
+                 bool retain) override {
+        Packet packet = {PACKET_PUBLISH, client, {topic, std::string((const char*)payload, size), retain}, {}, 0};
+        enqueue(packet, packet_size(2 + strlen(topic) + size));
+    }
+
+    void subscribe(PubSubClient *client, const char *topic) override {
+        Packet packet = {PACKET_SUBSCRIBE, client, {topic, "", false}, {}, 0};
+        enqueue(packet, packet_size(2 + 2 + strlen(topic) + 1));
+    }
+
+    // Device powered off: the broker only notices at the keep alive timeout
+    void lose(PubSubClient *client) {
+        auto id = mClientIds.find(client);
+        if (id != mClientIds.end()) {
+            Session &session = mSessions[id->second];
+            session.client = nullptr;
+            session.willAtUs = fake_arduino::timeUs + WILL_DELAY_US;
+            mClientIds.erase(id);
+        }
+        removeClient(client);
+    }
+
+    // Serve the packets due at the current time, then the wills of the lost clients
+    void process() {
+        uint64_t now = fake_arduino::timeUs;
+        while (!mQueue.empty() && mQueue.front().doneUs <= now) {
+            Packet packet = mQueue.front();
+            mQueue.pop_front();
+            switch (packet.type) {
+                case PACKET_CONNECT:
+                    if (!packet.takeoverWill.topic.empty()) {
+                        route(packet.takeoverWill);
+                    }
+                    break;
+                case PACKET_SUBSCRIBE:
+                    if (packet.client) {
+                        mSubscriptions.push_back({packet.client, packet.message.topic});
+                        deliverRetained(packet.client, packet.message.topic.c_str());
+                    }
+                    break;
+                case PACKET_PUBLISH:
+                    route(packet.message);
+                    break;
+                default:
+                    break;
+            }
+        }
+        for (auto it = mSessions.begin(); it != mSessions.end();) {
+            if (!it->second.client && it->second.willAtUs <= now) {
+                Message will = it->second.will;
+                it = mSessions.erase(it);
+                if (!will.topic.empty()) {
+                    route(will);
+                }
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+
+private:
+    struct Message {
+        std::string topic;
+        std::string payload;
+        bool retain = false;
+    };
+
+    struct Packet {
+        PacketType type;
+        PubSubClient *client;
+        Message message;
+        Message takeoverWill; // Sent when the CONNECT is served
+        uint64_t doneUs;
+    };
+
+    struct Session {
+        PubSubClient *client = nullptr;
+        Message will;
+        uint64_t willAtUs = 0;
+    };
+
+    struct Subscription {
+        PubSubClient *client;
+        std::string filter;
+    };
+
+    Stats& stats() {
+        return **mStats;
+    }
+
+    void enqueue(Packet &packet, uint32_t size) {
+        uint64_t now = fake_arduino::timeUs;
+        mFreeAtUs = std::max(mFreeAtUs, now) + mServiceUs;
+        packet.doneUs = mFreeAtUs;
+        mQueue.push_back(packet);
+        stats().packets[packet.type].add(now);
+        stats().inbound.add(now);
+        stats().inboundBytes += size;
+        stats().queueMax = std::max<uint32_t>(stats().queueMax, mQueue.size());
+        stats().waitMaxUs = std::max(stats().waitMaxUs, packet.doneUs - now);
+    }
+
+    // The queued packets are already sent, the subscriptions end with the connection
+    void removeClient(PubSubClient *client) {
+        for (Packet &packet : mQueue) {
+            if (packet.client == client) {
+                packet.client = nullptr;
+            }
+        }
+        mSubscriptions.erase(std::remove_if(mSubscriptions.begin(), mSubscriptions.end(),
+                                            [client](const Subscription &s) { return s.client == client; }),
+                             mSubscriptions.end());
+    }
+
+    void route(const Message &message) {
+        if (message.retain) {
+            if (message.payload.empty()) {
+                mRetained.erase(message.topic);
+            }
+            else {
+                mRetained[message.topic] = message.payload;
+            }
+        }
+        // A callback can't subscribe, only publish to the queue
+        for (size_t i = 0; i < mSubscriptions.size(); i++) {
+            if (topic_match(mSubscriptions[i].filter.c_str(), message.topic.c_str())) {
+                deliver(mSubscriptions[i].client, message.topic, message.payload);
+            }
+        }
+    }
+
+    void deliverRetained(PubSubClient *client, const char *filter) {
+        for (const auto &retained : mRetained) {
+            if (topic_match(filter, retained.first.c_str())) {
+                deliver(client, retained.first, retained.second);
+            }
+        }
+    }
+
+    void deliver(PubSubClient *client, const std::string &topic, const std::string &payload) {
+        stats().outbound.add(fake_arduino::timeUs);
+        stats().outboundBytes += packet_size(2 + topic.size() + payload.size());
+        client->receive(topic.c_str(), (const uint8_t*)payload.data(), payload.size());
+    }
+
+    uint64_t mServiceUs;
+    uint64_t mFreeAtUs = 0;
+    Stats **mStats;
+    std::deque<Packet> mQueue;
+    std::map<std::string, Session> mSessions;
+    std::map<PubSubClient*, std::string> mClientIds;
+    std::vector<Subscription> mSubscriptions;
+    std::map<std::string, std::string> mRetained;
+};
+
+/*
+ * Home Assistant: subscribed to the discovery configs and to all the device topics,
+ * it tracks the availability of each device and the state topics received.
+ */
+class HomeAssistant {
+public:
+    HomeAssistant(FakeMqttBroker *broker, Stats **stats, uint64_t *startUs) : mClient(mWifiClient), mStats(stats),
+                                                                            mStartUs(startUs) {
+        // Not limited like the devices
+        mClient.setBufferSize(HA_BUFFER_SIZE);
+        mClient.setBroker(broker);
+        mClient.setCallback([this](char *topic, uint8_t *payload, unsigned int len) {
+            callback(topic, (const char*)payload, len);
+        });
+    }
+
+    void start() {
+        mClient.connect(HA_CLIENT_ID, "host", "host", HA_STATUS_TOPIC, 1, false, "offline");
+        mClient.subscribe("homeassistant/#");
+        mClient.subscribe("home/#");
+        mClient.publish(HA_STATUS_TOPIC, "online");
+    }
+
+    void stop() {
+        mClient.publish(HA_STATUS_TOPIC, "offline");
+        mClient.disconnect();
+        mStates.clear();
+    }
+
+    void publish(const char *topic, const char *payload) {
+        mClient.publish(topic, payload);
+    }
+
+    // The devices are available once "online" is received after this call
+    void resetAvailability() {
+        mOnline.clear();
+    }
+
+    uint32_t getOnline(const std::vector<std::string> &topics) const {
+        uint32_t online = 0;
+        for (const std::string &topic : topics) {
+            online += mOnline.count(topic);
+        }
+        return online;
+    }
+
+    const std::set<std::string>& getStates() const {
+        return mStates;
+    }
+
+    // Devices that sent their update state since this call
+    void resetUpdates() {
+        mUpdates.clear();
+    }
+
+    uint32_t getUpdates() const {
+        return mUpdates.size();
+    }
+
+private:
+    void callback(const char *topic, const char *payload, unsigned int len) {
+        uint64_t us = fake_arduino::timeUs - *mStartUs;
+        std::string value(payload, len);
+        size_t topicLen = strlen(topic);
+        HaMessage type;
+        if (strcmp(topic, HA_STATUS_TOPIC) == 0) {
+            return;
+        }
+        if (strncmp(topic, "homeassistant/", 14) == 0) {
+            type = HA_CONFIG;
+        }
+        else if (topicLen > 13 && strcmp(topic + topicLen - 13, "/availability") == 0) {
+            type = HA_AVAILABILITY;
+            if (value == "online") {
+                mOnline.insert(topic);
+            }
+            else {
+                mOnline.erase(topic);
+            }
+        }
+        else {
+            type = HA_STATE;
+            if (len > 0) {
+                mStates.insert(topic);
+            }
+            if (topicLen > 13 && strcmp(topic + topicLen - 13, "/update/state") == 0) {
+                mUpdates.insert(topic);
+            }
+        }
+        (*mStats)->ha[type].add(us);
+        (*mStats)->haTotal.add(us);
+    }
+
+    WiFiClient mWifiClient;
+    PubSubClient mClient;
+    Stats **mStats;
+    uint64_t *mStartUs;
+    std::set<std::string> mOnline;
+    std::set<std::string> mStates;
+    std::set<std::string> mUpdates;
+};
+
+enum Scenario {
+    SCENARIO_BOOT,
+    SCENARIO_POWER_CUT,
+    SCENARIO_HA_RESTART,
+    SCENARIO_OTA_CHECK,
+    SCENARIO_COUNT,
+};
+
+static const char *scenario_names[SCENARIO_COUNT] = {"boot", "power-cut", "ha-restart", "ota-check"};
+
+struct Fleet {
+    uint32_t ledCount;
+    uint32_t radiatorCount;
+    std::vector<std::unique_ptr<FleetDevice>> devices;
+    std::vector<uint64_t> bootAtUs;
+    std::vector<std::string> availabilityTopics;
+};
+
+static void print_stat(bool csv, const char *scenario, const char *metric, double value, const char *unit) {
+    if (csv) {
+        printf("%s,%s,%.1f\n", scenario, metric, value);
+    } else {
+        printf("  %-36s %12.1f %s\n", metric, value, unit);
+    }
+}
+
+static void print_stats(bool csv, Scenario scenario, const Stats &stats, double done_s) {
+    const char *name = scenario_names[scenario];
+    char metric[64];
+
+    if (!csv) {
+        printf("Scenario %s:\n", name);
+    }
+    for (int t = 0; t < PACKET_TYPE_COUNT; t++) {
+        snprintf(metric, sizeof(metric), "Broker %s", packet_names[t]);
+        print_stat(csv, name, metric, stats.packets[t].getTotal(), "packets");
+    }
+    print_stat(csv, name, "Broker inbound", stats.inbound.getTotal(), "packets");
+    print_stat(csv, name, "Broker inbound bytes", stats.inboundBytes, "B");
+    print_stat(csv, name, "Broker inbound peak", stats.inbound.getPeak(), "packets/s");
+    print_stat(csv, name, "Broker outbound", stats.outbound.getTotal(), "packets");
+    print_stat(csv, name, "Broker outbound bytes", stats.outboundBytes, "B");
+    print_stat(csv, name, "Broker outbound peak", stats.outbound.getPeak(), "packets/s");
+    print_stat(csv, name, "Broker queue max", stats.queueMax, "packets");
+    print_stat(csv, name, "Broker wait max", stats.waitMaxUs / 1000.0, "ms");
+    print_stat(csv, name, "Connections refused", stats.refused, "");
+    for (int t = 0; t < HA_MESSAGE_COUNT; t++) {
+        snprintf(metric, sizeof(metric), "HA %s", ha_message_names[t]);
+        print_stat(csv, name, metric, stats.ha[t].getTotal(), "messages");
+    }
+    print_stat(csv, name, "HA peak", stats.haTotal.getPeak(), "messages/s");
+    print_stat(csv, name, "HTTP requests", stats.http.getTotal(), "");
+    print_stat(csv, name, "HTTP peak", stats.http.getPeak(), "requests/s");
+    switch (scenario) {
+        case SCENARIO_BOOT:
+        case SCENARIO_POWER_CUT:
+            print_stat(csv, name, "Time to all available", done_s, "s");
+            break;
+        case SCENARIO_HA_RESTART:
+            print_stat(csv, name, "Time to all states", done_s, "s");
+            break;
+        case SCENARIO_OTA_CHECK:
+            print_stat(csv, name, "Time to all update states", done_s, "s");
+            break;
+        default:
+            break;
+    }
+}
+
+static struct option long_options[] = {
+    {"help",        no_argument,       NULL, 'h'},
+    {"led",         required_argument, NULL, 'l'},
+    {"radiator",    required_argument, NULL, 'r'},
+    {"broker-rate", required_argument, NULL, 'b'},
+    {"scenario",    required_argument, NULL, 'S'},
+    {"cut",         required_argument, NULL, 'c'},
+    {"window",      required_argument, NULL, 'w'},
+    {"seed",        required_argument, NULL, 's'},
+    {"csv",         no_argument,       NULL, 'v'},
+    {NULL, 0, NULL, 0}
+};
+
+void print_help() {
+    printf("\n");
+    printf("Virtual device fleet simulator\n");
+    printf("Usage: fleet_sim [options]\n");
+    printf("Options:\n");
+    printf("  -h, --help                Show this help message\n");
+    printf("  -l, --led <N>             LedStripLight2 devices (default: 50)\n");
+    printf("  -r, --radiator <N>        RadiatorController devices (default: 100)\n");
+    printf("  -b, --broker-rate <N>     Packets served by the broker per second (default: 1000)\n");
+    printf("  -S, --scenario <NAME>     all, power-cut, ha-restart or ota-check, after the boot (default: all)\n");
+    printf("  -c, --cut <S>             Power cut duration, in s (default: 60)\n");
+    printf("  -w, --window <S>          Duration of each scenario, in s (default: 120)\n");
+    printf("  -s, --seed <N>            Random seed (default: 1)\n");
+    printf("  -v, --csv                 Output in CSV format\n");
+    printf("Example:\n");
+    printf("  ./fleet_sim --led 100 --radiator 300 --broker-rate 500 --scenario power-cut\n");
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    Fleet fleet = {50, 100, {}, {}, {}};
+    double broker_rate = 1000;
+    const char *scenario_name = "all";
+    uint32_t cut_s = 60;
+    uint32_t window_s = 120;
+    uint32_t seed = 1;
+    bool csv = false;
+    int opt_idx = 0;
+    int c;
+
+    // Parse arguments
+    while ((c = getopt_long(argc, argv, "hl:r:b:S:c:w:s:v", long_options, &opt_idx)) != -1) {
+        switch (c) {
+            case 'h':
+                print_help();
+                return 0;
+            case 'l':
+                fleet.ledCount = strtoul(optarg, NULL, 10);
+                break;
+            case 'r':
+                fleet.radiatorCount = strtoul(optarg, NULL, 10);
+                break;
+            case 'b':
+                broker_rate = atof(optarg);
+                break;
+            case 'S':
+                scenario_name = optarg;
+                break;
+            case 'c':
+                cut_s = strtoul(optarg, NULL, 10);
+                break;
+            case 'w':
+                window_s = strtoul(optarg, NULL, 10);
+                break;
+            case 's':
+                seed = strtoul(optarg, NULL, 10);
+                break;
+            case 'v':
+                csv = true;
+                break;
+            default:
+                print_help();
+                fprintf(stderr, "ERROR: Invalid option.\n");
+                return EXIT_FAILURE;
+        }
+    }
+    bool scenarios[SCENARIO_COUNT] = {true, false, false, false};
+    for (int s = SCENARIO_POWER_CUT; s < SCENARIO_COUNT; s++) {
+        scenarios[s] = strcmp(scenario_name, "all") == 0 || strcmp(scenario_name, scenario_names[s]) == 0;
+    }
+    if (strcmp(scenario_name, "all") != 0 && !scenarios[SCENARIO_POWER_CUT] && !scenarios[SCENARIO_HA_RESTART] &&
+        !scenarios[SCENARIO_OTA_CHECK]) {
+        fprintf(stderr, "ERROR: Invalid scenario.\n");
+        return EXIT_FAILURE;
+    }
+    uint32_t total = fleet.ledCount + fleet.radiatorCount;
+    if (total == 0 || total > 0xFFFF) {
+        fprintf(stderr, "ERROR: Invalid device count.\n");
+        return EXIT_FAILURE;
+    }
+    if (broker_rate <= 0) {
+        fprintf(stderr, "ERROR: Invalid broker rate.\n");
+        return EXIT_FAILURE;
+    }
+    // The devices boot 2 to 8 s after the power is back
+    if (window_s < cut_s + 30) {
+        fprintf(stderr, "ERROR: The window must be at least 30 s longer than the power cut.\n");
+        return EXIT_FAILURE;
+    }
+
+    std::mt19937 rng(seed);
+    srand(seed);
+    fake_http::files[OTA_SERVER_URL] = FIRMWARES_JSON;
+
+    Stats stats_by_scenario[SCENARIO_COUNT];
+    Stats *stats = &stats_by_scenario[SCENARIO_BOOT];
+    uint64_t start_us = 0;
+    FleetBroker broker(broker_rate, &stats);
+    HomeAssistant ha(&broker, &stats, &start_us);
+    fleet.devices.resize(total);
+    fleet.bootAtUs.resize(total);
+    uint32_t http_requests = 0;
+
+    auto boot_all = [&] {
+        std::uniform_int_distribution<uint64_t> boot_us(2000000, 8000000);
+        for (uint32_t i = 0; i < total; i++) {
+            fleet.bootAtUs[i] = fake_arduino::timeUs + boot_us(rng);
+        }
+    };
+    // One tick: the broker serves its queue, then each device runs its loop
+    auto tick = [&] {
+        fake_arduino::timeUs += TICK_US;
+        broker.process();
+        for (uint32_t i = 0; i < total; i++) {
+            if (!fleet.devices[i] && fleet.bootAtUs[i] && fleet.bootAtUs[i] <= fake_arduino::timeUs) {
+                fleet.devices[i] = i < fleet.ledCount ? create_led_device(i, &broker)
+                                                      : create_radiator_device(i - fleet.ledCount, &broker);
+                fleet.bootAtUs[i] = 0;
+                if (fleet.availabilityTopics.size() < total) {
+                    fleet.availabilityTopics.push_back(fleet.devices[i]->getAvailabilityTopic());
+                }
+            }
+            if (fleet.devices[i]) {
+                fleet.devices[i]->loop();
+            }
+        }
+        if (fake_http::requests != http_requests) {
+            stats->http.add(fake_arduino::timeUs - start_us, fake_http::requests - http_requests);
+            http_requests = fake_http::requests;
+        }
+    };
+    // Run the window of the scenario, return the time from ref_us the check is first true
+    auto run = [&](uint64_t ref_us, auto done) {
+        double done_s = -1;
+        while (fake_arduino::timeUs < start_us + window_s * 1000000ULL) {
+            tick();
+            if (done_s < 0 && fake_arduino::timeUs >= ref_us && done()) {
+                done_s = (fake_arduino::timeUs - ref_us) / 1e6;
+            }
+        }
+        return done_s;
+    };
+    auto all_available = [&] {
+        return fleet.availabilityTopics.size() == total && ha.getOnline(fleet.availabilityTopics) == total;
+    };
+    int errors = 0;
+
+    if (csv) {
+        printf("scenario,metric,value\n");
+    } else {
+        printf("Fleet of %u LedStripLight2 and %u RadiatorController, broker %.0f packets/s\n",
+               fleet.ledCount, fleet.radiatorCount, broker_rate);
+    }
+
+    // Home Assistant is running, all the devices boot
+    ha.start();
+    boot_all();
+    double done_s = run(0, all_available);
+    print_stats(csv, SCENARIO_BOOT, *stats, done_s);
+    if (done_s < 0) {
+        fprintf(stderr, "ERROR: Not all the devices are available after the boot.\n");
+        return EXIT_FAILURE;
+    }
+    std::set<std::string> states = ha.getStates();
+
+    // All the devices lose the power, the broker sends their will after the keep alive
+    if (scenarios[SCENARIO_POWER_CUT]) {
+        stats = &stats_by_scenario[SCENARIO_POWER_CUT];
+        start_us = fake_arduino::timeUs;
+        for (auto &device : fleet.devices) {
+            broker.lose(&device->getClient());
+            device.reset();
+        }
+        while (fake_arduino::timeUs < start_us + cut_s * 1000000ULL) {
+            tick();
+        }
+        ha.resetAvailability();
+        boot_all();
+        done_s = run(fake_arduino::timeUs, all_available);
+        print_stats(csv, SCENARIO_POWER_CUT, *stats, done_s);
+        if (done_s < 0) {
+            fprintf(stderr, "ERROR: Not all the devices are available after the power cut.\n");
+            errors++;
+        }
+    }
+
+    // Home Assistant restarts, the devices send their snapshot after a random delay
+    if (scenarios[SCENARIO_HA_RESTART]) {
+        stats = &stats_by_scenario[SCENARIO_HA_RESTART];
+        start_us = fake_arduino::timeUs;
+        ha.stop();
+        while (fake_arduino::timeUs < start_us + HA_DOWN_US) {
+            tick();
+        }
+        ha.start();
+        done_s = run(fake_arduino::timeUs, [&] {
+            return std::includes(ha.getStates().begin(), ha.getStates().end(), states.begin(), states.end());
+        });
+        print_stats(csv, SCENARIO_HA_RESTART, *stats, done_s);
+        if (done_s < 0) {
+            fprintf(stderr, "ERROR: Home Assistant is missing states after its restart.\n");
+            errors++;
+        }
+    }
+
+    // The update check of the Home Assistant automation, each device gets the index
+    if (scenarios[SCENARIO_OTA_CHECK]) {
+        stats = &stats_by_scenario[SCENARIO_OTA_CHECK];
+        start_us = fake_arduino::timeUs;
+        ha.resetUpdates();
+        ha.publish(OTA_CHECK_TOPIC, "{\"url\": \"" OTA_SERVER_URL "\"}");
+        done_s = run(start_us, [&] {
+            return ha.getUpdates() == total;
+        });
+        print_stats(csv, SCENARIO_OTA_CHECK, *stats, done_s);
+        if (done_s < 0) {
+            fprintf(stderr, "ERROR: Not all the devices checked the update.\n");
+            errors++;
+        }
+    }
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <memory>
+#include <stdint.h>
+#include <string>
+
+#include "Arduino.h"
+#include "ESP8266WiFi.h"
+#include "PubSubClient.h"
+
+// Same as the sketches
+#define FLEET_RECONNECT_PERIOD_MS 5000
+
+/*
+ * Virtual device of the fleet simulator: the MQTT class of a firmware (LedMqtt.h or
+ * RadiatorMqtt.h) built for the host, driven by the connection sequence and the
+ * MQTT callback of its sketch. Each firmware is built in its own file, their headers
+ * can't be in the same one.
+ */
+class FleetDevice {
+public:
+    FleetDevice(FakeMqttBroker *broker) : mClient(mWifiClient) {
+        mClient.setBroker(broker);
+        mClient.setCallback([this](char *topic, uint8_t *payload, unsigned int len) {
+            callback(topic, payload, len);
+        });
+    }
+
+    virtual ~FleetDevice() {
+    }
+
+    // Same as the loop() of the sketches: connection attempt every 5 s, then snapshot
+    void loop() {
+        if (!mClient.connected() && (mAttempts == 0 || millis() - mLastAttemptMs >= FLEET_RECONNECT_PERIOD_MS)) {
+            mAttempts++;
+            mLastAttemptMs = millis();
+            if (mClient.connect(mClientId.c_str(), "host", "host", mAvailabilityTopic.c_str(), 1, true, "offline")) {
+                onConnect();
+            }
+        }
+        mClient.loop();
+        if (mClient.connected()) {
+            loopSnapshot();
+        }
+    }
+
+    PubSubClient& getClient() {
+        return mClient;
+    }
+
+    const std::string& getAvailabilityTopic() const {
+        return mAvailabilityTopic;
+    }
+
+    uint32_t getAttempts() const {
+        return mAttempts;
+    }
+
+protected:
+    virtual void onConnect() = 0;
+    virtual void loopSnapshot() = 0;
+    virtual void callback(char *topic, uint8_t *payload, unsigned int len) = 0;
+
+    WiFiClient mWifiClient;
+    PubSubClient mClient;
+    std::string mClientId;
+    std::string mAvailabilityTopic;
+    uint32_t mAttempts = 0;
+    unsigned long mLastAttemptMs = 0;
+};
+
+// Device booted with a blank RAM, its first states are in the snapshot
+std::unique_ptr<FleetDevice> create_led_device(uint32_t id, FakeMqttBroker *broker);
+std::unique_ptr<FleetDevice> create_radiator_device(uint32_t id, FakeMqttBroker *broker);
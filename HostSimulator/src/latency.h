@@ -0,0 +1,180 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#include "Arduino.h"
+
+/*
+ * Command latency of a firmware built for the host, included after the sketch (the
+ * CommandLatency.h records). The commands are pushed to the MQTT client at their
+ * publish time, a Poisson arrival at the given rate, and received by client.loop()
+ * like a message waiting in the socket. Time only moves with the firmware delays, the
+ * LED frames and a minimum duration of each loop() iteration. The timings are the
+ * ones of the firmware waits (loop delays, frame rate cap, timer ticks, blocking
+ * output), not of the ESP8266 CPU.
+ */
+
+enum LatencySegment {
+    LATENCY_WAIT,     // Published, to mqtt_callback()
+    LATENCY_DISPATCH, // To the handler of the topic
+    LATENCY_APPLY,    // To the firmware state changed
+    LATENCY_OUTPUT,   // To the output changed
+    LATENCY_TOTAL,    // Published, to the output changed
+    LATENCY_SEGMENT_COUNT,
+};
+
+static const char *latency_segment_names[LATENCY_SEGMENT_COUNT] = {
+    "publish -> arrival", "arrival -> dispatch", "dispatch -> applied", "applied -> output", "publish -> output"
+};
+
+// Next command publish of run_commands(), pushed by the hook even during a firmware delay
+inline uint64_t latency_next_publish_us = UINT64_MAX;
+inline std::function<void()> latency_publish;
+
+// Timer1 interrupt and command publishes during the firmware delays, in time order.
+// TIM_DIV256 at 80 MHz is 3.2 us per count.
+inline void latency_advance_hook(uint64_t to_us) {
+    static uint64_t next_tick_us = 0;
+    uint64_t period_us = fake_arduino::timer1Ticks * 16 / 5;
+    bool timer = fake_arduino::timer1Handler && period_us > 0;
+
+    if (timer && next_tick_us == 0) {
+        next_tick_us = fake_arduino::timeUs + period_us;
+    }
+    while (true) {
+        uint64_t tick_us = timer ? next_tick_us : UINT64_MAX;
+        uint64_t next_us = std::min(tick_us, latency_next_publish_us);
+        if (next_us > to_us) {
+            break;
+        }
+        fake_arduino::timeUs = next_us;
+        if (next_us == tick_us) {
+            fake_arduino::timer1Handler();
+            next_tick_us += period_us;
+        } else {
+            latency_publish();
+        }
+    }
+    fake_arduino::timeUs = to_us;
+}
+
+class LatencyReport {
+public:
+    void add(uint64_t publish_us, const CommandLatencyRecord &record) {
+        const uint32_t *stage = record.stageUs;
+        mSamples[LATENCY_WAIT].push_back(stage[COMMAND_STAGE_ARRIVAL] - (uint32_t)publish_us);
+        mSamples[LATENCY_DISPATCH].push_back(stage[COMMAND_STAGE_DISPATCH] - stage[COMMAND_STAGE_ARRIVAL]);
+        mSamples[LATENCY_APPLY].push_back(stage[COMMAND_STAGE_APPLIED] - stage[COMMAND_STAGE_DISPATCH]);
+        mSamples[LATENCY_OUTPUT].push_back(stage[COMMAND_STAGE_OUTPUT] - stage[COMMAND_STAGE_APPLIED]);
+        mSamples[LATENCY_TOTAL].push_back(stage[COMMAND_STAGE_OUTPUT] - (uint32_t)publish_us);
+    }
+
+    size_t getCount() const {
+        return mSamples[LATENCY_TOTAL].size();
+    }
+
+    // Percentiles of each segment, then the histogram of the total in powers of 2
+    void print(bool csv) {
+        if (csv) {
+            printf("segment,count,p50_us,p90_us,p99_us,max_us\n");
+        } else {
+            printf("%-22s %8s %10s %10s %10s %10s\n", "Segment", "count", "p50 ms", "p90 ms", "p99 ms", "max ms");
+        }
+        for (int s = 0; s < LATENCY_SEGMENT_COUNT; s++) {
+            std::vector<uint32_t> &samples = mSamples[s];
+            std::sort(samples.begin(), samples.end());
+            if (csv) {
+                printf("%s,%zu,%u,%u,%u,%u\n", latency_segment_names[s], samples.size(), getPercentile(samples, 50),
+                       getPercentile(samples, 90), getPercentile(samples, 99), samples.empty() ? 0 : samples.back());
+            } else {
+                printf("%-22s %8zu %10.2f %10.2f %10.2f %10.2f\n", latency_segment_names[s], samples.size(),
+                       getPercentile(samples, 50) / 1000.0, getPercentile(samples, 90) / 1000.0,
+                       getPercentile(samples, 99) / 1000.0, samples.empty() ? 0 : samples.back() / 1000.0);
+            }
+        }
+        if (csv || mSamples[LATENCY_TOTAL].empty()) {
+            return;
+        }
+
+        uint32_t buckets[32] = {};
+        uint32_t peak = 0;
+        for (uint32_t us : mSamples[LATENCY_TOTAL]) {
+            int b = 0;
+            while (b < 31 && (us >> (b + 1)) > 0) {
+                b++;
+            }
+            peak = std::max(peak, ++buckets[b]);
+        }
+        printf("\nHistogram of %s:\n", latency_segment_names[LATENCY_TOTAL]);
+        for (int b = 0; b < 32; b++) {
+            if (buckets[b] == 0) {
+                continue;
+            }
+            printf("  %10.3f - %10.3f ms %8u ", (1u << b) / 1000.0, (2ull << b) / 1000.0, buckets[b]);
+            for (uint32_t i = 0; i < (buckets[b] * 50 + peak - 1) / peak; i++) {
+                putchar('#');
+            }
+            putchar('\n');
+        }
+    }
+
+private:
+    static uint32_t getPercentile(const std::vector<uint32_t> &sorted, uint32_t percent) {
+        if (sorted.empty()) {
+            return 0;
+        }
+        return sorted[(sorted.size() - 1) * percent / 100];
+    }
+
+    std::vector<uint32_t> mSamples[LATENCY_SEGMENT_COUNT];
+};
+
+/*
+ * Run the firmware loop and push the commands at their publish time, also in the
+ * middle of a firmware delay. A command arriving before the output of the previous
+ * one replaces it, it is counted as superseded. Return the commands without output
+ * after the drain time.
+ */
+inline uint32_t run_commands(uint32_t count, double rate, uint32_t loop_us, std::mt19937 &rng,
+                             const CommandLatency &latency, LatencyReport &report,
+                             std::function<void(uint32_t)> publish, std::function<void()> loop) {
+    std::exponential_distribution<double> interval_s(rate);
+    std::vector<uint64_t> publish_us;
+    uint32_t base = latency.getArrivals();
+    uint32_t completed = latency.getCompleted();
+    uint64_t drain_end_us = UINT64_MAX;
+
+    latency_next_publish_us = fake_arduino::timeUs + interval_s(rng) * 1e6;
+    latency_publish = [&]() {
+        publish((uint32_t)publish_us.size());
+        publish_us.push_back(latency_next_publish_us);
+        latency_next_publish_us += interval_s(rng) * 1e6;
+        if (publish_us.size() == count) {
+            latency_next_publish_us = UINT64_MAX;
+            drain_end_us = fake_arduino::timeUs + 10000000;
+        }
+    };
+
+    while (fake_arduino::timeUs < drain_end_us && report.getCount() < count) {
+        uint64_t start_us = fake_arduino::timeUs;
+        loop();
+        if (fake_arduino::timeUs - start_us < loop_us) {
+            fake_arduino::advanceUs(loop_us - (fake_arduino::timeUs - start_us));
+        }
+
+        if (latency.getCompleted() != completed) {
+            completed = latency.getCompleted();
+            const CommandLatencyRecord &record = latency.getLast();
+            if (record.arrival > base && record.arrival - base <= publish_us.size()) {
+                report.add(publish_us[record.arrival - base - 1], record);
+            }
+        }
+    }
+    latency_next_publish_us = UINT64_MAX;
+    return count - report.getCount();
+}
@@ -0,0 +1,146 @@
+#include <chrono>
+#include <getopt.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "LedDither.h"
+
+#define LED_NUM_DEFAULT 330
+
+static struct option long_options[] = {
+    {"help",     no_argument,       NULL, 'h'},
+    {"value",    required_argument, NULL, 'v'},
+    {"leds",     required_argument, NULL, 'n'},
+    {"frames",   required_argument, NULL, 'f'},
+    {"temporal", no_argument,       NULL, 't'},
+    {"out",      required_argument, NULL, 'o'},
+    {NULL, 0, NULL, 0}
+};
+
+void print_help() {
+    printf("\n");
+    printf("LED dithering simulator\n");
+    printf("Usage: led_dither_sim [options]\n");
+    printf("Options:\n");
+    printf("  -h, --help                Show this help message\n");
+    printf("  -v, --value <VALUE>       Brightness in LED steps, fractional (e.g., \"2.25\")\n");
+    printf("  -n, --leds <NUM>          Number of LEDs (default: %d)\n", LED_NUM_DEFAULT);
+    printf("  -f, --frames <NUM>        Number of frames to render (default: 256)\n");
+    printf("  -t, --temporal            Enable temporal dithering\n");
+    printf("  -o, --out <OUTPUT>        Write the frames to a PPM image, one row per frame\n");
+    printf("Example:\n");
+    printf("  ./led_dither_sim --value 2.25 --frames 100 --temporal --out dither.ppm\n");
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    double value = 1.5;
+    int led_num = LED_NUM_DEFAULT;
+    int frames = 256;
+    bool temporal = false;
+    char output_path[256] = {};
+    int opt_idx = 0;
+    int c;
+
+    // Parse arguments
+    while ((c = getopt_long(argc, argv, "hv:n:f:to:", long_options, &opt_idx)) != -1) {
+        switch (c) {
+            case 'h':
+                print_help();
+                return 0;
+            case 'v':
+                value = atof(optarg);
+                break;
+            case 'n':
+                led_num = atoi(optarg);
+                break;
+            case 'f':
+                frames = atoi(optarg);
+                break;
+            case 't':
+                temporal = true;
+                break;
+            case 'o':
+                strncpy(output_path, optarg, sizeof(output_path) - 1);
+                break;
+            default:
+                print_help();
+                fprintf(stderr, "ERROR: Invalid option.\n");
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (value < 0 || value > 255 || led_num <= 0 || frames <= 0) {
+        print_help();
+        fprintf(stderr, "ERROR: Invalid value.\n");
+        return EXIT_FAILURE;
+    }
+
+    uint16_t v16 = (uint16_t)lround(value * 256);
+    LedColor16 color = { v16, v16, v16 };
+    LedDither dither;
+    std::vector<uint8_t> image((size_t)frames * led_num * 3);
+    std::vector<uint32_t> sum(led_num);
+    double total_ns = 0;
+    int flicker = 0;
+
+    for (int f = 0; f < frames; f++) {
+        uint8_t *row = &image[(size_t)f * led_num * 3];
+
+        auto start = std::chrono::steady_clock::now();
+        dither.beginFrame(temporal);
+        for (int i = 0; i < led_num; i++) {
+            LedColor8 pixel = dither.pixel(color);
+            row[i * 3 + 0] = pixel.r;
+            row[i * 3 + 1] = pixel.g;
+            row[i * 3 + 2] = pixel.b;
+        }
+        auto end = std::chrono::steady_clock::now();
+        total_ns += std::chrono::duration<double, std::nano>(end - start).count();
+
+        for (int i = 0; i < led_num; i++) {
+            sum[i] += row[i * 3];
+            if (f > 0) {
+                int diff = abs(row[i * 3] - row[i * 3 - led_num * 3]);
+                if (diff > flicker) {
+                    flicker = diff;
+                }
+            }
+        }
+    }
+
+    // Average of each pixel over time compared with the requested value
+    double max_error = 0;
+    double strip_sum = 0;
+    for (int i = 0; i < led_num; i++) {
+        double average = (double)sum[i] / frames;
+        strip_sum += average;
+        max_error = fmax(max_error, fabs(average - v16 / 256.0));
+    }
+
+    printf("Value             : %.4f (8.8 fixed point: %u)\n", v16 / 256.0, v16);
+    printf("LEDs              : %d\n", led_num);
+    printf("Frames            : %d (temporal dithering %s)\n", frames, temporal ? "on" : "off");
+    printf("CPU time per frame: %.1f us\n", total_ns / frames / 1000);
+    printf("Strip average     : %.4f\n", strip_sum / led_num);
+    printf("Pixel max error   : %.4f step\n", max_error);
+    printf("Flicker           : %d step\n", flicker);
+
+    if (output_path[0] != '\0') {
+        FILE *fp = fopen(output_path, "wb");
+        if (!fp) {
+            fprintf(stderr, "ERROR: Cannot create output file '%s'.\n", output_path);
+            return EXIT_FAILURE;
+        }
+        fprintf(fp, "P6\n%d %d\n255\n", led_num, frames);
+        fwrite(image.data(), 1, image.size(), fp);
+        fclose(fp);
+        printf("Frames written to '%s'\n", output_path);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,139 @@
+// The sketch first, built with the fake Arduino libraries, its globals are used below
+#include "LedStripLight2.ino.cpp"
+
+#include <benchmark/benchmark.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Microbenchmarks of the firmware code built for the host, on Google Benchmark. The
+ * numbers compare two versions of the code on the same host, they are not the ESP8266
+ * timings (about 20 to 50 times slower). The results are checked by led_firmware_test.
+ */
+
+#define BENCH_SERIAL_NUMBER 1
+#define BENCH_ROOM_NAME "bench"
+
+static const char ALARMS_PAYLOAD[] =
+    "[{\"time\": \"06:30\", \"days\": [\"mon\", \"tue\", \"wed\", \"thu\", \"fri\"]},"
+    " {\"time\": \"08:15\", \"days\": [\"sat\", \"sun\"]},"
+    " {\"time\": \"07:00\", \"days\": [\"wed\"]}]";
+
+// A topic not handled by the sketch goes through all the comparisons
+static const char UNKNOWN_TOPIC[] = "home/bench/led/unknown/set";
+
+static char topic_rgb_set[MQTT_MSG_TOPIC_MAX_SIZE];
+
+// Serial number and room name of the NVM config, the MQTT topics are built from them
+static void provision() {
+    char room_name[CONFIG_ROOM_NAME_SIZE] = BENCH_ROOM_NAME;
+    configStore.begin();
+    configStore.set(CONFIG_KEY_DEVICE_SERIAL_NUMBER, (uint32_t)BENCH_SERIAL_NUMBER);
+    configStore.set(CONFIG_KEY_ROOM_NAME, room_name);
+    configStore.set(CONFIG_KEY_VERSION, CONFIG_VERSION);
+    configStore.commit();
+}
+
+// The callback gets a copy, as PubSubClient gives its own buffer
+static void receive(const char *topic, const char *payload) {
+    char topic_buf[MQTT_MSG_TOPIC_MAX_SIZE];
+    uint8_t payload_buf[MQTT_MSG_PAYLOAD_MAX_SIZE];
+    size_t len = strlen(payload);
+    snprintf(topic_buf, sizeof(topic_buf), "%s", topic);
+    memcpy(payload_buf, payload, len);
+    mqtt_callback(topic_buf, payload_buf, len);
+}
+
+// Parsers, the payload and its length are hidden from the compiler so the call is not folded
+static void BM_getStateFromMqttPayload(benchmark::State &state) {
+    const char *payload = "OFF";
+    unsigned int length = 3;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(payload);
+        benchmark::DoNotOptimize(length);
+        benchmark::DoNotOptimize(getStateFromMqttPayload(payload, length));
+    }
+}
+BENCHMARK(BM_getStateFromMqttPayload);
+
+static void BM_getEffectFromMqttPayload(benchmark::State &state) {
+    const char *payload = "rainbow";
+    unsigned int length = 7;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(payload);
+        benchmark::DoNotOptimize(length);
+        benchmark::DoNotOptimize(getEffectFromMqttPayload(payload, length));
+    }
+}
+BENCHMARK(BM_getEffectFromMqttPayload);
+
+static void BM_getMqttPayloadRgb(benchmark::State &state) {
+    const char *payload = "255, 128, 7";
+    unsigned int length = 11;
+    for (auto _ : state) {
+        uint8_t r, g, b;
+        benchmark::DoNotOptimize(payload);
+        benchmark::DoNotOptimize(length);
+        getMqttPayload(payload, length, &r, &g, &b);
+        benchmark::DoNotOptimize(r + g + b);
+    }
+}
+BENCHMARK(BM_getMqttPayloadRgb);
+
+static void BM_getSunriseAlarmsFromMqttPayload(benchmark::State &state) {
+    SunriseAlarm alarms[SUNRISE_ALARM_MAX];
+    unsigned int length = sizeof(ALARMS_PAYLOAD) - 1;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(length);
+        benchmark::DoNotOptimize(getSunriseAlarmsFromMqttPayload(ALARMS_PAYLOAD, length, alarms));
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_getSunriseAlarmsFromMqttPayload);
+
+// Topic routing, a segment command and the worst case
+static void BM_mqtt_callback_rgb_set(benchmark::State &state) {
+    for (auto _ : state) {
+        receive(topic_rgb_set, "10, 20, 30");
+    }
+}
+BENCHMARK(BM_mqtt_callback_rgb_set);
+
+static void BM_mqtt_callback_unknown_topic(benchmark::State &state) {
+    for (auto _ : state) {
+        receive(UNKNOWN_TOPIC, "ON");
+    }
+}
+BENCHMARK(BM_mqtt_callback_unknown_topic);
+
+// Sunrise curve, once per frame of the sunrise
+static void BM_getSunriseIntensity(benchmark::State &state) {
+    uint32_t progress = 0;
+    for (auto _ : state) {
+        progress = (progress + 97) & 0xFFFF;
+        benchmark::DoNotOptimize(getSunriseIntensity(progress));
+    }
+}
+BENCHMARK(BM_getSunriseIntensity);
+
+// The firmware boots once with a provisioned NVM config, connected to the fake broker
+int main(int argc, char *argv[]) {
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return EXIT_FAILURE;
+    }
+    provision();
+    setup();
+    loop();
+    if (!client.connected()) {
+        fprintf(stderr, "ERROR: Firmware not connected after setup.\n");
+        return EXIT_FAILURE;
+    }
+    snprintf(topic_rgb_set, sizeof(topic_rgb_set), "%s", mqtt.getSegmentTopic(0, MQTT_TOPIC_LED_SUFFIX_RGB_SET));
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,151 @@
+// The sketch first, built with the fake Arduino libraries, its globals are used below
+#include "LedStripLight2.ino.cpp"
+
+#include <getopt.h>
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "latency.h"
+
+#define BENCH_SERIAL_NUMBER 1
+#define BENCH_ROOM_NAME "bench"
+
+// Two colors in turn, so each command changes the frame
+static const char *RGB_PAYLOADS[] = {"255, 0, 0", "0, 0, 255"};
+
+// Serial number and room name of the NVM config, the MQTT topics are built from them
+static void provision() {
+    char room_name[CONFIG_ROOM_NAME_SIZE] = BENCH_ROOM_NAME;
+    configStore.begin();
+    configStore.set(CONFIG_KEY_DEVICE_SERIAL_NUMBER, (uint32_t)BENCH_SERIAL_NUMBER);
+    configStore.set(CONFIG_KEY_ROOM_NAME, room_name);
+    configStore.set(CONFIG_KEY_VERSION, CONFIG_VERSION);
+    configStore.commit();
+}
+
+static void push(const char *topic, const char *payload) {
+    client.push(topic, (const uint8_t*)payload, strlen(payload));
+}
+
+static struct option long_options[] = {
+    {"help",     no_argument,       NULL, 'h'},
+    {"commands", required_argument, NULL, 'n'},
+    {"rate",     required_argument, NULL, 'r'},
+    {"loop-us",  required_argument, NULL, 'l'},
+    {"seed",     required_argument, NULL, 's'},
+    {"csv",      no_argument,       NULL, 'c'},
+    {"verbose",  no_argument,       NULL, 'v'},
+    {NULL, 0, NULL, 0}
+};
+
+void print_help() {
+    printf("\n");
+    printf("LedStripLight2 command latency benchmark, from rgb/set to the LED frame, output %s\n", LedOutput::NAME);
+    printf("Usage: led_latency_bench [options]\n");
+    printf("Options:\n");
+    printf("  -h, --help                Show this help message\n");
+    printf("  -n, --commands <N>        Commands sent (default: 1000)\n");
+    printf("  -r, --rate <N>            Commands per second, Poisson arrivals (default: 2)\n");
+    printf("  -l, --loop-us <US>        Minimum duration of a loop() iteration, in us (default: 100)\n");
+    printf("  -s, --seed <N>            Random seed (default: 1)\n");
+    printf("  -c, --csv                 Output in CSV format\n");
+    printf("  -v, --verbose             Print the firmware serial output\n");
+    printf("Example:\n");
+    printf("  ./led_latency_bench --commands 5000 --rate 10\n");
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t commands = 1000;
+    double rate = 2;
+    uint32_t loop_us = 100;
+    uint32_t seed = 1;
+    bool csv = false;
+    bool verbose = false;
+    int opt_idx = 0;
+    int c;
+
+    // Parse arguments
+    while ((c = getopt_long(argc, argv, "hn:r:l:s:cv", long_options, &opt_idx)) != -1) {
+        switch (c) {
+            case 'h':
+                print_help();
+                return 0;
+            case 'n':
+                commands = strtoul(optarg, NULL, 10);
+                break;
+            case 'r':
+                rate = atof(optarg);
+                break;
+            case 'l':
+                loop_us = strtoul(optarg, NULL, 10);
+                break;
+            case 's':
+                seed = strtoul(optarg, NULL, 10);
+                break;
+            case 'c':
+                csv = true;
+                break;
+            case 'v':
+                verbose = true;
+                break;
+            default:
+                print_help();
+                fprintf(stderr, "ERROR: Invalid option.\n");
+                return EXIT_FAILURE;
+        }
+    }
+    if (commands == 0 || rate <= 0) {
+        fprintf(stderr, "ERROR: Invalid commands or rate.\n");
+        return EXIT_FAILURE;
+    }
+
+    // Boot the firmware, connected to the fake broker, with the first segment on
+    std::mt19937 rng(seed);
+    fake_arduino::serialOut = verbose ? stdout : NULL;
+    fake_arduino::advanceHook = latency_advance_hook;
+    provision();
+    setup();
+    loop();
+    if (!client.connected()) {
+        fprintf(stderr, "ERROR: Firmware not connected after setup.\n");
+        return EXIT_FAILURE;
+    }
+    char topic_rgb_set[MQTT_MSG_TOPIC_MAX_SIZE];
+    snprintf(topic_rgb_set, sizeof(topic_rgb_set), "%s", mqtt.getSegmentTopic(0, MQTT_TOPIC_LED_SUFFIX_RGB_SET));
+    push(mqtt.getSegmentTopic(0, MQTT_TOPIC_LED_SUFFIX_STATE_SET), "ON");
+    for (uint32_t i = 0; i < 1000; i++) {
+        loop();
+        delay(1);
+    }
+
+    LatencyReport report;
+    LedFrameBuffer::Stats start_stats = frame.getStats();
+    uint64_t start_us = micros();
+    uint32_t missed = run_commands(commands, rate, loop_us, rng, commandLatency, report,
+                                   [&topic_rgb_set](uint32_t i) { push(topic_rgb_set, RGB_PAYLOADS[i % 2]); },
+                                   [] { loop(); });
+    if (!csv) {
+        printf("LedStripLight2 rgb/set to the first LED frame, %u commands at %.1f/s, output %s\n",
+               commands, rate, LedOutput::NAME);
+    }
+    report.print(csv);
+    if (!csv) {
+        // Frames of the fades between the colors, the output is idle between them
+        const LedFrameBuffer::Stats &stats = frame.getStats();
+        uint32_t shows = stats.showCount - start_stats.showCount;
+        printf("\nCommands without output (replaced by the next one): %u\n", missed);
+        printf("Output frames: %u, %.1f per second, show avg %u us, delayed %u, busy %u\n", shows,
+               shows * 1e6 / (micros() - start_us), shows ? (stats.showTimeUs - start_stats.showTimeUs) / shows : 0,
+               stats.delayCount - start_stats.delayCount, stats.busyCount - start_stats.busyCount);
+    }
+    if (report.getCount() == 0) {
+        fprintf(stderr, "ERROR: No command reached the output.\n");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
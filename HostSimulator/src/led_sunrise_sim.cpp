@@ -0,0 +1,384 @@
+#include <chrono>
+#include <getopt.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "Arduino.h"
+#include "ezWS2812.h"
+
+// LedStripLight2
+#include "LedDither.h"
+#include "LedEffects.h"
+#include "LedFrameBuffer.h"
+
+// LedStripLight (Matter)
+#include "SunriseProfile.h"
+
+#define LED_NUM_DEFAULT 330
+
+// Same settings as LedStripLight2.ino with the bitbang output
+#define SUNRISE_BRIGHTNESS_MAX  50
+#define SUNRISE_FRAME_PERIOD_MS 250
+
+enum Firmware {
+    FIRMWARE_LED_STRIP_LIGHT2,
+    FIRMWARE_LED_STRIP_LIGHT,
+};
+
+struct SimOptions {
+    Firmware firmware;
+    int led_num;
+    unsigned long duration_ms;
+    uint8_t brightness;
+    uint32_t loop_us;
+    unsigned long out_period_ms;
+    char profile[256];
+};
+
+/*
+ * Collects the frames sent to the strip: statistics of every frame and a PPM image
+ * with one row every out_period_ms of simulated time.
+ */
+class FrameRecorder {
+public:
+    FrameRecorder(int led_num, unsigned long out_period_ms) : mLedNum(led_num), mOutPeriodMs(out_period_ms), mSeen(1 << 24) {
+    }
+
+    void record(unsigned long now_ms, uint32_t (*get_pixel)(void *ctx, uint16_t i), void *ctx) {
+        std::vector<uint8_t> row(mLedNum * 3);
+        uint64_t sum = 0;
+
+        for (int i = 0; i < mLedNum; i++) {
+            uint32_t color = get_pixel(ctx, i);
+            if (!mSeen[color]) {
+                mSeen[color] = true;
+                mDistinct++;
+            }
+            row[i * 3 + 0] = color >> 16;
+            row[i * 3 + 1] = color >> 8;
+            row[i * 3 + 2] = color;
+            sum += row[i * 3] + row[i * 3 + 1] + row[i * 3 + 2];
+            for (int c = 0; c < 3; c++) {
+                if (row[i * 3 + c] > mMaxValue) {
+                    mMaxValue = row[i * 3 + c];
+                }
+            }
+        }
+
+        if (mFrames > 0 && sum < mPrevSum) {
+            mDecreases++;
+        }
+        if (mFrames == 0 || sum != mPrevSum) {
+            mLevels++;
+        }
+        mPrevSum = sum;
+        mFrames++;
+
+        if (mImage.empty() || now_ms - mLastRowMs >= mOutPeriodMs) {
+            mImage.insert(mImage.end(), row.begin(), row.end());
+            mLastRowMs = now_ms;
+        }
+    }
+
+    int write(const char *path) const {
+        FILE *fp = fopen(path, "wb");
+        if (!fp) {
+            fprintf(stderr, "ERROR: Cannot create output file '%s'.\n", path);
+            return -1;
+        }
+        // The max value of the image is used as white, so dim frames stay visible
+        fprintf(fp, "P6\n%d %zu\n%d\n", mLedNum, mImage.size() / (mLedNum * 3), mMaxValue ? mMaxValue : 255);
+        fwrite(mImage.data(), 1, mImage.size(), fp);
+        fclose(fp);
+        return 0;
+    }
+
+    void print() const {
+        printf("Frames sent       : %u\n", mFrames);
+        printf("Distinct pixels   : %u\n", mDistinct);
+        printf("Brightness levels : %u (frames with a new strip sum)\n", mLevels);
+        printf("Brightness drops  : %u\n", mDecreases);
+    }
+
+private:
+    int mLedNum;
+    unsigned long mOutPeriodMs;
+    std::vector<bool> mSeen;
+    std::vector<uint8_t> mImage;
+    unsigned long mLastRowMs = 0;
+    uint64_t mPrevSum = 0;
+    uint32_t mFrames = 0;
+    uint32_t mDistinct = 0;
+    uint32_t mLevels = 0;
+    uint32_t mDecreases = 0;
+    uint8_t mMaxValue = 0;
+};
+
+struct CpuStats {
+    uint32_t count = 0;
+    double total_ns = 0;
+    double max_ns = 0;
+
+    void add(std::chrono::steady_clock::time_point start) {
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        count++;
+        total_ns += ns;
+        if (ns > max_ns) {
+            max_ns = ns;
+        }
+    }
+
+    void print() const {
+        printf("Frames computed   : %u\n", count);
+        printf("CPU time per frame: avg %.2f us, max %.2f us\n", count ? total_ns / count / 1000 : 0, max_ns / 1000);
+    }
+};
+
+static uint32_t get_pixel_led_output(void *ctx, uint16_t i) {
+    return static_cast<LedOutput *>(ctx)->getPixelColor(i);
+}
+
+static uint32_t get_pixel_ez_ws2812(void *ctx, uint16_t i) {
+    return static_cast<ezWS2812 *>(ctx)->getPixelColor(i);
+}
+
+// Sunrise curve of LedStripLight2 before the lookup table, float math with cos() and pow()
+static float get_sunrise_intensity_libm(float progress) {
+    if (progress < 0.0) progress = 0.0;
+    if (progress > 1.0) progress = 1.0;
+    progress = progress / 2;
+    float cosinus = 0.5 * (1.0 - cos(progress * M_PI));
+    return pow(cosinus, SUNRISE_GAMMA) * 2;
+}
+
+/*
+ * Compares the sunrise table (SunriseCurve.h) with the libm curve, at every table entry
+ * and at every Q16 progress value. A step is 1/256 of a brightness level at
+ * SUNRISE_BRIGHTNESS_MAX, the resolution of the dithered output.
+ */
+static bool check_sunrise_curve() {
+    const double steps_per_q16 = (double)(SUNRISE_BRIGHTNESS_MAX << 8) / SUNRISE_Q16_ONE;
+    double entry_max = 0;
+    double value_max = 0;
+
+    for (uint32_t i = 0; i <= SUNRISE_LUT_SIZE; i++) {
+        double libm = get_sunrise_intensity_libm((float)i / SUNRISE_LUT_SIZE) * SUNRISE_Q16_ONE;
+        entry_max = fmax(entry_max, fabs(SUNRISE_LUT.value[i] - libm) * steps_per_q16);
+    }
+    for (uint32_t p = 0; p <= SUNRISE_Q16_ONE; p++) {
+        double libm = get_sunrise_intensity_libm((float)p / SUNRISE_Q16_ONE) * SUNRISE_Q16_ONE;
+        value_max = fmax(value_max, fabs(getSunriseIntensity(p) - libm) * steps_per_q16);
+    }
+
+    printf("Curve vs libm     : max %.3f steps at the %u table entries, %.3f over the %u progress values\n",
+           entry_max, SUNRISE_LUT_SIZE + 1, value_max, SUNRISE_Q16_ONE + 1);
+    if (entry_max >= 1 || value_max >= 1) {
+        fprintf(stderr, "ERROR: The sunrise table is one step or more away from the libm curve.\n");
+        return false;
+    }
+    return true;
+}
+
+// Same rendering path as ledColorLoop() of LedStripLight2 during a sunrise
+static void simulate_led_strip_light2(const SimOptions &opt, FrameRecorder &recorder, CpuStats &cpu) {
+    LedOutput leds(opt.led_num, 0);
+    LedFrameBuffer frame(leds);
+    LedDither dither;
+    LedEffects effects(opt.led_num);
+
+    frame.begin();
+    frame.setFramePeriodMs(SUNRISE_FRAME_PERIOD_MS);
+    effects.setEffect(LED_EFFECT_SUNRISE, opt.duration_ms, {SUNRISE_BRIGHTNESS_MAX << 8, SUNRISE_BRIGHTNESS_MAX << 8, SUNRISE_BRIGHTNESS_MAX << 8});
+
+    while (!effects.isFinished() || frame.isDirty()) {
+        auto start = std::chrono::steady_clock::now();
+        if (effects.update(millis())) {
+            dither.beginFrame(false);
+            for (int i = 0; i < opt.led_num; i++) {
+                LedColor8 pixel = dither.pixel(effects.pixel(i));
+                frame.setPixel(i, pixel.r, pixel.g, pixel.b);
+            }
+            cpu.add(start);
+        }
+        if (frame.show()) {
+            recorder.record(millis(), get_pixel_led_output, &leds);
+        }
+        fake_arduino::advanceUs(opt.loop_us);
+    }
+
+    const LedFrameBuffer::Stats &stats = frame.getStats();
+    printf("show() count      : %u (delayed %u)\n", stats.showCount, stats.delayCount);
+    printf("Interrupts off    : %u ms\n", stats.showTimeUs / 1000);
+}
+
+// Same rendering path as setLedSunrise() of LedStripLight, called on every loop
+static void simulate_led_strip_light(const SimOptions &opt, FrameRecorder &recorder, CpuStats &cpu) {
+    ezWS2812 leds(opt.led_num);
+    SunriseProfile profile;
+    SunriseFrame last = {};
+    unsigned long start_ms = millis();
+    uint64_t busy_us = 0;
+
+    if (opt.profile[0] != '\0') {
+        profile.parse(opt.profile);
+    }
+
+    leds.begin();
+    leds.set_all(0, 0, 0);
+    profile.start(opt.duration_ms, opt.brightness, opt.led_num);
+
+    while (true) {
+        auto start = std::chrono::steady_clock::now();
+        SunriseFrame sunrise = profile.getFrame(millis() - start_ms);
+        cpu.add(start);
+
+        if (sunrise.finished || sunrise.activeLeds != last.activeLeds || sunrise.brightness != last.brightness) {
+            uint64_t before_us = micros();
+            if (sunrise.finished) {
+                leds.set_all(0, 0, 0); // setModeSunriseActive(false)
+            }
+            leds.set_pixel(sunrise.activeLeds, sunrise.brightness, sunrise.brightness, sunrise.brightness, 100, true);
+            busy_us += micros() - before_us;
+            recorder.record(millis(), get_pixel_ez_ws2812, &leds);
+            last = sunrise;
+        }
+
+        if (sunrise.finished || millis() - start_ms > opt.duration_ms * 2) {
+            break;
+        }
+        fake_arduino::advanceUs(opt.loop_us);
+    }
+
+    printf("show() count      : %u\n", leds.getShowCount());
+    printf("Interrupts off    : %llu ms\n", (unsigned long long)(busy_us / 1000));
+}
+
+static struct option long_options[] = {
+    {"help",       no_argument,       NULL, 'h'},
+    {"firmware",   required_argument, NULL, 'f'},
+    {"leds",       required_argument, NULL, 'n'},
+    {"duration",   required_argument, NULL, 'd'},
+    {"brightness", required_argument, NULL, 'b'},
+    {"loop-us",    required_argument, NULL, 'l'},
+    {"out",        required_argument, NULL, 'o'},
+    {"out-period", required_argument, NULL, 'p'},
+    {"profile",    required_argument, NULL, 'k'},
+    {NULL, 0, NULL, 0}
+};
+
+void print_help() {
+    printf("\n");
+    printf("LED sunrise simulator\n");
+    printf("Usage: led_sunrise_sim [options]\n");
+    printf("Options:\n");
+    printf("  -h, --help                Show this help message\n");
+    printf("  -f, --firmware <NAME>     Firmware to simulate: \"LedStripLight2\" (default) or \"LedStripLight\"\n");
+    printf("  -n, --leds <NUM>          Number of LEDs (default: %d)\n", LED_NUM_DEFAULT);
+    printf("  -d, --duration <SECONDS>  Sunrise duration (default: 1800)\n");
+    printf("  -b, --brightness <LEVEL>  LedStripLight target level [1..254] (default: 254)\n");
+    printf("  -l, --loop-us <US>        Time of a main loop without LED transfer (default: 100)\n");
+    printf("  -o, --out <OUTPUT>        Write the frames to a PPM image, one row per frame\n");
+    printf("  -p, --out-period <MS>     Minimal simulated time between two rows of the image (default: 1000)\n");
+    printf("  -k, --profile <KEYFRAMES> LedStripLight sunrise profile, same format as the serial console\n");
+    printf("Example:\n");
+    printf("  ./led_sunrise_sim --firmware LedStripLight2 --duration 1800 --out sunrise.ppm\n");
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    SimOptions opt = { FIRMWARE_LED_STRIP_LIGHT2, LED_NUM_DEFAULT, 1800000, 254, 100, 1000, {} };
+    char output_path[256] = {};
+    int opt_idx = 0;
+    int c;
+
+    // Parse arguments
+    while ((c = getopt_long(argc, argv, "hf:n:d:b:l:o:p:k:", long_options, &opt_idx)) != -1) {
+        switch (c) {
+            case 'h':
+                print_help();
+                return 0;
+            case 'f':
+                if (strcmp(optarg, "LedStripLight2") == 0) {
+                    opt.firmware = FIRMWARE_LED_STRIP_LIGHT2;
+                } else if (strcmp(optarg, "LedStripLight") == 0) {
+                    opt.firmware = FIRMWARE_LED_STRIP_LIGHT;
+                } else {
+                    print_help();
+                    fprintf(stderr, "ERROR: Unknown firmware '%s'.\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'n':
+                opt.led_num = atoi(optarg);
+                break;
+            case 'd':
+                opt.duration_ms = strtoul(optarg, NULL, 10) * 1000;
+                break;
+            case 'b':
+                opt.brightness = atoi(optarg);
+                break;
+            case 'l':
+                opt.loop_us = strtoul(optarg, NULL, 10);
+                break;
+            case 'o':
+                strncpy(output_path, optarg, sizeof(output_path) - 1);
+                break;
+            case 'p':
+                opt.out_period_ms = strtoul(optarg, NULL, 10);
+                break;
+            case 'k':
+                strncpy(opt.profile, optarg, sizeof(opt.profile) - 1);
+                break;
+            default:
+                print_help();
+                fprintf(stderr, "ERROR: Invalid option.\n");
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (opt.led_num <= 0 || opt.led_num > UINT16_MAX || opt.duration_ms == 0 || opt.brightness == 0) {
+        print_help();
+        fprintf(stderr, "ERROR: Invalid value.\n");
+        return EXIT_FAILURE;
+    }
+
+    SunriseProfile profile;
+    if (opt.profile[0] != '\0' && !profile.parse(opt.profile)) {
+        print_help();
+        fprintf(stderr, "ERROR: Invalid sunrise profile.\n");
+        return EXIT_FAILURE;
+    }
+
+    FrameRecorder recorder(opt.led_num, opt.out_period_ms);
+    CpuStats cpu;
+
+    printf("Firmware          : %s\n", opt.firmware == FIRMWARE_LED_STRIP_LIGHT2 ? "LedStripLight2" : "LedStripLight");
+    printf("LEDs              : %d\n", opt.led_num);
+    printf("Sunrise duration  : %lu s\n", opt.duration_ms / 1000);
+
+    if (opt.firmware == FIRMWARE_LED_STRIP_LIGHT2) {
+        if (!check_sunrise_curve()) {
+            return EXIT_FAILURE;
+        }
+        simulate_led_strip_light2(opt, recorder, cpu);
+    } else {
+        simulate_led_strip_light(opt, recorder, cpu);
+    }
+
+    printf("Simulated time    : %lu s\n", millis() / 1000);
+    cpu.print();
+    recorder.print();
+
+    if (output_path[0] != '\0') {
+        if (recorder.write(output_path) < 0) {
+            return EXIT_FAILURE;
+        }
+        printf("Frames written to '%s'\n", output_path);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,261 @@
+#include <chrono>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Transition.h"
+
+static struct option long_options[] = {
+    {"help",      no_argument,       NULL, 'h'},
+    {"from",      required_argument, NULL, 'f'},
+    {"to",        required_argument, NULL, 't'},
+    {"duration",  required_argument, NULL, 'd'},
+    {"direction", required_argument, NULL, 'r'},
+    {"rate",      required_argument, NULL, 'm'},
+    {"hue-rate",  required_argument, NULL, 'u'},
+    {"stop",      required_argument, NULL, 's'},
+    {"xy",        required_argument, NULL, 'x'},
+    {"csv",       no_argument,       NULL, 'c'},
+    {NULL, 0, NULL, 0}
+};
+
+void print_help() {
+    printf("\n");
+    printf("Matter light transition simulator\n");
+    printf("Usage: light_transition_sim [options]\n");
+    printf("Options:\n");
+    printf("  -h, --help                Show this help message\n");
+    printf("  -f, --from <L,H,S>        Start level, hue and saturation, 0-254 (default: 1,0,0)\n");
+    printf("  -t, --to <L,H,S>          Target level, hue and saturation, 0-254 (default: 254,127,254)\n");
+    printf("  -d, --duration <MS>       Transition time in ms (default: 2000)\n");
+    printf("  -r, --direction <DIR>     Hue direction: shortest, longest, up or down (default: shortest)\n");
+    printf("  -m, --rate <N>            Move command to the target at N units per second, replaces the duration\n");
+    printf("  -u, --hue-rate <N>        MoveHue command, the hue turns at N units per second (< 0: down) until\n");
+    printf("                            the stop, the target is not used\n");
+    printf("  -s, --stop <MS>           Stop command after MS, the transition stays where it is\n");
+    printf("  -x, --xy <X,Y>            Target color as Matter CIE xy (0-65279), replaces the target hue and saturation\n");
+    printf("  -c, --csv                 Print the frames: time, level, hue, saturation, red, green, blue\n");
+    printf("Example:\n");
+    printf("  ./light_transition_sim --from 254,250,254 --to 254,10,254 --duration 1000 --csv\n");
+    printf("  ./light_transition_sim --from 254,0,254 --to 1,0,254 --rate 50 --stop 3000\n");
+    printf("\n");
+}
+
+static bool parse_state(const char *text, LightState *state) {
+    unsigned level, hue, saturation;
+    if (sscanf(text, "%u,%u,%u", &level, &hue, &saturation) != 3 ||
+        level > LIGHT_VALUE_MAX || hue >= (unsigned)LIGHT_HUE_CIRCLE || saturation > LIGHT_VALUE_MAX) {
+        return false;
+    }
+    *state = { (uint8_t)level, (uint8_t)hue, (uint8_t)saturation };
+    return true;
+}
+
+static bool parse_direction(const char *text, HueDirection *direction) {
+    const char *names[] = { "shortest", "longest", "up", "down" };
+    for (int i = 0; i < 4; i++) {
+        if (strcmp(text, names[i]) == 0) {
+            *direction = (HueDirection)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char *argv[]) {
+    LightState from = { 1, 0, 0 };
+    LightState to = { LIGHT_VALUE_MAX, 127, LIGHT_VALUE_MAX };
+    uint32_t duration_ms = 2000;
+    HueDirection direction = HUE_DIRECTION_SHORTEST;
+    uint32_t rate = 0;
+    int32_t hue_rate = 0;
+    uint32_t stop_ms = UINT32_MAX;
+    bool csv = false;
+    int opt_idx = 0;
+    int c;
+
+    // Parse arguments
+    while ((c = getopt_long(argc, argv, "hf:t:d:r:m:u:s:x:c", long_options, &opt_idx)) != -1) {
+        switch (c) {
+            case 'h':
+                print_help();
+                return 0;
+            case 'f':
+                if (!parse_state(optarg, &from)) {
+                    fprintf(stderr, "ERROR: Invalid start state '%s'.\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 't':
+                if (!parse_state(optarg, &to)) {
+                    fprintf(stderr, "ERROR: Invalid target state '%s'.\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'd':
+                duration_ms = strtoul(optarg, NULL, 10);
+                break;
+            case 'r':
+                if (!parse_direction(optarg, &direction)) {
+                    fprintf(stderr, "ERROR: Invalid direction '%s'.\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'm':
+                rate = strtoul(optarg, NULL, 10);
+                if (rate == 0 || rate > 255) {
+                    fprintf(stderr, "ERROR: Invalid rate '%s'.\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'u':
+                hue_rate = strtol(optarg, NULL, 10);
+                if (hue_rate == 0 || hue_rate < -255 || hue_rate > 255) {
+                    fprintf(stderr, "ERROR: Invalid hue rate '%s'.\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 's':
+                stop_ms = strtoul(optarg, NULL, 10);
+                break;
+            case 'x': {
+                unsigned x, y;
+                if (sscanf(optarg, "%u,%u", &x, &y) != 2 || x > 65279 || y > 65279) {
+                    fprintf(stderr, "ERROR: Invalid xy color '%s'.\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                xyToHueSaturation(x, y, &to.hue, &to.saturation);
+                printf("xy %u,%u         : hue %u, saturation %u\n", x, y, to.hue, to.saturation);
+                break;
+            }
+            case 'c':
+                csv = true;
+                break;
+            default:
+                print_help();
+                fprintf(stderr, "ERROR: Invalid option.\n");
+                return EXIT_FAILURE;
+        }
+    }
+
+    // Move commands, the time comes from the rate, the hue move only ends with the stop
+    if (rate != 0) {
+        duration_ms = LightTransition::getMoveDurationMs(from, to, rate);
+    }
+    if (hue_rate != 0) {
+        if (stop_ms == UINT32_MAX) {
+            fprintf(stderr, "ERROR: A hue move needs a stop time.\n");
+            return EXIT_FAILURE;
+        }
+        to = from;
+        duration_ms = stop_ms;
+    }
+    bool stopped = stop_ms <= duration_ms;
+
+    // Simulated loop every ms, starting close to the millis() wrap
+    const uint32_t start_ms = UINT32_MAX - duration_ms / 2;
+    int32_t hue_delta = hue_rate ? hue_rate * (int32_t)stop_ms / 1000 : LightTransition::getHueDelta(from.hue, to.hue, direction);
+    int32_t hue_direction = hue_rate ? hue_rate : hue_delta;
+    LightTransition transition;
+    LightState prev = from;
+    uint32_t frames = 0;
+    int32_t hue_moved = 0;
+    int max_level_step = 0;
+    int max_hue_step = 0;
+    int errors = 0;
+    double total_ns = 0;
+
+    if (hue_rate != 0) {
+        transition.startHueMove(from, hue_rate, start_ms);
+    } else {
+        transition.start(from, to, duration_ms, direction, start_ms);
+    }
+    for (uint32_t t = 0; transition.isActive(); t++) {
+        if (t == stop_ms) {
+            transition.stop();
+            break;
+        }
+        if (t > duration_ms + LIGHT_TRANSITION_FRAME_MS) {
+            fprintf(stderr, "ERROR: Transition not finished after %u ms.\n", t);
+            return EXIT_FAILURE;
+        }
+
+        auto begin = std::chrono::steady_clock::now();
+        bool frame = transition.update(start_ms + t);
+        auto end = std::chrono::steady_clock::now();
+        total_ns += std::chrono::duration<double, std::nano>(end - begin).count();
+        if (!frame) {
+            continue;
+        }
+        frames++;
+
+        const LightState &state = transition.getState();
+        int level_step = abs(state.level - prev.level);
+        int hue_step = (state.hue - prev.hue + LIGHT_HUE_CIRCLE) % LIGHT_HUE_CIRCLE;
+        if (hue_direction < 0 && hue_step != 0) {
+            hue_step -= LIGHT_HUE_CIRCLE;
+        }
+        hue_moved += hue_step;
+        max_level_step = level_step > max_level_step ? level_step : max_level_step;
+        max_hue_step = abs(hue_step) > max_hue_step ? abs(hue_step) : max_hue_step;
+
+        // Level and saturation never go back, hue never turns the wrong way
+        if (abs(to.level - state.level) > abs(to.level - prev.level) ||
+            abs(to.saturation - state.saturation) > abs(to.saturation - prev.saturation) ||
+            (hue_direction > 0 && hue_step < 0) || (hue_direction < 0 && hue_step > 0)) {
+            fprintf(stderr, "ERROR: Frame at %u ms moves backward.\n", t);
+            errors++;
+        }
+
+        if (csv) {
+            uint8_t r, g, b;
+            lightStateToRgb(state, &r, &g, &b);
+            printf("%u,%u,%u,%u,%u,%u,%u\n", t, state.level, state.hue, state.saturation, r, g, b);
+        }
+        prev = state;
+    }
+
+    // Nothing moves after the stop, like a dimmer released
+    const LightState &state = transition.getState();
+    if (stopped) {
+        for (uint32_t t = stop_ms; t < stop_ms + 1000; t++) {
+            if (transition.update(start_ms + t) || transition.isActive()) {
+                fprintf(stderr, "ERROR: Transition still moving %u ms after the stop.\n", t - stop_ms);
+                errors++;
+                break;
+            }
+        }
+        if (state.level != prev.level || state.hue != prev.hue || state.saturation != prev.saturation) {
+            fprintf(stderr, "ERROR: Stopped at %u,%u,%u instead of the last frame.\n", state.level, state.hue, state.saturation);
+            errors++;
+        }
+    } else if (state.level != to.level || state.hue != to.hue || state.saturation != to.saturation) {
+        fprintf(stderr, "ERROR: Transition ends at %u,%u,%u.\n", state.level, state.hue, state.saturation);
+        errors++;
+    }
+
+    // The hue move is stopped up to a frame after the last one, a stopped transition is
+    // only checked frame by frame
+    int32_t hue_tolerance = hue_rate ? abs(hue_rate) * (int32_t)LIGHT_TRANSITION_FRAME_MS / 1000 + 1 : 0;
+    if ((!stopped || hue_rate != 0) && abs(hue_moved - hue_delta) > hue_tolerance) {
+        fprintf(stderr, "ERROR: Hue moved by %d instead of %d.\n", hue_moved, hue_delta);
+        errors++;
+    }
+
+    if (hue_rate != 0) {
+        printf("Hue turning       : %u,%u,%u at %d/s\n", from.level, from.hue, from.saturation, hue_rate);
+    } else {
+        printf("Transition        : %u,%u,%u -> %u,%u,%u in %u ms\n", from.level, from.hue, from.saturation, to.level, to.hue, to.saturation, duration_ms);
+    }
+    if (stopped) {
+        printf("Stopped           : %u,%u,%u after %u ms\n", state.level, state.hue, state.saturation, stop_ms);
+    }
+    printf("Frames            : %u (%u ms period)\n", frames, LIGHT_TRANSITION_FRAME_MS);
+    printf("Hue move          : %d\n", hue_delta);
+    printf("Max step          : level %d, hue %d\n", max_level_step, max_hue_step);
+    printf("CPU time per loop : %.1f ns\n", total_ns / (duration_ms + 1));
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
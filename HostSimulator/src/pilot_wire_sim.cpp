@@ -0,0 +1,229 @@
+#include <algorithm>
+#include <getopt.h>
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "Arduino.h"
+#include "PilotWire.h"
+
+struct Options {
+    uint32_t periods = 4;
+    uint32_t latency_us = 5;
+    double late_rate = 0;
+    uint32_t late_us = 100;
+    uint32_t loop_ms = 500;
+    double block_rate = 2;
+    uint32_t block_ms = 5000;
+    uint32_t seed = 1;
+    bool csv = false;
+};
+
+struct Transition {
+    uint64_t timeUs;
+    PilotWireSignal signal;
+};
+
+struct Pulses {
+    uint32_t count = 0;
+    int64_t maxDurationErrorUs = 0;
+    int64_t maxPeriodErrorUs = 0;
+};
+
+// Eco pulses (full sine) of a comfort -1 or -2 waveform, from startUs to endUs
+static Pulses measure(const std::vector<Transition> &transitions, uint64_t startUs, uint64_t endUs, uint32_t pulseMs) {
+    Pulses pulses;
+    uint64_t pulseStartUs = 0;
+    uint64_t lastPulseStartUs = 0;
+    bool inPulse = false;
+
+    for (const Transition &transition : transitions) {
+        if (transition.timeUs < startUs || transition.timeUs >= endUs) {
+            continue;
+        }
+        if (transition.signal == PILOT_WIRE_SIGNAL_FULL) {
+            if (pulses.count > 0) {
+                int64_t error = llabs((int64_t)(transition.timeUs - lastPulseStartUs) - (int64_t)PILOT_WIRE_PERIOD_MS * 1000);
+                pulses.maxPeriodErrorUs = std::max(pulses.maxPeriodErrorUs, error);
+            }
+            pulseStartUs = transition.timeUs;
+            lastPulseStartUs = pulseStartUs;
+            inPulse = true;
+        } else if (inPulse) {
+            int64_t error = llabs((int64_t)(transition.timeUs - pulseStartUs) - (int64_t)pulseMs * 1000);
+            pulses.maxDurationErrorUs = std::max(pulses.maxDurationErrorUs, error);
+            pulses.count++;
+            inPulse = false;
+        }
+    }
+    return pulses;
+}
+
+static void print_pulses(const char *name, const Pulses &pulses) {
+    printf("%s : %u pulses, duration error max %.3f ms, period error max %.3f ms\n", name, pulses.count,
+           pulses.maxDurationErrorUs / 1000., pulses.maxPeriodErrorUs / 1000.);
+}
+
+static struct option long_options[] = {
+    {"help",       no_argument,       NULL, 'h'},
+    {"periods",    required_argument, NULL, 'n'},
+    {"latency",    required_argument, NULL, 'L'},
+    {"late-rate",  required_argument, NULL, 'r'},
+    {"late",       required_argument, NULL, 'l'},
+    {"loop-ms",    required_argument, NULL, 'u'},
+    {"block-rate", required_argument, NULL, 'b'},
+    {"block-ms",   required_argument, NULL, 'B'},
+    {"seed",       required_argument, NULL, 's'},
+    {"csv",        no_argument,       NULL, 'c'},
+    {NULL, 0, NULL, 0}
+};
+
+void print_help() {
+    printf("\n");
+    printf("RadiatorController pilot wire waveform simulator\n");
+    printf("Usage: pilot_wire_sim [options]\n");
+    printf("Options:\n");
+    printf("  -h, --help                Show this help message\n");
+    printf("  -n, --periods <N>         300s periods of comfort -1, then of comfort -2 (default: 4)\n");
+    printf("  -L, --latency <US>        Timer interrupt latency, random up to this value (default: 5)\n");
+    printf("  -r, --late-rate <PCT>     Ticks with a late interrupt, in %% (default: 0)\n");
+    printf("  -l, --late <US>           Late interrupt delay (default: 100)\n");
+    printf("  -u, --loop-ms <MS>        Loop period of the loop-driven waveform compared (default: 500)\n");
+    printf("  -b, --block-rate <PCT>    Loops blocked by an MQTT reconnect, in %% (default: 2)\n");
+    printf("  -B, --block-ms <MS>       Blocked loop duration (default: 5000)\n");
+    printf("  -s, --seed <N>            Random seed (default: 1)\n");
+    printf("  -c, --csv                 Print the transitions of the timer waveform: time in us, signal\n");
+    printf("Example:\n");
+    printf("  ./pilot_wire_sim --periods 10 --late-rate 1 --late 200\n");
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    Options opt;
+    int opt_idx = 0;
+    int c;
+
+    // Parse arguments
+    while ((c = getopt_long(argc, argv, "hn:L:r:l:u:b:B:s:c", long_options, &opt_idx)) != -1) {
+        switch (c) {
+            case 'h':
+                print_help();
+                return 0;
+            case 'n':
+                opt.periods = strtoul(optarg, NULL, 10);
+                break;
+            case 'L':
+                opt.latency_us = strtoul(optarg, NULL, 10);
+                break;
+            case 'r':
+                opt.late_rate = atof(optarg);
+                break;
+            case 'l':
+                opt.late_us = strtoul(optarg, NULL, 10);
+                break;
+            case 'u':
+                opt.loop_ms = strtoul(optarg, NULL, 10);
+                break;
+            case 'b':
+                opt.block_rate = atof(optarg);
+                break;
+            case 'B':
+                opt.block_ms = strtoul(optarg, NULL, 10);
+                break;
+            case 's':
+                opt.seed = strtoul(optarg, NULL, 10);
+                break;
+            case 'c':
+                opt.csv = true;
+                break;
+            default:
+                print_help();
+                fprintf(stderr, "ERROR: Invalid option.\n");
+                return EXIT_FAILURE;
+        }
+    }
+    if (opt.periods == 0 || opt.loop_ms == 0) {
+        fprintf(stderr, "ERROR: Invalid periods or loop period.\n");
+        return EXIT_FAILURE;
+    }
+
+    std::mt19937 rng(opt.seed);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    const uint64_t tick_us = PILOT_WIRE_TICK_MS * 1000;
+    const uint64_t period_us = PILOT_WIRE_PERIOD_MS * 1000ULL;
+    // Comfort -2 is set in the middle of a tick, while comfort -1 is in its last period
+    const uint64_t switch_us = opt.periods * period_us + period_us / 2 + tick_us / 2;
+    const uint64_t end_us = switch_us + opt.periods * period_us;
+
+    // Timer interrupt every tick, the loop only changes the state
+    PilotWireScheduler scheduler;
+    std::vector<Transition> transitions;
+    int output = -1;
+    uint32_t injected_max_us = 0;
+    bool switched = false;
+
+    scheduler.setState(PILOT_WIRE_STATE_COMFORT_MINUS_1);
+    for (uint64_t t = 0; t < end_us; t += tick_us) {
+        if (!switched && t > switch_us) {
+            scheduler.setState(PILOT_WIRE_STATE_COMFORT_MINUS_2);
+            switched = true;
+        }
+        uint32_t latency = uniform(rng) * opt.latency_us + (uniform(rng) * 100 < opt.late_rate ? opt.late_us : 0);
+        injected_max_us = std::max(injected_max_us, latency);
+        uint64_t isr_us = t + latency;
+        PilotWireSignal signal = scheduler.tick(isr_us);
+        if (signal != output) {
+            output = signal;
+            transitions.push_back({ isr_us, signal });
+            if (opt.csv) {
+                printf("%llu,%d\n", (unsigned long long)isr_us, signal);
+            }
+        }
+    }
+
+    // Same waveform computed by loop() from millis(), delayed by the loop period and blocking calls
+    std::vector<Transition> loop_transitions;
+    int loop_output = -1;
+    for (uint64_t t = 0; t < end_us; ) {
+        PilotWireState state = t > switch_us ? PILOT_WIRE_STATE_COMFORT_MINUS_2 : PILOT_WIRE_STATE_COMFORT_MINUS_1;
+        uint64_t phase_us = t > switch_us ? t - switch_us : t;
+        PilotWireSignal signal = PilotWireScheduler::getSignal(state, (phase_us % period_us) / 1000);
+        if (signal != loop_output) {
+            loop_output = signal;
+            loop_transitions.push_back({ t, signal });
+        }
+        t += (uniform(rng) * 100 < opt.block_rate ? opt.block_ms : opt.loop_ms) * 1000ULL;
+    }
+
+    Pulses timer_minus_1 = measure(transitions, 0, switch_us, PILOT_WIRE_COMFORT_MINUS_1_MS);
+    Pulses timer_minus_2 = measure(transitions, switch_us, end_us, PILOT_WIRE_COMFORT_MINUS_2_MS);
+    Pulses loop_minus_1 = measure(loop_transitions, 0, switch_us, PILOT_WIRE_COMFORT_MINUS_1_MS);
+    Pulses loop_minus_2 = measure(loop_transitions, switch_us, end_us, PILOT_WIRE_COMFORT_MINUS_2_MS);
+
+    print_pulses("Timer comfort -1", timer_minus_1);
+    print_pulses("Timer comfort -2", timer_minus_2);
+    print_pulses("Loop  comfort -1", loop_minus_1);
+    print_pulses("Loop  comfort -2", loop_minus_2);
+    printf("Timer jitter     : %lu us reported, %u us max latency injected\n", scheduler.getJitterMaxUs(), injected_max_us);
+
+    // Each edge is on a tick, only moved by the interrupt latency
+    int errors = 0;
+    const Pulses *timer_pulses[] = { &timer_minus_1, &timer_minus_2 };
+    for (const Pulses *pulses : timer_pulses) {
+        if (pulses->count < opt.periods ||
+            pulses->maxDurationErrorUs > injected_max_us || pulses->maxPeriodErrorUs > injected_max_us) {
+            errors++;
+        }
+    }
+    if (scheduler.getJitterMaxUs() > injected_max_us) {
+        errors++;
+    }
+    if (errors) {
+        fprintf(stderr, "ERROR: Timer waveform out of tolerance.\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
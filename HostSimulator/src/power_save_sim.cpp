@@ -0,0 +1,238 @@
+#include <algorithm>
+#include <getopt.h>
+#include <math.h>
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "PowerSave.h"
+
+// Same settings as RadiatorController.ino
+#define DHT_PERIOD_MS 5000
+#define DHT_READING_MS 10 // Start signal and frame, no idle wait meanwhile
+#define MQTT_KEEPALIVE_MS 15000
+#define LATENCY_DEFAULT_MS 500 // The firmware default is 0, without idle mode
+
+// ESP8266EX datasheet figures, radio on is added to the CPU
+#define CURRENT_CPU_MA 15        // Modem sleep, CPU running
+#define CURRENT_LIGHT_SLEEP_MA 0.9
+#define CURRENT_RX_MA 56
+#define CURRENT_TX_MA 170
+
+enum Mode {
+    MODE_BUSY,   // Radio always on, loop() never waits
+    MODE_MODEM,  // Pilot wire waveform: modem sleep and idle wait
+    MODE_LIGHT,  // Steady pilot wire: light sleep in the idle wait
+};
+
+struct Options {
+    double hours = 1;
+    uint16_t latency_ms = LATENCY_DEFAULT_MS;
+    uint32_t loop_ms = 1;
+    uint32_t beacon_ms = 3;
+    uint32_t publish_period_ms = 30000;
+    uint32_t tx_ms = 2;
+    double commands = 600;
+    double bias = 1.0;
+    uint32_t seed = 1;
+};
+
+struct Result {
+    double averageMa = 0;
+    double idle = 0;
+    std::vector<uint32_t> latencies;
+    uint32_t loopGapMaxMs = 0;
+};
+
+static Result run(const Options &opt, Mode mode) {
+    std::mt19937 rng(opt.seed);
+    std::exponential_distribution<double> arrival(opt.commands / 3600000.);
+    Result result;
+    const uint64_t end_ms = opt.hours * 3600000;
+    const double listen_ms = getPowerSaveListenInterval(opt.latency_ms) * WIFI_BEACON_INTERVAL_MS;
+    const uint32_t idle_max_ms = mode == MODE_BUSY ? 0 : getPowerSaveIdleMs(opt.latency_ms);
+    double charge = 0;
+    uint64_t idle_ms = 0;
+    uint64_t next_command_ms = arrival(rng);
+    std::vector<uint64_t> received; // Commands waiting for loop()
+    std::vector<uint64_t> sent;
+    uint64_t next_dht_ms = 0;
+    uint64_t dht_end_ms = 0;
+    uint64_t next_publish_ms = opt.publish_period_ms;
+    uint64_t last_loop_ms = 0;
+    uint64_t loop_end_ms = 0;
+    uint64_t idle_end_ms = 0;
+
+    for (uint64_t t = 0; t < end_ms; t++) {
+        // Radio: commands buffered by the access point until the next listened beacon
+        bool beacon = mode == MODE_BUSY || fmod(t, listen_ms) < opt.beacon_ms;
+        while (next_command_ms <= t) {
+            sent.push_back(next_command_ms);
+            next_command_ms += std::max(1., arrival(rng));
+        }
+        if (beacon) {
+            received.insert(received.end(), sent.begin(), sent.end());
+            sent.clear();
+        }
+
+        // loop(): work, then the idle wait up to the next DHT22 reading, each poll
+        // delay ends it when a command waits in the socket
+        if (t >= loop_end_ms && t < idle_end_ms && !received.empty() && (t - loop_end_ms) % POWER_SAVE_IDLE_POLL_MS == 0) {
+            idle_end_ms = t;
+        }
+        bool cpu_active = t < loop_end_ms || t < dht_end_ms;
+        if (t >= loop_end_ms && t >= idle_end_ms) {
+            result.loopGapMaxMs = std::max(result.loopGapMaxMs, (uint32_t)(t - last_loop_ms));
+            last_loop_ms = t;
+            for (uint64_t command : received) {
+                result.latencies.push_back(t - command);
+            }
+            received.clear();
+            if (t >= next_dht_ms) {
+                next_dht_ms = t + DHT_PERIOD_MS;
+                dht_end_ms = t + DHT_READING_MS;
+            }
+            loop_end_ms = t + opt.loop_ms;
+            uint64_t idle = t < dht_end_ms ? 0 : std::min<uint64_t>(idle_max_ms, next_dht_ms - loop_end_ms);
+            idle_end_ms = loop_end_ms + idle;
+            cpu_active = true;
+        }
+        if (!cpu_active) {
+            idle_ms++;
+        }
+
+        double current = !cpu_active && mode == MODE_LIGHT ? CURRENT_LIGHT_SLEEP_MA : CURRENT_CPU_MA;
+        if (t >= next_publish_ms && t < next_publish_ms + opt.tx_ms) {
+            current += CURRENT_TX_MA;
+        } else if (beacon) {
+            current += CURRENT_RX_MA;
+        }
+        if (t >= next_publish_ms + opt.tx_ms) {
+            next_publish_ms += opt.publish_period_ms;
+        }
+        charge += current;
+    }
+    result.averageMa = charge / end_ms;
+    result.idle = (double)idle_ms / end_ms;
+    std::sort(result.latencies.begin(), result.latencies.end());
+    return result;
+}
+
+static uint32_t percentile(const std::vector<uint32_t> &sorted, double p) {
+    return sorted.empty() ? 0 : sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+}
+
+static void print_result(const char *name, const Result &result, const Result &busy, const Options &opt) {
+    printf("%s : %5.1f mA, idle %3.0f%%, bias %.2f C, command latency p50 %4u ms, p99 %4u ms, max %4u ms, loop gap max %4u ms\n",
+           name, result.averageMa, result.idle * 100, opt.bias * result.averageMa / busy.averageMa,
+           percentile(result.latencies, 0.5), percentile(result.latencies, 0.99),
+           result.latencies.empty() ? 0 : result.latencies.back(), result.loopGapMaxMs);
+}
+
+static struct option long_options[] = {
+    {"help",           no_argument,       NULL, 'h'},
+    {"hours",          required_argument, NULL, 'H'},
+    {"latency",        required_argument, NULL, 'L'},
+    {"loop-ms",        required_argument, NULL, 'u'},
+    {"beacon-ms",      required_argument, NULL, 'b'},
+    {"publish-period", required_argument, NULL, 'p'},
+    {"commands",       required_argument, NULL, 'n'},
+    {"bias",           required_argument, NULL, 't'},
+    {"seed",           required_argument, NULL, 's'},
+    {NULL, 0, NULL, 0}
+};
+
+void print_help() {
+    printf("\n");
+    printf("RadiatorController power save simulator\n");
+    printf("Usage: power_save_sim [options]\n");
+    printf("Options:\n");
+    printf("  -h, --help                  Show this help message\n");
+    printf("  -H, --hours <N>             Simulated duration (default: 1)\n");
+    printf("  -L, --latency <MS>          Command latency bound, as /power_save/latency/set (default: %u)\n", LATENCY_DEFAULT_MS);
+    printf("  -u, --loop-ms <MS>          Work of one loop (default: 1)\n");
+    printf("  -b, --beacon-ms <MS>        Radio on for each listened beacon (default: 3)\n");
+    printf("  -p, --publish-period <MS>   Time between two published messages (default: 30000)\n");
+    printf("  -n, --commands <N>          Commands received per hour (default: 600)\n");
+    printf("  -t, --bias <C>              Self-heating bias measured without power save (default: 1.0)\n");
+    printf("  -s, --seed <N>              Random seed (default: 1)\n");
+    printf("Example:\n");
+    printf("  ./power_save_sim --latency 1000 --bias 1.4\n");
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    Options opt;
+    int opt_idx = 0;
+    int c;
+
+    // Parse arguments
+    while ((c = getopt_long(argc, argv, "hH:L:u:b:p:n:t:s:", long_options, &opt_idx)) != -1) {
+        switch (c) {
+            case 'h':
+                print_help();
+                return 0;
+            case 'H':
+                opt.hours = atof(optarg);
+                break;
+            case 'L':
+                opt.latency_ms = strtoul(optarg, NULL, 10);
+                break;
+            case 'u':
+                opt.loop_ms = strtoul(optarg, NULL, 10);
+                break;
+            case 'b':
+                opt.beacon_ms = strtoul(optarg, NULL, 10);
+                break;
+            case 'p':
+                opt.publish_period_ms = strtoul(optarg, NULL, 10);
+                break;
+            case 'n':
+                opt.commands = atof(optarg);
+                break;
+            case 't':
+                opt.bias = atof(optarg);
+                break;
+            case 's':
+                opt.seed = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                print_help();
+                fprintf(stderr, "ERROR: Invalid option.\n");
+                return EXIT_FAILURE;
+        }
+    }
+    if (opt.hours <= 0 || opt.latency_ms == 0 || !isPowerSaveLatencyValid(opt.latency_ms) ||
+        opt.loop_ms == 0 || opt.publish_period_ms == 0 || opt.commands <= 0) {
+        fprintf(stderr, "ERROR: Invalid duration, latency, loop, publish period or commands.\n");
+        return EXIT_FAILURE;
+    }
+
+    Result busy = run(opt, MODE_BUSY);
+    Result modem = run(opt, MODE_MODEM);
+    Result light = run(opt, MODE_LIGHT);
+
+    printf("Power save : latency %u ms, listen interval %u beacons, idle wait max %u ms\n", opt.latency_ms,
+           getPowerSaveListenInterval(opt.latency_ms), getPowerSaveIdleMs(opt.latency_ms));
+    print_result("Busy loop  ", busy, busy, opt);
+    print_result("Modem sleep", modem, busy, opt);
+    print_result("Light sleep", light, busy, opt);
+
+    // One listen interval and one poll delay, plus a DHT22 reading and a loop
+    double bound_ms = getPowerSaveListenInterval(opt.latency_ms) * WIFI_BEACON_INTERVAL_MS + POWER_SAVE_IDLE_POLL_MS +
+                      DHT_READING_MS + opt.loop_ms;
+    const Result *results[] = { &modem, &light };
+    for (const Result *result : results) {
+        if (!result->latencies.empty() && result->latencies.back() > bound_ms) {
+            fprintf(stderr, "ERROR: Command latency above %.0f ms.\n", bound_ms);
+            return EXIT_FAILURE;
+        }
+        if (result->loopGapMaxMs >= MQTT_KEEPALIVE_MS) {
+            fprintf(stderr, "ERROR: MQTT keepalive missed.\n");
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
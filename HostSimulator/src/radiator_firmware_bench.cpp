@@ -0,0 +1,129 @@
+// The sketch first, built with the fake Arduino libraries, its globals are used below
+#include "RadiatorController.ino.cpp"
+
+#include <benchmark/benchmark.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Microbenchmarks of the firmware code built for the host, on Google Benchmark. The
+ * numbers compare two versions of the code on the same host, they are not the ESP8266
+ * timings (about 20 to 50 times slower). The results are checked by radiator_firmware_test.
+ */
+
+#define BENCH_SERIAL_NUMBER 1
+#define BENCH_ROOM_NAME "bench"
+
+// A topic not handled by the sketch goes through all the comparisons
+static const char UNKNOWN_TOPIC[] = "home/bench/radiator/unknown/set";
+
+static char topic_preset_mode_set[MQTT_MSG_TOPIC_MAX_SIZE];
+
+// Serial number and room name of the NVM config, the MQTT topics are built from them
+static void provision() {
+    char room_name[CONFIG_ROOM_NAME_SIZE] = BENCH_ROOM_NAME;
+    configStore.begin();
+    configStore.set(CONFIG_KEY_DEVICE_SERIAL_NUMBER, (uint32_t)BENCH_SERIAL_NUMBER);
+    configStore.set(CONFIG_KEY_ROOM_NAME, room_name);
+    configStore.set(CONFIG_KEY_VERSION, CONFIG_VERSION);
+    configStore.commit();
+}
+
+// The callback gets a copy, as PubSubClient gives its own buffer
+static void receive(const char *topic, const char *payload) {
+    char topic_buf[MQTT_MSG_TOPIC_MAX_SIZE];
+    uint8_t payload_buf[MQTT_MSG_PAYLOAD_MAX_SIZE];
+    size_t len = strlen(payload);
+    snprintf(topic_buf, sizeof(topic_buf), "%s", topic);
+    memcpy(payload_buf, payload, len);
+    mqtt_callback(topic_buf, payload_buf, len);
+}
+
+// Parsers, the payload and its length are hidden from the compiler so the call is not folded
+static void BM_getPowerFromMqttPayload(benchmark::State &state) {
+    const char *payload = "OFF";
+    unsigned int length = 3;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(payload);
+        benchmark::DoNotOptimize(length);
+        benchmark::DoNotOptimize(getPowerFromMqttPayload(payload, length));
+    }
+}
+BENCHMARK(BM_getPowerFromMqttPayload);
+
+static void BM_getModeFromMqttPayload(benchmark::State &state) {
+    const char *payload = "heat";
+    unsigned int length = 4;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(payload);
+        benchmark::DoNotOptimize(length);
+        benchmark::DoNotOptimize(getModeFromMqttPayload(payload, length));
+    }
+}
+BENCHMARK(BM_getModeFromMqttPayload);
+
+static void BM_getPresetModeFromMqttPayload(benchmark::State &state) {
+    const char *payload = "comfort-2";
+    unsigned int length = 9;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(payload);
+        benchmark::DoNotOptimize(length);
+        benchmark::DoNotOptimize(getPresetModeFromMqttPayload(payload, length));
+    }
+}
+BENCHMARK(BM_getPresetModeFromMqttPayload);
+
+// Topic routing, a preset change applied to the pilot wire and the worst case
+static void BM_mqtt_callback_preset_mode_set(benchmark::State &state) {
+    bool eco = false;
+    for (auto _ : state) {
+        eco = !eco;
+        receive(topic_preset_mode_set, eco ? "eco" : "away");
+    }
+}
+BENCHMARK(BM_mqtt_callback_preset_mode_set);
+
+static void BM_mqtt_callback_unknown_topic(benchmark::State &state) {
+    for (auto _ : state) {
+        receive(UNKNOWN_TOPIC, "ON");
+    }
+}
+BENCHMARK(BM_mqtt_callback_unknown_topic);
+
+// Sensor filter, one reading every 5 s: median of 5 then running mean of 24
+static void BM_SensorFilter(benchmark::State &state) {
+    SensorFilter<DHT_MEDIAN_SIZE, DHT_TAB_MAX> sensor_filter;
+    int16_t reading = 2000;
+    for (auto _ : state) {
+        reading = reading == 2000 ? 2010 : 2000;
+        sensor_filter.add(reading);
+        benchmark::DoNotOptimize(sensor_filter.get());
+    }
+}
+BENCHMARK(BM_SensorFilter);
+
+// The firmware boots once with a provisioned NVM config, connected to the fake broker
+// and on in heat mode, so the preset mode is applied to the pilot wire
+int main(int argc, char *argv[]) {
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return EXIT_FAILURE;
+    }
+    provision();
+    setup();
+    loop();
+    if (!client.connected()) {
+        fprintf(stderr, "ERROR: Firmware not connected after setup.\n");
+        return EXIT_FAILURE;
+    }
+    receive(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_POWER_SET), "ON");
+    receive(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_MODE_SET), "heat");
+    snprintf(topic_preset_mode_set, sizeof(topic_preset_mode_set), "%s",
+             mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_PRESET_MODE_SET));
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return EXIT_SUCCESS;
+}
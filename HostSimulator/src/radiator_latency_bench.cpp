@@ -0,0 +1,158 @@
+// The sketch first, built with the fake Arduino libraries, its globals are used below
+#include "RadiatorController.ino.cpp"
+
+#include <getopt.h>
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "latency.h"
+
+#define BENCH_SERIAL_NUMBER 1
+#define BENCH_ROOM_NAME "bench"
+
+// Two presets in turn, so each command changes the pilot wire signal
+static const char *PRESET_PAYLOADS[] = {"eco", "away"};
+
+// Serial number and room name of the NVM config, the MQTT topics are built from them
+static void provision(long power_save_latency) {
+    char room_name[CONFIG_ROOM_NAME_SIZE] = BENCH_ROOM_NAME;
+    configStore.begin();
+    configStore.set(CONFIG_KEY_DEVICE_SERIAL_NUMBER, (uint32_t)BENCH_SERIAL_NUMBER);
+    configStore.set(CONFIG_KEY_ROOM_NAME, room_name);
+    if (power_save_latency >= 0) {
+        configStore.set(CONFIG_KEY_POWER_SAVE_LATENCY, (uint16_t)power_save_latency);
+    }
+    configStore.set(CONFIG_KEY_VERSION, CONFIG_VERSION);
+    configStore.commit();
+}
+
+static void push(const char *topic, const char *payload) {
+    client.push(topic, (const uint8_t*)payload, strlen(payload));
+}
+
+static struct option long_options[] = {
+    {"help",               no_argument,       NULL, 'h'},
+    {"commands",           required_argument, NULL, 'n'},
+    {"rate",               required_argument, NULL, 'r'},
+    {"loop-us",            required_argument, NULL, 'l'},
+    {"power-save-latency", required_argument, NULL, 'p'},
+    {"seed",               required_argument, NULL, 's'},
+    {"csv",                no_argument,       NULL, 'c'},
+    {"verbose",            no_argument,       NULL, 'v'},
+    {NULL, 0, NULL, 0}
+};
+
+void print_help() {
+    printf("\n");
+    printf("RadiatorController command latency benchmark, from preset_mode/set to the pilot wire output\n");
+    printf("Usage: radiator_latency_bench [options]\n");
+    printf("Options:\n");
+    printf("  -h, --help                     Show this help message\n");
+    printf("  -n, --commands <N>             Commands sent (default: 1000)\n");
+    printf("  -r, --rate <N>                 Commands per second, Poisson arrivals (default: 0.5)\n");
+    printf("  -l, --loop-us <US>             Minimum duration of a loop() iteration, in us (default: 100)\n");
+    printf("  -p, --power-save-latency <MS>  Power save latency of the NVM config, 0 disables the idle mode\n");
+    printf("                                 (default: firmware default)\n");
+    printf("  -s, --seed <N>                 Random seed (default: 1)\n");
+    printf("  -c, --csv                      Output in CSV format\n");
+    printf("  -v, --verbose                  Print the firmware serial output\n");
+    printf("Example:\n");
+    printf("  ./radiator_latency_bench --power-save-latency 0\n");
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t commands = 1000;
+    double rate = 0.5;
+    uint32_t loop_us = 100;
+    long power_save_latency = -1;
+    uint32_t seed = 1;
+    bool csv = false;
+    bool verbose = false;
+    int opt_idx = 0;
+    int c;
+
+    // Parse arguments
+    while ((c = getopt_long(argc, argv, "hn:r:l:p:s:cv", long_options, &opt_idx)) != -1) {
+        switch (c) {
+            case 'h':
+                print_help();
+                return 0;
+            case 'n':
+                commands = strtoul(optarg, NULL, 10);
+                break;
+            case 'r':
+                rate = atof(optarg);
+                break;
+            case 'l':
+                loop_us = strtoul(optarg, NULL, 10);
+                break;
+            case 'p':
+                power_save_latency = strtol(optarg, NULL, 10);
+                break;
+            case 's':
+                seed = strtoul(optarg, NULL, 10);
+                break;
+            case 'c':
+                csv = true;
+                break;
+            case 'v':
+                verbose = true;
+                break;
+            default:
+                print_help();
+                fprintf(stderr, "ERROR: Invalid option.\n");
+                return EXIT_FAILURE;
+        }
+    }
+    if (commands == 0 || rate <= 0) {
+        fprintf(stderr, "ERROR: Invalid commands or rate.\n");
+        return EXIT_FAILURE;
+    }
+    if (power_save_latency >= 0 && !isPowerSaveLatencyValid(power_save_latency)) {
+        fprintf(stderr, "ERROR: Invalid power save latency.\n");
+        return EXIT_FAILURE;
+    }
+
+    // Boot the firmware, connected to the fake broker, heating
+    std::mt19937 rng(seed);
+    fake_arduino::serialOut = verbose ? stdout : NULL;
+    fake_arduino::advanceHook = latency_advance_hook;
+    provision(power_save_latency);
+    setup();
+    loop();
+    if (!client.connected()) {
+        fprintf(stderr, "ERROR: Firmware not connected after setup.\n");
+        return EXIT_FAILURE;
+    }
+    char topic_preset_set[MQTT_MSG_TOPIC_MAX_SIZE];
+    snprintf(topic_preset_set, sizeof(topic_preset_set), "%s", mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_PRESET_MODE_SET));
+    push(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_POWER_SET), "ON");
+    push(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_MODE_SET), "heat");
+    for (uint32_t i = 0; i < 1000; i++) {
+        loop();
+        delay(1);
+    }
+
+    LatencyReport report;
+    uint32_t missed = run_commands(commands, rate, loop_us, rng, commandLatency, report,
+                                   [&topic_preset_set](uint32_t i) { push(topic_preset_set, PRESET_PAYLOADS[i % 2]); },
+                                   [] { loop(); });
+    if (!csv) {
+        printf("RadiatorController preset_mode/set to the pilot wire output, %u commands at %.1f/s, power save latency %u ms\n",
+               commands, rate, config.powerSaveLatency);
+    }
+    report.print(csv);
+    if (!csv) {
+        printf("\nCommands without output (replaced by the next one): %u\n", missed);
+    }
+    if (report.getCount() == 0) {
+        fprintf(stderr, "ERROR: No command reached the output.\n");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
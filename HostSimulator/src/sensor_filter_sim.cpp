@@ -0,0 +1,346 @@
+#include <getopt.h>
+#include <math.h>
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "SensorFilter.h"
+
+// Same settings as RadiatorController.ino
+#define DHT_PERIOD_MS 5000
+#define DHT_TAB_MAX 24
+#define DHT_VAL_MIN 3
+#define DHT_MEDIAN_SIZE 5
+#define DHT_TIMEOUT_MS 120000
+#define SENSOR_TEMPERATURE_DEADBAND 10
+#define SENSOR_HUMIDITY_DEADBAND 50
+#define SENSOR_HEARTBEAT_MS 600000
+
+struct Sample {
+    float temperature; // NaN for a failed reading
+    float humidity;
+    float trueTemperature; // NaN when unknown (recorded trace)
+    float trueHumidity;
+};
+
+struct Result {
+    uint32_t messages = 0;
+    double maxTemperatureError = 0;
+    double maxHumidityError = 0;
+    double sumTemperatureError = 0;
+    uint32_t errorSamples = 0;
+    bool published = false;
+    float temperature = 0; // Last published values, as seen by Home Assistant
+    float humidity = 0;
+
+    void publish(bool publishTemperature, float t, bool publishHumidity, float h) {
+        if (publishTemperature) {
+            temperature = t;
+            messages++;
+        }
+        if (publishHumidity) {
+            humidity = h;
+            messages++;
+        }
+        published |= publishTemperature || publishHumidity;
+    }
+
+    void compare(const Sample &sample) {
+        if (!published || isnan(sample.trueTemperature)) {
+            return;
+        }
+        double temperatureError = fabs(temperature - sample.trueTemperature);
+        double humidityError = fabs(humidity - sample.trueHumidity);
+        maxTemperatureError = temperatureError > maxTemperatureError ? temperatureError : maxTemperatureError;
+        maxHumidityError = humidityError > maxHumidityError ? humidityError : maxHumidityError;
+        sumTemperatureError += temperatureError;
+        errorSamples++;
+    }
+};
+
+static struct option long_options[] = {
+    {"help",                 no_argument,       NULL, 'h'},
+    {"trace",                required_argument, NULL, 'f'},
+    {"hours",                required_argument, NULL, 'H'},
+    {"temperature",          required_argument, NULL, 't'},
+    {"glitch-rate",          required_argument, NULL, 'g'},
+    {"seed",                 required_argument, NULL, 's'},
+    {"max-error",            required_argument, NULL, 'e'},
+    {"csv",                  no_argument,       NULL, 'c'},
+    {NULL, 0, NULL, 0}
+};
+
+void print_help() {
+    printf("\n");
+    printf("RadiatorController sensor filter simulator\n");
+    printf("Usage: sensor_filter_sim [options]\n");
+    printf("Options:\n");
+    printf("  -h, --help                Show this help message\n");
+    printf("  -f, --trace <FILE>        Recorded trace, one DHT22 reading every 5s per line: temperature,humidity\n");
+    printf("                            (nan for a failed reading), instead of the synthetic trace\n");
+    printf("  -H, --hours <N>           Synthetic trace duration (default: 24)\n");
+    printf("  -t, --temperature <C>     Synthetic trace mean temperature (default: 19)\n");
+    printf("  -g, --glitch-rate <PCT>   Synthetic trace glitched readings, in %% (default: 1)\n");
+    printf("  -s, --seed <N>            Synthetic trace random seed (default: 1)\n");
+    printf("  -e, --max-error <C>       Fail if the new pipeline temperature error is larger (default: 0.5)\n");
+    printf("  -c, --csv                 Print the published values: time, old temperature, old humidity,\n");
+    printf("                            new temperature, new humidity\n");
+    printf("Example:\n");
+    printf("  ./sensor_filter_sim --hours 48 --glitch-rate 2\n");
+    printf("\n");
+}
+
+// Room heated by cycles, with the DHT22 0.1 resolution and noise, and its known failures
+static std::vector<Sample> generate_trace(double hours, double mean, double glitchRate, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::normal_distribution<double> noise(0, 0.05);
+    std::vector<Sample> trace;
+    uint32_t count = hours * 3600 * 1000 / DHT_PERIOD_MS;
+
+    for (uint32_t i = 0; i < count; i++) {
+        double t = i * (DHT_PERIOD_MS / 1000.);
+        double cycle = fmod(t, 3600) / 3600; // Radiator on the first 20 min of each hour
+        double heating = cycle < 1/3. ? cycle * 3 : 1 - (cycle - 1/3.) * 1.5;
+        Sample sample;
+        sample.trueTemperature = mean + 1.5 * sin(2 * M_PI * t / 86400) + 0.4 * (heating - 0.5);
+        sample.trueHumidity = 50 + 5 * sin(2 * M_PI * t / 86400 + 1) - 1.5 * (heating - 0.5);
+        sample.temperature = round((sample.trueTemperature + noise(rng)) * 10) / 10;
+        sample.humidity = round((sample.trueHumidity + noise(rng) * 4) * 10) / 10;
+
+        if (uniform(rng) * 100 < glitchRate) {
+            double kind = uniform(rng);
+            if (kind < 0.4) {
+                sample.temperature = NAN; // Checksum or timeout
+                sample.humidity = NAN;
+            } else if (kind < 0.6) {
+                sample.temperature = 0; // Sensor not answering
+                sample.humidity = 0;
+            } else if (kind < 0.8) {
+                sample.temperature += uniform(rng) < 0.5 ? -25 : 25; // Bit error
+            } else {
+                sample.humidity = uniform(rng) < 0.5 ? 0.1 : 99.9;
+            }
+        }
+        trace.push_back(sample);
+    }
+    return trace;
+}
+
+static bool load_trace(const char *path, std::vector<Sample> *trace) {
+    FILE *file = fopen(path, "r");
+    char line[128];
+    if (!file) {
+        return false;
+    }
+    while (fgets(line, sizeof(line), file)) {
+        Sample sample = { NAN, NAN, NAN, NAN };
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        char *end;
+        sample.temperature = strtof(line, &end);
+        if (*end == ',') {
+            sample.humidity = strtof(end + 1, NULL);
+        }
+        trace->push_back(sample);
+    }
+    fclose(file);
+    return true;
+}
+
+// Firmware up to 3.3.1: mean of the 24 last readings, 0 for invalid, published on each reading
+class OldPipeline {
+public:
+    void loop(const Sample &sample, Result *result, float *t, float *h) {
+        float humidity = sample.humidity;
+        float temperature = sample.temperature;
+        if (isnan(humidity) || isnan(temperature) || (humidity == 0 && temperature == 0)) {
+            mHumidityTab[mIndex] = 0;
+            mTemperatureTab[mIndex] = 0;
+        } else {
+            mHumidityTab[mIndex] = humidity * 100;
+            mTemperatureTab[mIndex] = temperature * 100.;
+        }
+        mIndex = (mIndex + 1) % DHT_TAB_MAX;
+
+        humidity = computeAverage(mHumidityTab) / 100.;
+        temperature = computeAverage(mTemperatureTab) / 100.;
+        bool valid = temperature > 0 && temperature < 80 && humidity > 0 && humidity < 100;
+        result->publish(valid, temperature, valid, humidity);
+        *t = valid ? temperature : NAN;
+        *h = valid ? humidity : NAN;
+    }
+
+private:
+    static int32_t computeAverage(int16_t val[DHT_TAB_MAX]) {
+        int64_t res = 0;
+        int valid = 0;
+        for (int i = 0; i < DHT_TAB_MAX; i++) {
+            if (val[i]) {
+                res += val[i];
+                valid++;
+            }
+        }
+        return valid < DHT_VAL_MIN ? 0 : res / valid;
+    }
+
+    int16_t mTemperatureTab[DHT_TAB_MAX] = {};
+    int16_t mHumidityTab[DHT_TAB_MAX] = {};
+    int mIndex = 0;
+};
+
+// Current firmware, same code as loop_temp()
+class NewPipeline {
+public:
+    void loop(const Sample &sample, unsigned long currentTime, Result *result, float *t, float *h) {
+        float humidity = sample.humidity;
+        float temperature = sample.temperature;
+        *t = NAN;
+        *h = NAN;
+        if (isnan(humidity) || isnan(temperature) || (humidity == 0 && temperature == 0)) {
+            if (currentTime - mLastValidTime > DHT_TIMEOUT_MS) {
+                mHumidityFilter.reset();
+                mTemperatureFilter.reset();
+            }
+        } else {
+            mHumidityFilter.add(round(humidity * 100));
+            mTemperatureFilter.add(round(temperature * 100));
+            mLastValidTime = currentTime;
+        }
+
+        if (mTemperatureFilter.getCount() < DHT_VAL_MIN) {
+            return;
+        }
+
+        humidity = mHumidityFilter.get() / 100.;
+        temperature = mTemperatureFilter.get() / 100.;
+        if (temperature >= -40 && temperature <= 80 && humidity >= 0 && humidity <= 100) {
+            bool publishHumidity = mHumidityDeadband.check(mHumidityFilter.get(), currentTime);
+            bool publishTemperature = mTemperatureDeadband.check(mTemperatureFilter.get(), currentTime);
+            result->publish(publishTemperature, temperature, publishHumidity, humidity);
+            *t = publishTemperature ? temperature : NAN;
+            *h = publishHumidity ? humidity : NAN;
+        }
+    }
+
+private:
+    SensorFilter<DHT_MEDIAN_SIZE, DHT_TAB_MAX> mTemperatureFilter;
+    SensorFilter<DHT_MEDIAN_SIZE, DHT_TAB_MAX> mHumidityFilter;
+    PublishDeadband mTemperatureDeadband{SENSOR_TEMPERATURE_DEADBAND, SENSOR_HEARTBEAT_MS};
+    PublishDeadband mHumidityDeadband{SENSOR_HUMIDITY_DEADBAND, SENSOR_HEARTBEAT_MS};
+    unsigned long mLastValidTime = 0;
+};
+
+static void print_result(const char *name, const Result &result, double hours, bool known) {
+    printf("%s : %7.1f messages/hour", name, result.messages / hours);
+    if (known && result.errorSamples) {
+        printf(", temperature error max %.2f mean %.3f, humidity error max %.2f",
+               result.maxTemperatureError, result.sumTemperatureError / result.errorSamples, result.maxHumidityError);
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *trace_path = NULL;
+    double hours = 24;
+    double mean = 19;
+    double glitch_rate = 1;
+    uint32_t seed = 1;
+    double max_error = 0.5;
+    bool csv = false;
+    int opt_idx = 0;
+    int c;
+
+    // Parse arguments
+    while ((c = getopt_long(argc, argv, "hf:H:t:g:s:e:c", long_options, &opt_idx)) != -1) {
+        switch (c) {
+            case 'h':
+                print_help();
+                return 0;
+            case 'f':
+                trace_path = optarg;
+                break;
+            case 'H':
+                hours = atof(optarg);
+                break;
+            case 't':
+                mean = atof(optarg);
+                break;
+            case 'g':
+                glitch_rate = atof(optarg);
+                break;
+            case 's':
+                seed = strtoul(optarg, NULL, 10);
+                break;
+            case 'e':
+                max_error = atof(optarg);
+                break;
+            case 'c':
+                csv = true;
+                break;
+            default:
+                print_help();
+                fprintf(stderr, "ERROR: Invalid option.\n");
+                return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<Sample> trace;
+    if (trace_path) {
+        if (!load_trace(trace_path, &trace)) {
+            fprintf(stderr, "ERROR: Cannot read trace '%s'.\n", trace_path);
+            return EXIT_FAILURE;
+        }
+    } else {
+        trace = generate_trace(hours, mean, glitch_rate, seed);
+    }
+    if (trace.empty()) {
+        fprintf(stderr, "ERROR: Empty trace.\n");
+        return EXIT_FAILURE;
+    }
+
+    // Simulated loop_temp() every 5s, starting close to the millis() wrap
+    OldPipeline oldPipeline;
+    NewPipeline newPipeline;
+    Result oldResult;
+    Result newResult;
+    const unsigned long start_ms = (unsigned long)UINT32_MAX - 3600000UL;
+    bool known = !isnan(trace[0].trueTemperature);
+    uint32_t invalid = 0;
+
+    for (size_t i = 0; i < trace.size(); i++) {
+        const Sample &sample = trace[i];
+        unsigned long now = (uint32_t)(start_ms + i * DHT_PERIOD_MS);
+        float old_t, old_h, new_t, new_h;
+        invalid += isnan(sample.temperature) || isnan(sample.humidity);
+
+        oldPipeline.loop(sample, &oldResult, &old_t, &old_h);
+        newPipeline.loop(sample, now, &newResult, &new_t, &new_h);
+        oldResult.compare(sample);
+        newResult.compare(sample);
+
+        if (csv) {
+            printf("%zu,%.2f,%.2f,%.2f,%.2f\n", i * DHT_PERIOD_MS / 1000, old_t, old_h, new_t, new_h);
+        }
+    }
+
+    hours = trace.size() * (DHT_PERIOD_MS / 1000.) / 3600;
+    printf("Trace        : %s, %zu readings (%.1f hours), %u failed\n",
+           trace_path ? trace_path : "synthetic", trace.size(), hours, invalid);
+    print_result("Old pipeline", oldResult, hours, known);
+    print_result("New pipeline", newResult, hours, known);
+
+    if (known && newResult.maxTemperatureError > max_error) {
+        fprintf(stderr, "ERROR: Temperature error %.2f above %.2f.\n", newResult.maxTemperatureError, max_error);
+        return EXIT_FAILURE;
+    }
+    if (newResult.messages == 0) {
+        fprintf(stderr, "ERROR: Nothing published.\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
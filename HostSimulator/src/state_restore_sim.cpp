@@ -0,0 +1,298 @@
+#include <algorithm>
+#include <getopt.h>
+#include <memory>
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ConfigStore.h"
+#include "SavedState.h"
+
+// State of LedStripLight2, the largest one: 4 segments of on/off, RGB and effect
+struct State {
+    uint8_t segments[4][5];
+};
+
+constexpr uint8_t STATE_KEY = CONFIG_KEY_LED_STATE;
+constexpr unsigned long STEP_MS = 100;
+constexpr uint64_t DAY_MS = 24 * 3600 * 1000ULL;
+
+// The first 128 bytes are overwritten by the OTA boot command, all of them are random
+// after power on
+class SimRtc {
+public:
+    bool read(uint8_t offset, uint32_t *data, uint16_t size) {
+        if (offset * 4u + size > sizeof(mData)) {
+            return false;
+        }
+        memcpy(data, mData + offset * 4, size);
+        return true;
+    }
+
+    bool write(uint8_t offset, uint32_t *data, uint16_t size) {
+        if (offset * 4u + size > sizeof(mData)) {
+            return false;
+        }
+        memcpy(mData + offset * 4, data, size);
+        mWrites++;
+        return true;
+    }
+
+    void scramble(uint16_t size, std::mt19937 &rng) {
+        for (uint16_t i = 0; i < size; i++) {
+            mData[i] = rng();
+        }
+    }
+
+    uint32_t getWrites() const {
+        return mWrites;
+    }
+
+private:
+    uint8_t mData[512];
+    uint32_t mWrites = 0;
+};
+
+// NOR flash of the NVM config store, without power cut (see config_store_sim)
+class SimFlash {
+public:
+    SimFlash() {
+        memset(mData, 0xFF, sizeof(mData));
+    }
+
+    uint8_t getSectorCount() const {
+        return CONFIG_STORE_SECTOR_MAX;
+    }
+
+    bool erase(uint8_t sector) {
+        memset(mData[sector], 0xFF, CONFIG_STORE_SECTOR_SIZE);
+        mErases++;
+        return true;
+    }
+
+    bool write(uint8_t sector, uint16_t offset, const uint32_t *data, uint16_t size) {
+        for (uint16_t i = 0; i < size / 4; i++) {
+            mData[sector][offset / 4 + i] &= data[i];
+        }
+        return true;
+    }
+
+    bool read(uint8_t sector, uint16_t offset, uint32_t *data, uint16_t size) const {
+        memcpy(data, (const uint8_t*)mData[sector] + offset, size);
+        return true;
+    }
+
+    uint32_t getErases() const {
+        return mErases;
+    }
+
+private:
+    uint32_t mData[CONFIG_STORE_SECTOR_MAX][CONFIG_STORE_SECTOR_SIZE / 4];
+    uint32_t mErases = 0;
+};
+
+enum Reset {
+    RESET_SOFTWARE, // Restart after a room change, watchdog
+    RESET_OTA,      // OTA update, the boot command is in the RTC memory
+    RESET_POWER,    // Power loss
+    RESET_COUNT,
+};
+
+static const char *reset_names[RESET_COUNT] = {"reset", "OTA update", "power loss"};
+
+static struct option long_options[] = {
+    {"help",        no_argument,       NULL, 'h'},
+    {"days",        required_argument, NULL, 'd'},
+    {"commands",    required_argument, NULL, 'c'},
+    {"slider-rate", required_argument, NULL, 'l'},
+    {"reset-rate",  required_argument, NULL, 'r'},
+    {"seed",        required_argument, NULL, 's'},
+    {NULL, 0, NULL, 0}
+};
+
+void print_help() {
+    printf("\n");
+    printf("Saved state restore simulator\n");
+    printf("Usage: state_restore_sim [options]\n");
+    printf("Options:\n");
+    printf("  -h, --help                Show this help message\n");
+    printf("  -d, --days <N>            Simulated days (default: 30)\n");
+    printf("  -c, --commands <N>        Commands per day (default: 40)\n");
+    printf("  -l, --slider-rate <PCT>   Commands sent as a burst of values by a slider, in %% (default: 30)\n");
+    printf("  -r, --reset-rate <N>      Reboots per day, reset, OTA update or power loss in turn (default: 3)\n");
+    printf("  -s, --seed <N>            Random seed (default: 1)\n");
+    printf("Example:\n");
+    printf("  ./state_restore_sim --days 365 --commands 100 --reset-rate 10\n");
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t days = 30;
+    double commands = 40;
+    double slider_rate = 30;
+    double reset_rate = 3;
+    uint32_t seed = 1;
+    int opt_idx = 0;
+    int c;
+
+    // Parse arguments
+    while ((c = getopt_long(argc, argv, "hd:c:l:r:s:", long_options, &opt_idx)) != -1) {
+        switch (c) {
+            case 'h':
+                print_help();
+                return 0;
+            case 'd':
+                days = strtoul(optarg, NULL, 10);
+                break;
+            case 'c':
+                commands = atof(optarg);
+                break;
+            case 'l':
+                slider_rate = atof(optarg);
+                break;
+            case 'r':
+                reset_rate = atof(optarg);
+                break;
+            case 's':
+                seed = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                print_help();
+                fprintf(stderr, "ERROR: Invalid option.\n");
+                return EXIT_FAILURE;
+        }
+    }
+    if (days == 0) {
+        fprintf(stderr, "ERROR: Invalid days.\n");
+        return EXIT_FAILURE;
+    }
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    static SimFlash flash;
+    SimRtc rtc;
+    rtc.scramble(512, rng);
+    ConfigStore<SimFlash> store(flash);
+    store.begin();
+    store.format();
+    uint32_t format_erases = flash.getErases();
+
+    State state = {};
+    State flashed = {};
+    std::unique_ptr<SavedState<State, SimRtc>> saved(new SavedState<State, SimRtc>(rtc));
+    saved->setSaved(state);
+
+    uint32_t changes = 0;
+    uint32_t saves = 0;
+    uint32_t burst = 0;
+    uint32_t reboots[RESET_COUNT] = {};
+    uint32_t restored[RESET_COUNT] = {};
+    uint32_t stale = 0;
+    uint64_t stale_max_ms = 0;
+    uint64_t change_ms = 0;
+    int errors = 0;
+    unsigned long millis_ms = 0;
+
+    for (uint64_t now = 0; now < days * DAY_MS && !errors; now += STEP_MS, millis_ms += STEP_MS) {
+        // Commands, a slider sends a value every 200 ms while moved
+        bool changed = false;
+        if (burst > 0 && now % 200 == 0) {
+            burst--;
+            changed = true;
+        }
+        else if (uniform(rng) < commands * STEP_MS / DAY_MS) {
+            burst = uniform(rng) * 100 < slider_rate ? 5 + rng() % 20 : 0;
+            changed = true;
+        }
+        if (changed) {
+            state.segments[rng() % 4][rng() % 5] = rng();
+            changes++;
+            change_ms = now;
+        }
+
+        // Loop of the firmware
+        saved->update(state, millis_ms);
+        if (saved->isSaveDue(millis_ms)) {
+            store.set(STATE_KEY, &state, sizeof(state));
+            store.commit();
+            saved->setSaved(state);
+            flashed = state;
+            saves++;
+        }
+
+        if (uniform(rng) >= reset_rate * STEP_MS / DAY_MS) {
+            continue;
+        }
+
+        // Reboot, the RTC memory is kept except for the boot command
+        uint32_t total = reboots[0] + reboots[1] + reboots[2];
+        Reset reset = (Reset)(total % RESET_COUNT);
+        reboots[reset]++;
+        if (reset == RESET_OTA) {
+            rtc.scramble(4 * STATE_RTC_OFFSET, rng);
+        }
+        else if (reset == RESET_POWER) {
+            rtc.scramble(512, rng);
+        }
+        burst = 0;
+        millis_ms = 0;
+
+        State loaded = {};
+        saved.reset(new SavedState<State, SimRtc>(rtc));
+        ConfigStore<SimFlash> reloaded(flash);
+        reloaded.begin();
+        if (saved->load(loaded)) {
+            restored[reset]++;
+        }
+        else {
+            if (reset != RESET_POWER) {
+                fprintf(stderr, "ERROR: State not found in the RTC memory after %s at %.3f days.\n",
+                        reset_names[reset], (double)now / DAY_MS);
+                errors++;
+            }
+            if (!reloaded.get(STATE_KEY, &loaded, sizeof(loaded))) {
+                loaded = {};
+            }
+            saved->setSaved(loaded);
+        }
+
+        // The flash copy misses the changes of the last STATE_SAVE_DELAY_MS at most, from
+        // the boot for a change restored from the RTC memory
+        const State &expected = reset == RESET_POWER ? flashed : state;
+        if (memcmp(&loaded, &expected, sizeof(State)) != 0) {
+            fprintf(stderr, "ERROR: Wrong state restored after %s at %.3f days.\n", reset_names[reset], (double)now / DAY_MS);
+            errors++;
+        }
+        if (reset == RESET_POWER && memcmp(&state, &flashed, sizeof(State)) != 0) {
+            stale++;
+            stale_max_ms = std::max(stale_max_ms, now - change_ms);
+        }
+
+        state = loaded;
+        change_ms = now;
+    }
+
+    // A write on each command would take one commit per change
+    double sector_records = (double)(CONFIG_STORE_SECTOR_SIZE - CONFIG_STORE_HEADER_SIZE) / (4 + sizeof(State) + 8);
+    printf("Commands   : %u changes, %u flash writes (%.1f/day), %u RTC memory writes\n",
+           changes, saves, (double)saves / days, rtc.getWrites());
+    printf("Erases     : %.2f/day of each sector, %.2f/day with a write on each change\n",
+           (double)(flash.getErases() - format_erases) / days / CONFIG_STORE_SECTOR_MAX,
+           changes / sector_records / days / CONFIG_STORE_SECTOR_MAX);
+    for (uint8_t r = 0; r < RESET_COUNT; r++) {
+        printf("%-11s: %u, %u restored from the RTC memory, %u from the flash copy\n", reset_names[r], reboots[r],
+               restored[r], reboots[r] - restored[r]);
+    }
+    printf("Stale      : %u power losses lost the last change, %.1f s after it at most\n", stale, stale_max_ms / 1000.);
+
+    if (stale_max_ms > STATE_SAVE_DELAY_MS) {
+        fprintf(stderr, "ERROR: Flash copy older than the save delay.\n");
+        errors++;
+    }
+    if (errors) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,175 @@
+#include <getopt.h>
+#include <math.h>
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "TelemetryHistory.h"
+
+// Same settings as RadiatorController.ino
+#define TELEMETRY_PERIOD_MS 60000
+
+// Samples start on 2023-11-14
+#define TELEMETRY_TIME_START 1700000000
+
+// Time, temperature, humidity and rssi without encoding
+#define TELEMETRY_RAW_SIZE 9
+
+struct Options {
+    double hours = 24;
+    double gap_rate = 0.5;
+    double spike_rate = 0.1;
+    uint32_t seed = 1;
+    bool csv = false;
+};
+
+static bool same(const TelemetrySample &a, const TelemetrySample &b) {
+    return a.time == b.time && a.temperature == b.temperature && a.humidity == b.humidity && a.rssi == b.rssi;
+}
+
+static struct option long_options[] = {
+    {"help",       no_argument,       NULL, 'h'},
+    {"hours",      required_argument, NULL, 'H'},
+    {"gap-rate",   required_argument, NULL, 'g'},
+    {"spike-rate", required_argument, NULL, 'k'},
+    {"seed",       required_argument, NULL, 's'},
+    {"csv",        no_argument,       NULL, 'c'},
+    {NULL, 0, NULL, 0}
+};
+
+void print_help() {
+    printf("\n");
+    printf("RadiatorController telemetry history simulator\n");
+    printf("Usage: telemetry_history_sim [options]\n");
+    printf("Options:\n");
+    printf("  -h, --help                Show this help message\n");
+    printf("  -H, --hours <N>           Broker outage duration (default: 24)\n");
+    printf("  -g, --gap-rate <PCT>      Samples missed for a few minutes, in %% (default: 0.5)\n");
+    printf("  -k, --spike-rate <PCT>    Samples with a large sensor step, in %% (default: 0.1)\n");
+    printf("  -s, --seed <N>            Random seed (default: 1)\n");
+    printf("  -c, --csv                 Print the samples sent after the outage: time, temperature, humidity, rssi\n");
+    printf("Example:\n");
+    printf("  ./telemetry_history_sim --hours 8 --gap-rate 2\n");
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    Options opt;
+    int opt_idx = 0;
+    int c;
+
+    // Parse arguments
+    while ((c = getopt_long(argc, argv, "hH:g:k:s:c", long_options, &opt_idx)) != -1) {
+        switch (c) {
+            case 'h':
+                print_help();
+                return 0;
+            case 'H':
+                opt.hours = atof(optarg);
+                break;
+            case 'g':
+                opt.gap_rate = atof(optarg);
+                break;
+            case 'k':
+                opt.spike_rate = atof(optarg);
+                break;
+            case 's':
+                opt.seed = strtoul(optarg, NULL, 10);
+                break;
+            case 'c':
+                opt.csv = true;
+                break;
+            default:
+                print_help();
+                fprintf(stderr, "ERROR: Invalid option.\n");
+                return EXIT_FAILURE;
+        }
+    }
+    if (opt.hours <= 0) {
+        fprintf(stderr, "ERROR: Invalid duration.\n");
+        return EXIT_FAILURE;
+    }
+
+    std::mt19937 rng(opt.seed);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::normal_distribution<double> noise(0, 1);
+    TelemetryHistory history;
+    std::vector<TelemetrySample> added;
+    double temperature = 19;
+    double humidity = 50;
+    double rssi = -65;
+    uint32_t time = TELEMETRY_TIME_START;
+    uint32_t used_max = 0;
+
+    // Sensors sampled every minute while the broker is not reachable
+    const uint32_t end = time + opt.hours * 3600;
+    while (time < end) {
+        temperature += noise(rng) * 0.03;
+        humidity += noise(rng) * 0.1;
+        rssi += noise(rng) * 0.5;
+        if (uniform(rng) * 100 < opt.spike_rate) {
+            temperature += noise(rng) * 3; // Window opened
+            humidity += noise(rng) * 15;
+        }
+        temperature = fmin(fmax(temperature, -40), 80);
+        humidity = fmin(fmax(humidity, 0), 100);
+        rssi = fmin(fmax(rssi, -100), -30);
+
+        TelemetrySample sample = {
+            time,
+            (int16_t)lround(temperature * 100),
+            (uint16_t)lround(humidity * 10),
+            (int8_t)(uniform(rng) < 0.02 ? 0 : lround(rssi)), // WiFi lost
+        };
+        history.add(sample);
+        added.push_back(sample);
+        used_max = used_max > history.getUsedSize() ? used_max : history.getUsedSize();
+
+        time += TELEMETRY_PERIOD_MS / 1000;
+        if (uniform(rng) * 100 < opt.gap_rate) {
+            time += 60 + uniform(rng) * 600; // DHT22 timeout, clock jump
+        }
+    }
+
+    // Broker back, the blocks are sent oldest first
+    uint32_t retained = history.getSampleCount();
+    uint32_t used = history.getUsedSize();
+    uint8_t blocks = history.getBlockCount();
+    size_t index = added.size() - retained;
+    uint32_t errors = 0;
+    while (history.getBlockCount() > 0) {
+        TelemetrySample samples[TELEMETRY_BLOCK_SAMPLE_MAX];
+        uint8_t count = history.readOldestBlock(samples);
+        for (uint8_t i = 0; i < count; i++, index++) {
+            if (index >= added.size() || !same(samples[i], added[index])) {
+                errors++;
+            }
+            if (opt.csv) {
+                printf("%u,%.2f,%.1f,%d\n", samples[i].time, samples[i].temperature / 100., samples[i].humidity / 10., samples[i].rssi);
+            }
+        }
+        history.dropOldestBlock();
+    }
+    if (index != added.size()) {
+        errors++;
+    }
+
+    double bytes_per_sample = retained ? (double)used / retained : 0;
+    printf("Memory     : %u bytes, %u blocks of %u bytes, %u bytes used max\n",
+           TELEMETRY_BLOCK_MAX * TELEMETRY_BLOCK_SIZE, TELEMETRY_BLOCK_MAX, TELEMETRY_BLOCK_SIZE, used_max);
+    printf("Samples    : %zu taken, %u retained in %u blocks, %zu dropped\n",
+           added.size(), retained, blocks, added.size() - retained);
+    printf("Encoding   : %.2f bytes/sample, %u raw, ratio %.2f\n",
+           bytes_per_sample, TELEMETRY_RAW_SIZE, bytes_per_sample ? TELEMETRY_RAW_SIZE / bytes_per_sample : 0);
+    printf("Retained   : %.1f h at one sample every %u s\n",
+           retained ? (added.back().time - added[added.size() - retained].time) / 3600. : 0, TELEMETRY_PERIOD_MS / 1000);
+
+    // The newest samples are sent back unchanged, only the oldest ones are dropped
+    if (errors) {
+        fprintf(stderr, "ERROR: %u samples sent back differ from the samples taken.\n", errors);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
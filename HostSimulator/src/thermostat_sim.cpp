@@ -0,0 +1,222 @@
+#include <getopt.h>
+#include <math.h>
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "SensorFilter.h"
+#include "Thermostat.h"
+
+// Same settings as RadiatorController.ino
+#define DHT_PERIOD_MS 5000
+#define DHT_TAB_MAX 24
+#define DHT_MEDIAN_SIZE 5
+
+// Pilot wire eco is the radiator comfort temperature minus 3.5 C
+#define RADIATOR_ECO_OFFSET 3.5
+#define RADIATOR_HYSTERESIS 0.5
+
+struct Options {
+    double hours = 48;
+    double setpoint = 20;
+    double hysteresis = THERMOSTAT_HYSTERESIS_DEFAULT;
+    double radiator_comfort = 22;
+    double outdoor = 5;
+    double power_w = 1500;
+    double loss_w_k = 60;
+    double capacity_kj_k = 4000;
+    bool csv = false;
+};
+
+// One room heated by one radiator with its own on/off thermostat, losses to the outdoor
+class Room {
+public:
+    Room(const Options &opt) : mOpt(opt), mTemperature(opt.setpoint - 2) {
+    }
+
+    // Pilot wire comfort or eco, return true if the radiator heats
+    bool step(bool comfort, double outdoor, double seconds) {
+        double target = mOpt.radiator_comfort - (comfort ? 0 : RADIATOR_ECO_OFFSET);
+        if (mTemperature < target - RADIATOR_HYSTERESIS) {
+            mHeating = true;
+        } else if (mTemperature > target + RADIATOR_HYSTERESIS) {
+            mHeating = false;
+        }
+        double power = (mHeating ? mOpt.power_w : 0) - (mTemperature - outdoor) * mOpt.loss_w_k;
+        mTemperature += power * seconds / (mOpt.capacity_kj_k * 1000);
+        return mHeating;
+    }
+
+    double getTemperature() const {
+        return mTemperature;
+    }
+
+private:
+    const Options &mOpt;
+    double mTemperature;
+    bool mHeating = false;
+};
+
+struct Result {
+    double sumError = 0;
+    double sumSquareError = 0;
+    double maxError = 0;
+    uint32_t samples = 0;
+    uint32_t switches = 0;
+    double heatingSeconds = 0;
+};
+
+static Result run(const Options &opt, bool regulation, bool csv) {
+    std::mt19937 rng(1);
+    std::normal_distribution<double> noise(0, 0.05);
+    SensorFilter<DHT_MEDIAN_SIZE, DHT_TAB_MAX> filter;
+    Thermostat thermostat;
+    Room room(opt);
+    Result result;
+    bool comfort = true;
+    const double step_s = DHT_PERIOD_MS / 1000.;
+    const uint32_t steps = opt.hours * 3600 / step_s;
+    // Same wrap as millis() after 49 days
+    const uint32_t start_ms = UINT32_MAX - 3600000;
+
+    thermostat.setSetpoint(regulation ? opt.setpoint : NAN);
+    thermostat.setHysteresis(opt.hysteresis);
+
+    for (uint32_t i = 0; i < steps; i++) {
+        double t = i * step_s;
+        double outdoor = opt.outdoor + 4 * sin(2 * M_PI * (t / 86400 - 0.375)); // Warmest at 15h
+        if (room.step(comfort, outdoor, step_s)) {
+            result.heatingSeconds += step_s;
+        }
+
+        // DHT22 0.1 resolution and noise, then the firmware filter
+        double reading = round((room.getTemperature() + noise(rng)) * 10) / 10;
+        filter.add(round(reading * 100));
+        bool heating = thermostat.update(filter.get() / 100., start_ms + (uint32_t)(t * 1000));
+        if (heating != comfort) {
+            comfort = heating;
+            result.switches++;
+        }
+
+        // Regulation error after the first hour
+        if (t >= 3600) {
+            double error = fabs(room.getTemperature() - opt.setpoint);
+            result.sumError += error;
+            result.sumSquareError += error * error;
+            result.maxError = error > result.maxError ? error : result.maxError;
+            result.samples++;
+        }
+        if (csv && i % 12 == 0) {
+            printf("%.0f,%.2f,%.2f,%.2f,%d\n", t, outdoor, room.getTemperature(), filter.get() / 100., comfort);
+        }
+    }
+    return result;
+}
+
+static void print_result(const char *name, const Result &result, const Options &opt) {
+    printf("%s : error mean %.2f C, rms %.2f C, max %.2f C, pilot wire switches %.1f/day, heating %.0f%%\n", name,
+           result.sumError / result.samples, sqrt(result.sumSquareError / result.samples), result.maxError,
+           result.switches * 24 / opt.hours, result.heatingSeconds * 100 / (opt.hours * 3600));
+}
+
+static struct option long_options[] = {
+    {"help",             no_argument,       NULL, 'h'},
+    {"hours",            required_argument, NULL, 'H'},
+    {"setpoint",         required_argument, NULL, 't'},
+    {"hysteresis",       required_argument, NULL, 'y'},
+    {"radiator-comfort", required_argument, NULL, 'r'},
+    {"outdoor",          required_argument, NULL, 'o'},
+    {"power",            required_argument, NULL, 'p'},
+    {"loss",             required_argument, NULL, 'l'},
+    {"capacity",         required_argument, NULL, 'C'},
+    {"csv",              no_argument,       NULL, 'c'},
+    {NULL, 0, NULL, 0}
+};
+
+void print_help() {
+    printf("\n");
+    printf("RadiatorController thermostat simulator\n");
+    printf("Usage: thermostat_sim [options]\n");
+    printf("Options:\n");
+    printf("  -h, --help                   Show this help message\n");
+    printf("  -H, --hours <N>              Simulated duration (default: 48)\n");
+    printf("  -t, --setpoint <C>           Target temperature (default: 20)\n");
+    printf("  -y, --hysteresis <C>         Thermostat hysteresis (default: %.1f)\n", THERMOSTAT_HYSTERESIS_DEFAULT);
+    printf("  -r, --radiator-comfort <C>   Comfort temperature set on the radiator (default: 22)\n");
+    printf("  -o, --outdoor <C>            Mean outdoor temperature, +/- 4 C over the day (default: 5)\n");
+    printf("  -p, --power <W>              Radiator power (default: 1500)\n");
+    printf("  -l, --loss <W/K>             Room losses (default: 60)\n");
+    printf("  -C, --capacity <kJ/K>        Room thermal capacity (default: 4000)\n");
+    printf("  -c, --csv                    Print each minute: time, outdoor, room, filtered, comfort\n");
+    printf("Example:\n");
+    printf("  ./thermostat_sim --setpoint 19.5 --hysteresis 0.2 --outdoor 0\n");
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    Options opt;
+    int opt_idx = 0;
+    int c;
+
+    // Parse arguments
+    while ((c = getopt_long(argc, argv, "hH:t:y:r:o:p:l:C:c", long_options, &opt_idx)) != -1) {
+        switch (c) {
+            case 'h':
+                print_help();
+                return 0;
+            case 'H':
+                opt.hours = atof(optarg);
+                break;
+            case 't':
+                opt.setpoint = atof(optarg);
+                break;
+            case 'y':
+                opt.hysteresis = atof(optarg);
+                break;
+            case 'r':
+                opt.radiator_comfort = atof(optarg);
+                break;
+            case 'o':
+                opt.outdoor = atof(optarg);
+                break;
+            case 'p':
+                opt.power_w = atof(optarg);
+                break;
+            case 'l':
+                opt.loss_w_k = atof(optarg);
+                break;
+            case 'C':
+                opt.capacity_kj_k = atof(optarg);
+                break;
+            case 'c':
+                opt.csv = true;
+                break;
+            default:
+                print_help();
+                fprintf(stderr, "ERROR: Invalid option.\n");
+                return EXIT_FAILURE;
+        }
+    }
+    if (opt.hours <= 1 || !isThermostatSetpointValid(opt.setpoint) || !isThermostatHysteresisValid(opt.hysteresis)) {
+        fprintf(stderr, "ERROR: Invalid duration, setpoint or hysteresis.\n");
+        return EXIT_FAILURE;
+    }
+
+    Result comfort = run(opt, false, false);
+    Result regulated = run(opt, true, opt.csv);
+
+    printf("Room         : %.0f W radiator, %.0f W/K losses, %.0f kJ/K, outdoor %.1f C\n",
+           opt.power_w, opt.loss_w_k, opt.capacity_kj_k, opt.outdoor);
+    printf("Target       : %.1f C, hysteresis %.2f C, radiator comfort %.1f C\n",
+           opt.setpoint, opt.hysteresis, opt.radiator_comfort);
+    print_result("Comfort only", comfort, opt);
+    print_result("Thermostat  ", regulated, opt);
+
+    // The thermostat never switches faster than its minimum state time
+    if (regulated.switches > opt.hours * 3600000 / THERMOSTAT_MIN_STATE_MS + 1) {
+        fprintf(stderr, "ERROR: Too many pilot wire switches.\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,191 @@
+// The sketch first, built with the fake Arduino libraries, its globals are used below
+#include "LedStripLight2.ino.cpp"
+
+#include <gtest/gtest.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_SERIAL_NUMBER 1
+#define TEST_ROOM_NAME "test"
+
+static const char ALARMS_PAYLOAD[] =
+    "[{\"time\": \"06:30\", \"days\": [\"mon\", \"tue\", \"wed\", \"thu\", \"fri\"]},"
+    " {\"time\": \"08:15\", \"days\": [\"sat\", \"sun\"]},"
+    " {\"time\": \"07:00\", \"days\": [\"wed\"]}]";
+
+// A topic not handled by the sketch goes through all the comparisons
+static const char UNKNOWN_TOPIC[] = "home/test/led/unknown/set";
+
+// Serial number and room name of the NVM config, the MQTT topics are built from them
+static void provision() {
+    char room_name[CONFIG_ROOM_NAME_SIZE] = TEST_ROOM_NAME;
+    configStore.begin();
+    configStore.set(CONFIG_KEY_DEVICE_SERIAL_NUMBER, (uint32_t)TEST_SERIAL_NUMBER);
+    configStore.set(CONFIG_KEY_ROOM_NAME, room_name);
+    configStore.set(CONFIG_KEY_VERSION, CONFIG_VERSION);
+    configStore.commit();
+}
+
+// The callback gets a copy, as PubSubClient gives its own buffer
+static void receive(const char *topic, const char *payload) {
+    char topic_buf[MQTT_MSG_TOPIC_MAX_SIZE];
+    uint8_t payload_buf[MQTT_MSG_PAYLOAD_MAX_SIZE] = {};
+    size_t len = strlen(payload);
+    snprintf(topic_buf, sizeof(topic_buf), "%s", topic);
+    memcpy(payload_buf, payload, len);
+    mqtt_callback(topic_buf, payload_buf, len);
+}
+
+// Sunrise curve of LedStripLight2 before the lookup table, float math with cos() and pow()
+static float get_sunrise_intensity_libm(float progress) {
+    progress = progress / 2;
+    float cosinus = 0.5 * (1.0 - cos(progress * M_PI));
+    return pow(cosinus, SUNRISE_GAMMA) * 2;
+}
+
+TEST(LedParsers, State) {
+    EXPECT_EQ(getStateFromMqttPayload("ON", 2), STATE_ON);
+    EXPECT_EQ(getStateFromMqttPayload("OFF", 3), STATE_OFF);
+    EXPECT_EQ(getStateFromMqttPayload("ONE", 3), STATE_UNKNOWN);
+    EXPECT_EQ(getStateFromMqttPayload("", 0), STATE_UNKNOWN);
+}
+
+TEST(LedParsers, Effect) {
+    EXPECT_EQ(getEffectFromMqttPayload("rainbow", 7), LED_EFFECT_RAINBOW);
+    EXPECT_EQ(getEffectFromMqttPayload("rainbo", 6), LED_EFFECT_UNKNOWN);
+}
+
+TEST(LedParsers, Rgb) {
+    uint8_t red = 0, green = 0, blue = 0;
+    getMqttPayload("255, 128, 7", 11, &red, &green, &blue);
+    EXPECT_EQ(red, 255);
+    EXPECT_EQ(green, 128);
+    EXPECT_EQ(blue, 7);
+}
+
+TEST(LedParsers, SunriseAlarms) {
+    SunriseAlarm alarms[SUNRISE_ALARM_MAX];
+    ASSERT_TRUE(getSunriseAlarmsFromMqttPayload(ALARMS_PAYLOAD, strlen(ALARMS_PAYLOAD), alarms));
+    EXPECT_EQ(alarms[0].hour, 6);
+    EXPECT_EQ(alarms[0].minute, 30);
+    EXPECT_EQ(alarms[0].days, 0x3E);
+    EXPECT_EQ(alarms[1].hour, 8);
+    EXPECT_EQ(alarms[1].minute, 15);
+    EXPECT_EQ(alarms[1].days, 0x41);
+    EXPECT_EQ(alarms[2].days, 0x08);
+    for (uint8_t i = 3; i < SUNRISE_ALARM_MAX; i++) {
+        EXPECT_FALSE(isSunriseAlarmEnabled(alarms[i])) << "alarm " << (int)i;
+    }
+}
+
+TEST(LedParsers, SunriseAlarmsInvalid) {
+    SunriseAlarm alarms[SUNRISE_ALARM_MAX];
+    EXPECT_FALSE(getSunriseAlarmsFromMqttPayload("[{\"time\": 630}]", 15, alarms));
+    EXPECT_FALSE(getSunriseAlarmsFromMqttPayload("[{\"time\": \"25:00\"}]", 19, alarms));
+    EXPECT_FALSE(getSunriseAlarmsFromMqttPayload("{", 1, alarms));
+}
+
+TEST(LedMqttCallback, RgbSet) {
+    receive(mqtt.getSegmentTopic(0, MQTT_TOPIC_LED_SUFFIX_RGB_SET), "10, 20, 30");
+    EXPECT_EQ(gLedSegments[0].red, 10);
+    EXPECT_EQ(gLedSegments[0].green, 20);
+    EXPECT_EQ(gLedSegments[0].blue, 30);
+    EXPECT_EQ(gLedSegments[0].effect, LED_EFFECT_NONE);
+}
+
+TEST(LedMqttCallback, UnknownTopic) {
+    LedSegment before = gLedSegments[0];
+    uint32_t published = client.getPublished();
+    receive(UNKNOWN_TOPIC, "ON");
+    EXPECT_EQ(client.getPublished(), published);
+    EXPECT_EQ(gLedSegments[0].red, before.red);
+    EXPECT_EQ(gLedSegments[0].effect, before.effect);
+}
+
+// Within the range of the Home Assistant number, NaN and overflows rejected
+TEST(LedMqttCallback, TransitionSet) {
+    receive(mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_TRANSITION_SET), "2.5");
+    EXPECT_EQ(gLedTransitionMs, 2500u);
+    for (const char *payload : {"-1", "60.5", "1e30", "nan", "inf", "fast"}) {
+        receive(mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_TRANSITION_SET), payload);
+        EXPECT_EQ(gLedTransitionMs, 2500u) << payload;
+    }
+    receive(mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_TRANSITION_SET), "60");
+    EXPECT_EQ(gLedTransitionMs, 60000u);
+    gLedTransitionMs = LED_TRANSITION_DEFAULT_MS;
+}
+
+// Color of the first LED, one frame after the scene is applied
+static LedColor16 apply_scene_frame(uint8_t id) {
+    applyLedScene(id);
+    delay(LED_EFFECT_FRAME_MS);
+    gLedSegments[0].effects.update(millis());
+    return gLedSegments[0].effects.pixel(0);
+}
+
+// Recalling a scene with the effect already running takes the scene brightness
+TEST(LedScenes, EffectSceneRestartsEffect) {
+    config.ledScenes[0] = {255, 0, 0, 255, LED_EFFECT_COLORLOOP, 0};
+    config.ledScenes[1] = {255, 0, 0, 64, LED_EFFECT_COLORLOOP, 0};
+    uint16_t bright = apply_scene_frame(0).r;
+    EXPECT_EQ(gLedSegments[0].effects.getEffect(), LED_EFFECT_COLORLOOP);
+    uint16_t dim = apply_scene_frame(1).r;
+    EXPECT_EQ(gLedSegments[0].effects.getEffect(), LED_EFFECT_COLORLOOP);
+    EXPECT_GT(bright, 0);
+    EXPECT_LT(dim, bright);
+    EXPECT_EQ(apply_scene_frame(0).r, bright);
+}
+
+TEST(LedScenes, EffectWithTransitionRejected) {
+    LedScene scenes[LED_SCENE_MAX] = {};
+    const uint8_t solid_fade[] = {2, 255, 128, 0, 200, LED_EFFECT_NONE, 20, 0};
+    const uint8_t effect_fade[] = {3, 255, 128, 0, 200, LED_EFFECT_RAINBOW, 20, 0};
+    const uint8_t effect_off_fade[] = {4, 0, 0, 0, 0, LED_EFFECT_RAINBOW, 20, 0};
+    EXPECT_TRUE(setLedScenesFromPayload(solid_fade, sizeof(solid_fade), scenes));
+    EXPECT_EQ(scenes[2].transitionDs, 20);
+    EXPECT_FALSE(setLedScenesFromPayload(effect_fade, sizeof(effect_fade), scenes));
+    EXPECT_FALSE(isLedSceneValid(scenes[3]));
+    EXPECT_TRUE(setLedScenesFromPayload(effect_off_fade, sizeof(effect_off_fade), scenes));
+}
+
+TEST(SunriseCurve, Bounds) {
+    EXPECT_EQ(getSunriseIntensity(0), 0u);
+    EXPECT_EQ(getSunriseIntensity(SUNRISE_Q16_ONE), SUNRISE_LUT.value[SUNRISE_LUT_SIZE]);
+    EXPECT_EQ(getSunriseIntensity(UINT32_MAX), SUNRISE_LUT.value[SUNRISE_LUT_SIZE]);
+}
+
+TEST(SunriseCurve, NonDecreasing) {
+    uint32_t previous = 0;
+    for (uint32_t p = 0; p <= SUNRISE_Q16_ONE; p++) {
+        ASSERT_GE(getSunriseIntensity(p), previous) << "progress " << p;
+        previous = getSunriseIntensity(p);
+    }
+}
+
+// Within one dithering step, 1/256 of a brightness level at SUNRISE_BRIGHTNESS_MAX
+TEST(SunriseCurve, MatchesLibm) {
+    const double steps_per_q16 = (double)(SUNRISE_BRIGHTNESS_MAX << 8) / SUNRISE_Q16_ONE;
+    for (uint32_t i = 0; i <= SUNRISE_LUT_SIZE; i++) {
+        double libm = get_sunrise_intensity_libm((float)i / SUNRISE_LUT_SIZE) * SUNRISE_Q16_ONE;
+        ASSERT_LT(fabs(SUNRISE_LUT.value[i] - libm) * steps_per_q16, 1.0) << "entry " << i;
+    }
+    for (uint32_t p = 0; p <= SUNRISE_Q16_ONE; p++) {
+        double libm = get_sunrise_intensity_libm((float)p / SUNRISE_Q16_ONE) * SUNRISE_Q16_ONE;
+        ASSERT_LT(fabs(getSunriseIntensity(p) - libm) * steps_per_q16, 1.0) << "progress " << p;
+    }
+}
+
+// The firmware boots once with a provisioned NVM config, connected to the fake broker
+int main(int argc, char *argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+    provision();
+    setup();
+    loop();
+    if (!client.connected()) {
+        fprintf(stderr, "ERROR: Firmware not connected after setup.\n");
+        return EXIT_FAILURE;
+    }
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,161 @@
+// The sketch first, built with the fake Arduino libraries, its globals are used below
+#include "RadiatorController.ino.cpp"
+
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_SERIAL_NUMBER 1
+#define TEST_ROOM_NAME "test"
+
+// A topic not handled by the sketch goes through all the comparisons
+static const char UNKNOWN_TOPIC[] = "home/test/radiator/unknown/set";
+
+// Serial number and room name of the NVM config, the MQTT topics are built from them
+static void provision() {
+    char room_name[CONFIG_ROOM_NAME_SIZE] = TEST_ROOM_NAME;
+    configStore.begin();
+    configStore.set(CONFIG_KEY_DEVICE_SERIAL_NUMBER, (uint32_t)TEST_SERIAL_NUMBER);
+    configStore.set(CONFIG_KEY_ROOM_NAME, room_name);
+    configStore.set(CONFIG_KEY_VERSION, CONFIG_VERSION);
+    configStore.commit();
+}
+
+// The callback gets a copy, as PubSubClient gives its own buffer
+static void receive(const char *topic, const char *payload) {
+    char topic_buf[MQTT_MSG_TOPIC_MAX_SIZE];
+    uint8_t payload_buf[MQTT_MSG_PAYLOAD_MAX_SIZE];
+    size_t len = strlen(payload);
+    snprintf(topic_buf, sizeof(topic_buf), "%s", topic);
+    memcpy(payload_buf, payload, len);
+    mqtt_callback(topic_buf, payload_buf, len);
+}
+
+TEST(RadiatorParsers, Power) {
+    EXPECT_EQ(getPowerFromMqttPayload("ON", 2), POWER_ON);
+    EXPECT_EQ(getPowerFromMqttPayload("OFF", 3), POWER_OFF);
+    EXPECT_EQ(getPowerFromMqttPayload("OF", 2), POWER_UNKNOWN);
+}
+
+TEST(RadiatorParsers, Mode) {
+    EXPECT_EQ(getModeFromMqttPayload("heat", 4), MODE_HEAT);
+    EXPECT_EQ(getModeFromMqttPayload("heating", 7), MODE_UNKNOWN);
+}
+
+TEST(RadiatorParsers, PresetMode) {
+    EXPECT_EQ(getPresetModeFromMqttPayload("comfort", 7), PRESET_MODE_COMFORT);
+    EXPECT_EQ(getPresetModeFromMqttPayload("comfort-1", 9), PRESET_MODE_COMFORT_MINUS_1);
+    EXPECT_EQ(getPresetModeFromMqttPayload("comfort-2", 9), PRESET_MODE_COMFORT_MINUS_2);
+    EXPECT_EQ(getPresetModeFromMqttPayload("eco", 3), PRESET_MODE_ECO);
+    EXPECT_EQ(getPresetModeFromMqttPayload("away", 4), PRESET_MODE_AWAY);
+    EXPECT_EQ(getPresetModeFromMqttPayload("comfort-", 8), PRESET_MODE_UNKNOWN);
+    EXPECT_EQ(getPresetModeFromMqttPayload("comfort-3", 9), PRESET_MODE_UNKNOWN);
+}
+
+// The preset mode is applied to the pilot wire once the radiator is on in heat mode
+TEST(RadiatorMqttCallback, PresetModeSet) {
+    receive(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_POWER_SET), "ON");
+    receive(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_MODE_SET), "heat");
+    receive(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_PRESET_MODE_SET), "eco");
+    EXPECT_EQ(currentPower, POWER_ON);
+    EXPECT_EQ(currentMode, MODE_HEAT);
+    EXPECT_EQ(currentPresetMode, PRESET_MODE_ECO);
+
+    receive(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_PRESET_MODE_SET), "eco2");
+    EXPECT_EQ(currentPresetMode, PRESET_MODE_ECO);
+}
+
+TEST(RadiatorMqttCallback, UnknownTopic) {
+    uint32_t published = client.getPublished();
+    receive(UNKNOWN_TOPIC, "ON");
+    EXPECT_EQ(client.getPublished(), published);
+}
+
+TEST(RadiatorMqttCallback, OffsetOutOfRange) {
+    float offset = config.sensorTemperatureOffset;
+    receive(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_TEMPERATURE_OFFSET_SET), "500");
+    EXPECT_EQ(config.sensorTemperatureOffset, offset);
+    receive(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_TEMPERATURE_OFFSET_SET), "nan");
+    EXPECT_EQ(config.sensorTemperatureOffset, offset);
+    receive(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_TEMPERATURE_OFFSET_SET), "-1.5");
+    EXPECT_EQ(config.sensorTemperatureOffset, -1.5f);
+}
+
+// Up to 2 consecutive glitches are rejected by the median
+TEST(SensorFilter, RejectsGlitches) {
+    SensorFilter<DHT_MEDIAN_SIZE, DHT_TAB_MAX> filter;
+    for (uint8_t i = 0; i < DHT_TAB_MAX; i++) {
+        filter.add(i % 10 >= 8 ? 9000 : 2000);
+    }
+    EXPECT_EQ(filter.getCount(), DHT_TAB_MAX);
+    EXPECT_EQ(filter.get(), 2000);
+}
+
+TEST(SensorFilter, AveragesAndRounds) {
+    SensorFilter<DHT_MEDIAN_SIZE, DHT_TAB_MAX> filter;
+    EXPECT_EQ(filter.get(), 0);
+    for (uint8_t i = 0; i < DHT_TAB_MAX; i++) {
+        filter.add(2000 + i % 2);
+    }
+    // Median of 5 alternating values, then the mean of the medians
+    EXPECT_GE(filter.get(), 2000);
+    EXPECT_LE(filter.get(), 2001);
+
+    RunningAverage<4> average;
+    average.add(1);
+    average.add(2);
+    EXPECT_EQ(average.get(), 2); // 1.5 rounded to the nearest
+    average.add(-10);
+    average.add(-10);
+    average.add(-10);
+    EXPECT_EQ(average.get(), -7); // -28 / 4
+}
+
+TEST(SensorFilter, Reset) {
+    SensorFilter<DHT_MEDIAN_SIZE, DHT_TAB_MAX> filter;
+    filter.add(2500);
+    filter.reset();
+    EXPECT_EQ(filter.getCount(), 0);
+    filter.add(-300);
+    EXPECT_EQ(filter.get(), -300);
+}
+
+// Last test, the NVM config is provisioned again after it
+TEST(RadiatorNvmConfig, MigrateFromEeprom) {
+    EepromConfig eeprom = {1.5f, -2.0f, 7, "old room"};
+    for (uint8_t sector = 0; sector < configFlash.getSectorCount(); sector++) {
+        ASSERT_TRUE(configFlash.erase(sector));
+    }
+    EEPROM.put(0x00, eeprom);
+    ASSERT_TRUE(configStore.begin());
+    ASSERT_EQ(configStore.getVersion(), 0);
+
+    migrate_config();
+    EXPECT_EQ(configStore.getVersion(), CONFIG_VERSION);
+    load_config();
+    EXPECT_EQ(config.sensorTemperatureOffset, 1.5f);
+    EXPECT_EQ(config.sensorHumidityOffset, -2.0f);
+    EXPECT_EQ(config.deviceSerialNumber, 7u);
+    EXPECT_STREQ(config.roomName, "old room");
+    // Keys added after the EEPROM layout, as in a blank EEPROM
+    EXPECT_TRUE(isnan(config.thermostatSetpoint));
+    EXPECT_EQ(config.radiatorPower, 0xFFFF);
+    EXPECT_EQ(config.powerSaveLatency, 0xFFFF);
+
+    provision();
+    load_config();
+}
+
+// The firmware boots once with a provisioned NVM config, connected to the fake broker
+int main(int argc, char *argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+    provision();
+    setup();
+    loop();
+    if (!client.connected()) {
+        fprintf(stderr, "ERROR: Firmware not connected after setup.\n");
+        return EXIT_FAILURE;
+    }
+    return RUN_ALL_TESTS();
+}
@@ -1,34 +1,250 @@
+#pragma once
+
 #include <functional>
 
 #include <app/InteractionModelEngine.h>
 #include <app/CommandHandlerInterface.h>
 
-#pragma one
+#include "Transition.h"
+
+constexpr uint8_t LIGHT_MOVE_RATE_DEFAULT = 64; // Level Move commands without rate, units per second
+
+// Level and color commands decoded from the Matter clusters, the transition is computed by the sketch
+struct LightCommand {
+  enum Field : uint8_t {
+    LEVEL = 0x01,
+    HUE = 0x02,
+    SATURATION = 0x04,
+  };
+
+  uint8_t fields = 0;           // Values set by the command
+  bool relative = false;        // Step commands, the values are added to the current ones
+  bool withOnOff = false;       // Level commands also switching the light on, or off at level 0
+  bool stop = false;            // Stop the running transition where it is
+  uint8_t rate = 0;             // Move commands, units per second to the target instead of the transition time
+  int16_t hueRate = 0;          // MoveHue commands, units per second, the hue turns until stopped
+  int16_t level = 0;
+  int16_t hue = 0;
+  int16_t saturation = 0;
+  HueDirection direction = HUE_DIRECTION_SHORTEST;
+  bool hasTransition = false;   // The level commands transition time can be null
+  uint32_t transitionMs = 0;
+};
 
+/*
+ * Override the commands with a transition or a move of one cluster (LevelControl or
+ * ColorControl), the other commands of the cluster are left to the default server.
+ * The stop commands stop the transition on the device and still go to the default
+ * server, which stops its own moves (color temperature).
+ */
 class CommandHandler : public chip::app::CommandHandlerInterface
 {
 public:
-  CommandHandler(std::function<void(chip::app::Clusters::LevelControl::Commands::MoveToLevelWithOnOff::DecodableType&)> callback) : 
-    CommandHandlerInterface(Optional<EndpointId>::Missing(),
-    chip::app::Clusters::LevelControl::Id),
+  CommandHandler(chip::ClusterId clusterId, std::function<void(const LightCommand&)> callback) :
+    CommandHandlerInterface(Optional<EndpointId>::Missing(), clusterId),
     callback(callback) {
   }
 
   void InvokeCommand(chip::app::CommandHandlerInterface::HandlerContext & handlerContext) override {
-    chip::app::Clusters::LevelControl::Commands::MoveToLevelWithOnOff::DecodableType cmd;
-    if (handlerContext.mRequestPath.mCommandId != chip::app::Clusters::LevelControl::Commands::MoveToLevelWithOnOff::Id) {
-      return;
+    // Command ids are only unique in a cluster
+    if (handlerContext.mRequestPath.mClusterId == chip::app::Clusters::LevelControl::Id) {
+      invokeLevelControlCommand(handlerContext);
+    } else if (handlerContext.mRequestPath.mClusterId == chip::app::Clusters::ColorControl::Id) {
+      invokeColorControlCommand(handlerContext);
+    }
+  }
+
+private:
+  void invokeLevelControlCommand(chip::app::CommandHandlerInterface::HandlerContext & handlerContext) {
+    using namespace chip::app::Clusters::LevelControl::Commands;
+
+    if (handlerContext.mRequestPath.mCommandId == Stop::Id || handlerContext.mRequestPath.mCommandId == StopWithOnOff::Id) {
+      callback(getStop());
+      return; // Not handled, the default server replies
     }
-    cmd.Decode(handlerContext.GetReader());
-    callback(cmd);
+    HandleCommand<MoveToLevel::DecodableType>(handlerContext, [this](HandlerContext & ctx, const auto & cmd) {
+      reply(ctx, getMoveToLevel(cmd, false));
+    });
+    HandleCommand<MoveToLevelWithOnOff::DecodableType>(handlerContext, [this](HandlerContext & ctx, const auto & cmd) {
+      reply(ctx, getMoveToLevel(cmd, true));
+    });
+    HandleCommand<Step::DecodableType>(handlerContext, [this](HandlerContext & ctx, const auto & cmd) {
+      reply(ctx, getStep(cmd, false));
+    });
+    HandleCommand<StepWithOnOff::DecodableType>(handlerContext, [this](HandlerContext & ctx, const auto & cmd) {
+      reply(ctx, getStep(cmd, true));
+    });
+    HandleCommand<Move::DecodableType>(handlerContext, [this](HandlerContext & ctx, const auto & cmd) {
+      replyMove(ctx, getMove(cmd, false));
+    });
+    HandleCommand<MoveWithOnOff::DecodableType>(handlerContext, [this](HandlerContext & ctx, const auto & cmd) {
+      replyMove(ctx, getMove(cmd, true));
+    });
+  }
+
+  void invokeColorControlCommand(chip::app::CommandHandlerInterface::HandlerContext & handlerContext) {
+    using namespace chip::app::Clusters::ColorControl::Commands;
+
+    if (handlerContext.mRequestPath.mCommandId == StopMoveStep::Id) {
+      callback(getStop());
+      return; // Not handled, the default server replies
+    }
+    HandleCommand<MoveToHue::DecodableType>(handlerContext, [this](HandlerContext & ctx, const auto & cmd) {
+      LightCommand light;
+      light.fields = LightCommand::HUE;
+      light.hue = cmd.hue;
+      light.direction = (HueDirection)static_cast<uint8_t>(cmd.direction);
+      setTransition(light, cmd.transitionTime);
+      reply(ctx, light);
+    });
+    HandleCommand<MoveToSaturation::DecodableType>(handlerContext, [this](HandlerContext & ctx, const auto & cmd) {
+      LightCommand light;
+      light.fields = LightCommand::SATURATION;
+      light.saturation = cmd.saturation;
+      setTransition(light, cmd.transitionTime);
+      reply(ctx, light);
+    });
+    HandleCommand<MoveToHueAndSaturation::DecodableType>(handlerContext, [this](HandlerContext & ctx, const auto & cmd) {
+      LightCommand light;
+      light.fields = LightCommand::HUE | LightCommand::SATURATION;
+      light.hue = cmd.hue;
+      light.saturation = cmd.saturation;
+      setTransition(light, cmd.transitionTime);
+      reply(ctx, light);
+    });
+    HandleCommand<MoveToColor::DecodableType>(handlerContext, [this](HandlerContext & ctx, const auto & cmd) {
+      LightCommand light;
+      uint8_t hue = 0;
+      uint8_t saturation = 0;
+      xyToHueSaturation(cmd.colorX, cmd.colorY, &hue, &saturation);
+      light.fields = LightCommand::HUE | LightCommand::SATURATION;
+      light.hue = hue;
+      light.saturation = saturation;
+      setTransition(light, cmd.transitionTime);
+      reply(ctx, light);
+    });
+    HandleCommand<StepHue::DecodableType>(handlerContext, [this](HandlerContext & ctx, const auto & cmd) {
+      LightCommand light;
+      light.fields = LightCommand::HUE;
+      light.relative = true;
+      light.hue = isColorStepDown(static_cast<uint8_t>(cmd.stepMode)) ? -cmd.stepSize : cmd.stepSize;
+      light.direction = light.hue < 0 ? HUE_DIRECTION_DOWN : HUE_DIRECTION_UP;
+      setTransition(light, (uint16_t)cmd.transitionTime);
+      reply(ctx, light);
+    });
+    HandleCommand<StepSaturation::DecodableType>(handlerContext, [this](HandlerContext & ctx, const auto & cmd) {
+      LightCommand light;
+      light.fields = LightCommand::SATURATION;
+      light.relative = true;
+      light.saturation = isColorStepDown(static_cast<uint8_t>(cmd.stepMode)) ? -cmd.stepSize : cmd.stepSize;
+      setTransition(light, (uint16_t)cmd.transitionTime);
+      reply(ctx, light);
+    });
+    HandleCommand<EnhancedMoveToHue::DecodableType>(handlerContext, [this](HandlerContext & ctx, const auto & cmd) {
+      LightCommand light;
+      light.fields = LightCommand::HUE;
+      light.hue = cmd.enhancedHue >> 8;
+      light.direction = (HueDirection)static_cast<uint8_t>(cmd.direction);
+      setTransition(light, cmd.transitionTime);
+      reply(ctx, light);
+    });
+    HandleCommand<MoveHue::DecodableType>(handlerContext, [this](HandlerContext & ctx, const auto & cmd) {
+      replyMove(ctx, getMoveHue(static_cast<uint8_t>(cmd.moveMode), cmd.rate));
+    });
+    HandleCommand<EnhancedMoveHue::DecodableType>(handlerContext, [this](HandlerContext & ctx, const auto & cmd) {
+      // Enhanced hue in 1/256 units, a slow move still turns
+      replyMove(ctx, getMoveHue(static_cast<uint8_t>(cmd.moveMode), cmd.rate > 0 && cmd.rate < 256 ? 1 : cmd.rate >> 8));
+    });
+    HandleCommand<MoveSaturation::DecodableType>(handlerContext, [this](HandlerContext & ctx, const auto & cmd) {
+      LightCommand light = getStop();
+      uint8_t moveMode = static_cast<uint8_t>(cmd.moveMode);
+      if (moveMode != 0) { // 0: stop
+        light.stop = false;
+        light.fields = LightCommand::SATURATION;
+        light.saturation = isColorStepDown(moveMode) ? 0 : LIGHT_VALUE_MAX;
+        light.rate = cmd.rate;
+      }
+      replyMove(ctx, light);
+    });
+  }
+
+  template <typename T>
+  static LightCommand getMoveToLevel(const T & cmd, bool withOnOff) {
+    LightCommand light;
+    light.fields = LightCommand::LEVEL;
+    light.withOnOff = withOnOff;
+    light.level = cmd.level;
+    setTransition(light, cmd.transitionTime);
+    return light;
+  }
+
+  template <typename T>
+  static LightCommand getStep(const T & cmd, bool withOnOff) {
+    LightCommand light;
+    light.fields = LightCommand::LEVEL;
+    light.relative = true;
+    light.withOnOff = withOnOff;
+    light.level = static_cast<uint8_t>(cmd.stepMode) == 1 ? -cmd.stepSize : cmd.stepSize; // 0: up, 1: down
+    setTransition(light, cmd.transitionTime);
+    return light;
+  }
+
+  // To the maximum level or the minimum (off with on/off), at the rate
+  template <typename T>
+  static LightCommand getMove(const T & cmd, bool withOnOff) {
+    LightCommand light;
+    light.fields = LightCommand::LEVEL;
+    light.withOnOff = withOnOff;
+    light.level = static_cast<uint8_t>(cmd.moveMode) == 1 ? 0 : LIGHT_VALUE_MAX; // 0: up, 1: down
+    light.rate = cmd.rate.IsNull() ? LIGHT_MOVE_RATE_DEFAULT : cmd.rate.Value();
+    return light;
+  }
+
+  // Hue turning until stopped, the move mode is the one of the step mode with 0 to stop
+  static LightCommand getMoveHue(uint8_t moveMode, uint16_t rate) {
+    LightCommand light = getStop();
+    if (moveMode != 0) {
+      light.stop = false;
+      light.hueRate = isColorStepDown(moveMode) ? -(int16_t)rate : rate;
+    }
+    return light;
+  }
+
+  static LightCommand getStop() {
+    LightCommand light;
+    light.stop = true;
+    return light;
+  }
+
+  // ColorControl step mode, 1: up, 3: down
+  static bool isColorStepDown(uint8_t stepMode) {
+    return stepMode == 3;
+  }
+
+  // Transition time in 1/10 seconds
+  static void setTransition(LightCommand & light, uint16_t transitionTime) {
+    light.hasTransition = true;
+    light.transitionMs = (uint32_t)transitionTime * 100;
+  }
+
+  static void setTransition(LightCommand & light, const chip::app::DataModel::Nullable<uint16_t> & transitionTime) {
+    if (!transitionTime.IsNull()) {
+      setTransition(light, transitionTime.Value());
+    }
+  }
+
+  void reply(chip::app::CommandHandlerInterface::HandlerContext & handlerContext, const LightCommand & light) {
+    callback(light);
     handlerContext.mCommandHandler.AddStatus(handlerContext.mRequestPath, chip::Protocols::InteractionModel::Status::Success);
   }
 
-  CHIP_ERROR EnumerateAcceptedCommands(const chip::app::ConcreteClusterPath & cluster,chip::app::CommandHandlerInterface::CommandIdCallback callback, void * context) override {
-    callback(chip::app::Clusters::LevelControl::Commands::MoveToLevelWithOnOff::Id, context);
-    return CHIP_NO_ERROR;
+  // A move at rate 0 doesn't change anything
+  void replyMove(chip::app::CommandHandlerInterface::HandlerContext & handlerContext, const LightCommand & light) {
+    if (light.stop || light.rate != 0 || light.hueRate != 0) {
+      callback(light);
+    }
+    handlerContext.mCommandHandler.AddStatus(handlerContext.mRequestPath, chip::Protocols::InteractionModel::Status::Success);
   }
 
-private:
-  std::function<void(chip::app::Clusters::LevelControl::Commands::MoveToLevelWithOnOff::DecodableType&)> callback;
+  std::function<void(const LightCommand&)> callback;
 };
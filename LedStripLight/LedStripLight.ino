@@ -4,13 +4,18 @@
 #include <ezWS2812.h>
 
 #include "CommandHandler.h"
+#include "LedDither.h"
+#include "SunriseProfile.h"
+#include "Transition.h"
 
 // Firmware version
 #define VERSION "0.3.0"
 
 // Settings
 #define LED_NUM               330
-#define MODE_LOW_BRIGHTNESS   0
+#define LED_DITHER_TEMPORAL_HZ  0   // Temporal dithering refresh rate, 0 to disable (each frame blocks ~10ms)
+#define SERIAL_CONSOLE_LINE_MAX 256
+#define LIGHT_TRANSITION_DEFAULT_MS 500 // Level commands without transition time
 
 // Matter description
 #define DEVICE_NAME   "Bedroom Led Strip Light"
@@ -26,26 +31,36 @@
 #define OFF                         0
 #define ON                          1
 
-#define MAX(a, b) (a > b ? a : b)
-#define MAX3(a, b, c) MAX(MAX(a, b), c)
-
-void MoveToLevelWithOnOffCallback(chip::app::Clusters::LevelControl::Commands::MoveToLevelWithOnOff::DecodableType&);
+void lightCommandCallback(const LightCommand&);
 
 // Devices
 MatterColorLightbulb matterDevice;
 MatterOnOffPluginUnit matterSwitchSunrise;
 ezWS2812 leds(LED_NUM); // Use SPI MOSI D11
-CommandHandler gCommandHandler(MoveToLevelWithOnOffCallback);
+CommandHandler gLevelCommandHandler(chip::app::Clusters::LevelControl::Id, lightCommandCallback);
+CommandHandler gColorCommandHandler(chip::app::Clusters::ColorControl::Id, lightCommandCallback);
+LedDither dither;
 
 // Sunrise Mode
 bool modeSunriseEnable = false;
 bool modeSunriseActive = false;
 unsigned long startSunriseTimeMs = 0;
 unsigned long durationSunriseTimeMs = 0;
+SunriseProfile sunriseProfile;
+SunriseFrame sunriseLastFrame = {};
 
-// MoveToLevelWithOnOff
+// Sunrise requested level
 uint8_t ledBrightness = 0;
-bool pendingOnRequest = false;
+
+// Level and color transitions, the commands are applied by ledColorLoop()
+LightCommand pendingLightCommand;
+bool pendingLightRequest = false;
+LightTransition lightTransition;
+bool lightOffAtEnd = false;
+
+// Rendering
+LedColor16 ledFrameColor = {};
+unsigned long ledFrameTimeMs = 0;
 
 void setLedColorDebug(uint8_t red, uint8_t green, uint8_t blue) {
     if (LED_BUILTIN_ACTIVE == LOW) {
@@ -60,102 +75,60 @@ void setLedColorDebug(uint8_t red, uint8_t green, uint8_t blue) {
 }
 
 void setLedSunrise() {
-  unsigned long currentTime = millis();
-  unsigned long progress = (currentTime-startSunriseTimeMs) * 10000 / durationSunriseTimeMs;
-  uint32_t active_leds = 0;
-  uint8_t brightness_value = 0;
-
-  if (progress < 2000) { // 0% - <20%
-    active_leds = progress * LED_NUM / 2000;
-    brightness_value = 2;
-
-  } else if (progress < 3000) { // 20% - 30%
-    active_leds = (progress-2000) * LED_NUM / 1000;
-    brightness_value = 4;
-  
-  } else if (progress < 3500) { // 30% - 35%
-    active_leds = (progress-3000) * LED_NUM / 500;
-    brightness_value = 6;
-
-  } else if (progress < 4000) { // 35% - 40%
-    active_leds = (progress-3500) * LED_NUM / 500;
-    brightness_value = 9;
-
-  } else if (progress < 4400) { // 40 % - 44%
-    active_leds = (progress-4000) * LED_NUM / 400;
-    brightness_value = 12;
-
-  } else if (progress < 4700) { // 44% - 47%
-    active_leds = (progress-4400) * LED_NUM / 300;
-    brightness_value = 15;
-
-  } else if (progress < 5000) { // 47% - 50%
-    active_leds = (progress-4700) * LED_NUM / 300;
-    brightness_value = 20;
-
-  } else if (progress < 10000) {  // 50% - 100%
-    active_leds = LED_NUM;
-    if (ledBrightness <= 20) {
-      brightness_value = 20; // Minimal value required
-    } else {
-      brightness_value = 20 + (uint32_t)(((progress-5000) * (ledBrightness-20)) / (10000-20)); // Remap [5000,10000] -> [20,ledBrightness]
-    }
+  SunriseFrame frame = sunriseProfile.getFrame(millis() - startSunriseTimeMs);
 
-  } else { // End
-    active_leds = LED_NUM;
-    if (ledBrightness <= 20) {
-      brightness_value = 20; // Minimal value required
-    } else {
-      brightness_value = ledBrightness;
-    }
+  // Nothing to send while the frame doesn't change
+  if (!frame.finished && frame.activeLeds == sunriseLastFrame.activeLeds && frame.brightness == sunriseLastFrame.brightness) {
+    return;
+  }
+
+  if (frame.finished) {
     setModeSunriseActive(false);
     matterSwitchSunrise.set_onoff(OFF);
   }
 
-  matterDevice.set_brightness_percent(brightness_value);
+  if (frame.finished) {
+    matterDevice.set_brightness(ledBrightness);
+  } else if (frame.brightness != sunriseLastFrame.brightness) {
+    matterDevice.set_brightness_percent(frame.brightness);
+  }
 
   noInterrupts();
-  leds.set_pixel(active_leds, brightness_value, brightness_value, brightness_value, 100, true);
+  leds.set_pixel(frame.activeLeds, frame.brightness, frame.brightness, frame.brightness, 100, true);
   interrupts();
 
+  sunriseLastFrame = frame;
 }
 
-void setLedWS2812(uint8_t r, uint8_t g, uint8_t b) {
-#if MODE_LOW_BRIGHTNESS
-  uint8_t v = MAX3(r, g, b);
-
-  noInterrupts();
+void renderLedFrame(const LedColor16 &color) {
+  static LedColor8 pixels[LED_NUM];
+  bool fractional = ((color.r | color.g | color.b) & 0xFF) != 0; // No fractional part, nothing to dither
 
-  if (v == 0) { // 0%
-    leds.set_pixel(LED_NUM, 0, 0, 0, 0, false); 
-  } if (v <= 25) { // <10% -> x LED 1%
-    uint16_t active_leds = v*10/25;
-    uint8_t r_low = r * 4 / v;  // v=4 -> 1%
-    uint8_t g_low = g * 4 / v;
-    uint8_t b_low = b * 4 / v;
+  // Dithered before the transfer, so interrupts are only disabled to send the pixels
+  dither.beginFrame(LED_DITHER_TEMPORAL_HZ != 0);
+  if (fractional) {
     for (uint16_t i=0; i<LED_NUM; i++) {
-        if (i % 10 < active_leds) {
-            leds.set_pixel(1, r_low, g_low, b_low, 100, false); // ON
-        } else {
-            leds.set_pixel(1, 0, 0, 0, 0, false); // OFF
-        }
+      pixels[i] = dither.pixel(color);
     }
-  } else { // >10% -> all LED x%
-      uint8_t v_scaled = 4 + ((v - 27) * (255 - 4)) / (255 - 27); // Remap [27,255] -> [4,255]
-      uint8_t r_adj = (uint16_t)r * v_scaled / v;
-      uint8_t g_adj = (uint16_t)g * v_scaled / v;
-      uint8_t b_adj = (uint16_t)b * v_scaled / v;
-      leds.set_pixel(LED_NUM, r_adj, g_adj, b_adj, 100, false); 
   }
-  
-  leds.end_transfer();
-  interrupts();
 
-#else
   noInterrupts();
-  leds.set_all(r, g, b);
+  if (!fractional) {
+    leds.set_all(color.r >> 8, color.g >> 8, color.b >> 8);
+  } else {
+    for (uint16_t i=0; i<LED_NUM; i++) {
+      leds.set_pixel(1, pixels[i].r, pixels[i].g, pixels[i].b, 100, false);
+    }
+    leds.end_transfer();
+  }
   interrupts();
-#endif
+
+  ledFrameColor = color;
+  ledFrameTimeMs = millis();
+}
+
+void setLedWS2812(uint8_t r, uint8_t g, uint8_t b) {
+  renderLedFrame(ledGamma(r, g, b));
 }
 
 void setLedColorRGB(uint8_t red, uint8_t green, uint8_t blue) {
@@ -198,27 +171,89 @@ void printThreadIPv6Addr() {
   }
 }
 
-void MoveToLevelWithOnOffCallback(chip::app::Clusters::LevelControl::Commands::MoveToLevelWithOnOff::DecodableType& cmd) {
-  Serial.printf("Override command MoveToLevelWithOnOff: Level: %d, TransitionTime: %d\n", cmd.level, cmd.transitionTime.IsNull() ? 0 : cmd.transitionTime.Value());
-
-  if (cmd.level == 0 || cmd.level == 255) { // Always start from 0, so only an increase is supported
-    Serial.printf("Backward mode: No valid level\n");
-    ledBrightness = 0;
-    setModeSunriseActive(false);
-    
-  } else if (modeSunriseEnable && !cmd.transitionTime.IsNull() && cmd.transitionTime.Value() != 0) {
-    Serial.printf("Setup mode sunrise\n");
-    ledBrightness = cmd.level;
-    durationSunriseTimeMs = cmd.transitionTime.Value() * 100; // transitionTime in 1/10 seconds
-    startSunriseTimeMs = millis();
-    setModeSunriseActive(true);
-
-  } else { // Backward default mode
-    Serial.printf("Normal mode\n");
-    ledBrightness = cmd.level;
-    pendingOnRequest = true;
+void lightCommandCallback(const LightCommand& cmd) {
+  Serial.printf("Override command: Fields: 0x%x%s%s%s, Level: %d, Hue: %d, Saturation: %d, TransitionTime: %lu ms, Rate: %u/s, HueRate: %d/s\n",
+    cmd.fields, cmd.relative ? " step" : "", cmd.withOnOff ? " with on/off" : "", cmd.stop ? " stop" : "",
+    cmd.level, cmd.hue, cmd.saturation, cmd.hasTransition ? cmd.transitionMs : LIGHT_TRANSITION_DEFAULT_MS,
+    cmd.rate, cmd.hueRate);
+
+  if (cmd.fields & LightCommand::LEVEL) {
+    if (cmd.withOnOff && !cmd.relative && modeSunriseEnable && cmd.hasTransition && cmd.transitionMs != 0) {
+      if (cmd.level == 0 || cmd.level == 255) { // Always start from 0, so only an increase is supported
+        Serial.printf("Sunrise mode: No valid level\n");
+        setModeSunriseActive(false);
+        return;
+      }
+      Serial.printf("Setup mode sunrise\n");
+      ledBrightness = cmd.level;
+      durationSunriseTimeMs = cmd.transitionMs;
+      startSunriseTimeMs = millis();
+      sunriseProfile.start(durationSunriseTimeMs, ledBrightness, LED_NUM);
+      setModeSunriseActive(true);
+      return;
+    }
     setModeSunriseActive(false);
   }
+
+  pendingLightCommand = cmd;
+  pendingLightRequest = true;
+}
+
+LightState getLightState() {
+  return { matterDevice.get_brightness(), matterDevice.get_hue(), matterDevice.get_saturation() };
+}
+
+int16_t clampLightValue(int16_t value, int16_t min) {
+  return value < min ? min : value > LIGHT_VALUE_MAX ? LIGHT_VALUE_MAX : value;
+}
+
+// The attributes are set to the target once, the LEDs follow the transition frames. A hue
+// move stops the running transition where it is and turns until the next command.
+void startLightTransition(const LightCommand& cmd) {
+  bool on = matterDevice.get_onoff() == ON;
+  LightState from = lightTransition.isActive() ? lightTransition.getState() : getLightState();
+  LightState to = lightTransition.isActive() ? lightTransition.getTarget() : from;
+  if (cmd.stop || cmd.hueRate != 0) {
+    lightTransition.stop();
+    lightOffAtEnd = false;
+    to = from;
+  }
+
+  if (cmd.fields & LightCommand::LEVEL) {
+    int16_t level = cmd.relative ? to.level + cmd.level : cmd.level;
+    if (!cmd.relative && cmd.level == 255) { // Null level
+      level = to.level;
+    }
+    to.level = clampLightValue(level, cmd.withOnOff ? 0 : 1); // Level 0 only switches off
+    lightOffAtEnd = cmd.withOnOff && to.level == 0;
+    if (cmd.withOnOff && to.level > 0 && !on) {
+      from.level = 0;
+      matterDevice.set_onoff(ON);
+    }
+  }
+  if ((cmd.fields & LightCommand::HUE) && (cmd.relative || cmd.hue < LIGHT_HUE_CIRCLE)) {
+    int16_t hue = cmd.relative ? to.hue + cmd.hue : cmd.hue;
+    to.hue = (hue % LIGHT_HUE_CIRCLE + LIGHT_HUE_CIRCLE) % LIGHT_HUE_CIRCLE;
+  }
+  if (cmd.fields & LightCommand::SATURATION) {
+    to.saturation = clampLightValue(cmd.relative ? to.saturation + cmd.saturation : cmd.saturation, 0);
+  }
+
+  if (to.level > 0) {
+    matterDevice.set_brightness(to.level);
+  }
+  matterDevice.set_hue(to.hue);
+  matterDevice.set_saturation(to.saturation);
+
+  if (cmd.hueRate != 0) {
+    lightTransition.startHueMove(from, cmd.hueRate, millis());
+  } else if (!cmd.stop) {
+    uint32_t durationMs = cmd.hasTransition ? cmd.transitionMs : LIGHT_TRANSITION_DEFAULT_MS;
+    if (cmd.rate != 0) {
+      durationMs = LightTransition::getMoveDurationMs(from, to, cmd.rate);
+    }
+    lightTransition.start(from, to, durationMs, cmd.direction, millis());
+  }
 }
 
 void setup() {
@@ -242,7 +277,8 @@ void setup() {
   matterSwitchSunrise.begin();
 
   // Register command handler
-  chip::app::InteractionModelEngine::GetInstance()->RegisterCommandHandler(&gCommandHandler);
+  chip::app::InteractionModelEngine::GetInstance()->RegisterCommandHandler(&gLevelCommandHandler);
+  chip::app::InteractionModelEngine::GetInstance()->RegisterCommandHandler(&gColorCommandHandler);
 
   // Button On/Off
   pinMode(BUTTON_PIN, INPUT_PULLUP);
@@ -315,17 +351,13 @@ void ledColorLoop() {
   uint8_t green = 0;
   uint8_t blue = 0;
 
-  if (pendingOnRequest) {
-    matterDevice.set_onoff(true);
-    pendingOnRequest = false;
-  }
-
   state = matterDevice.get_onoff();
   if (prevState != state) {
     Serial.printf("LED %s\n", state == ON ? "ON" : "OFF");
     if (state == OFF) {
       setModeSunriseActive(false);
       matterSwitchSunrise.set_onoff(false);
+      lightTransition.stop();
     }
   }
 
@@ -336,21 +368,40 @@ void ledColorLoop() {
       matterDevice.set_hue(0);
       matterDevice.set_saturation(0);
       matterDevice.set_brightness(1);
+      lightTransition.stop();
       setLedColorRGB(0, 0, 0);
+      sunriseLastFrame = {};
       prevModeSunriseActive = true;
     } else { // Mode surise active
       setLedSunrise();
     }
   } else {
-    if (ledBrightness) {
-      matterDevice.set_brightness(ledBrightness);
+    if (pendingLightRequest) {
+      pendingLightRequest = false;
+      startLightTransition(pendingLightCommand);
+    }
+    if (lightTransition.update(millis()) && !lightTransition.isActive() && lightOffAtEnd) {
+      lightOffAtEnd = false;
+      matterDevice.set_onoff(OFF);
+      state = OFF;
     }
     if (state == ON) {
-      matterDevice.get_rgb(&red, &green, &blue);
+      if (lightTransition.isActive()) {
+        lightStateToRgb(lightTransition.getState(), &red, &green, &blue);
+      } else {
+        matterDevice.get_rgb(&red, &green, &blue);
+      }
     }
     setLedColorRGB(red, green, blue);
   }
 
+#if LED_DITHER_TEMPORAL_HZ
+  // Move the dithering pattern at a fixed rate
+  if (!modeSunriseActive && dither.isFractional() && millis() - ledFrameTimeMs >= 1000 / LED_DITHER_TEMPORAL_HZ) {
+    renderLedFrame(ledFrameColor);
+  }
+#endif
+
   prevState = state;
   prevModeSunriseActive = modeSunriseActive;
 }
@@ -367,6 +418,51 @@ void switchSunriseLoop() {
   }
 }
 
+void printSunriseProfile() {
+  char buf[SunriseProfile::KEYFRAME_MAX * 12];
+  sunriseProfile.print(buf, sizeof(buf));
+  Serial.printf("Sunrise profile: %s\n", buf);
+}
+
+void handleConsoleCommand(const char* cmd) {
+  if (strcmp(cmd, "sunrise") == 0) {
+    printSunriseProfile();
+  } else if (strcmp(cmd, "sunrise default") == 0) {
+    sunriseProfile.set(SUNRISE_PROFILE_DEFAULT, sizeof(SUNRISE_PROFILE_DEFAULT) / sizeof(SUNRISE_PROFILE_DEFAULT[0]));
+    printSunriseProfile();
+  } else if (strncmp(cmd, "sunrise ", 8) == 0) {
+    if (sunriseProfile.parse(cmd + 8)) {
+      printSunriseProfile();
+    } else {
+      Serial.printf("Invalid sunrise profile\n");
+    }
+  } else {
+    Serial.printf("Commands:\n");
+    Serial.printf("  sunrise                  Show the sunrise profile\n");
+    Serial.printf("  sunrise default          Restore the default sunrise profile\n");
+    Serial.printf("  sunrise <keyframes>      Set the sunrise profile, <progress 0-9999>:<brightness>:<F fill|R ramp>\n");
+    Serial.printf("                           separated by commas, e.g. \"0:2:F,2000:4:F,5000:20:R\"\n");
+  }
+}
+
+void serialConsoleLoop() {
+  static char line[SERIAL_CONSOLE_LINE_MAX];
+  static size_t len = 0;
+
+  while (Serial.available() > 0) {
+    char c = Serial.read();
+    if (c == '\r' || c == '\n') {
+      if (len > 0) {
+        line[len] = '\0';
+        handleConsoleCommand(line);
+        len = 0;
+      }
+    } else if (len < sizeof(line) - 1) {
+      line[len++] = c;
+    }
+  }
+}
+
 void loop() {
 
   buttonLoop();
@@ -374,4 +470,6 @@ void loop() {
   ledColorLoop();
 
   switchSunriseLoop();
+
+  serialConsoleLoop();
 }
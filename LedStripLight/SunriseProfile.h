@@ -0,0 +1,166 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Sunrise profile, independent of the Matter and LED drivers.
+ *
+ * The profile is a table of keyframes sorted by progress (1/10000 of the sunrise
+ * duration), each one lasting until the next keyframe or the end:
+ *  - FILL: the LEDs are switched on one after the other at the keyframe brightness.
+ *  - RAMP: the whole strip goes from the keyframe brightness to the requested one.
+ *
+ * The table is walked with a cursor that only moves forward while the sunrise
+ * runs, a frame is a few multiplications whatever the table size.
+ */
+
+constexpr uint16_t SUNRISE_PROGRESS_END = 10000;
+
+enum SunriseStep : uint8_t {
+  SUNRISE_STEP_FILL = 'F',
+  SUNRISE_STEP_RAMP = 'R',
+};
+
+struct SunriseKeyframe {
+  uint16_t progress;    // Start of the keyframe
+  uint8_t brightness;   // Color value of the lit LEDs
+  SunriseStep step;
+};
+
+constexpr SunriseKeyframe SUNRISE_PROFILE_DEFAULT[] = {
+  {    0,  2, SUNRISE_STEP_FILL },
+  { 2000,  4, SUNRISE_STEP_FILL },
+  { 3000,  6, SUNRISE_STEP_FILL },
+  { 3500,  9, SUNRISE_STEP_FILL },
+  { 4000, 12, SUNRISE_STEP_FILL },
+  { 4400, 15, SUNRISE_STEP_FILL },
+  { 4700, 20, SUNRISE_STEP_FILL },
+  { 5000, 20, SUNRISE_STEP_RAMP },
+};
+
+struct SunriseFrame {
+  uint32_t activeLeds;  // LEDs lit from the start of the strip
+  uint8_t brightness;   // Color value of the lit LEDs, also reported as brightness percent
+  bool finished;
+};
+
+class SunriseProfile {
+public:
+  static constexpr uint8_t KEYFRAME_MAX = 16;
+
+  SunriseProfile() {
+    set(SUNRISE_PROFILE_DEFAULT, sizeof(SUNRISE_PROFILE_DEFAULT) / sizeof(SUNRISE_PROFILE_DEFAULT[0]));
+  }
+
+  // Keyframes must start at 0 with an increasing progress, return false if invalid
+  bool set(const SunriseKeyframe *keyframes, uint8_t count) {
+    if (count == 0 || count > KEYFRAME_MAX || keyframes[0].progress != 0) {
+      return false;
+    }
+    for (uint8_t i=0; i<count; i++) {
+      if (keyframes[i].step != SUNRISE_STEP_FILL && keyframes[i].step != SUNRISE_STEP_RAMP) {
+        return false;
+      }
+      if (keyframes[i].progress >= SUNRISE_PROGRESS_END || (i > 0 && keyframes[i].progress <= keyframes[i-1].progress)) {
+        return false;
+      }
+    }
+    for (uint8_t i=0; i<count; i++) {
+      mKeyframes[i] = keyframes[i];
+    }
+    mCount = count;
+    mCursor = 0;
+    return true;
+  }
+
+  // Text format: "<progress>:<brightness>:<F|R>" separated by commas, e.g. "0:2:F,5000:20:R"
+  bool parse(const char *text) {
+    SunriseKeyframe keyframes[KEYFRAME_MAX];
+    uint8_t count = 0;
+    const char *p = text;
+
+    while (*p != '\0') {
+      char *end = nullptr;
+      if (count >= KEYFRAME_MAX) {
+        return false;
+      }
+      unsigned long progress = strtoul(p, &end, 10);
+      if (end == p || *end != ':') {
+        return false;
+      }
+      p = end + 1;
+      unsigned long brightness = strtoul(p, &end, 10);
+      if (end == p || *end != ':' || brightness > 255) {
+        return false;
+      }
+      p = end + 1;
+      keyframes[count++] = { (uint16_t)(progress > UINT16_MAX ? UINT16_MAX : progress), (uint8_t)brightness, (SunriseStep)*p };
+      if (*p != '\0') {
+        p++;
+      }
+      if (*p == ',') {
+        p++;
+      } else if (*p != '\0') {
+        return false;
+      }
+    }
+    return set(keyframes, count);
+  }
+
+  // Same format as parse()
+  void print(char *buf, size_t size) const {
+    size_t len = 0;
+    buf[0] = '\0';
+    for (uint8_t i=0; i<mCount && len < size; i++) {
+      len += snprintf(buf + len, size - len, "%s%u:%u:%c", i ? "," : "", mKeyframes[i].progress, mKeyframes[i].brightness, mKeyframes[i].step);
+    }
+  }
+
+  void start(uint32_t durationMs, uint8_t brightness, uint32_t ledNum) {
+    mDurationMs = durationMs ? durationMs : 1;
+    mBrightness = brightness;
+    mLedNum = ledNum;
+    mCursor = 0;
+  }
+
+  // Elapsed time must not go backward until the next start()
+  SunriseFrame getFrame(uint32_t elapsedMs) {
+    if (elapsedMs >= mDurationMs) {
+      return { mLedNum, endBrightness(mKeyframes[mCount-1]), true };
+    }
+
+    uint16_t progress = (uint64_t)elapsedMs * SUNRISE_PROGRESS_END / mDurationMs;
+    while (mCursor + 1 < mCount && progress >= mKeyframes[mCursor+1].progress) {
+      mCursor++;
+    }
+
+    const SunriseKeyframe &keyframe = mKeyframes[mCursor];
+    uint32_t first = keyframe.progress;
+    uint32_t length = (mCursor + 1 < mCount ? mKeyframes[mCursor+1].progress : SUNRISE_PROGRESS_END) - first;
+    uint32_t position = progress - first;
+
+    if (keyframe.step == SUNRISE_STEP_FILL) {
+      return { position * mLedNum / length, keyframe.brightness, false };
+    }
+    uint8_t to = endBrightness(keyframe);
+    return { mLedNum, (uint8_t)(keyframe.brightness + position * (to - keyframe.brightness) / length), false };
+  }
+
+private:
+  // A ramp never goes down, the requested brightness is a minimum of the last keyframe
+  uint8_t endBrightness(const SunriseKeyframe &keyframe) const {
+    if (keyframe.step == SUNRISE_STEP_RAMP && mBrightness > keyframe.brightness) {
+      return mBrightness;
+    }
+    return keyframe.brightness;
+  }
+
+  SunriseKeyframe mKeyframes[KEYFRAME_MAX] = {};
+  uint8_t mCount = 0;
+  uint8_t mCursor = 0;
+  uint32_t mDurationMs = 1;
+  uint8_t mBrightness = 0;
+  uint32_t mLedNum = 0;
+};
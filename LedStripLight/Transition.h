@@ -0,0 +1,203 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * Level and color transitions computed on the device, independent of Matter.
+ *
+ * Values use the Matter attribute ranges: level, hue and saturation in [0, 254],
+ * the hue 254 being 360 degrees. A transition is sampled at a fixed frame rate, so
+ * a fade is one command over Thread instead of one command per step.
+ */
+
+constexpr uint32_t LIGHT_TRANSITION_FRAME_MS = 40; // 25 fps, a frame of 330 LEDs blocks ~10ms
+constexpr uint8_t LIGHT_VALUE_MAX = 254;
+constexpr int16_t LIGHT_HUE_CIRCLE = 254;
+
+struct LightState {
+  uint8_t level;
+  uint8_t hue;
+  uint8_t saturation;
+};
+
+// Same values as the Matter ColorControl direction
+enum HueDirection : uint8_t {
+  HUE_DIRECTION_SHORTEST = 0,
+  HUE_DIRECTION_LONGEST = 1,
+  HUE_DIRECTION_UP = 2,
+  HUE_DIRECTION_DOWN = 3,
+};
+
+class LightTransition {
+public:
+  void start(const LightState &from, const LightState &to, uint32_t durationMs, HueDirection direction, uint32_t nowMs) {
+    mFrom = from;
+    mTo = to;
+    mState = from;
+    mHueDelta = getHueDelta(from.hue, to.hue, direction);
+    mHueRate = 0;
+    mDurationMs = durationMs;
+    mStartMs = nowMs;
+    mLastFrameMs = nowMs - LIGHT_TRANSITION_FRAME_MS;
+    mActive = true;
+  }
+
+  // Turn the hue at a rate in units per second until stopped (Matter MoveHue), the level
+  // and saturation don't change
+  void startHueMove(const LightState &from, int16_t huePerSecond, uint32_t nowMs) {
+    start(from, from, 0, HUE_DIRECTION_SHORTEST, nowMs);
+    mHueRate = huePerSecond;
+  }
+
+  void stop() {
+    mActive = false;
+  }
+
+  bool isActive() const {
+    return mActive;
+  }
+
+  // Move to the next frame if the frame period elapsed, return true if the state changed
+  bool update(uint32_t nowMs) {
+    if (!mActive || nowMs - mLastFrameMs < LIGHT_TRANSITION_FRAME_MS) {
+      return false;
+    }
+    mLastFrameMs = nowMs;
+
+    uint32_t elapsed = nowMs - mStartMs;
+    if (mHueRate != 0) {
+      int32_t hue = mFrom.hue + (int32_t)((int64_t)mHueRate * elapsed / 1000 % LIGHT_HUE_CIRCLE);
+      mState.hue = (hue % LIGHT_HUE_CIRCLE + LIGHT_HUE_CIRCLE) % LIGHT_HUE_CIRCLE;
+      mTo.hue = mState.hue; // A command during the move starts from the current hue
+      return true;
+    }
+    if (elapsed >= mDurationMs) {
+      mState = mTo;
+      mActive = false;
+      return true;
+    }
+
+    uint32_t progress = ((uint64_t)elapsed << 16) / mDurationMs; // Q16
+    mState.level = lerp(mFrom.level, mTo.level, progress);
+    mState.saturation = lerp(mFrom.saturation, mTo.saturation, progress);
+    int32_t hue = mFrom.hue + (((int32_t)mHueDelta * (int32_t)progress) >> 16);
+    mState.hue = (hue % LIGHT_HUE_CIRCLE + LIGHT_HUE_CIRCLE) % LIGHT_HUE_CIRCLE;
+    return true;
+  }
+
+  const LightState& getState() const {
+    return mState;
+  }
+
+  const LightState& getTarget() const {
+    return mTo;
+  }
+
+  // Time to reach the target at a rate in units per second (Matter Move commands), the
+  // slowest of the level and the saturation
+  static uint32_t getMoveDurationMs(const LightState &from, const LightState &to, uint8_t rate) {
+    int32_t level = abs(to.level - from.level);
+    int32_t saturation = abs(to.saturation - from.saturation);
+    return rate ? (uint32_t)(level > saturation ? level : saturation) * 1000 / rate : 0;
+  }
+
+  // Signed hue move from `from` to `to` around the circle
+  static int16_t getHueDelta(uint8_t from, uint8_t to, HueDirection direction) {
+    int16_t up = ((int16_t)to - from + LIGHT_HUE_CIRCLE) % LIGHT_HUE_CIRCLE; // [0, 254)
+    int16_t down = up - LIGHT_HUE_CIRCLE;                                    // (-254, 0]
+    if (up == 0) {
+      return 0;
+    }
+    switch (direction) {
+      case HUE_DIRECTION_UP:      return up;
+      case HUE_DIRECTION_DOWN:    return down;
+      case HUE_DIRECTION_LONGEST: return up >= -down ? up : down;
+      case HUE_DIRECTION_SHORTEST:
+      default:                    return up <= -down ? up : down;
+    }
+  }
+
+private:
+  static uint8_t lerp(uint8_t from, uint8_t to, uint32_t progress) {
+    return from + (((int32_t)to - from) * (int32_t)progress >> 16);
+  }
+
+  LightState mFrom = {};
+  LightState mTo = {};
+  LightState mState = {};
+  int16_t mHueDelta = 0;
+  int16_t mHueRate = 0;
+  uint32_t mDurationMs = 0;
+  uint32_t mStartMs = 0;
+  uint32_t mLastFrameMs = 0;
+  bool mActive = false;
+};
+
+// HSV to RGB, the level is the value
+inline void lightStateToRgb(const LightState &state, uint8_t *red, uint8_t *green, uint8_t *blue) {
+  uint32_t value = state.level * 255 / LIGHT_VALUE_MAX;
+  uint32_t saturation = state.saturation * 255 / LIGHT_VALUE_MAX;
+  uint32_t hue = (state.hue % LIGHT_HUE_CIRCLE) * 6 * 256 / LIGHT_HUE_CIRCLE; // 6 sectors of 256
+  uint32_t fraction = hue & 0xFF;
+
+  uint8_t p = value * (255 - saturation) / 255;
+  uint8_t q = value * (255 * 256 - saturation * fraction) / (255 * 256);
+  uint8_t t = value * (255 * 256 - saturation * (256 - fraction)) / (255 * 256);
+  uint8_t v = value;
+
+  switch (hue >> 8) {
+    case 0:  *red = v; *green = t; *blue = p; break;
+    case 1:  *red = q; *green = v; *blue = p; break;
+    case 2:  *red = p; *green = v; *blue = t; break;
+    case 3:  *red = p; *green = q; *blue = v; break;
+    case 4:  *red = t; *green = p; *blue = v; break;
+    default: *red = v; *green = p; *blue = q; break;
+  }
+}
+
+// CIE xy (Matter 0-65279 for 0.0-0.996) to hue and saturation, only computed once per command
+inline void xyToHueSaturation(uint16_t colorX, uint16_t colorY, uint8_t *hue, uint8_t *saturation) {
+  float x = colorX / 65536.f;
+  float y = colorY / 65536.f;
+  if (y <= 0.f) {
+    *hue = 0;
+    *saturation = 0;
+    return;
+  }
+
+  // xy to XYZ with Y = 1, then to linear sRGB (D65)
+  float X = x / y;
+  float Z = (1.f - x - y) / y;
+  float r =  3.2406f * X - 1.5372f - 0.4986f * Z;
+  float g = -0.9689f * X + 1.8758f + 0.0415f * Z;
+  float b =  0.0557f * X - 0.2040f + 1.0570f * Z;
+
+  // Out of gamut colors are clipped
+  float low = fminf(r, fminf(g, b));
+  if (low < 0.f) {
+    r -= low;
+    g -= low;
+    b -= low;
+  }
+
+  float high = fmaxf(r, fmaxf(g, b));
+  float delta = high - fminf(r, fminf(g, b));
+  if (high <= 0.f || delta <= 0.f) {
+    *hue = 0;
+    *saturation = 0;
+    return;
+  }
+
+  float h;
+  if (high == r) {
+    h = fmodf((g - b) / delta + 6.f, 6.f);
+  } else if (high == g) {
+    h = (b - r) / delta + 2.f;
+  } else {
+    h = (r - g) / delta + 4.f;
+  }
+  *hue = (uint8_t)(h / 6.f * LIGHT_HUE_CIRCLE + 0.5f) % LIGHT_HUE_CIRCLE;
+  *saturation = (uint8_t)(delta / high * LIGHT_VALUE_MAX + 0.5f);
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "LedMath.h"
+
+/*
+ * Rendering stage from 16-bit colors to the 8-bit colors sent to the strip.
+ *
+ * Colors are 8.8 fixed point (256 = one LED step):
+ *  - Gamma: a per-channel table converts the 8-bit input colors to 16-bit.
+ *  - Spatial dithering: the quantization error of a pixel is carried to the next
+ *    one (1D error diffusion), so a fractional value is spread evenly along the
+ *    strip (0.25 lights one LED out of four one step higher) instead of a band.
+ *  - Temporal dithering: each frame starts from a different error, so the LEDs
+ *    lit one step higher move from frame to frame and every LED averages to the
+ *    exact value when frames are refreshed at a fixed rate.
+ *
+ * With 330 LEDs a single frame resolves 1/330 of a step, about 12-bit effective
+ * depth at low brightness.
+ */
+
+// Per-channel gamma applied to the 8-bit input colors, 1.0 sends them unchanged
+#ifndef LED_GAMMA_RED
+#define LED_GAMMA_RED   1.0
+#endif
+#ifndef LED_GAMMA_GREEN
+#define LED_GAMMA_GREEN 1.0
+#endif
+#ifndef LED_GAMMA_BLUE
+#define LED_GAMMA_BLUE  1.0
+#endif
+
+struct LedColor16 {
+  uint16_t r;
+  uint16_t g;
+  uint16_t b;
+};
+
+struct LedColor8 {
+  uint8_t r;
+  uint8_t g;
+  uint8_t b;
+};
+
+struct LedGammaLut {
+  uint16_t value[256];
+};
+
+constexpr LedGammaLut makeLedGammaLut(double gamma) {
+  LedGammaLut lut = {};
+  for (int i = 0; i < 256; i++) {
+    lut.value[i] = (uint16_t)(led_math::pow(i / 255.0, gamma) * (255 << 8) + 0.5);
+  }
+  return lut;
+}
+
+constexpr LedGammaLut LED_GAMMA_LUT_RED   = makeLedGammaLut(LED_GAMMA_RED);
+constexpr LedGammaLut LED_GAMMA_LUT_GREEN = makeLedGammaLut(LED_GAMMA_GREEN);
+constexpr LedGammaLut LED_GAMMA_LUT_BLUE  = makeLedGammaLut(LED_GAMMA_BLUE);
+
+// A gamma of 1.0 doesn't need the table, it is then dropped at link time
+inline LedColor16 ledGamma(uint8_t r, uint8_t g, uint8_t b) {
+  return {
+    LED_GAMMA_RED   == 1.0 ? (uint16_t)(r << 8) : LED_GAMMA_LUT_RED.value[r],
+    LED_GAMMA_GREEN == 1.0 ? (uint16_t)(g << 8) : LED_GAMMA_LUT_GREEN.value[g],
+    LED_GAMMA_BLUE  == 1.0 ? (uint16_t)(b << 8) : LED_GAMMA_LUT_BLUE.value[b],
+  };
+}
+
+class LedDither {
+public:
+  // Start a new frame, pixels are then dithered in strip order
+  void beginFrame(bool temporal) {
+    uint8_t error = 128; // Round to nearest
+    if (temporal) {
+      // 157/256 is close to the golden ratio, all the 256 start errors are used in turn
+      mFrame++;
+      error = (uint8_t)(mFrame * 157);
+    }
+    mError[0] = error;
+    mError[1] = error;
+    mError[2] = error;
+    mFractional = false;
+  }
+
+  LedColor8 pixel(const LedColor16 &color) {
+    return { channel(0, color.r), channel(1, color.g), channel(2, color.b) };
+  }
+
+  // True if a pixel of the last frame had a fractional value, the frame then needs
+  // to be refreshed for temporal dithering
+  bool isFractional() const {
+    return mFractional;
+  }
+
+private:
+  uint8_t channel(uint8_t c, uint16_t value) {
+    uint32_t acc = (uint32_t)value + mError[c];
+    uint32_t out = acc >> 8;
+    if (out > 255) {
+      out = 255;
+    }
+    uint32_t error = acc - (out << 8);
+    mError[c] = error > 255 ? 255 : error;
+    mFractional |= (value & 0xFF) != 0;
+    return out;
+  }
+
+  uint8_t mError[3] = {};
+  uint8_t mFrame = 0;
+  bool mFractional = false;
+};
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "LedDither.h"
+#include "SunriseCurve.h"
+
+/*
+ * Effects engine driven by a fixed-timestep scheduler.
+ *
+ * update() advances the engine time by whole LED_EFFECT_FRAME_MS steps and
+ * computes the per-frame parameters of the active effect, pixel() then returns
+ * the color of each LED for that frame. Kernels only use values precomputed when
+ * the effect starts, nothing is allocated per frame.
+ */
+
+constexpr unsigned long LED_EFFECT_FRAME_MS = 25;               // 40 fps
+constexpr unsigned long LED_EFFECT_FRAME_BUDGET_US = 2000;      // Compute budget of a 330 LEDs frame, show() excluded
+constexpr unsigned long LED_EFFECT_COLORLOOP_PERIOD_MS = 60000; // Full hue cycle
+constexpr unsigned long LED_EFFECT_RAINBOW_PERIOD_MS = 20000;   // Full hue cycle
+
+constexpr uint16_t LED_HUE_MAX = 6 * 256; // 6 segments of the color wheel
+
+// Sunset starts from the full current color, 1.0 / (end of the sunrise curve) in Q16
+constexpr uint32_t LED_EFFECT_SUNSET_SCALE = ((uint64_t)SUNRISE_Q16_ONE << 16) / getSunriseIntensity(SUNRISE_Q16_ONE);
+
+enum LedEffect {
+  LED_EFFECT_UNKNOWN,
+  LED_EFFECT_NONE,      // Solid color, with a fade on change
+  LED_EFFECT_SUNRISE,   // Sunrise curve up to the effect color
+  LED_EFFECT_SUNSET,    // Reverse sunrise curve from the current color down to off
+  LED_EFFECT_COLORLOOP, // Whole strip cycles through the hues
+  LED_EFFECT_RAINBOW,   // Hues spread along the strip and moving
+};
+
+class LedEffects {
+public:
+  LedEffects() {
+  }
+
+  LedEffects(uint16_t ledNum) {
+    setLedNum(ledNum);
+  }
+
+  // Number of LEDs the rainbow is spread on
+  void setLedNum(uint16_t ledNum) {
+    mHueStep = ledNum ? ((uint32_t)LED_HUE_MAX << 8) / ledNum : 0;
+  }
+
+  // Fade from the current color to a solid color
+  void setColor(const LedColor16 &color, unsigned long transitionMs) {
+    start(LED_EFFECT_NONE, transitionMs, color);
+  }
+
+  // Start an effect, color is the end color of the sunrise or gives the brightness of
+  // the color loops, the sunset starts from the current color
+  void setEffect(LedEffect effect, unsigned long durationMs, const LedColor16 &color) {
+    start(effect, durationMs, color);
+  }
+
+  LedEffect getEffect() const {
+    return mEffect;
+  }
+
+  // True when the sunrise, sunset or fade reached its end
+  bool isFinished() const {
+    return mElapsedMs >= mDurationMs && (mEffect == LED_EFFECT_NONE || mEffect == LED_EFFECT_SUNRISE || mEffect == LED_EFFECT_SUNSET);
+  }
+
+  // Advance the scheduler, return true when a new frame has to be rendered
+  bool update(unsigned long nowMs) {
+    if (nowMs - mLastFrameMs < LED_EFFECT_FRAME_MS) {
+      return false;
+    }
+    unsigned long elapsed = nowMs - mLastFrameMs;
+    mLastFrameMs += elapsed - elapsed % LED_EFFECT_FRAME_MS; // Late frames are dropped, the timestep stays fixed
+
+    if (!mChanged && isFinished()) {
+      return false;
+    }
+    mElapsedMs = mLastFrameMs - mStartMs;
+    computeFrame();
+    mChanged = false;
+    return true;
+  }
+
+  // Color of the LED i in the current frame, uniform effects return the same color
+  LedColor16 pixel(uint16_t i) const {
+    if (mEffect != LED_EFFECT_RAINBOW) {
+      return mColor;
+    }
+    uint32_t hue = mHue + ((i * mHueStep) >> 8);
+    return wheel(hue % LED_HUE_MAX, mBrightness);
+  }
+
+  // Uniform color of the current frame (not meaningful for the rainbow)
+  const LedColor16& getColor() const {
+    return mColor;
+  }
+
+private:
+  void start(LedEffect effect, unsigned long durationMs, const LedColor16 &color) {
+    mEffect = effect;
+    mFrom = mColor;
+    mTarget = color;
+    mDurationMs = durationMs;
+    mStartMs = mLastFrameMs;
+    mElapsedMs = 0;
+    mBrightness = max3(color.r, color.g, color.b);
+    mChanged = true;
+  }
+
+  void computeFrame() {
+    uint32_t progress = mElapsedMs >= mDurationMs ? SUNRISE_Q16_ONE : ((uint64_t)mElapsedMs << 16) / mDurationMs;
+
+    switch (mEffect) {
+      case LED_EFFECT_SUNRISE:
+        mColor = scale(mTarget, getSunriseIntensity(progress));
+        break;
+      case LED_EFFECT_SUNSET:
+        mColor = scale(mFrom, (getSunriseIntensity(SUNRISE_Q16_ONE - progress) * LED_EFFECT_SUNSET_SCALE) >> 16);
+        break;
+      case LED_EFFECT_COLORLOOP:
+        mColor = wheel((uint32_t)(mElapsedMs % LED_EFFECT_COLORLOOP_PERIOD_MS) * LED_HUE_MAX / LED_EFFECT_COLORLOOP_PERIOD_MS, mBrightness);
+        break;
+      case LED_EFFECT_RAINBOW:
+        mHue = (uint32_t)(mElapsedMs % LED_EFFECT_RAINBOW_PERIOD_MS) * LED_HUE_MAX / LED_EFFECT_RAINBOW_PERIOD_MS;
+        break;
+      case LED_EFFECT_NONE:
+      default:
+        mColor = {
+          lerp(mFrom.r, mTarget.r, progress),
+          lerp(mFrom.g, mTarget.g, progress),
+          lerp(mFrom.b, mTarget.b, progress),
+        };
+        break;
+    }
+  }
+
+  static uint16_t lerp(uint16_t from, uint16_t to, uint32_t progress) {
+    return from + (int32_t)(((int64_t)to - from) * progress >> 16);
+  }
+
+  static LedColor16 scale(const LedColor16 &color, uint32_t factor) {
+    return {
+      (uint16_t)((color.r * factor) >> 16),
+      (uint16_t)((color.g * factor) >> 16),
+      (uint16_t)((color.b * factor) >> 16),
+    };
+  }
+
+  static uint16_t max3(uint16_t a, uint16_t b, uint16_t c) {
+    uint16_t m = a > b ? a : b;
+    return m > c ? m : c;
+  }
+
+  // Fully saturated color of the wheel, hue in [0, LED_HUE_MAX)
+  static LedColor16 wheel(uint16_t hue, uint16_t brightness) {
+    uint16_t up = ((uint32_t)brightness * (hue & 0xFF)) >> 8;
+    uint16_t down = brightness - up;
+    switch (hue >> 8) {
+      case 0:  return { brightness, up, 0 };
+      case 1:  return { down, brightness, 0 };
+      case 2:  return { 0, brightness, up };
+      case 3:  return { 0, down, brightness };
+      case 4:  return { up, 0, brightness };
+      default: return { brightness, 0, down };
+    }
+  }
+
+  LedEffect mEffect = LED_EFFECT_NONE;
+  LedColor16 mFrom = {};
+  LedColor16 mTarget = {};
+  LedColor16 mColor = {};
+  unsigned long mLastFrameMs = 0;
+  unsigned long mStartMs = 0;
+  unsigned long mElapsedMs = 0;
+  unsigned long mDurationMs = 0;
+  uint32_t mHueStep = 0;
+  uint32_t mHue = 0;
+  uint16_t mBrightness = 0;
+  bool mChanged = false;
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "LedOutput.h"
+
+// Sending a frame of 330 LEDs takes ~10ms, with interrupts disabled for the bitbang output
+constexpr unsigned long LED_FRAME_PERIOD_MIN_MS = LedOutput::BLOCKING ? 20 : 12; // 50 fps / 83 fps max
+
+/*
+ * Frame buffer on top of LedOutput, only changed pixels are written and a frame
+ * is sent to the strip only when at least one pixel changed, with a frame-rate
+ * cap. A frame delayed by the cap, or by the transfer of the previous frame with
+ * the non-blocking outputs, stays pending until the next show().
+ */
+class LedFrameBuffer {
+public:
+  struct Stats {
+    uint32_t showCount;     // Frames sent to the strip
+    uint32_t delayCount;    // show() calls delayed by the frame-rate cap
+    uint32_t busyCount;     // show() calls delayed by the transfer of the previous frame
+    uint32_t showTimeUs;    // Total time spent in LedOutput::show(), interrupts off for the bitbang output
+  };
+
+  LedFrameBuffer(LedOutput &leds) : mLeds(leds) {
+  }
+
+  void begin() {
+    mLeds.begin();
+    markDirty(0, mLeds.numPixels());
+    resetStats();
+  }
+
+  void setFramePeriodMs(unsigned long periodMs) {
+    mFramePeriodMs = periodMs < LED_FRAME_PERIOD_MIN_MS ? LED_FRAME_PERIOD_MIN_MS : periodMs;
+  }
+
+  unsigned long getFramePeriodMs() const {
+    return mFramePeriodMs;
+  }
+
+  uint16_t numPixels() const {
+    return mLeds.numPixels();
+  }
+
+  void setPixel(uint16_t i, uint8_t r, uint8_t g, uint8_t b) {
+    if (mLeds.getPixelColor(i) != LedOutput::color(r, g, b)) {
+      mLeds.setPixelColor(i, r, g, b);
+      markDirty(i, 1);
+    }
+  }
+
+  void fill(uint8_t r, uint8_t g, uint8_t b) {
+    fill(r, g, b, 0, mLeds.numPixels());
+  }
+
+  void fill(uint8_t r, uint8_t g, uint8_t b, uint16_t first, uint16_t count) {
+    uint16_t end = first + count;
+    if (end > mLeds.numPixels()) {
+      end = mLeds.numPixels();
+    }
+    for (uint16_t i = first; i < end; i++) {
+      setPixel(i, r, g, b);
+    }
+  }
+
+  bool isDirty() const {
+    return mDirtyFirst < mDirtyEnd;
+  }
+
+  // Send the frame if a pixel changed and the frame period elapsed, return true if sent
+  bool show() {
+    unsigned long now = millis();
+
+    if (!isDirty()) {
+      return false;
+    }
+    if (mShowDone && now - mLastShowMs < mFramePeriodMs) {
+      mStats.delayCount++;
+      return false;
+    }
+    if (!LedOutput::BLOCKING && !mLeds.canShow()) {
+      mStats.busyCount++;
+      return false;
+    }
+
+    unsigned long start = micros();
+    mLeds.show();
+    mStats.showTimeUs += micros() - start;
+    mStats.showCount++;
+
+    mLastShowMs = now;
+    mShowDone = true;
+    mDirtyFirst = UINT16_MAX;
+    mDirtyEnd = 0;
+    return true;
+  }
+
+  const Stats& getStats() const {
+    return mStats;
+  }
+
+  void resetStats() {
+    mStats = {};
+  }
+
+private:
+  void markDirty(uint16_t first, uint16_t count) {
+    if (first < mDirtyFirst) mDirtyFirst = first;
+    if (first + count > mDirtyEnd) mDirtyEnd = first + count;
+  }
+
+  LedOutput &mLeds;
+  unsigned long mFramePeriodMs = LED_FRAME_PERIOD_MIN_MS;
+  unsigned long mLastShowMs = 0;
+  bool mShowDone = false;
+  uint16_t mDirtyFirst = UINT16_MAX;
+  uint16_t mDirtyEnd = 0;
+  Stats mStats = {};
+};
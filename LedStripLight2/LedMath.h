@@ -0,0 +1,54 @@
+#pragma once
+
+// Math functions usable in constant expressions, to generate lookup tables at compile time.
+// They are accurate for the ranges used by the LED tables, not as general replacements of libm.
+
+namespace led_math {
+
+constexpr double PI_VALUE = 3.14159265358979323846;
+constexpr double LN2_VALUE = 0.69314718055994530942;
+
+constexpr double cos(double x) {
+  double term = 1.0;
+  double sum = 1.0;
+  for (int i = 1; i < 16; i++) {
+    term *= -x * x / ((2 * i - 1) * (2 * i));
+    sum += term;
+  }
+  return sum;
+}
+
+// Natural logarithm for x > 0
+constexpr double log(double x) {
+  int exponent = 0;
+  while (x < 0.5) { x *= 2; exponent--; }
+  while (x >= 1.0) { x /= 2; exponent++; }
+  // ln(x) = 2 * atanh((x-1)/(x+1)), x in [0.5, 1)
+  double z = (x - 1) / (x + 1);
+  double term = z;
+  double sum = 0.0;
+  for (int i = 1; i < 40; i += 2) {
+    sum += term / i;
+    term *= z * z;
+  }
+  return 2 * sum + exponent * LN2_VALUE;
+}
+
+constexpr double exp(double x) {
+  int halvings = 0;
+  while (x > 0.5 || x < -0.5) { x /= 2; halvings++; }
+  double term = 1.0;
+  double sum = 1.0;
+  for (int i = 1; i < 20; i++) {
+    term *= x / i;
+    sum += term;
+  }
+  while (halvings--) { sum *= sum; }
+  return sum;
+}
+
+constexpr double pow(double base, double exponent) {
+  return base <= 0.0 ? 0.0 : exp(exponent * log(base));
+}
+
+} // namespace led_math
@@ -3,18 +3,27 @@
 #include <ArduinoJson.h>
 #include <PubSubClient.h>
 
+#include "LedEffects.h"
+#include "LedScene.h"
 #include "Logger.h"
+#include "MqttSnapshot.h"
+#include "SunriseAlarm.h"
 
 constexpr size_t MQTT_MSG_TOPIC_MAX_SIZE  = 64;
 constexpr size_t MQTT_MSG_PAYLOAD_MAX_SIZE = 4096;
+constexpr float MQTT_LED_TRANSITION_MAX_S = 60; // Max of the Home Assistant transition number
 
 /* EXTERNAL MQTT TOPIC */
 // Home Assistant
 constexpr const char* MQTT_TOPIC_HOMEASSISTANT_STATUS                = "homeassistant/status";  // ["online", "offline"]
 constexpr const char* MQTT_TOPIC_HOMEASSISTANT_SWITCH_SUNRISE_CONFIG = "homeassistant/switch/led_sunrise_%s_%d/config";   // %s replaced by ROOM_NAME, %d replaced by SERIAL_NUMBER
 constexpr const char* MQTT_TOPIC_HOMEASSISTANT_LIGHT_CONFIG          = "homeassistant/light/led_light_%s_%d/config";      // %s replaced by ROOM_NAME, %d replaced by SERIAL_NUMBER
+constexpr const char* MQTT_TOPIC_HOMEASSISTANT_LIGHT_SEGMENT_CONFIG  = "homeassistant/light/led_light_%s_%d_segment%u/config"; // %s replaced by ROOM_NAME, %d replaced by SERIAL_NUMBER, %u replaced by segment number
 constexpr const char* MQTT_TOPIC_HOMEASSISTANT_UPDATE_CONFIG         = "homeassistant/update/led_update_%s_%d/config";    // %s replaced by ROOM_NAME, %d replaced by SERIAL_NUMBER
 constexpr const char* MQTT_TOPIC_HOMEASSISTANT_SENSOR_RSSI_CONFIG    = "homeassistant/sensor/led_rssi_%s_%d/config";      // %s replaced by ROOM_NAME, %d replaced by SERIAL_NUMBER
+constexpr const char* MQTT_TOPIC_HOMEASSISTANT_NUMBER_TRANSITION_CONFIG = "homeassistant/number/led_transition_%s_%d/config"; // %s replaced by ROOM_NAME, %d replaced by SERIAL_NUMBER
+constexpr const char* MQTT_TOPIC_HOMEASSISTANT_SENSOR_NEXT_ALARM_CONFIG = "homeassistant/sensor/led_next_alarm_%s_%d/config"; // %s replaced by ROOM_NAME, %d replaced by SERIAL_NUMBER
+constexpr const char* MQTT_TOPIC_HOMEASSISTANT_SCENE_CONFIG          = "homeassistant/scene/led_scene_%s_%d_%u/config"; // %s replaced by ROOM_NAME, %d replaced by SERIAL_NUMBER, %u replaced by scene id
 
 // OTA firmware server
 constexpr const char* MQTT_TOPIC_OTA_CHECK_UPDATE                    = "home/ota/check_update";
@@ -26,16 +35,34 @@ constexpr const char* MQTT_TOPIC_LED_SUFFIX_AVAILABILITY             = "/availab
 // Home Assistant switch sunrise topics
 constexpr const char* MQTT_TOPIC_LED_SUFFIX_SUNRISE                  = "/sunrise";              // ["OFF", "ON"]
 constexpr const char* MQTT_TOPIC_LED_SUFFIX_SUNRISE_SET              = "/sunrise/set";          // ["OFF", "ON"]
-// Home Assistant light topics
+// Sunrise alarms, the sunrise starts at the alarm time
+constexpr const char* MQTT_TOPIC_LED_SUFFIX_ALARM_SET                = "/alarm/set";            // [{"time": "06:30", "days": ["mon", "tue", ...]}, ...] up to SUNRISE_ALARM_MAX, [] to clear
+constexpr const char* MQTT_TOPIC_LED_SUFFIX_ALARM                    = "/alarm";                // Same as /alarm/set
+// Home Assistant light topics, prefixed by MQTT_TOPIC_LED_SEGMENT for the segments after the first one
+constexpr const char* MQTT_TOPIC_LED_SEGMENT                         = "/segment%u";            // %u replaced by segment number, from 2
 constexpr const char* MQTT_TOPIC_LED_SUFFIX_STATE_SET                = "/state/set";            // ["OFF", "ON"]
 constexpr const char* MQTT_TOPIC_LED_SUFFIX_STATE                    = "/state";                // ["OFF", "ON"]
 constexpr const char* MQTT_TOPIC_LED_SUFFIX_RGB_SET                  = "/rgb/set";              // [red, green, blue] between [0..255]
 constexpr const char* MQTT_TOPIC_LED_SUFFIX_RGB                      = "/rgb";                  // [red, green, blue] between [0..255]
+constexpr const char* MQTT_TOPIC_LED_SUFFIX_EFFECT_SET               = "/effect/set";           // ["none", "sunrise", "sunset", "colorloop", "rainbow"]
+constexpr const char* MQTT_TOPIC_LED_SUFFIX_EFFECT                   = "/effect";               // ["none", "sunrise", "sunset", "colorloop", "rainbow"]
+// Home Assistant scene topics
+constexpr const char* MQTT_TOPIC_LED_SUFFIX_SCENE_SET                = "/scene/set";            // [0..LED_SCENE_MAX-1] scene id
+constexpr const char* MQTT_TOPIC_LED_SUFFIX_SCENE_UPLOAD             = "/scene/upload";         // Binary records, see LedScene.h
+// Home Assistant number transition topics
+constexpr const char* MQTT_TOPIC_LED_SUFFIX_TRANSITION_SET           = "/transition/set";       // [float] in seconds
+constexpr const char* MQTT_TOPIC_LED_SUFFIX_TRANSITION               = "/transition";           // [float] in seconds
+// Diagnostic topics
+constexpr const char* MQTT_TOPIC_LED_SUFFIX_DIAG_PING                = "/diag/ping";            // millis() of the sender, round-trip through the broker
+// Device config topics
+constexpr const char* MQTT_TOPIC_LED_SUFFIX_CONFIG                   = "/config";               // {"serial_number", "room_name", "led_segments": [length, ...]}, retained
+constexpr const char* MQTT_TOPIC_LED_SUFFIX_CONFIG_SET               = "/config/set";           // Any keys of /config, applied at once or not at all
 // Home Assistant update topics
 constexpr const char* MQTT_TOPIC_LED_SUFFIX_UPDATE_STATE             = "/update/state";         // {installed_version, in_progress }
 constexpr const char* MQTT_TOPIC_LED_SUFFIX_UPDATE_COMMAND           = "/update/command";
 // Home Assisanst sensors
 constexpr const char* MQTT_TOPIC_LED_SUFFIX_SENSOR_RSSI              = "/sensor/rssi";          // [float]
+constexpr const char* MQTT_TOPIC_LED_SUFFIX_SENSOR_NEXT_ALARM        = "/sensor/next_alarm";    // ISO 8601 UTC timestamp, "None" without alarm
 
 
 /* MQTT PAYPLOAD */
@@ -51,6 +78,17 @@ enum State {
   STATE_OFF,
   STATE_ON,
 };
+// Effect
+constexpr const char* MQTT_PAYLOAD_EFFECT_UNKNOWN   = "unknown";
+constexpr const char* MQTT_PAYLOAD_EFFECT_NONE      = "none";
+constexpr const char* MQTT_PAYLOAD_EFFECT_SUNRISE   = "sunrise";
+constexpr const char* MQTT_PAYLOAD_EFFECT_SUNSET    = "sunset";
+constexpr const char* MQTT_PAYLOAD_EFFECT_COLORLOOP = "colorloop";
+constexpr const char* MQTT_PAYLOAD_EFFECT_RAINBOW   = "rainbow";
+// Sensor without value
+constexpr const char* MQTT_PAYLOAD_NONE = "None";
+// Alarm days, in the order of the SunriseAlarm days bits
+constexpr const char* MQTT_PAYLOAD_DAYS[7] = { "sun", "mon", "tue", "wed", "thu", "fri", "sat" };
 
 // Entity category
 constexpr const char* MQTT_PAYLOAD_CATEGORY_CONFIG = "config";
@@ -81,6 +119,26 @@ enum State getStateFromMqttPayload(const char* payload, size_t size) {
   return STATE_UNKNOWN;
 }
 
+const char* getMqttPayload(enum LedEffect effect) {
+  switch (effect) {
+    case LED_EFFECT_NONE: return MQTT_PAYLOAD_EFFECT_NONE;
+    case LED_EFFECT_SUNRISE: return MQTT_PAYLOAD_EFFECT_SUNRISE;
+    case LED_EFFECT_SUNSET: return MQTT_PAYLOAD_EFFECT_SUNSET;
+    case LED_EFFECT_COLORLOOP: return MQTT_PAYLOAD_EFFECT_COLORLOOP;
+    case LED_EFFECT_RAINBOW: return MQTT_PAYLOAD_EFFECT_RAINBOW;
+    default: return MQTT_PAYLOAD_EFFECT_UNKNOWN;
+  }
+}
+
+enum LedEffect getEffectFromMqttPayload(const char* payload, size_t size) {
+  if      (isPayloadEqual<MQTT_PAYLOAD_EFFECT_NONE>(payload, size))      return LED_EFFECT_NONE;
+  else if (isPayloadEqual<MQTT_PAYLOAD_EFFECT_SUNRISE>(payload, size))   return LED_EFFECT_SUNRISE;
+  else if (isPayloadEqual<MQTT_PAYLOAD_EFFECT_SUNSET>(payload, size))    return LED_EFFECT_SUNSET;
+  else if (isPayloadEqual<MQTT_PAYLOAD_EFFECT_COLORLOOP>(payload, size)) return LED_EFFECT_COLORLOOP;
+  else if (isPayloadEqual<MQTT_PAYLOAD_EFFECT_RAINBOW>(payload, size))   return LED_EFFECT_RAINBOW;
+  return LED_EFFECT_UNKNOWN;
+}
+
 void getMqttPayload(const char* payload, size_t size, uint8_t* val1, uint8_t* val2, uint8_t* val3) {
   char str[size+1];
   memcpy(str, payload, size);
@@ -88,6 +146,45 @@ void getMqttPayload(const char* payload, size_t size, uint8_t* val1, uint8_t* va
   sscanf(str, "%hhu, %hhu, %hhu", val1, val2, val3);
 }
 
+// Fill the SUNRISE_ALARM_MAX alarms, the ones not in the payload are disabled, return false if invalid
+bool getSunriseAlarmsFromMqttPayload(const char* payload, size_t size, SunriseAlarm* alarms) {
+  StaticJsonDocument<1024> json;
+  DeserializationError error = deserializeJson(json, payload, size);
+  if (error) {
+    Log.error("Alarm JSON error: %s", error.f_str());
+    return false;
+  }
+
+  JsonArray array = json.as<JsonArray>();
+  if (array.isNull() || array.size() > SUNRISE_ALARM_MAX) {
+    return false;
+  }
+
+  uint8_t i = 0;
+  for (JsonObject item : array) {
+    const char* time = item["time"];
+    SunriseAlarm alarm = {};
+    if (time == nullptr || sscanf(time, "%hhu:%hhu", &alarm.hour, &alarm.minute) != 2) {
+      return false;
+    }
+    for (const char* day : item["days"].as<JsonArray>()) {
+      for (uint8_t d=0; d<7; d++) {
+        if (day != nullptr && strcmp(day, MQTT_PAYLOAD_DAYS[d]) == 0) {
+          alarm.days |= 1 << d;
+        }
+      }
+    }
+    if (!isSunriseAlarmEnabled(alarm)) {
+      return false;
+    }
+    alarms[i++] = alarm;
+  }
+  for (; i<SUNRISE_ALARM_MAX; i++) {
+    alarms[i] = {};
+  }
+  return true;
+}
+
 /* Class */
 
 class LedMqtt {
@@ -114,6 +211,10 @@ public:
     mMqttTopicLightConfig.replace("%s", roomName);
     mMqttTopicLightConfig.replace("%d", String(serialNumber));
 
+    mMqttTopicLightSegmentConfig = MQTT_TOPIC_HOMEASSISTANT_LIGHT_SEGMENT_CONFIG;
+    mMqttTopicLightSegmentConfig.replace("%s", roomName);
+    mMqttTopicLightSegmentConfig.replace("%d", String(serialNumber));
+
     mMqttTopicUpdateConfig = MQTT_TOPIC_HOMEASSISTANT_UPDATE_CONFIG;
     mMqttTopicUpdateConfig.replace("%s", roomName);
     mMqttTopicUpdateConfig.replace("%d", String(serialNumber));
@@ -121,6 +222,18 @@ public:
     mMqttTopicSensorRssiConfig = MQTT_TOPIC_HOMEASSISTANT_SENSOR_RSSI_CONFIG;
     mMqttTopicSensorRssiConfig.replace("%s", roomName);
     mMqttTopicSensorRssiConfig.replace("%d", String(serialNumber));
+
+    mMqttTopicNumberTransitionConfig = MQTT_TOPIC_HOMEASSISTANT_NUMBER_TRANSITION_CONFIG;
+    mMqttTopicNumberTransitionConfig.replace("%s", roomName);
+    mMqttTopicNumberTransitionConfig.replace("%d", String(serialNumber));
+
+    mMqttTopicSensorNextAlarmConfig = MQTT_TOPIC_HOMEASSISTANT_SENSOR_NEXT_ALARM_CONFIG;
+    mMqttTopicSensorNextAlarmConfig.replace("%s", roomName);
+    mMqttTopicSensorNextAlarmConfig.replace("%d", String(serialNumber));
+
+    mMqttTopicSceneConfig = MQTT_TOPIC_HOMEASSISTANT_SCENE_CONFIG;
+    mMqttTopicSceneConfig.replace("%s", roomName);
+    mMqttTopicSceneConfig.replace("%d", String(serialNumber));
   }
 
   char* getLedTopic(const char* topicSuffix) {
@@ -129,6 +242,18 @@ public:
     return buf;
   }
 
+  // Light topics of a segment, the first segment keeps the topics of the whole strip
+  char* getSegmentTopic(uint8_t segment, const char* topicSuffix) {
+    static char buf[MQTT_MSG_TOPIC_MAX_SIZE] = {};
+    if (segment == 0) {
+      return getLedTopic(topicSuffix);
+    }
+    char segmentTopic[16] = {};
+    snprintf(segmentTopic, sizeof(segmentTopic)-1, MQTT_TOPIC_LED_SEGMENT, segment + 1);
+    snprintf(buf, MQTT_MSG_TOPIC_MAX_SIZE-1, "%s%s%s", mMqttTopicLedPrefix.c_str(), segmentTopic, topicSuffix);
+    return buf;
+  }
+
   void publishMessage(const char* topic, const char* payload, bool retain = false) {
     Log.info("Publish message [%s]: %s", topic, payload);
     if (!mClient.publish(topic, payload, retain)) {
@@ -136,28 +261,105 @@ public:
     }
   }
 
+  // Entity state, kept in the snapshot and sent again on reconnect and Home Assistant restart.
+  // Only the states of the light and the switch are retained, not the telemetry.
+  void publishState(const char* topic, const char* payload, bool retain = false) {
+    if (!mSnapshot.setState(topic, payload, retain)) {
+      Log.warning("State not kept in the snapshot [%s]", topic);
+    }
+    if (mClient.connected()) {
+      publishMessage(topic, payload, retain);
+    }
+  }
+
+  // Discovery config, only sent if it changed since the last send
+  void publishDiscoveryConfig(const char* topic, const char* payload) {
+    if (mSnapshot.isConfigChanged(topic, payload)) {
+      publishMessage(topic, payload, true);
+    }
+  }
+
+  // All the entity states in one burst
+  void publishSnapshot() {
+    Log.info("Publish snapshot of %u states", mSnapshot.getStateCount());
+    for (uint8_t i=0; i<mSnapshot.getStateCount(); i++) {
+      publishMessage(mSnapshot.getStateTopic(i), mSnapshot.getStatePayload(i), mSnapshot.getStateRetain(i));
+    }
+  }
+
+  // New broker connection, all the discovery configs are sent again
+  void clearDiscoveryConfigs() {
+    mSnapshot.clearConfigs();
+  }
+
+  void scheduleSnapshot(unsigned long nowMs, unsigned long delayMs) {
+    mSnapshot.schedule(nowMs, delayMs);
+  }
+
+  bool isSnapshotDue(unsigned long nowMs) {
+    return mSnapshot.isDue(nowMs);
+  }
+
   void publishMessage(const char* topic, const float value) {
     snprintf (mMsgPayload, MQTT_MSG_PAYLOAD_MAX_SIZE, "%.2f", value);
-    publishMessage(topic, mMsgPayload);
+    publishState(topic, mMsgPayload);
   }
 
   void publishMessage(const char* topic, const long value) {
     snprintf (mMsgPayload, MQTT_MSG_PAYLOAD_MAX_SIZE, "%ld", value);
-    publishMessage(topic, mMsgPayload);
+    publishState(topic, mMsgPayload);
   }
 
   void publishMessage(const char* topic, const uint8_t value) {
     snprintf (mMsgPayload, MQTT_MSG_PAYLOAD_MAX_SIZE, "%d", value);
-    publishMessage(topic, mMsgPayload);
+    publishState(topic, mMsgPayload);
   }
 
   void publishMessage(const char* topic, const uint8_t val1, const uint8_t val2, const uint8_t val3) {
     snprintf (mMsgPayload, MQTT_MSG_PAYLOAD_MAX_SIZE, "%d, %d, %d", val1, val2, val3);
-    publishMessage(topic, mMsgPayload);
+    publishState(topic, mMsgPayload, true);
   }
 
   void publishMessage(const char* topic, enum State state) {
-    publishMessage(topic, getMqttPayload(state));
+    publishState(topic, getMqttPayload(state), true);
+  }
+
+  void publishMessage(const char* topic, enum LedEffect effect) {
+    publishState(topic, getMqttPayload(effect), true);
+  }
+
+  void publishMessage(const char* topic, const SunriseAlarm* alarms) {
+    StaticJsonDocument<1024> json;
+    JsonArray array = json.to<JsonArray>();
+    for (uint8_t i=0; i<SUNRISE_ALARM_MAX; i++) {
+      if (!isSunriseAlarmEnabled(alarms[i])) {
+        continue;
+      }
+      char time[6];
+      snprintf(time, sizeof(time), "%02u:%02u", alarms[i].hour, alarms[i].minute);
+      JsonObject item = array.createNestedObject();
+      item["time"] = time;
+      JsonArray days = item.createNestedArray("days");
+      for (uint8_t d=0; d<7; d++) {
+        if (alarms[i].days & (1 << d)) {
+          days.add(MQTT_PAYLOAD_DAYS[d]);
+        }
+      }
+    }
+    serializeJson(json, mMsgPayload);
+    publishState(topic, mMsgPayload, true);
+  }
+
+  // ISO 8601 in UTC, 0 is published as no value
+  void publishMessageTimestamp(const char* topic, time_t timestamp) {
+    if (timestamp == 0) {
+      publishState(topic, MQTT_PAYLOAD_NONE, true);
+      return;
+    }
+    struct tm utc;
+    gmtime_r(&timestamp, &utc);
+    strftime(mMsgPayload, MQTT_MSG_PAYLOAD_MAX_SIZE, "%Y-%m-%dT%H:%M:%S+00:00", &utc);
+    publishState(topic, mMsgPayload, true);
   }
 
   void publishMessageSwitchSuriseConfig() {
@@ -173,26 +375,42 @@ public:
     if (size > MQTT_MSG_PAYLOAD_MAX_SIZE) {
       Log.error("Buffer payload is too small, need: %d", size);
     }
-    publishMessage(mMqttTopicSwitchSunriseConfig.c_str(), mMsgPayload, true);
+    publishDiscoveryConfig(mMqttTopicSwitchSunriseConfig.c_str(), mMsgPayload);
   }
 
-  void publishMessageLightConfig() {
+  void publishMessageLightConfig(uint8_t segment) {
     StaticJsonDocument<MQTT_MSG_PAYLOAD_MAX_SIZE> config;
-    config["name"] = "Light";
-    config["unique_id"] = "id_led_light_" + mRoomName + "_" + mSerialNumber;
+    String topic = mMqttTopicLightConfig;
+    if (segment == 0) {
+      config["name"] = "Light";
+      config["unique_id"] = "id_led_light_" + mRoomName + "_" + mSerialNumber;
+    } else {
+      config["name"] = "Light " + String(segment + 1);
+      config["unique_id"] = "id_led_light_" + mRoomName + "_" + mSerialNumber + "_segment" + String(segment + 1);
+      topic = mMqttTopicLightSegmentConfig;
+      topic.replace("%u", String(segment + 1));
+    }
     config["platform"] = "light";
     config["availability_topic"] = getLedTopic(MQTT_TOPIC_LED_SUFFIX_AVAILABILITY);
-    config["command_topic"] = getLedTopic(MQTT_TOPIC_LED_SUFFIX_STATE_SET);
-    config["state_topic"] = getLedTopic(MQTT_TOPIC_LED_SUFFIX_STATE);
-    config["rgb_command_topic"] = getLedTopic(MQTT_TOPIC_LED_SUFFIX_RGB_SET);
-    config["rgb_state_topic"] = getLedTopic(MQTT_TOPIC_LED_SUFFIX_RGB);
+    config["command_topic"] = getSegmentTopic(segment, MQTT_TOPIC_LED_SUFFIX_STATE_SET);
+    config["state_topic"] = getSegmentTopic(segment, MQTT_TOPIC_LED_SUFFIX_STATE);
+    config["rgb_command_topic"] = getSegmentTopic(segment, MQTT_TOPIC_LED_SUFFIX_RGB_SET);
+    config["rgb_state_topic"] = getSegmentTopic(segment, MQTT_TOPIC_LED_SUFFIX_RGB);
+    config["effect_command_topic"] = getSegmentTopic(segment, MQTT_TOPIC_LED_SUFFIX_EFFECT_SET);
+    config["effect_state_topic"] = getSegmentTopic(segment, MQTT_TOPIC_LED_SUFFIX_EFFECT);
+    JsonArray effects = config.createNestedArray("effect_list");
+    effects.add(MQTT_PAYLOAD_EFFECT_NONE);
+    effects.add(MQTT_PAYLOAD_EFFECT_SUNRISE);
+    effects.add(MQTT_PAYLOAD_EFFECT_SUNSET);
+    effects.add(MQTT_PAYLOAD_EFFECT_COLORLOOP);
+    effects.add(MQTT_PAYLOAD_EFFECT_RAINBOW);
     config["retain"] = true;
     addDeviceJson(config);
     size_t size = serializeJson(config, mMsgPayload);
     if (size > MQTT_MSG_PAYLOAD_MAX_SIZE) {
       Log.error("Buffer payload is too small, need: %d", size);
     }
-    publishMessage(mMqttTopicLightConfig.c_str(), mMsgPayload, true);
+    publishDiscoveryConfig(topic.c_str(), mMsgPayload);
   }
 
   void publishMessageUpdateConfig() {
@@ -211,7 +429,7 @@ public:
     if (size > MQTT_MSG_PAYLOAD_MAX_SIZE) {
       Log.error("Buffer payload is too small, need: %d", size);
     }
-    publishMessage(mMqttTopicUpdateConfig.c_str(), mMsgPayload, true);
+    publishDiscoveryConfig(mMqttTopicUpdateConfig.c_str(), mMsgPayload);
   }
 
   void publishMessageSensorRssiConfig() {
@@ -229,7 +447,69 @@ public:
     if (size > MQTT_MSG_PAYLOAD_MAX_SIZE) {
       Log.error("Buffer payload is too small, need: %d", size);
     }
-    publishMessage(mMqttTopicSensorRssiConfig.c_str(), mMsgPayload, true);
+    publishDiscoveryConfig(mMqttTopicSensorRssiConfig.c_str(), mMsgPayload);
+  }
+
+  void publishMessageNumberTransitionConfig() {
+    StaticJsonDocument<MQTT_MSG_PAYLOAD_MAX_SIZE> config;
+    config["name"] = "Transition";
+    config["unique_id"] = "id_led_transition_" + mRoomName + "_" + mSerialNumber;
+    config["platform"] = "number";
+    config["command_topic"] = getLedTopic(MQTT_TOPIC_LED_SUFFIX_TRANSITION_SET);
+    config["state_topic"] = getLedTopic(MQTT_TOPIC_LED_SUFFIX_TRANSITION);
+    config["availability_topic"] = getLedTopic(MQTT_TOPIC_LED_SUFFIX_AVAILABILITY);
+    config["min"] = 0;
+    config["max"] = MQTT_LED_TRANSITION_MAX_S;
+    config["step"] = 0.1;
+    config["unit_of_measurement"] = "s";
+    config["entity_category"] = MQTT_PAYLOAD_CATEGORY_CONFIG;
+    config["retain"] = true;
+    addDeviceJson(config);
+    size_t size = serializeJson(config, mMsgPayload);
+    if (size > MQTT_MSG_PAYLOAD_MAX_SIZE) {
+      Log.error("Buffer payload is too small, need: %d", size);
+    }
+    publishDiscoveryConfig(mMqttTopicNumberTransitionConfig.c_str(), mMsgPayload);
+  }
+
+  void publishMessageSensorNextAlarmConfig() {
+    StaticJsonDocument<MQTT_MSG_PAYLOAD_MAX_SIZE> config;
+    config["name"] = "Next alarm";
+    config["unique_id"] = "id_led_next_alarm_" + mRoomName + "_" + mSerialNumber;
+    config["platform"] = "sensor";
+    config["device_class"] = "timestamp";
+    config["state_topic"] = getLedTopic(MQTT_TOPIC_LED_SUFFIX_SENSOR_NEXT_ALARM);
+    config["availability_topic"] = getLedTopic(MQTT_TOPIC_LED_SUFFIX_AVAILABILITY);
+    config["icon"] = "mdi:alarm";
+    addDeviceJson(config);
+    size_t size = serializeJson(config, mMsgPayload);
+    if (size > MQTT_MSG_PAYLOAD_MAX_SIZE) {
+      Log.error("Buffer payload is too small, need: %d", size);
+    }
+    publishDiscoveryConfig(mMqttTopicSensorNextAlarmConfig.c_str(), mMsgPayload);
+  }
+
+  // An empty scene slot removes the entity
+  void publishMessageSceneConfig(uint8_t id, const LedScene &scene) {
+    String topic = mMqttTopicSceneConfig;
+    topic.replace("%u", String(id));
+    if (!isLedSceneValid(scene)) {
+      publishDiscoveryConfig(topic.c_str(), "");
+      return;
+    }
+    StaticJsonDocument<MQTT_MSG_PAYLOAD_MAX_SIZE> config;
+    config["name"] = "Scene " + String(id);
+    config["unique_id"] = "id_led_scene_" + mRoomName + "_" + mSerialNumber + "_" + String(id);
+    config["platform"] = "scene";
+    config["command_topic"] = getLedTopic(MQTT_TOPIC_LED_SUFFIX_SCENE_SET);
+    config["payload_on"] = String(id);
+    config["availability_topic"] = getLedTopic(MQTT_TOPIC_LED_SUFFIX_AVAILABILITY);
+    addDeviceJson(config);
+    size_t size = serializeJson(config, mMsgPayload);
+    if (size > MQTT_MSG_PAYLOAD_MAX_SIZE) {
+      Log.error("Buffer payload is too small, need: %d", size);
+    }
+    publishDiscoveryConfig(topic.c_str(), mMsgPayload);
   }
 
   void publishMessageUpdateState(const char* latest_version, bool in_progress = false) {
@@ -241,7 +521,7 @@ public:
     if (size > MQTT_MSG_PAYLOAD_MAX_SIZE) {
       Log.error("Buffer payload is too small, need: %d", size);
     }
-    publishMessage(getLedTopic(MQTT_TOPIC_LED_SUFFIX_UPDATE_STATE), mMsgPayload, true);
+    publishState(getLedTopic(MQTT_TOPIC_LED_SUFFIX_UPDATE_STATE), mMsgPayload, true);
   }
 
   void deleteMessageUpdateCommand() {
@@ -267,9 +547,14 @@ private:
   String mMqttTopicLedPrefix = "";
   String mMqttTopicSwitchSunriseConfig = "";
   String mMqttTopicLightConfig = "";
+  String mMqttTopicLightSegmentConfig = "";
   String mMqttTopicUpdateConfig = "";
   String mMqttTopicSensorRssiConfig = "";
+  String mMqttTopicNumberTransitionConfig = "";
+  String mMqttTopicSensorNextAlarmConfig = "";
+  String mMqttTopicSceneConfig = "";
   PubSubClient &mClient;
+  MqttSnapshot mSnapshot;
   String mVersion = "";
   String mRoomName = "";
   String mMacWifi = "";
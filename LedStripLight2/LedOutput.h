@@ -0,0 +1,124 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * WS2812 output backends, selected at build time with LED_OUTPUT:
+ *  - LED_OUTPUT_BITBANG: Adafruit_NeoPixel, show() bit-bangs the whole frame with
+ *    interrupts disabled (~10ms for 330 LEDs), any pin.
+ *  - LED_OUTPUT_DMA: NeoPixelBus I2S DMA, GPIO3 (RX) only. show() encodes the
+ *    pixels in the DMA buffer and returns, the transfer runs in the background.
+ *  - LED_OUTPUT_UART: NeoPixelBus UART1 with interrupts, GPIO2 (TX1) only, Serial1
+ *    can't be used. Same behavior as DMA with more CPU load during the transfer.
+ *
+ * With DMA and UART the pixel buffer and the transfer buffer are separate, the next
+ * frame is written while the previous one is sent. show() only waits if the previous
+ * transfer is still running, canShow() tells it beforehand.
+ */
+
+#define LED_OUTPUT_BITBANG  0
+#define LED_OUTPUT_DMA      1
+#define LED_OUTPUT_UART     2
+
+#ifndef LED_OUTPUT
+#define LED_OUTPUT LED_OUTPUT_BITBANG
+#endif
+
+#if LED_OUTPUT == LED_OUTPUT_BITBANG
+#include <Adafruit_NeoPixel.h>
+#elif LED_OUTPUT == LED_OUTPUT_DMA || LED_OUTPUT == LED_OUTPUT_UART
+#include <NeoPixelBus.h>
+#else
+#error "Unsupported LED_OUTPUT"
+#endif
+
+class LedOutput {
+public:
+#if LED_OUTPUT == LED_OUTPUT_BITBANG
+  static constexpr bool BLOCKING = true;
+  static constexpr const char* NAME = "bitbang";
+#elif LED_OUTPUT == LED_OUTPUT_DMA
+  static constexpr bool BLOCKING = false;
+  static constexpr const char* NAME = "i2s-dma";
+#else
+  static constexpr bool BLOCKING = false;
+  static constexpr const char* NAME = "uart1";
+#endif
+
+  // The pin is only used by the bitbang backend, DMA and UART have a fixed pin
+  LedOutput(uint16_t ledNum, uint8_t pin)
+#if LED_OUTPUT == LED_OUTPUT_BITBANG
+    : mLeds(ledNum, pin, NEO_GRB + NEO_KHZ800) {
+  }
+#else
+    : mLeds(ledNum) {
+    (void)pin;
+  }
+#endif
+
+#if LED_OUTPUT == LED_OUTPUT_BITBANG
+  void begin() {
+    mLeds.begin();
+    mLeds.clear();
+  }
+
+  uint16_t numPixels() const {
+    return mLeds.numPixels();
+  }
+
+  uint32_t getPixelColor(uint16_t i) const {
+    return mLeds.getPixelColor(i);
+  }
+
+  void setPixelColor(uint16_t i, uint8_t r, uint8_t g, uint8_t b) {
+    mLeds.setPixelColor(i, r, g, b);
+  }
+
+  bool canShow() {
+    return mLeds.canShow();
+  }
+
+  void show() {
+    mLeds.show();
+  }
+#else
+  void begin() {
+    mLeds.Begin();
+    mLeds.ClearTo(RgbColor(0));
+  }
+
+  uint16_t numPixels() const {
+    return mLeds.PixelCount();
+  }
+
+  uint32_t getPixelColor(uint16_t i) const {
+    RgbColor color = mLeds.GetPixelColor(i);
+    return ((uint32_t)color.R << 16) | ((uint32_t)color.G << 8) | color.B;
+  }
+
+  void setPixelColor(uint16_t i, uint8_t r, uint8_t g, uint8_t b) {
+    mLeds.SetPixelColor(i, RgbColor(r, g, b));
+  }
+
+  bool canShow() {
+    return mLeds.CanShow();
+  }
+
+  void show() {
+    mLeds.Show();
+  }
+#endif
+
+  static uint32_t color(uint8_t r, uint8_t g, uint8_t b) {
+    return ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+  }
+
+private:
+#if LED_OUTPUT == LED_OUTPUT_BITBANG
+  Adafruit_NeoPixel mLeds;
+#elif LED_OUTPUT == LED_OUTPUT_DMA
+  NeoPixelBus<NeoGrbFeature, NeoEsp8266Dma800KbpsMethod> mLeds;
+#else
+  NeoPixelBus<NeoGrbFeature, NeoEsp8266AsyncUart1800KbpsMethod> mLeds;
+#endif
+};
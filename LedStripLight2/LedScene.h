@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "LedEffects.h"
+
+/*
+ * Scene presets, stored in the NVM config and recalled by ID.
+ *
+ * A scene applies the same color, brightness, effect and fade to all the segments.
+ * Scenes are uploaded in bulk as a binary payload of LED_SCENE_RECORD_SIZE bytes
+ * records: id, red, green, blue, brightness, effect (LedEffect value), transition in
+ * 1/10 s (uint16, little-endian). A record with an unknown effect deletes the scene.
+ *
+ * The fade is the transition to a solid color or to off: an effect scene starts its
+ * effect at once, a record with an effect and a transition is rejected.
+ */
+
+constexpr uint8_t LED_SCENE_MAX = 16;
+constexpr size_t LED_SCENE_RECORD_SIZE = 8;
+
+#pragma pack(push, 1)
+struct LedScene {
+  uint8_t red;
+  uint8_t green;
+  uint8_t blue;
+  uint8_t brightness;     // 0 switches the light off
+  uint8_t effect;         // LedEffect, LED_EFFECT_UNKNOWN (or 0xFF in a blank EEPROM) for an empty slot
+  uint16_t transitionDs;  // Fade duration in 1/10 s
+};
+#pragma pack(pop)
+static_assert(sizeof(struct LedScene) == 7, "LED scene structure size is incorrect");
+
+inline bool isLedSceneEffectValid(uint8_t effect) {
+  return effect >= LED_EFFECT_NONE && effect <= LED_EFFECT_RAINBOW;
+}
+
+inline bool isLedSceneValid(const LedScene &scene) {
+  return isLedSceneEffectValid(scene.effect);
+}
+
+// Update the scenes of the payload records, nothing is changed if a record is invalid
+inline bool setLedScenesFromPayload(const uint8_t *payload, size_t size, LedScene *scenes) {
+  if (size == 0 || size % LED_SCENE_RECORD_SIZE != 0) {
+    return false;
+  }
+  for (size_t i=0; i<size; i+=LED_SCENE_RECORD_SIZE) {
+    const uint8_t *record = payload + i;
+    bool effect = isLedSceneEffectValid(record[5]) && record[5] != LED_EFFECT_NONE;
+    if (record[0] >= LED_SCENE_MAX || (effect && record[4] != 0 && (record[6] || record[7]))) {
+      return false;
+    }
+  }
+  for (size_t i=0; i<size; i+=LED_SCENE_RECORD_SIZE) {
+    const uint8_t *record = payload + i;
+    LedScene &scene = scenes[record[0]];
+    scene.red = record[1];
+    scene.green = record[2];
+    scene.blue = record[3];
+    scene.brightness = record[4];
+    scene.effect = isLedSceneEffectValid(record[5]) ? record[5] : (uint8_t)LED_EFFECT_UNKNOWN;
+    scene.transitionDs = record[6] | (record[7] << 8);
+  }
+  return true;
+}
@@ -1,57 +1,146 @@
 #include <EEPROM.h>
 #include <ESP8266WiFi.h>
 #include <PubSubClient.h>
-#include <Adafruit_NeoPixel.h>
+#include <time.h>
 
+#include "CommandLatency.h"
+#include "ConfigStore.h"
 #include "Credentials.h"
+#include "LedDither.h"
+#include "LedEffects.h"
+#include "LedFrameBuffer.h"
 #include "LedMqtt.h"
+#include "LedOutput.h"
+#include "LedScene.h"
+#include "NvmConfig.h"
 #include "OtaUpdater.h"
 #include "Logger.h"
+#include "SavedState.h"
+#include "SunriseAlarm.h"
+#include "SunriseCurve.h"
 
 // OTA
 #define VERSION "1.1.0"
 #define DEVICE  "LedStripLight2"
 
 // Settings (TODO later move in NVM config)
-#define LED_PIN   0
+#define LED_PIN   0 // Bitbang output only, the DMA output uses GPIO3 (RX) and the UART output GPIO2
 #define LED_NUM   330
+#define LED_SEGMENT_MAX CONFIG_LED_SEGMENT_MAX
 
 // Wifi
 #define WIFI_HOSTNAME "%s-%d-ledStrip" // %s replaced by ROOM_NAME, %d replaced by SERIAL_NUMBER
 
+// MQTT
+#define MQTT_RECONNECT_PERIOD_MS 5000
+#define CONFIG_JSON_SIZE 512
+
+// Time, for the sunrise alarms
+#define NTP_SERVER  "pool.ntp.org"
+#define TIME_ZONE   "CET-1CEST,M3.5.0,M10.5.0/3" // POSIX TZ, local time of the alarms
+
+// Rendering
+#if LED_OUTPUT == LED_OUTPUT_BITBANG
+#define LED_DITHER_TEMPORAL_HZ    0   // Temporal dithering refresh rate, 0 to disable (each frame blocks ~10ms)
+#else
+#define LED_DITHER_TEMPORAL_HZ    40  // Frames are sent in the background
+#endif
+#define LED_TRANSITION_DEFAULT_MS 500 // Fade duration on color change
+#define LED_DIAG_PERIOD_MS        10000 // Output frame rate and MQTT round-trip report while an animation runs
+
 // Sunrise
 #define SUNRISE_BRIGHTNESS_MAX  50
-#define SUNRISE_PIXELS_NB       (SUNRISE_BRIGHTNESS_MAX * LED_NUM)
+#if LED_DITHER_TEMPORAL_HZ
+#define SUNRISE_FRAME_PERIOD_MS (1000 / LED_DITHER_TEMPORAL_HZ)
+#else
+#define SUNRISE_FRAME_PERIOD_MS 250 // A 1/256 step of the brightness doesn't need a faster refresh
+#endif
+static_assert(SUNRISE_BRIGHTNESS_MAX * getSunriseLutMaxError() < SUNRISE_Q16_ONE / 256, "Sunrise LUT error exceeds one dithering step");
+#define SUNRISE_ALARM_LATE_MAX_S 60 // An alarm found later (clock step, blocked loop) is skipped
 
-// TODO Move in lib
-#pragma pack(1)
+// RAM copy of the NVM config, the values of the keys (see NvmConfig.h)
 struct NVMConfig {
   float     sensorTemperatureOffset;
   float     sensorHumidityOffset;
   uint32_t  deviceSerialNumber;
-  char      roomName[32];
+  char      roomName[CONFIG_ROOM_NAME_SIZE];
+  uint8_t   ledSegmentCount;                    // 0 or 0xFF (blank) for a single segment
+  uint16_t  ledSegmentLength[LED_SEGMENT_MAX];  // The last segment extends to the end of the strip
+  SunriseAlarm sunriseAlarms[SUNRISE_ALARM_MAX]; // Set over MQTT
+  LedScene  ledScenes[LED_SCENE_MAX];           // Set over MQTT
+};
+static_assert(sizeof(NVMConfig::sunriseAlarms) == CONFIG_SUNRISE_ALARMS_SIZE, "Sunrise alarms differ from their NVM config key");
+static_assert(sizeof(NVMConfig::ledScenes) == CONFIG_LED_SCENES_SIZE, "LED scenes differ from their NVM config key");
+
+// Last state of the segments, restored at boot (see SavedState.h)
+struct LedSegmentState {
+  uint8_t   state;    // enum State
+  uint8_t   red;
+  uint8_t   green;
+  uint8_t   blue;
+  uint8_t   effect;   // enum LedEffect, a sunrise is kept as its current color and a sunset as off
+};
+struct LedState {
+  LedSegmentState segments[LED_SEGMENT_MAX];
 };
-static_assert(sizeof(struct NVMConfig) == 4+4+4+32, "EEPROM config structure size is incorrect");
 
 WiFiClient wifiClient;
 PubSubClient client(wifiClient);
 LedMqtt mqtt(client);
 OtaUpdater ota(DEVICE, VERSION);
+EspConfigFlash configFlash;
+ConfigStore<EspConfigFlash> configStore(configFlash);
+EspRtcMemory rtcMemory;
+SavedState<LedState, EspRtcMemory> savedState(rtcMemory);
 struct NVMConfig config = {};
-Adafruit_NeoPixel leds(LED_NUM, LED_PIN, NEO_GRB + NEO_KHZ800);
+LedOutput leds(LED_NUM, LED_PIN);
+LedFrameBuffer frame(leds);
+LedDither dither;
+
+// LED segments, consecutive parts of the strip each exposed as a light
+struct LedSegment {
+  uint16_t first;
+  uint16_t count;
+  State state;
+  uint8_t red;
+  uint8_t green;
+  uint8_t blue;
+  LedEffect effect;
+  LedEffects effects;
+  bool colorApplied;    // Effects engine shows the last color of setLedColorRGB()
+  uint8_t appliedRed;
+  uint8_t appliedGreen;
+  uint8_t appliedBlue;
+  State prevState;
+  LedEffect prevEffect;
+};
+LedSegment gLedSegments[LED_SEGMENT_MAX];
+uint8_t gLedSegmentCount = 1;
 
 // LED
-State gLedState = STATE_UNKNOWN;
 State gSunriseState = STATE_OFF;
-uint8_t gLedRed = 0;
-uint8_t gLedGreen = 0;
-uint8_t gLedBlue = 0;
+unsigned long gLedTransitionMs = LED_TRANSITION_DEFAULT_MS;
+unsigned long gLedFrameTimeMs = 0;
+
+// Frame compute time, show() excluded
+struct LedFrameStats {
+  uint32_t count;
+  uint32_t overBudget;
+  uint32_t maxUs;
+  uint64_t sumUs;
+} ledFrameStats = {};
+
+// Diagnostic
+long gMqttRoundTripMs = -1;
+CommandLatency commandLatency; // From a segment command to the first frame sent
 
 // Sunrise Mode
-unsigned long sunriseStartTimeMs = 0;
 unsigned long sunriseDurationTimeMs = 1800000; // 30 min
-uint16_t sunriseCurrentLevel = 0;
-uint16_t sunriseCurrentLedsInLevel = 0;
+uint8_t sunriseCurrentLevel = 0;
+
+// Sunrise alarms
+time_t gSunriseNextAlarm = 0;
+bool gSunriseAlarmChanged = true;
 
 void setup_wifi() {
   delay(10);
@@ -81,40 +170,77 @@ void setup_mqtt() {
   mqtt_reconnect();
 }
 
+// Doesn't block, the LEDs and the alarms keep running while the broker is unreachable
 void mqtt_reconnect() {
-  // Loop until we're reconnected
-  while (!client.connected())
-  {
-    Log.info("Attempting MQTT connection...");
-
-    // Create a random client ID
-    String clientId = "ESP8266Client-LedStrip-";
-    clientId += String(config.roomName);
-    clientId += "-";
-    clientId += String(config.deviceSerialNumber);
-
-    // Attempt to connect
-    if (client.connect(clientId.c_str(), MQTT_USERNAME, MQTT_PASSWORD, mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_AVAILABILITY), 1, true, MQTT_PAYLOAD_OFFLINE)) {
-      Log.info("connected");
-      client.subscribe(MQTT_TOPIC_HOMEASSISTANT_STATUS);
-      client.subscribe(MQTT_TOPIC_OTA_CHECK_UPDATE);
-      client.subscribe(mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_SUNRISE_SET));
-      client.subscribe(mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_STATE_SET));
-      client.subscribe(mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_RGB_SET));
-      client.subscribe(mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_UPDATE_COMMAND));
-      client.subscribe(Log.getMqttTopicLevel());
-      // Set device online
-      mqtt.publishMessage(mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_AVAILABILITY), MQTT_PAYLOAD_ONLINE, true);
-      mqtt.publishMessageSwitchSuriseConfig();
-      mqtt.publishMessageLightConfig();
-      mqtt.publishMessageUpdateConfig();
-      mqtt.publishMessageSensorRssiConfig();
-    }
-    else {
-      Log.warning("failed, rc=%d try again in 5 seconds", client.state());
-      // Wait 5 seconds before retrying
-      delay(5000);
+  static bool firstAttempt = true;
+  static unsigned long lastAttemptMs = 0;
+
+  if (client.connected() || (!firstAttempt && millis() - lastAttemptMs < MQTT_RECONNECT_PERIOD_MS)) {
+    return;
+  }
+  firstAttempt = false;
+  lastAttemptMs = millis();
+
+  Log.info("Attempting MQTT connection...");
+
+  // Create a random client ID
+  String clientId = "ESP8266Client-LedStrip-";
+  clientId += String(config.roomName);
+  clientId += "-";
+  clientId += String(config.deviceSerialNumber);
+
+  // Attempt to connect
+  if (client.connect(clientId.c_str(), MQTT_USERNAME, MQTT_PASSWORD, mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_AVAILABILITY), 1, true, MQTT_PAYLOAD_OFFLINE)) {
+    Log.info("connected");
+    client.subscribe(MQTT_TOPIC_HOMEASSISTANT_STATUS);
+    client.subscribe(MQTT_TOPIC_OTA_CHECK_UPDATE);
+    client.subscribe(mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_SUNRISE_SET));
+    client.subscribe(mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_ALARM_SET));
+    client.subscribe(mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_SCENE_SET));
+    client.subscribe(mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_SCENE_UPLOAD));
+    for (uint8_t s=0; s<gLedSegmentCount; s++) {
+      client.subscribe(mqtt.getSegmentTopic(s, MQTT_TOPIC_LED_SUFFIX_STATE_SET));
+      client.subscribe(mqtt.getSegmentTopic(s, MQTT_TOPIC_LED_SUFFIX_RGB_SET));
+      client.subscribe(mqtt.getSegmentTopic(s, MQTT_TOPIC_LED_SUFFIX_EFFECT_SET));
     }
+    client.subscribe(mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_TRANSITION_SET));
+    client.subscribe(mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_UPDATE_COMMAND));
+    client.subscribe(mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_DIAG_PING));
+    client.subscribe(mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_CONFIG_SET));
+    client.subscribe(Log.getMqttTopicLevel());
+    // Set device online
+    mqtt.publishMessage(mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_AVAILABILITY), MQTT_PAYLOAD_ONLINE, true);
+    mqtt.clearDiscoveryConfigs();
+    publishDiscovery();
+    publishConfig();
+    // With the states changed while offline
+    mqtt.publishSnapshot();
+  }
+  else {
+    Log.warning("failed, rc=%d try again in %d seconds", client.state(), MQTT_RECONNECT_PERIOD_MS / 1000);
+  }
+}
+
+// Only the configs changed since the last send are published
+void publishDiscovery() {
+  mqtt.publishMessageSwitchSuriseConfig();
+  for (uint8_t s=0; s<gLedSegmentCount; s++) {
+    mqtt.publishMessageLightConfig(s);
+  }
+  mqtt.publishMessageUpdateConfig();
+  mqtt.publishMessageSensorRssiConfig();
+  mqtt.publishMessageNumberTransitionConfig();
+  mqtt.publishMessageSensorNextAlarmConfig();
+  for (uint8_t id=0; id<LED_SCENE_MAX; id++) {
+    mqtt.publishMessageSceneConfig(id, config.ledScenes[id]);
+  }
+}
+
+// Home Assistant restarted, the burst is sent after the jitter of the device
+void snapshotLoop() {
+  if (mqtt.isSnapshotDue(millis()) && client.connected()) {
+    publishDiscovery();
+    mqtt.publishSnapshot();
   }
 }
 
@@ -128,9 +254,17 @@ void setup() {
   Serial.println("Starting LedStripLight2...");
 
   // Read NVM
-  EEPROM.begin(sizeof(NVMConfig));
-  EEPROM.get(0x00, config);
-  EEPROM.end();
+  if (configStore.begin()) {
+    if (configStore.getVersion() < CONFIG_VERSION) {
+      migrateNvmConfig();
+    }
+    loadNvmConfig();
+  }
+  else {
+    // Without FS area in the flash layout, nothing can be saved
+    Log.error("No flash sector for the NVM config store");
+    readEepromConfig();
+  }
 
   Log.setup(&client, config.roomName, "led");
 
@@ -139,42 +273,233 @@ void setup() {
   Log.info("Serial number: %d\n", config.deviceSerialNumber);
   Log.info("Room name: %s\n", config.roomName);
 
+  setupLedSegments();
+
+  // Last state before the WiFi and Home Assistant, from the RTC memory after a reset or
+  // an OTA update, else from the flash copy. The strip keeps its frame through a reset
+  // until the first one sent.
+  frame.begin();
+  LedState state;
+  if (savedState.load(state)) {
+    restoreLedState(state);
+    Log.info("LED state restored from RTC memory at %lu ms", millis());
+  }
+  else {
+    if (configStore.get(CONFIG_KEY_LED_STATE, state)) {
+      restoreLedState(state);
+      Log.info("LED state restored from flash at %lu ms", millis());
+    }
+    savedState.setSaved(getLedState());
+  }
+
   setup_wifi();
+  configTime(TIME_ZONE, NTP_SERVER);
   randomSeed(micros());
   mqtt.setup(config.roomName, config.deviceSerialNumber, VERSION, WiFi.macAddress().c_str());
+
+  // First states of the snapshot, sent once connected
+  publishLedState();
+  mqtt.publishMessage(mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_TRANSITION), gLedTransitionMs / 1000.f);
+  mqtt.publishMessage(mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_ALARM), config.sunriseAlarms);
+  setSunriseState(STATE_OFF);
+
   setup_mqtt();
 
   delay(1000);
+}
 
-  // LED
-  leds.begin();
-  leds.clear();
+void setupLedSegments() {
+  uint16_t first = 0;
 
-  // Init
-  setSunriseState(STATE_OFF);
+  gLedSegmentCount = config.ledSegmentCount;
+  if (gLedSegmentCount == 0 || gLedSegmentCount > LED_SEGMENT_MAX) {
+    gLedSegmentCount = 1;
+  }
+
+  for (uint8_t s=0; s<gLedSegmentCount; s++) {
+    LedSegment &segment = gLedSegments[s];
+    uint16_t count = config.ledSegmentLength[s];
+    if (s == gLedSegmentCount - 1 || first + count > LED_NUM) {
+      count = LED_NUM - first;
+    }
+    segment.first = first;
+    segment.count = count;
+    segment.state = STATE_UNKNOWN;
+    segment.effect = LED_EFFECT_NONE;
+    segment.prevState = STATE_OFF;
+    segment.prevEffect = LED_EFFECT_NONE;
+    segment.effects.setLedNum(count);
+    first += count;
+    Log.info("LED segment %u: first=%u, count=%u", s + 1, segment.first, segment.count);
+  }
 }
 
-void setLedWS2812(uint8_t r, uint8_t g, uint8_t b) {
-  for (int i=0; i<LED_NUM; i++){
-    leds.setPixelColor(i, r, g, b);
+LedState getLedState() {
+  LedState state = {};
+
+  for (uint8_t s=0; s<gLedSegmentCount; s++) {
+    const LedSegment &segment = gLedSegments[s];
+    LedSegmentState &saved = state.segments[s];
+    saved.state = segment.effect == LED_EFFECT_SUNSET ? STATE_OFF : segment.state;
+    saved.red = segment.red;
+    saved.green = segment.green;
+    saved.blue = segment.blue;
+    saved.effect = segment.effect == LED_EFFECT_SUNRISE || segment.effect == LED_EFFECT_SUNSET ? LED_EFFECT_NONE : segment.effect;
   }
-  leds.show();
+  return state;
 }
 
-void setLedColorRGB(uint8_t red, uint8_t green, uint8_t blue) {
-  static uint8_t prevRed = 0;
-  static uint8_t prevGreen = 0;
-  static uint8_t prevBlue = 0;
+// First frame, before the network is up: nothing is published and there is no fade
+void restoreLedState(const LedState &state) {
+  for (uint8_t s=0; s<gLedSegmentCount; s++) {
+    LedSegment &segment = gLedSegments[s];
+    const LedSegmentState &saved = state.segments[s];
+    if (saved.state != STATE_ON && saved.state != STATE_OFF) {
+      continue;
+    }
+    segment.state = (State)saved.state;
+    segment.prevState = segment.state;
+    segment.red = saved.red;
+    segment.green = saved.green;
+    segment.blue = saved.blue;
+    segment.effect = saved.effect == LED_EFFECT_COLORLOOP || saved.effect == LED_EFFECT_RAINBOW ? (LedEffect)saved.effect : LED_EFFECT_NONE;
+    segment.prevEffect = segment.effect;
 
-  if (prevRed != red || prevGreen != green || prevBlue != blue) {
-    Log.info("Setting LED color to > r: %u  g: %u  b: %u\n", red, green, blue);
+    if (segment.state == STATE_ON && segment.effect != LED_EFFECT_NONE) {
+      startLedEffect(s, segment.effect);
+    } else {
+      // ledSegmentLoop() then sees the color as applied
+      segment.appliedRed = segment.state == STATE_ON ? segment.red : 0;
+      segment.appliedGreen = segment.state == STATE_ON ? segment.green : 0;
+      segment.appliedBlue = segment.state == STATE_ON ? segment.blue : 0;
+      segment.colorApplied = true;
+      segment.effects.setColor(ledGamma(segment.appliedRed, segment.appliedGreen, segment.appliedBlue), 0);
+    }
+  }
+  ledEffectsLoop();
+  frame.show();
+}
 
-    setLedWS2812(red, green, blue);
-    mqtt.publishMessage(mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_RGB), red, green, blue);
+// State restored at boot, a segment without state is left unknown
+void publishLedState() {
+  for (uint8_t s=0; s<gLedSegmentCount; s++) {
+    const LedSegment &segment = gLedSegments[s];
+    if (segment.state == STATE_UNKNOWN) {
+      continue;
+    }
+    mqtt.publishMessage(mqtt.getSegmentTopic(s, MQTT_TOPIC_LED_SUFFIX_STATE), segment.state);
+    mqtt.publishMessage(mqtt.getSegmentTopic(s, MQTT_TOPIC_LED_SUFFIX_RGB), segment.red, segment.green, segment.blue);
+    mqtt.publishMessage(mqtt.getSegmentTopic(s, MQTT_TOPIC_LED_SUFFIX_EFFECT), segment.effect);
+  }
+}
 
-    prevRed = red;
-    prevGreen = green;
-    prevBlue = blue;
+// RTC memory on each change, flash copy once the state is settled
+void ledStateLoop() {
+  LedState state = getLedState();
+
+  savedState.update(state, millis());
+  if (savedState.isSaveDue(millis())) {
+    Log.info("Save LED state");
+    saveNvmConfig(CONFIG_KEY_LED_STATE, &state, sizeof(state));
+    savedState.setSaved(state);
+  }
+}
+
+// All the segments share the frame, so they are sent with a single show()
+void renderLedFrame() {
+  dither.beginFrame(LED_DITHER_TEMPORAL_HZ != 0);
+  for (uint8_t s=0; s<gLedSegmentCount; s++) {
+    const LedSegment &segment = gLedSegments[s];
+    for (uint16_t i=0; i<segment.count; i++) {
+      LedColor8 pixel = dither.pixel(segment.effects.pixel(i));
+      frame.setPixel(segment.first + i, pixel.r, pixel.g, pixel.b);
+    }
+  }
+  gLedFrameTimeMs = millis();
+}
+
+void logLedFrameStats() {
+  Log.info("LED frames: count=%u, compute avg=%u us, max=%u us, over budget=%u", ledFrameStats.count,
+           ledFrameStats.count ? (uint32_t)(ledFrameStats.sumUs / ledFrameStats.count) : 0, ledFrameStats.maxUs, ledFrameStats.overBudget);
+  ledFrameStats = {};
+}
+
+void ledEffectsLoop() {
+  unsigned long start = micros();
+  unsigned long now = millis();
+  bool changed = false;
+
+  for (uint8_t s=0; s<gLedSegmentCount; s++) {
+    changed |= gLedSegments[s].effects.update(now);
+  }
+  if (!changed) {
+    return;
+  }
+  renderLedFrame();
+
+  uint32_t duration = micros() - start;
+  ledFrameStats.count++;
+  ledFrameStats.sumUs += duration;
+  if (duration > ledFrameStats.maxUs) {
+    ledFrameStats.maxUs = duration;
+  }
+  if (duration > LED_EFFECT_FRAME_BUDGET_US) {
+    ledFrameStats.overBudget++;
+  }
+}
+
+bool isLedAnimationRunning() {
+  for (uint8_t s=0; s<gLedSegmentCount; s++) {
+    if (!gLedSegments[s].effects.isFinished()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void ledDiagLoop() {
+  static unsigned long prevMs = 0;
+  static LedFrameBuffer::Stats prevStats = {};
+  unsigned long now = millis();
+
+  if (now - prevMs < LED_DIAG_PERIOD_MS) {
+    return;
+  }
+
+  // Report only while an animation runs, the strip is idle otherwise
+  if (isLedAnimationRunning()) {
+    const LedFrameBuffer::Stats& stats = frame.getStats();
+    uint32_t shows = stats.showCount - prevStats.showCount;
+    uint32_t fps10 = shows * 10000 / (now - prevMs);
+    Log.info("LED output %s: %u.%u fps, show avg=%u us, delayed=%u, busy=%u, MQTT round-trip=%ld ms", LedOutput::NAME,
+             fps10 / 10, fps10 % 10, shows ? (stats.showTimeUs - prevStats.showTimeUs) / shows : 0,
+             stats.delayCount - prevStats.delayCount, stats.busyCount - prevStats.busyCount, gMqttRoundTripMs);
+
+    // Measured when the message comes back from the broker, reported next time
+    char payload[24];
+    snprintf(payload, sizeof(payload), "%lu", now);
+    gMqttRoundTripMs = -1;
+    mqtt.publishMessage(mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_DIAG_PING), payload);
+  }
+
+  prevMs = now;
+  prevStats = frame.getStats();
+}
+
+void setLedColorRGB(uint8_t s, uint8_t red, uint8_t green, uint8_t blue) {
+  LedSegment &segment = gLedSegments[s];
+
+  if (!segment.colorApplied || segment.appliedRed != red || segment.appliedGreen != green || segment.appliedBlue != blue) {
+    Log.info("Setting LED %u color to > r: %u  g: %u  b: %u\n", s + 1, red, green, blue);
+
+    segment.effects.setColor(ledGamma(red, green, blue), gLedTransitionMs);
+    commandLatency.mark(COMMAND_STAGE_APPLIED);
+    mqtt.publishMessage(mqtt.getSegmentTopic(s, MQTT_TOPIC_LED_SUFFIX_RGB), red, green, blue);
+
+    segment.appliedRed = red;
+    segment.appliedGreen = green;
+    segment.appliedBlue = blue;
+    segment.colorApplied = true;
   }
 }
 
@@ -184,80 +509,92 @@ void setSunriseState(enum State state) {
   mqtt.publishMessage(mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_SUNRISE), gSunriseState);
 }
 
-void setLedState(enum State state) {
-  gLedState = state;
-  Log.info("Set Switch LED Mode to %s", getMqttPayload(gLedState));
-  mqtt.publishMessage(mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_STATE), gLedState);
+void setLedState(uint8_t s, enum State state) {
+  gLedSegments[s].state = state;
+  Log.info("Set Switch LED %u Mode to %s", s + 1, getMqttPayload(state));
+  mqtt.publishMessage(mqtt.getSegmentTopic(s, MQTT_TOPIC_LED_SUFFIX_STATE), state);
+  gLedSegments[s].prevState = state;
 }
 
-/**
- * Calculates a smooth sunrise coefficient using a cosine S-curve 
- * combined with gamma correction for human eye perception.
- * * @param progression: A value from 0.0 (start) to 1.0 (end).
- * @return: A normalized intensity coefficient between 0.0 and 1.0.
- */
-float getSunriseIntensity(float progress) {
-  // Constrain input to ensure it stays within the [0.0, 1.0] range
-  if (progress < 0.0) progress = 0.0;
-  if (progress > 1.0) progress = 1.0;
-
-  // Only first part of the curbe is used
-  progress = progress / 2;
+void startLedEffect(uint8_t s, LedEffect effect) {
+  LedSegment &segment = gLedSegments[s];
+  LedColor16 color = ledGamma(segment.red, segment.green, segment.blue);
+  if (segment.red == 0 && segment.green == 0 && segment.blue == 0) {
+    color = ledGamma(255, 255, 255);
+  }
 
-  // 1. Cosine curve: Creates a smooth S-curve (Ease-in-Out) 
-  // to prevent abrupt speed changes at the start and end.
-  float cosinus = 0.5 * (1.0 - cos(progress * PI));
-  
-  // 2. Gamma Correction: Adjusts the linear signal to match 
-  // the non-linear human perception of brightness.
-  return pow(cosinus, 2.2) * 2;
+  Log.info("LED %u effect %s started", s + 1, getMqttPayload(effect));
+  segment.effects.setEffect(effect, sunriseDurationTimeMs, color);
+  segment.colorApplied = false;
+  commandLatency.mark(COMMAND_STAGE_APPLIED);
+  logLedFrameStats();
 }
 
+// The sunrise runs on all the segments with the same timing, the first one gives the progress
 void ledSunriseLoop() {
-  unsigned long currentTime = millis();
-  float progress = (float)(currentTime-sunriseStartTimeMs) / (float)sunriseDurationTimeMs;
-  float sunrise_intensity = getSunriseIntensity(progress);
-  uint32_t pixels_active = SUNRISE_PIXELS_NB * sunrise_intensity;
-  uint16_t level = pixels_active / LED_NUM;
-  uint16_t leds_in_level = pixels_active % LED_NUM;
+  const LedEffects &effects = gLedSegments[0].effects;
+  uint8_t level = effects.getColor().r >> 8;
 
-  if (progress > 1.0) {
+  if (effects.isFinished()) {
+    const LedFrameBuffer::Stats& stats = frame.getStats();
     Log.info("SUNRISE finish");
+    Log.info("SUNRISE frames: show=%u, delayed=%u, interrupts off=%u ms", stats.showCount, stats.delayCount, stats.showTimeUs / 1000);
+    logLedFrameStats();
+    frame.setFramePeriodMs(LED_FRAME_PERIOD_MIN_MS);
     setSunriseState(STATE_OFF);
-    setLedColorRGB(SUNRISE_BRIGHTNESS_MAX, SUNRISE_BRIGHTNESS_MAX, SUNRISE_BRIGHTNESS_MAX);
+    for (uint8_t s=0; s<gLedSegmentCount; s++) {
+      LedSegment &segment = gLedSegments[s];
+      segment.effect = LED_EFFECT_NONE;
+      segment.red = SUNRISE_BRIGHTNESS_MAX;
+      segment.green = SUNRISE_BRIGHTNESS_MAX;
+      segment.blue = SUNRISE_BRIGHTNESS_MAX;
+      setLedColorRGB(s, segment.red, segment.green, segment.blue);
+    }
     return;
   }
 
-  if (level != sunriseCurrentLevel || leds_in_level != sunriseCurrentLedsInLevel) {
-    Log.debug("> SUNRISE: progress=%f, sunrise_intensity=%f, pixels_active=%d, level=%d, leds_next_level=%d", progress, sunrise_intensity, pixels_active, level, leds_in_level);
-  
-    for (int i=0; i<LED_NUM; i++) {
-      if (i < leds_in_level) {
-        leds.setPixelColor(i, level+1, level+1, level+1);
-      } else {
-        leds.setPixelColor(i, level, level, level);
-      }
+  if (level != sunriseCurrentLevel) {
+    Log.debug("> SUNRISE: value=%u/256", effects.getColor().r);
+    for (uint8_t s=0; s<gLedSegmentCount; s++) {
+      LedSegment &segment = gLedSegments[s];
+      segment.red = level;
+      segment.green = level;
+      segment.blue = level;
+      mqtt.publishMessage(mqtt.getSegmentTopic(s, MQTT_TOPIC_LED_SUFFIX_RGB), segment.red, segment.green, segment.blue);
     }
-    leds.show();
+    sunriseCurrentLevel = level;
+  }
+}
 
-    if (level != sunriseCurrentLevel) {
-      gLedRed = level;
-      gLedGreen = level;
-      gLedBlue = level;
-      mqtt.publishMessage(mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_RGB), gLedRed, gLedGreen, gLedBlue);
+void ledSegmentLoop(uint8_t s) {
+  LedSegment &segment = gLedSegments[s];
+
+  if (segment.state == STATE_ON && segment.effect != LED_EFFECT_NONE) {
+    if (segment.effects.getEffect() != segment.effect) {
+      startLedEffect(s, segment.effect);
+    } else if (segment.effect == LED_EFFECT_SUNSET && segment.effects.isFinished()) {
+      Log.info("Sunset %u finish", s + 1);
+      logLedFrameStats();
+      segment.effect = LED_EFFECT_NONE;
+      setLedState(s, STATE_OFF);
     }
-    sunriseCurrentLevel = level;
-    sunriseCurrentLedsInLevel = leds_in_level;
+  } else if (segment.state == STATE_ON) {
+    setLedColorRGB(s, segment.red, segment.green, segment.blue);
+  } else {
+    setLedColorRGB(s, 0, 0, 0);
   }
 }
 
 void ledColorLoop() {
-  static State prevLedState = STATE_OFF;
   static State prevSunriseState = STATE_OFF;
 
-  if (gLedState != prevLedState) {
-    Log.info("LED %s", getMqttPayload(gLedState));
-    mqtt.publishMessage(mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_STATE), gLedState);
+  for (uint8_t s=0; s<gLedSegmentCount; s++) {
+    LedSegment &segment = gLedSegments[s];
+    if (segment.state != segment.prevState) {
+      Log.info("LED %u %s", s + 1, getMqttPayload(segment.state));
+      mqtt.publishMessage(mqtt.getSegmentTopic(s, MQTT_TOPIC_LED_SUFFIX_STATE), segment.state);
+      segment.prevState = segment.state;
+    }
   }
 
   if (prevSunriseState != gSunriseState) {
@@ -268,26 +605,357 @@ void ledColorLoop() {
   if (gSunriseState == STATE_ON) {
     if (prevSunriseState == STATE_OFF) { // Sunrise started
       Log.info("Sunrise mode started");
-      setLedColorRGB(0, 0, 0);
-      setLedState(STATE_ON);
-      sunriseStartTimeMs = millis();
       sunriseCurrentLevel = 0;
-      sunriseCurrentLedsInLevel = 0;
+      frame.setFramePeriodMs(SUNRISE_FRAME_PERIOD_MS);
+      frame.resetStats();
+      logLedFrameStats();
+      for (uint8_t s=0; s<gLedSegmentCount; s++) {
+        LedSegment &segment = gLedSegments[s];
+        setLedState(s, STATE_ON);
+        segment.effect = LED_EFFECT_SUNRISE;
+        segment.colorApplied = false;
+        segment.effects.setEffect(LED_EFFECT_SUNRISE, sunriseDurationTimeMs, {SUNRISE_BRIGHTNESS_MAX << 8, SUNRISE_BRIGHTNESS_MAX << 8, SUNRISE_BRIGHTNESS_MAX << 8});
+      }
     } else { // Mode surise active
       ledSunriseLoop();
     }
   } else {
-    if (gLedState == STATE_ON) {
-      setLedColorRGB(gLedRed, gLedGreen, gLedBlue);
-    } else {
-      setLedColorRGB(0, 0, 0);
+    if (prevSunriseState == STATE_ON) { // Sunrise stopped
+      frame.setFramePeriodMs(LED_FRAME_PERIOD_MIN_MS);
+      for (uint8_t s=0; s<gLedSegmentCount; s++) {
+        if (gLedSegments[s].effect == LED_EFFECT_SUNRISE) {
+          gLedSegments[s].effect = LED_EFFECT_NONE;
+        }
+      }
+    }
+    for (uint8_t s=0; s<gLedSegmentCount; s++) {
+      ledSegmentLoop(s);
     }
   }
 
-  prevLedState = gLedState;
+  for (uint8_t s=0; s<gLedSegmentCount; s++) {
+    LedSegment &segment = gLedSegments[s];
+    if (segment.effect != segment.prevEffect) {
+      Log.info("LED %u effect %s", s + 1, getMqttPayload(segment.effect));
+      mqtt.publishMessage(mqtt.getSegmentTopic(s, MQTT_TOPIC_LED_SUFFIX_EFFECT), segment.effect);
+      segment.prevEffect = segment.effect;
+    }
+  }
+
+  ledEffectsLoop();
+
+#if LED_DITHER_TEMPORAL_HZ
+  // Move the dithering pattern at a fixed rate
+  if (dither.isFractional() && millis() - gLedFrameTimeMs >= 1000 / LED_DITHER_TEMPORAL_HZ) {
+    renderLedFrame();
+  }
+#endif
+
+  // Send the frame if it changed, or pending frame delayed by the frame rate cap
+  if (frame.show() && commandLatency.mark(COMMAND_STAGE_OUTPUT)) {
+    Log.debug("Command latency: dispatch=%u us, applied=%u us, output=%u us", commandLatency.getLastUs(COMMAND_STAGE_DISPATCH),
+              commandLatency.getLastUs(COMMAND_STAGE_APPLIED), commandLatency.getLastUs(COMMAND_STAGE_OUTPUT));
+  }
+
+  ledDiagLoop();
+
   prevSunriseState = gSunriseState;
 }
 
+// Config of the firmwares before the NVM config store, the other values as in a blank EEPROM
+void readEepromConfig() {
+  EepromConfig eeprom;
+  EEPROM.begin(sizeof(eeprom));
+  EEPROM.get(0x00, eeprom);
+  EEPROM.end();
+  memset(&config, 0xFF, sizeof(config));
+  config.sensorTemperatureOffset = eeprom.sensorTemperatureOffset;
+  config.sensorHumidityOffset = eeprom.sensorHumidityOffset;
+  config.deviceSerialNumber = eeprom.deviceSerialNumber;
+  memcpy(config.roomName, eeprom.roomName, sizeof(config.roomName));
+}
+
+// Imported in a single commit, the values of a blank EEPROM keep their meaning. The
+// keys added since then are left missing, they read as in a blank EEPROM. Nothing is
+// written if a key is not staged, the import runs again on the next boot.
+void migrateNvmConfig() {
+  Log.info("Migrate NVM config from EEPROM");
+  readEepromConfig();
+  bool ok = configStore.set(CONFIG_KEY_SENSOR_TEMPERATURE_OFFSET, config.sensorTemperatureOffset);
+  ok &= configStore.set(CONFIG_KEY_SENSOR_HUMIDITY_OFFSET, config.sensorHumidityOffset);
+  ok &= configStore.set(CONFIG_KEY_DEVICE_SERIAL_NUMBER, config.deviceSerialNumber);
+  ok &= configStore.set(CONFIG_KEY_ROOM_NAME, config.roomName);
+  ok &= configStore.set(CONFIG_KEY_VERSION, CONFIG_VERSION);
+  if (!ok) {
+    configStore.abort();
+  }
+  if (!ok || !configStore.commit()) {
+    Log.error("Failed to migrate NVM config");
+  }
+}
+
+// A missing key reads as in a blank EEPROM
+void loadNvmConfig() {
+  memset(&config, 0xFF, sizeof(config));
+  configStore.get(CONFIG_KEY_SENSOR_TEMPERATURE_OFFSET, config.sensorTemperatureOffset);
+  configStore.get(CONFIG_KEY_SENSOR_HUMIDITY_OFFSET, config.sensorHumidityOffset);
+  configStore.get(CONFIG_KEY_DEVICE_SERIAL_NUMBER, config.deviceSerialNumber);
+  configStore.get(CONFIG_KEY_ROOM_NAME, config.roomName);
+  configStore.get(CONFIG_KEY_LED_SEGMENT_COUNT, config.ledSegmentCount);
+  configStore.get(CONFIG_KEY_LED_SEGMENT_LENGTH, config.ledSegmentLength);
+  configStore.get(CONFIG_KEY_SUNRISE_ALARMS, config.sunriseAlarms);
+  configStore.get(CONFIG_KEY_LED_SCENES, config.ledScenes);
+}
+
+// Write one value of the NVM config, the rest is kept
+void saveNvmConfig(uint8_t key, const void* data, uint8_t size) {
+  if (!configStore.set(key, data, size)) {
+    configStore.abort();
+    Log.error("Failed to save NVM config");
+    return;
+  }
+  if (!configStore.commit()) {
+    Log.error("Failed to save NVM config");
+  }
+}
+
+void setSunriseAlarms(const SunriseAlarm* alarms) {
+  // The flash is only written on change, a retained message comes back on each reconnection
+  if (memcmp(config.sunriseAlarms, alarms, sizeof(config.sunriseAlarms)) != 0) {
+    memcpy(config.sunriseAlarms, alarms, sizeof(config.sunriseAlarms));
+    saveNvmConfig(CONFIG_KEY_SUNRISE_ALARMS, config.sunriseAlarms, sizeof(config.sunriseAlarms));
+    Log.info("Sunrise alarms saved");
+  }
+  mqtt.publishMessage(mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_ALARM), config.sunriseAlarms);
+  gSunriseAlarmChanged = true;
+}
+
+// Runs from the local clock, an alarm doesn't need the network once the time is synced
+void sunriseAlarmLoop() {
+  time_t now = time(nullptr);
+  if (now < SUNRISE_ALARM_TIME_VALID_MIN) {
+    return; // Waiting for NTP
+  }
+
+  if (gSunriseNextAlarm != 0 && now >= gSunriseNextAlarm) {
+    if (now - gSunriseNextAlarm <= SUNRISE_ALARM_LATE_MAX_S) {
+      Log.info("Sunrise alarm");
+      gSunriseState = STATE_ON;
+    } else {
+      Log.warning("Sunrise alarm skipped, late by %ld s", (long)(now - gSunriseNextAlarm));
+    }
+    gSunriseAlarmChanged = true;
+  }
+
+  if (gSunriseAlarmChanged) {
+    gSunriseNextAlarm = getNextSunriseAlarm(config.sunriseAlarms, SUNRISE_ALARM_MAX, now);
+    mqtt.publishMessageTimestamp(mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_SENSOR_NEXT_ALARM), gSunriseNextAlarm);
+    gSunriseAlarmChanged = false;
+  }
+}
+
+// All the segments are set before the next frame, the scene is shown at once. The
+// transition is the fade of a solid color or off scene, an effect starts at once.
+void applyLedScene(uint8_t id) {
+  const LedScene &scene = config.ledScenes[id];
+  unsigned long transitionMs = scene.transitionDs * 100UL;
+
+  Log.info("Apply scene %u", id);
+  if (scene.effect == LED_EFFECT_SUNRISE) {
+    gSunriseState = STATE_ON;
+    return;
+  }
+  gSunriseState = STATE_OFF;
+
+  for (uint8_t s=0; s<gLedSegmentCount; s++) {
+    LedSegment &segment = gLedSegments[s];
+    segment.state = scene.brightness ? STATE_ON : STATE_OFF;
+    segment.red = scene.red * scene.brightness / 255;
+    segment.green = scene.green * scene.brightness / 255;
+    segment.blue = scene.blue * scene.brightness / 255;
+    segment.effect = (LedEffect)scene.effect;
+
+    // Fade with the scene transition, ledSegmentLoop() then sees the color as applied
+    if (segment.effect == LED_EFFECT_NONE || segment.state == STATE_OFF) {
+      segment.effect = LED_EFFECT_NONE;
+      segment.appliedRed = segment.state == STATE_ON ? segment.red : 0;
+      segment.appliedGreen = segment.state == STATE_ON ? segment.green : 0;
+      segment.appliedBlue = segment.state == STATE_ON ? segment.blue : 0;
+      segment.colorApplied = true;
+      segment.effects.setColor(ledGamma(segment.appliedRed, segment.appliedGreen, segment.appliedBlue), transitionMs);
+    }
+    else {
+      // Restarted even if the segment runs the same effect, it takes the scene color
+      startLedEffect(s, segment.effect);
+    }
+    mqtt.publishMessage(mqtt.getSegmentTopic(s, MQTT_TOPIC_LED_SUFFIX_RGB), segment.red, segment.green, segment.blue);
+  }
+}
+
+// Used in the MQTT topics and the WiFi hostname
+bool isRoomNameValid(const char* name) {
+  size_t len = strlen(name);
+
+  if (len == 0 || len >= sizeof(config.roomName)) {
+    return false;
+  }
+  for (size_t i=0; i<len; i++) {
+    if (!isalnum(name[i]) && name[i] != '_' && name[i] != '-') {
+      return false;
+    }
+  }
+  return true;
+}
+
+void publishConfig() {
+  StaticJsonDocument<CONFIG_JSON_SIZE> json;
+  char payload[CONFIG_JSON_SIZE];
+
+  json["serial_number"] = config.deviceSerialNumber;
+  json["room_name"] = config.roomName;
+  JsonArray segments = json.createNestedArray("led_segments");
+  for (uint8_t s=0; s<gLedSegmentCount; s++) {
+    segments.add(gLedSegments[s].count);
+  }
+  serializeJson(json, payload, sizeof(payload));
+  mqtt.publishMessage(mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_CONFIG), payload, true);
+}
+
+// Apply any keys of /config in a single NVM commit, nothing if a value is invalid. They
+// are all in the MQTT topics or the Home Assistant entities, the device restarts.
+void setConfig(const uint8_t* payload, unsigned int len) {
+  StaticJsonDocument<CONFIG_JSON_SIZE> json;
+  struct NVMConfig next = config;
+  bool valid = true;
+
+  DeserializationError error = deserializeJson(json, payload, len);
+  if (error) {
+    Log.error("Config JSON error: %s", error.f_str());
+    return;
+  }
+
+  if (json.containsKey("serial_number")) {
+    next.deviceSerialNumber = json["serial_number"].as<uint32_t>();
+    valid &= json["serial_number"].is<uint32_t>() && next.deviceSerialNumber > 0;
+  }
+  if (json.containsKey("room_name")) {
+    const char* name = json["room_name"];
+    valid &= name != nullptr && isRoomNameValid(name);
+    if (valid) {
+      memset(next.roomName, 0, sizeof(next.roomName));
+      strncpy(next.roomName, name, sizeof(next.roomName) - 1);
+    }
+  }
+  if (json.containsKey("led_segments")) {
+    // The last segment extends to the end of the strip
+    JsonArray segments = json["led_segments"].as<JsonArray>();
+    uint32_t total = 0;
+    valid &= !segments.isNull() && segments.size() > 0 && segments.size() <= LED_SEGMENT_MAX;
+    if (valid) {
+      memset(next.ledSegmentLength, 0, sizeof(next.ledSegmentLength));
+      next.ledSegmentCount = segments.size();
+      for (uint8_t s=0; s<next.ledSegmentCount; s++) {
+        long length = segments[s].as<long>();
+        valid &= segments[s].is<long>() && length > 0 && length <= LED_NUM;
+        next.ledSegmentLength[s] = length;
+        total += length;
+      }
+      valid &= total <= LED_NUM;
+    }
+  }
+  if (!valid) {
+    Log.warning("Invalid config, nothing applied");
+    return;
+  }
+
+  // A value not staged aborts the whole batch, the config is applied together or not at all
+  bool restart = false;
+  bool staged = true;
+  if (next.deviceSerialNumber != config.deviceSerialNumber) {
+    staged &= configStore.set(CONFIG_KEY_DEVICE_SERIAL_NUMBER, next.deviceSerialNumber);
+    restart = true;
+  }
+  if (memcmp(next.roomName, config.roomName, sizeof(config.roomName)) != 0) {
+    staged &= configStore.set(CONFIG_KEY_ROOM_NAME, next.roomName);
+    restart = true;
+  }
+  if (next.ledSegmentCount != config.ledSegmentCount ||
+      memcmp(next.ledSegmentLength, config.ledSegmentLength, sizeof(config.ledSegmentLength)) != 0) {
+    staged &= configStore.set(CONFIG_KEY_LED_SEGMENT_COUNT, next.ledSegmentCount);
+    staged &= configStore.set(CONFIG_KEY_LED_SEGMENT_LENGTH, next.ledSegmentLength);
+    restart = true;
+  }
+  if (!staged) {
+    configStore.abort();
+    Log.error("Failed to save NVM config");
+    return;
+  }
+  if (!configStore.commit()) {
+    Log.error("Failed to save NVM config");
+    return;
+  }
+  config = next;
+
+  if (restart) {
+    // Retained config of the previous topics cleared, the disconnect flushes it
+    // to the broker before the restart drops the connection
+    mqtt.publishMessage(mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_CONFIG), "", true);
+    Log.info("Restart with the new config");
+    client.disconnect();
+    ESP.restart();
+  }
+  else {
+    publishConfig();
+  }
+}
+
+void setLedScenes(const uint8_t* payload, unsigned int len) {
+  if (!setLedScenesFromPayload(payload, len, config.ledScenes)) {
+    Log.warning("Invalid scene upload");
+    return;
+  }
+  saveNvmConfig(CONFIG_KEY_LED_SCENES, config.ledScenes, sizeof(config.ledScenes));
+  Log.info("%u scenes saved", len / LED_SCENE_RECORD_SIZE);
+  for (unsigned int i=0; i<len; i+=LED_SCENE_RECORD_SIZE) {
+    mqtt.publishMessageSceneConfig(payload[i], config.ledScenes[payload[i]]);
+  }
+}
+
+bool ledSegmentCallback(const char* topic, const char* payload, unsigned int len) {
+  for (uint8_t s=0; s<gLedSegmentCount; s++) {
+    LedSegment &segment = gLedSegments[s];
+
+    if (isTopicEqual(topic, mqtt.getSegmentTopic(s, MQTT_TOPIC_LED_SUFFIX_STATE_SET))) {
+      commandLatency.mark(COMMAND_STAGE_DISPATCH);
+      segment.state = getStateFromMqttPayload(payload, len);
+      gSunriseState = STATE_OFF;
+      return true;
+    }
+    else if (isTopicEqual(topic, mqtt.getSegmentTopic(s, MQTT_TOPIC_LED_SUFFIX_RGB_SET))) {
+      commandLatency.mark(COMMAND_STAGE_DISPATCH);
+      getMqttPayload(payload, len, &segment.red, &segment.green, &segment.blue);
+      gSunriseState = STATE_OFF;
+      segment.effect = LED_EFFECT_NONE;
+      return true;
+    }
+    else if (isTopicEqual(topic, mqtt.getSegmentTopic(s, MQTT_TOPIC_LED_SUFFIX_EFFECT_SET))) {
+      commandLatency.mark(COMMAND_STAGE_DISPATCH);
+      LedEffect effect = getEffectFromMqttPayload(payload, len);
+      if (effect == LED_EFFECT_UNKNOWN) {
+        Log.warning("Unknown LED effect");
+      } else if (effect == LED_EFFECT_SUNRISE) {
+        // The sunrise is for the whole strip
+        gSunriseState = STATE_ON;
+      } else {
+        segment.effect = effect;
+        gSunriseState = STATE_OFF;
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
 void mqtt_callback(char* t, byte* p, unsigned int len) {
   // Copy to avoid conflic when mqtt log are sent from the callback
   char topic[MQTT_MSG_TOPIC_MAX_SIZE] = {};
@@ -295,23 +963,57 @@ void mqtt_callback(char* t, byte* p, unsigned int len) {
   strncpy(topic, t, MQTT_MSG_TOPIC_MAX_SIZE - 1);
   memcpy(payload, p, len);
 
+  commandLatency.arrival();
   Log.debug("Message arrived [%s] %s", topic, Log.getString(payload, len).c_str());
 
   if (isTopicEqual(topic, mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_SUNRISE_SET))) {
     gSunriseState = getStateFromMqttPayload((char*)payload, len);
   }
-  else if (isTopicEqual(topic, mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_STATE_SET))) {
-    gLedState = getStateFromMqttPayload((char*)payload, len);
-    gSunriseState = STATE_OFF;
+  else if (isTopicEqual(topic, mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_ALARM_SET))) {
+    SunriseAlarm alarms[SUNRISE_ALARM_MAX];
+    if (getSunriseAlarmsFromMqttPayload((char*)payload, len, alarms)) {
+      setSunriseAlarms(alarms);
+    } else {
+      Log.warning("Invalid sunrise alarms");
+    }
+  }
+  else if (isTopicEqual(topic, mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_SCENE_SET))) {
+    char *endptr = nullptr;
+    unsigned long id = strtoul((char*)payload, &endptr, 10);
+    if ((char*)payload == endptr || id >= LED_SCENE_MAX || !isLedSceneValid(config.ledScenes[id])) {
+      Log.warning("Invalid scene");
+    } else {
+      applyLedScene(id);
+    }
+  }
+  else if (isTopicEqual(topic, mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_SCENE_UPLOAD))) {
+    setLedScenes(payload, len);
   }
-  else if (isTopicEqual(topic, mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_RGB_SET))) {
-    getMqttPayload((char*)payload, len, &gLedRed, &gLedGreen, &gLedBlue);
-    gSunriseState = STATE_OFF;
+  else if (isTopicEqual(topic, mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_CONFIG_SET))) {
+    setConfig(payload, len);
+  }
+  else if (ledSegmentCallback(topic, (char*)payload, len)) {
+    // Segment light topics
+  }
+  else if (isTopicEqual(topic, mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_DIAG_PING))) {
+    gMqttRoundTripMs = millis() - strtoul((char*)payload, nullptr, 10);
+  }
+  else if (isTopicEqual(topic, mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_TRANSITION_SET))) {
+    char *endptr = nullptr;
+    float val = strtof((char*)payload, &endptr);
+    // NaN fails both comparisons
+    if ((char*)payload == endptr || !(val >= 0 && val <= MQTT_LED_TRANSITION_MAX_S)) {
+      Log.warning("Invalid transition value");
+    } else {
+      Log.info("Set transition to %f s", val);
+      gLedTransitionMs = val * 1000;
+      mqtt.publishMessage(mqtt.getLedTopic(MQTT_TOPIC_LED_SUFFIX_TRANSITION), val);
+    }
   }
   else if (isTopicEqual(topic, MQTT_TOPIC_HOMEASSISTANT_STATUS)) {
     if (isPayloadEqual<MQTT_PAYLOAD_ONLINE>((char*) payload, len)) {
       Log.info("Home Assistant is connected");
-      // Publish current state unkown if reboot
+      mqtt.scheduleSnapshot(millis(), random(MQTT_SNAPSHOT_JITTER_MAX_MS));
     }
   }
   else if (isTopicEqual(topic, MQTT_TOPIC_OTA_CHECK_UPDATE)) {
@@ -367,7 +1069,11 @@ void loop() {
   mqtt_reconnect();
   client.loop();
 
+  sunriseAlarmLoop();
+
   ledColorLoop();
+  ledStateLoop();
 
+  snapshotLoop();
   rssiRssi();
 }
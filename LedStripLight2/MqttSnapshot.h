@@ -0,0 +1,145 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Entity states of a device, the same file in each sketch.
+ *
+ * The snapshot keeps the last payload of each state topic, so all of them are sent
+ * again in one burst when Home Assistant restarts, or on a new broker connection for
+ * the changes made while offline. Each state keeps its retain flag: only the states
+ * Home Assistant needs before the next change are retained, not the telemetry. The
+ * burst after a Home Assistant restart waits a random delay up to
+ * MQTT_SNAPSHOT_JITTER_MAX_MS, so the devices don't all send at once.
+ *
+ * The states are kept in fixed buffers, nothing is allocated: a topic or a payload
+ * too long for them is not kept (the largest payload is the JSON of all the sunrise
+ * alarms, 477 bytes with all of them on every day).
+ *
+ * The discovery configs are only kept as a hash of their topic and content: one is
+ * sent again only if it changed since the last send on this broker connection.
+ */
+
+constexpr uint8_t MQTT_SNAPSHOT_STATE_MAX = 24;
+constexpr size_t MQTT_SNAPSHOT_TOPIC_SIZE = 64;
+constexpr size_t MQTT_SNAPSHOT_PAYLOAD_SIZE = 512;
+constexpr uint8_t MQTT_SNAPSHOT_CONFIG_MAX = 32;
+constexpr unsigned long MQTT_SNAPSHOT_JITTER_MAX_MS = 5000;
+
+class MqttSnapshot {
+public:
+  // Last payload of a state topic, return false if it can't be kept
+  bool setState(const char* topic, const char* payload, bool retain) {
+    size_t size = strlen(payload) + 1;
+    if (size > MQTT_SNAPSHOT_PAYLOAD_SIZE) {
+      return false;
+    }
+    State *state = findState(topic);
+    if (state == nullptr) {
+      size_t topicSize = strlen(topic) + 1;
+      if (mStateCount >= MQTT_SNAPSHOT_STATE_MAX || topicSize > MQTT_SNAPSHOT_TOPIC_SIZE) {
+        return false;
+      }
+      state = &mStates[mStateCount++];
+      memcpy(state->topic, topic, topicSize);
+    }
+    memcpy(state->payload, payload, size);
+    state->retain = retain;
+    return true;
+  }
+
+  uint8_t getStateCount() const {
+    return mStateCount;
+  }
+
+  const char* getStateTopic(uint8_t i) const {
+    return mStates[i].topic;
+  }
+
+  const char* getStatePayload(uint8_t i) const {
+    return mStates[i].payload;
+  }
+
+  bool getStateRetain(uint8_t i) const {
+    return mStates[i].retain;
+  }
+
+  // Return true if the config has to be sent, then the new content is taken as sent
+  bool isConfigChanged(const char* topic, const char* payload) {
+    uint32_t topicHash = getHash(topic);
+    uint32_t contentHash = getHash(payload);
+    for (uint8_t i=0; i<mConfigCount; i++) {
+      if (mConfigs[i].topicHash == topicHash) {
+        if (mConfigs[i].contentHash == contentHash) {
+          return false;
+        }
+        mConfigs[i].contentHash = contentHash;
+        return true;
+      }
+    }
+    if (mConfigCount < MQTT_SNAPSHOT_CONFIG_MAX) {
+      mConfigs[mConfigCount++] = {topicHash, contentHash};
+    }
+    return true;
+  }
+
+  // On a new broker connection, a broker without persistence loses its retained messages
+  void clearConfigs() {
+    mConfigCount = 0;
+  }
+
+  // Home Assistant restarted, the burst is sent after delayMs
+  void schedule(unsigned long nowMs, unsigned long delayMs) {
+    mScheduled = true;
+    mScheduleMs = nowMs;
+    mDelayMs = delayMs;
+  }
+
+  // Return true once when the scheduled burst is due
+  bool isDue(unsigned long nowMs) {
+    if (!mScheduled || nowMs - mScheduleMs < mDelayMs) {
+      return false;
+    }
+    mScheduled = false;
+    return true;
+  }
+
+  // FNV-1a
+  static uint32_t getHash(const char* str) {
+    uint32_t hash = 2166136261u;
+    while (*str) {
+      hash = (hash ^ (uint8_t)*str++) * 16777619u;
+    }
+    return hash;
+  }
+
+private:
+  struct State {
+    char topic[MQTT_SNAPSHOT_TOPIC_SIZE];
+    char payload[MQTT_SNAPSHOT_PAYLOAD_SIZE];
+    bool retain;
+  };
+
+  struct Config {
+    uint32_t topicHash;
+    uint32_t contentHash;
+  };
+
+  State* findState(const char* topic) {
+    for (uint8_t i=0; i<mStateCount; i++) {
+      if (strcmp(mStates[i].topic, topic) == 0) {
+        return &mStates[i];
+      }
+    }
+    return nullptr;
+  }
+
+  State mStates[MQTT_SNAPSHOT_STATE_MAX] = {};
+  uint8_t mStateCount = 0;
+  Config mConfigs[MQTT_SNAPSHOT_CONFIG_MAX] = {};
+  uint8_t mConfigCount = 0;
+  bool mScheduled = false;
+  unsigned long mScheduleMs = 0;
+  unsigned long mDelayMs = 0;
+};
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Values of the NVM config keys (ConfigStore.h), the same file in each sketch.
+ *
+ * Each key keeps the size of its value, a new format takes a new key: the firmwares
+ * check their types against these sizes, and the NvmProgrammer only writes the keys
+ * it sets, a missing key is read as in a blank EEPROM.
+ *
+ * EepromConfig is the EEPROM layout of the firmwares before the NVM config store
+ * (CONFIG_VERSION 0), read once to import the keys. It only has the values of those
+ * firmwares, the keys added since then start from their blank EEPROM default.
+ */
+
+constexpr uint8_t CONFIG_ROOM_NAME_SIZE       = 32;
+constexpr uint8_t CONFIG_LED_SEGMENT_MAX      = 4;
+constexpr uint8_t CONFIG_SUNRISE_ALARMS_SIZE  = 21; // SunriseAlarm[SUNRISE_ALARM_MAX], LedStripLight2
+constexpr uint8_t CONFIG_LED_SCENES_SIZE      = 112; // LedScene[LED_SCENE_MAX], LedStripLight2
+constexpr uint8_t CONFIG_ENERGY_COUNTERS_SIZE = 40; // EnergyCounters, RadiatorController
+
+#pragma pack(push, 1)
+struct EepromConfig {
+  float     sensorTemperatureOffset;
+  float     sensorHumidityOffset;
+  uint32_t  deviceSerialNumber;
+  char      roomName[CONFIG_ROOM_NAME_SIZE];
+};
+#pragma pack(pop)
@@ -169,7 +169,7 @@ public:
     }
 
     // Check firmware size on server
-    if (header.firmware_size != total_payload_size - OTA_HEADER_SIZE - OTA_SIGNATURE_SIZE) {
+    if (header.firmware_size != (uint32_t)(total_payload_size - OTA_HEADER_SIZE - OTA_SIGNATURE_SIZE)) {
       Serial.println("ERROR: Incorrect firmware size.");
       goto error;
     }
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Last applied state of a device, restored at boot before the network is up, the same
+ * file in each sketch.
+ *
+ * The state is kept in the RTC user memory, which holds through a reset, an OTA update
+ * or a watchdog reboot, but not a power loss. The record has a magic, the state size
+ * and a CRC-16, so the random content after power on or the state of another firmware
+ * is never restored. The flash copy, a key of the NVM config store, covers the power
+ * loss: it is written once the state is unchanged for STATE_SAVE_DELAY_MS, so a burst
+ * of commands (color picker, brightness slider) is a single write, and never more than
+ * one every STATE_SAVE_DELAY_MS.
+ */
+
+constexpr uint32_t STATE_RTC_MAGIC = 0x31415453;  // "STA1"
+constexpr uint8_t STATE_RTC_OFFSET = 32;          // In words, the first 128 bytes hold the OTA boot command
+constexpr uint16_t STATE_RTC_SIZE = 512 - 4 * STATE_RTC_OFFSET;
+constexpr uint16_t STATE_RTC_HEADER_SIZE = 8;
+constexpr unsigned long STATE_SAVE_DELAY_MS = 30000;
+
+template<typename State, class Rtc>
+class SavedState {
+public:
+  static_assert(STATE_RTC_HEADER_SIZE + sizeof(State) <= STATE_RTC_SIZE, "State too large for the RTC memory");
+  static_assert(sizeof(State) < 256, "State size is stored on 8 bits");
+
+  SavedState(Rtc &rtc) : mRtc(rtc) {
+  }
+
+  // State of the RTC memory, return false after a power loss
+  bool load(State &state) {
+    uint32_t record[RECORD_WORDS];
+
+    if (!mRtc.read(STATE_RTC_OFFSET, record, sizeof(record)) || record[0] != STATE_RTC_MAGIC ||
+        (record[1] & 0xFF) != sizeof(State) || (record[1] >> 16) != getCrc(record)) {
+      return false;
+    }
+    memcpy(&mState, record + 2, sizeof(State));
+    mSaved = (record[1] >> 8) & 1;
+    mChangeMs = 0;
+    state = mState;
+    return true;
+  }
+
+  // State of the flash copy, restored or just written
+  void setSaved(const State &state) {
+    mState = state;
+    mSaved = true;
+    write();
+  }
+
+  // Called on each loop, the RTC memory is written on change
+  void update(const State &state, unsigned long nowMs) {
+    if (memcmp(&state, &mState, sizeof(State)) == 0) {
+      return;
+    }
+    mState = state;
+    mSaved = false;
+    mChangeMs = nowMs;
+    write();
+  }
+
+  // The state changed and then stayed the same for STATE_SAVE_DELAY_MS
+  bool isSaveDue(unsigned long nowMs) const {
+    return !mSaved && nowMs - mChangeMs >= STATE_SAVE_DELAY_MS;
+  }
+
+  const State& get() const {
+    return mState;
+  }
+
+private:
+  static constexpr uint16_t RECORD_WORDS = (STATE_RTC_HEADER_SIZE + sizeof(State) + 3) / 4;
+
+  // Magic, then size, saved flag and CRC in one word, then the state
+  void write() {
+    uint32_t record[RECORD_WORDS] = {};
+
+    record[0] = STATE_RTC_MAGIC;
+    record[1] = sizeof(State) | (mSaved ? 1 : 0) << 8;
+    memcpy(record + 2, &mState, sizeof(State));
+    record[1] |= (uint32_t)getCrc(record) << 16;
+    mRtc.write(STATE_RTC_OFFSET, record, sizeof(record));
+  }
+
+  // CRC-16/CCITT of the size and saved flag, then of the state
+  static uint16_t getCrc(const uint32_t *record) {
+    uint16_t crc = updateCrc(0xFFFF, record + 1, 2);
+    return updateCrc(crc, record + 2, sizeof(State));
+  }
+
+  static uint16_t updateCrc(uint16_t crc, const void *data, uint8_t size) {
+    for (uint8_t i=0; i<size; i++) {
+      crc ^= ((const uint8_t*)data)[i] << 8;
+      for (uint8_t b=0; b<8; b++) {
+        crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+      }
+    }
+    return crc;
+  }
+
+  Rtc &mRtc;
+  State mState = {};
+  bool mSaved = true;
+  unsigned long mChangeMs = 0;
+};
+
+#ifdef ARDUINO
+#include <Esp.h>
+
+// RTC user memory, 512 bytes kept while the chip is powered
+class EspRtcMemory {
+public:
+  bool read(uint8_t offset, uint32_t *data, uint16_t size) {
+    return ESP.rtcUserMemoryRead(offset, data, size);
+  }
+
+  bool write(uint8_t offset, uint32_t *data, uint16_t size) {
+    return ESP.rtcUserMemoryWrite(offset, data, size);
+  }
+};
+#endif
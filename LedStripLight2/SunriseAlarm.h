@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Weekly sunrise alarms, stored in the NVM config.
+ *
+ * An alarm starts the sunrise at hour:minute local time on the days of its mask,
+ * bit 0 for Sunday to bit 6 for Saturday (same order as tm_wday). An alarm without
+ * day or with an invalid time, as in a blank EEPROM, is disabled.
+ */
+
+constexpr uint8_t SUNRISE_ALARM_MAX = 7;
+constexpr uint8_t SUNRISE_ALARM_DAYS_ALL = 0x7F;
+constexpr time_t SUNRISE_ALARM_TIME_VALID_MIN = 1700000000; // Before the first NTP sync the clock starts at 1970
+
+struct SunriseAlarm {
+  uint8_t days;     // Bit mask, bit 0 is Sunday
+  uint8_t hour;     // Local time
+  uint8_t minute;
+};
+static_assert(sizeof(struct SunriseAlarm) == 3, "Sunrise alarm structure size is incorrect");
+
+inline bool isSunriseAlarmEnabled(const SunriseAlarm &alarm) {
+  return alarm.days != 0 && alarm.days <= SUNRISE_ALARM_DAYS_ALL && alarm.hour < 24 && alarm.minute < 60;
+}
+
+// Start of the first alarm strictly after now, 0 if there is none
+inline time_t getNextSunriseAlarm(const SunriseAlarm *alarms, uint8_t count, time_t now) {
+  struct tm today;
+  localtime_r(&now, &today);
+
+  // Day by day, the time of the day is converted with the DST of that day
+  for (uint8_t offset=0; offset<=7; offset++) {
+    uint8_t wday = (today.tm_wday + offset) % 7;
+    time_t next = 0;
+    for (uint8_t i=0; i<count; i++) {
+      if (!isSunriseAlarmEnabled(alarms[i]) || !(alarms[i].days & (1 << wday))) {
+        continue;
+      }
+      struct tm day = today;
+      day.tm_mday += offset;
+      day.tm_hour = alarms[i].hour;
+      day.tm_min = alarms[i].minute;
+      day.tm_sec = 0;
+      day.tm_isdst = -1;
+      time_t start = mktime(&day);
+      if (start > now && (next == 0 || start < next)) {
+        next = start;
+      }
+    }
+    if (next != 0) {
+      return next;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "LedMath.h"
+
+/*
+ * Sunrise intensity curve as a fixed-point lookup table generated at compile time.
+ *
+ * Progress and intensity are Q16 values (65536 = 1.0). The table holds
+ * SUNRISE_LUT_SIZE+1 points, values in between are linearly interpolated, so an
+ * evaluation is one shift, one multiply and no floating point.
+ */
+
+// Curves
+#define SUNRISE_CURVE_COSINE  0 // Cosine S-curve (ease-in-out), only the first half is used
+#define SUNRISE_CURVE_LINEAR  1
+
+#ifndef SUNRISE_CURVE
+#define SUNRISE_CURVE SUNRISE_CURVE_COSINE
+#endif
+
+// Gamma correction for the human eye perception
+#ifndef SUNRISE_GAMMA
+#define SUNRISE_GAMMA 2.2
+#endif
+
+constexpr uint32_t SUNRISE_Q16_ONE = 1UL << 16;
+constexpr uint8_t  SUNRISE_LUT_BITS = 8;
+constexpr uint16_t SUNRISE_LUT_SIZE = 1 << SUNRISE_LUT_BITS;
+
+/**
+ * Floating point reference of the sunrise curve, only evaluated at compile time.
+ * @param progress: A value from 0.0 (start) to 1.0 (end).
+ * @return: A normalized intensity coefficient.
+ */
+constexpr double sunriseCurveReference(double progress) {
+  if (progress < 0.0) progress = 0.0;
+  if (progress > 1.0) progress = 1.0;
+
+  // Only first part of the curve is used
+  progress = progress / 2;
+
+#if SUNRISE_CURVE == SUNRISE_CURVE_COSINE
+  double curve = 0.5 * (1.0 - led_math::cos(progress * led_math::PI_VALUE));
+#elif SUNRISE_CURVE == SUNRISE_CURVE_LINEAR
+  double curve = progress;
+#else
+#error "Unsupported SUNRISE_CURVE"
+#endif
+
+  return led_math::pow(curve, SUNRISE_GAMMA) * 2;
+}
+
+struct SunriseLut {
+  uint16_t value[SUNRISE_LUT_SIZE + 1];
+};
+
+constexpr SunriseLut makeSunriseLut() {
+  SunriseLut lut = {};
+  for (uint32_t i = 0; i <= SUNRISE_LUT_SIZE; i++) {
+    double v = sunriseCurveReference((double)i / SUNRISE_LUT_SIZE) * SUNRISE_Q16_ONE + 0.5;
+    lut.value[i] = v > UINT16_MAX ? UINT16_MAX : (uint16_t)v;
+  }
+  return lut;
+}
+
+constexpr SunriseLut SUNRISE_LUT = makeSunriseLut();
+
+// Intensity in Q16 for a progress in Q16, progress is clamped to [0, 1.0].
+// Curves are non-decreasing, so the interpolation stays unsigned.
+constexpr uint32_t getSunriseIntensity(uint32_t progress) {
+  if (progress >= SUNRISE_Q16_ONE) {
+    return SUNRISE_LUT.value[SUNRISE_LUT_SIZE];
+  }
+  constexpr uint8_t shift = 16 - SUNRISE_LUT_BITS;
+  uint32_t index = progress >> shift;
+  uint32_t frac = progress & ((1UL << shift) - 1);
+  uint32_t a = SUNRISE_LUT.value[index];
+  uint32_t b = SUNRISE_LUT.value[index + 1];
+  return a + (((b - a) * frac) >> shift);
+}
+
+// Max difference between the table and the reference over the whole curve, in Q16
+constexpr uint32_t getSunriseLutMaxError() {
+  double max = 0.0;
+  for (uint32_t p = 0; p <= SUNRISE_Q16_ONE; p += 16) {
+    double diff = getSunriseIntensity(p) - sunriseCurveReference((double)p / SUNRISE_Q16_ONE) * SUNRISE_Q16_ONE;
+    if (diff < 0) diff = -diff;
+    if (diff > max) max = diff;
+  }
+  return (uint32_t)max + 1;
+}
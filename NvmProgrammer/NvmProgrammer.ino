@@ -1,29 +1,67 @@
-#include <EEPROM.h>
+#include "ConfigStore.h"
+#include "NvmConfig.h"
 
 // Define  NVM config to write
 #define NVM_CONFIG_ID 10
 
-#pragma pack(1)
-struct NVMConfig {
+// Keys set for each device, the firmwares use their defaults for the other ones
+#define DEVICE_MAX 16
+struct DeviceConfig {
+  uint32_t  deviceSerialNumber;
+  char      roomName[CONFIG_ROOM_NAME_SIZE];
   float     sensorTemperatureOffset;
   float     sensorHumidityOffset;
-  uint32_t  deviceSerialNumber;
-  char      roomName[32];
+  uint8_t   ledSegmentCount;                            // 0 for a single segment
+  uint16_t  ledSegmentLength[CONFIG_LED_SEGMENT_MAX];
+  uint16_t  radiatorPower;                              // W, 0 if unknown
 };
-static_assert(sizeof(struct NVMConfig) == 4+4+4+32, "EEPROM config structure size is incorrect");
-
-struct NVMConfig devices[100];
-static_assert(sizeof(struct NVMConfig) * 100 == sizeof(devices), "devices structure size is incorrect");
+DeviceConfig devices[DEVICE_MAX];
+uint8_t deviceCount = 0;
+EspConfigFlash configFlash;
+ConfigStore<EspConfigFlash> configStore(configFlash);
+
+DeviceConfig* find_device(uint32_t deviceSerialNumber) {
+  for (uint8_t i=0; i<deviceCount; i++) {
+    if (devices[i].deviceSerialNumber == deviceSerialNumber) {
+      return &devices[i];
+    }
+  }
+  return NULL;
+}
 
 void init_device(float sensorTemperatureOffset,
                  float sensorHumidityOffset,
                  uint32_t deviceSerialNumber,
                  const char* roomName) {
-  int idx = deviceSerialNumber;
-  devices[idx].sensorTemperatureOffset = sensorTemperatureOffset;
-  devices[idx].sensorHumidityOffset = sensorHumidityOffset;
-  devices[idx].deviceSerialNumber = deviceSerialNumber;
-  strncpy(devices[idx].roomName, roomName, 32);
+  if (deviceCount >= DEVICE_MAX) {
+    Serial.printf("ERROR: No room for device %d, increase DEVICE_MAX\n", deviceSerialNumber);
+    return;
+  }
+  DeviceConfig& device = devices[deviceCount++];
+  memset(&device, 0, sizeof(device));
+  device.sensorTemperatureOffset = sensorTemperatureOffset;
+  device.sensorHumidityOffset = sensorHumidityOffset;
+  device.deviceSerialNumber = deviceSerialNumber;
+  strncpy(device.roomName, roomName, CONFIG_ROOM_NAME_SIZE - 1);
+}
+
+void init_led_segments(uint32_t deviceSerialNumber, uint8_t count, const uint16_t length[]) {
+  DeviceConfig* device = find_device(deviceSerialNumber);
+  if (device == NULL) {
+    return;
+  }
+  device->ledSegmentCount = count;
+  for (uint8_t i=0; i<count && i<CONFIG_LED_SEGMENT_MAX; i++) {
+    device->ledSegmentLength[i] = length[i];
+  }
+}
+
+void init_radiator_power(uint32_t deviceSerialNumber, uint16_t power) {
+  DeviceConfig* device = find_device(deviceSerialNumber);
+  if (device == NULL) {
+    return;
+  }
+  device->radiatorPower = power;
 }
 
 void init_devices() {
@@ -33,33 +71,68 @@ void init_devices() {
   init_device(0., 0., 3, "kitchen");
   init_device(0., 0., 4, "livingroom");
   init_device(0., 0., 5, "office");
+  // Radiator power in W for the energy sensors, e.g.:
+  // init_radiator_power(1, 1500);
 
   // LedStripLight2
   init_device(0., 0., 10, "bedroom");
+  // Strip split in several lights, e.g.:
+  // static const uint16_t bedroomSegments[] = {165, 165};
+  // init_led_segments(10, 2, bedroomSegments);
 
   // Test
   init_device(0., 0., 99, "test");
 }
 
-void write_nvm_config(int id) {
+void write_nvm_config(uint32_t id) {
   Serial.println("WRITE NVM CONFIG:");
 
-  EEPROM.begin(sizeof(NVMConfig));
+  const DeviceConfig* device = find_device(id);
+  if (device == NULL) {
+    Serial.printf("ERROR: No device %d in init_devices()\n", id);
+    return;
+  }
+
+  // The keys set in a single commit, on a blank store: the thermostat, energy counters,
+  // alarms, scenes and power save latency are missing and read as in a blank EEPROM
+  if (!configStore.begin() || !configStore.format()) {
+    Serial.println("ERROR: No flash sector for the NVM config store, set the FS size");
+    return;
+  }
+
+  Serial.printf(" - Sensor Temperature Offset: %f\n", device->sensorTemperatureOffset);
+  configStore.set(CONFIG_KEY_SENSOR_TEMPERATURE_OFFSET, device->sensorTemperatureOffset);
+
+  Serial.printf(" - Sensor Humidity Offset: %f\n", device->sensorHumidityOffset);
+  configStore.set(CONFIG_KEY_SENSOR_HUMIDITY_OFFSET, device->sensorHumidityOffset);
+
+  Serial.printf(" - Device Serial Number: %d\n", device->deviceSerialNumber);
+  configStore.set(CONFIG_KEY_DEVICE_SERIAL_NUMBER, device->deviceSerialNumber);
+
+  Serial.printf(" - Room Name: %s\n", device->roomName);
+  configStore.set(CONFIG_KEY_ROOM_NAME, device->roomName);
 
-  Serial.printf(" - Sensor Temperature Offset: %f\n", devices[id].sensorTemperatureOffset);
-  EEPROM.put(offsetof(NVMConfig, sensorTemperatureOffset), devices[id].sensorTemperatureOffset);
+  if (device->ledSegmentCount > 0) {
+    Serial.printf(" - LED Segment Count: %d\n", device->ledSegmentCount);
+    configStore.set(CONFIG_KEY_LED_SEGMENT_COUNT, device->ledSegmentCount);
 
-  Serial.printf(" - Sensor Humidity Offset: %f\n", devices[id].sensorHumidityOffset);
-  EEPROM.put(offsetof(NVMConfig, sensorHumidityOffset), devices[id].sensorHumidityOffset);
+    for (uint8_t i=0; i<device->ledSegmentCount && i<CONFIG_LED_SEGMENT_MAX; i++) {
+      Serial.printf(" - LED Segment %d Length: %d\n", i + 1, device->ledSegmentLength[i]);
+    }
+    configStore.set(CONFIG_KEY_LED_SEGMENT_LENGTH, device->ledSegmentLength);
+  }
 
-  Serial.printf(" - Device Serial Number: %d\n", devices[id].deviceSerialNumber);
-  EEPROM.put(offsetof(NVMConfig, deviceSerialNumber), devices[id].deviceSerialNumber);
+  if (device->radiatorPower > 0) {
+    Serial.printf(" - Radiator Power: %d W\n", device->radiatorPower);
+    configStore.set(CONFIG_KEY_RADIATOR_POWER, device->radiatorPower);
+  }
 
-  Serial.printf(" - Room Name: %s\n", devices[id].roomName);
-  EEPROM.put(offsetof(NVMConfig, roomName), devices[id].roomName);
+  Serial.printf(" - Config Version: %d\n", CONFIG_VERSION);
+  configStore.set(CONFIG_KEY_VERSION, CONFIG_VERSION);
 
-  EEPROM.commit();
-  EEPROM.end();
+  if (!configStore.commit()) {
+    Serial.println("ERROR: Failed to write NVM config");
+  }
 }
 
 void setup() {
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stdint.h>
+
+/*
+ * Timestamps of a command from Home Assistant, the same file in each sketch.
+ *
+ * The MQTT callback starts a record when a message arrives, then each stage is marked
+ * with micros() in order: handler of the topic found, firmware state changed, output
+ * changed (pilot wire GPIO written by the timer interrupt, LED frame sent). A stage
+ * only counts after the previous one, a message arriving before the output commit
+ * replaces the record. The last complete record is kept for the logs and the host
+ * latency benches.
+ */
+
+enum CommandStage {
+  COMMAND_STAGE_ARRIVAL,  // mqtt_callback() called by client.loop()
+  COMMAND_STAGE_DISPATCH, // Handler of the topic
+  COMMAND_STAGE_APPLIED,  // Firmware state changed
+  COMMAND_STAGE_OUTPUT,   // Output changed
+  COMMAND_STAGE_COUNT,
+};
+
+struct CommandLatencyRecord {
+  uint32_t arrival;                       // Message count, including this one
+  uint32_t stageUs[COMMAND_STAGE_COUNT];  // micros() at each stage
+};
+
+class CommandLatency {
+public:
+  void arrival() {
+    mCurrent.arrival = ++mArrivals;
+    mCurrent.stageUs[COMMAND_STAGE_ARRIVAL] = micros();
+    mStage = COMMAND_STAGE_ARRIVAL;
+  }
+
+  // Return true if the command is complete, can be called from an interrupt
+  bool IRAM_ATTR mark(CommandStage stage) {
+    if (mStage != stage - 1) {
+      return false;
+    }
+    mCurrent.stageUs[stage] = micros();
+    mStage = stage;
+    if (stage != COMMAND_STAGE_OUTPUT) {
+      return false;
+    }
+    mLast = mCurrent;
+    mCompleted++;
+    return true;
+  }
+
+  uint32_t getArrivals() const {
+    return mArrivals;
+  }
+
+  uint32_t getCompleted() const {
+    return mCompleted;
+  }
+
+  const CommandLatencyRecord& getLast() const {
+    return mLast;
+  }
+
+  // Time from the arrival to a stage of the last complete command
+  uint32_t getLastUs(CommandStage stage) const {
+    return mLast.stageUs[stage] - mLast.stageUs[COMMAND_STAGE_ARRIVAL];
+  }
+
+private:
+  CommandLatencyRecord mCurrent = {};
+  CommandLatencyRecord mLast = {};
+  volatile int mStage = COMMAND_STAGE_OUTPUT;
+  uint32_t mArrivals = 0;
+  volatile uint32_t mCompleted = 0;
+};
@@ -0,0 +1,389 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Log-structured key/value store of the NVM config, the same file in each sketch.
+ *
+ * The store uses up to CONFIG_STORE_SECTOR_MAX flash sectors, one of them active. A
+ * sector starts with a header (magic, sequence and its complement), then the records:
+ * key, size and CRC-16 in one word, then the value padded to 4 bytes. A batch of
+ * records is only applied once followed by its commit record, so a power cut during
+ * commit() keeps all the previous values. When the active sector is full, the latest
+ * value of each key and the batch are copied to the next sector, erased first, and its
+ * header is written last with the next sequence. The sectors are used in turn, each one
+ * is erased once every CONFIG_STORE_SECTOR_MAX compactions.
+ *
+ * begin() reads the sector headers, then the active sector once, and keeps the address
+ * of the latest value of each key: the load time does not depend on the number of
+ * writes, and get() reads a single record.
+ */
+
+constexpr uint16_t CONFIG_STORE_SECTOR_SIZE = 4096;
+constexpr uint8_t CONFIG_STORE_SECTOR_MAX = 8;
+constexpr uint8_t CONFIG_STORE_SECTOR_NONE = 0xFF;
+constexpr uint32_t CONFIG_STORE_MAGIC = 0x31474643; // "CFG1"
+constexpr uint16_t CONFIG_STORE_HEADER_SIZE = 12;
+constexpr uint8_t CONFIG_STORE_VALUE_MAX = 128;
+constexpr uint16_t CONFIG_STORE_BATCH_SIZE = 512;   // Records of one commit
+constexpr uint8_t CONFIG_KEY_MAX = 64;
+
+// Keys of all the devices, a removed key is never reused, the sizes of their values
+// are in NvmConfig.h
+enum ConfigKey : uint8_t {
+  CONFIG_KEY_VERSION                   = 0,  // uint16_t, CONFIG_VERSION
+  CONFIG_KEY_SENSOR_TEMPERATURE_OFFSET = 1,  // float
+  CONFIG_KEY_SENSOR_HUMIDITY_OFFSET    = 2,  // float
+  CONFIG_KEY_DEVICE_SERIAL_NUMBER      = 3,  // uint32_t
+  CONFIG_KEY_ROOM_NAME                 = 4,  // char[CONFIG_ROOM_NAME_SIZE]
+  CONFIG_KEY_LED_SEGMENT_COUNT         = 5,  // uint8_t, LedStripLight2
+  CONFIG_KEY_LED_SEGMENT_LENGTH        = 6,  // uint16_t[CONFIG_LED_SEGMENT_MAX], LedStripLight2
+  CONFIG_KEY_SUNRISE_ALARMS            = 7,  // SunriseAlarm[SUNRISE_ALARM_MAX], LedStripLight2
+  CONFIG_KEY_LED_SCENES                = 8,  // LedScene[LED_SCENE_MAX], LedStripLight2
+  CONFIG_KEY_THERMOSTAT_SETPOINT       = 9,  // float, RadiatorController
+  CONFIG_KEY_THERMOSTAT_HYSTERESIS     = 10, // float, RadiatorController
+  CONFIG_KEY_RADIATOR_POWER            = 11, // uint16_t, RadiatorController
+  CONFIG_KEY_ENERGY_COUNTERS           = 12, // EnergyCounters, RadiatorController
+  CONFIG_KEY_POWER_SAVE_LATENCY        = 13, // uint16_t, RadiatorController
+  CONFIG_KEY_RADIATOR_STATE            = 14, // RadiatorState, RadiatorController
+  CONFIG_KEY_LED_STATE                 = 15, // LedState, LedStripLight2
+  CONFIG_KEY_COMMIT                    = 0xFE, // uint32_t, records of the batch
+};
+
+// 0 is the EepromConfig layout (NvmConfig.h) at the start of the EEPROM, imported once
+constexpr uint16_t CONFIG_VERSION = 1;
+
+template<class Flash>
+class ConfigStore {
+public:
+  ConfigStore(Flash &flash) : mFlash(flash) {
+  }
+
+  // Find the active sector and load it, return false without two flash sectors at least
+  bool begin() {
+    uint32_t header[CONFIG_STORE_HEADER_SIZE / 4];
+
+    mSectorCount = mFlash.getSectorCount() < CONFIG_STORE_SECTOR_MAX ? mFlash.getSectorCount() : CONFIG_STORE_SECTOR_MAX;
+    mActive = CONFIG_STORE_SECTOR_NONE;
+    mSequence = 0;
+    mEnd = CONFIG_STORE_HEADER_SIZE;
+    mCompact = false;
+    mBatchSize = 0;
+    mBatchCount = 0;
+    memset(mAddress, 0, sizeof(mAddress));
+    if (mSectorCount < 2) {
+      return false;
+    }
+
+    for (uint8_t s=0; s<mSectorCount; s++) {
+      // The complement detects a torn header, a cut erase or write only sets bits
+      if (mFlash.read(s, 0, header, sizeof(header)) && header[0] == CONFIG_STORE_MAGIC &&
+          header[1] == ~header[2] && (mActive == CONFIG_STORE_SECTOR_NONE || header[1] > mSequence)) {
+        mActive = s;
+        mSequence = header[1];
+      }
+    }
+    if (mActive != CONFIG_STORE_SECTOR_NONE) {
+      load();
+    }
+    return true;
+  }
+
+  // Erase all the sectors, as for a new device
+  bool format() {
+    for (uint8_t s=0; s<mSectorCount; s++) {
+      if (!mFlash.erase(s)) {
+        return false;
+      }
+    }
+    mActive = CONFIG_STORE_SECTOR_NONE;
+    mSequence = 0;
+    mEnd = CONFIG_STORE_HEADER_SIZE;
+    mCompact = false;
+    memset(mAddress, 0, sizeof(mAddress));
+    return true;
+  }
+
+  bool has(uint8_t key) const {
+    return key < CONFIG_KEY_MAX && mAddress[key] != 0;
+  }
+
+  // Return false if the key is missing or its value has another size
+  bool get(uint8_t key, void *value, uint8_t size) const {
+    uint32_t record[1 + CONFIG_STORE_VALUE_MAX / 4];
+
+    if (!has(key) || size > CONFIG_STORE_VALUE_MAX ||
+        !mFlash.read(mActive, mAddress[key], record, 4 + pad(size)) || getSize(record[0]) != size) {
+      return false;
+    }
+    memcpy(value, record + 1, size);
+    return true;
+  }
+
+  template<class T>
+  bool get(uint8_t key, T &value) const {
+    return get(key, &value, sizeof(T));
+  }
+
+  uint16_t getVersion() const {
+    uint16_t version = 0;
+    get(CONFIG_KEY_VERSION, version);
+    return version;
+  }
+
+  // Staged until commit(), return false if the batch is full
+  bool set(uint8_t key, const void *value, uint8_t size) {
+    uint16_t recordSize = 4 + pad(size);
+
+    if (key >= CONFIG_KEY_MAX || size > CONFIG_STORE_VALUE_MAX ||
+        mBatchSize + recordSize + 8 > CONFIG_STORE_BATCH_SIZE) {
+      return false;
+    }
+    writeRecord(mBatch + mBatchSize / 4, key, value, size);
+    mBatchSize += recordSize;
+    mBatchCount++;
+    return true;
+  }
+
+  template<class T>
+  bool set(uint8_t key, const T &value) {
+    return set(key, &value, sizeof(T));
+  }
+
+  // Write the staged values at once, a power cut keeps all or none of them
+  bool commit() {
+    bool ok = mSectorCount >= 2;
+
+    if (ok && mBatchCount > 0) {
+      if (mActive != CONFIG_STORE_SECTOR_NONE && !mCompact &&
+          mEnd + mBatchSize + 8 <= CONFIG_STORE_SECTOR_SIZE) {
+        ok = append();
+      } else {
+        ok = compact();
+      }
+    }
+    mBatchSize = 0;
+    mBatchCount = 0;
+    return ok;
+  }
+
+  // Staged values dropped
+  void abort() {
+    mBatchSize = 0;
+    mBatchCount = 0;
+  }
+
+  uint8_t getActiveSector() const {
+    return mActive;
+  }
+
+  uint16_t getUsedSize() const {
+    return mEnd;
+  }
+
+private:
+  static uint16_t pad(uint8_t size) {
+    return (size + 3) & ~3;
+  }
+
+  static uint8_t getKey(uint32_t header) {
+    return header & 0xFF;
+  }
+
+  static uint8_t getSize(uint32_t header) {
+    return (header >> 8) & 0xFF;
+  }
+
+  // CRC-16/CCITT of the key, the size and the value
+  static uint16_t getCrc(uint8_t key, uint8_t size, const void *value) {
+    uint8_t head[2] = { key, size };
+    uint16_t crc = updateCrc(0xFFFF, head, sizeof(head));
+    return updateCrc(crc, value, size);
+  }
+
+  static uint16_t updateCrc(uint16_t crc, const void *data, uint8_t size) {
+    for (uint8_t i=0; i<size; i++) {
+      crc ^= ((const uint8_t*)data)[i] << 8;
+      for (uint8_t b=0; b<8; b++) {
+        crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+      }
+    }
+    return crc;
+  }
+
+  static void writeRecord(uint32_t *record, uint8_t key, const void *value, uint8_t size) {
+    record[0] = key | (uint32_t)size << 8 | (uint32_t)getCrc(key, size, value) << 16;
+    record[pad(size) / 4] = 0xFFFFFFFF;
+    memcpy(record + 1, value, size);
+  }
+
+  void load() {
+    uint16_t pending[CONFIG_KEY_MAX] = {};
+    uint32_t pendingCount = 0;
+    uint32_t record[1 + CONFIG_STORE_VALUE_MAX / 4];
+
+    for (uint16_t address=CONFIG_STORE_HEADER_SIZE; address + 4 <= CONFIG_STORE_SECTOR_SIZE; ) {
+      if (!mFlash.read(mActive, address, record, 4)) {
+        mCompact = true;
+        break;
+      }
+      // Erased word, end of the log
+      if (record[0] == 0xFFFFFFFF) {
+        break;
+      }
+      uint8_t key = getKey(record[0]);
+      uint8_t size = getSize(record[0]);
+      uint16_t recordSize = 4 + pad(size);
+      if (size > CONFIG_STORE_VALUE_MAX || address + recordSize > CONFIG_STORE_SECTOR_SIZE ||
+          !mFlash.read(mActive, address + 4, record + 1, pad(size)) ||
+          record[0] >> 16 != getCrc(key, size, record + 1)) {
+        mCompact = true;
+        break;
+      }
+      if (key == CONFIG_KEY_COMMIT) {
+        if (size != 4 || record[1] != pendingCount) {
+          mCompact = true;
+          break;
+        }
+        for (uint8_t k=0; k<CONFIG_KEY_MAX; k++) {
+          if (pending[k] != 0) {
+            mAddress[k] = pending[k];
+            pending[k] = 0;
+          }
+        }
+        pendingCount = 0;
+        mEnd = address + recordSize;
+      } else {
+        // Keys of a newer firmware are counted but not kept
+        if (key < CONFIG_KEY_MAX) {
+          pending[key] = address;
+        }
+        pendingCount++;
+      }
+      address += recordSize;
+    }
+    // Records after the last commit, the next commit moves to a new sector
+    if (pendingCount > 0) {
+      mCompact = true;
+    }
+  }
+
+  bool append() {
+    uint16_t address = mEnd;
+
+    writeRecord(mBatch + mBatchSize / 4, CONFIG_KEY_COMMIT, &mBatchCount, sizeof(mBatchCount));
+    if (!mFlash.write(mActive, address, mBatch, mBatchSize + 8)) {
+      mCompact = true;
+      return false;
+    }
+    for (uint16_t offset=0; offset<mBatchSize; offset+=4+pad(getSize(mBatch[offset / 4]))) {
+      mAddress[getKey(mBatch[offset / 4])] = address + offset;
+    }
+    mEnd = address + mBatchSize + 8;
+    return true;
+  }
+
+  bool compact() {
+    uint8_t next = mActive == CONFIG_STORE_SECTOR_NONE ? 0 : (mActive + 1) % mSectorCount;
+    uint16_t address = CONFIG_STORE_HEADER_SIZE;
+    uint16_t addresses[CONFIG_KEY_MAX] = {};
+    uint32_t count = 0;
+    uint32_t record[1 + CONFIG_STORE_VALUE_MAX / 4];
+    bool staged[CONFIG_KEY_MAX] = {};
+
+    for (uint16_t offset=0; offset<mBatchSize; offset+=4+pad(getSize(mBatch[offset / 4]))) {
+      staged[getKey(mBatch[offset / 4])] = true;
+    }
+    if (!mFlash.erase(next)) {
+      return false;
+    }
+
+    // Latest values of the keys not staged, then the batch
+    for (uint8_t key=0; key<CONFIG_KEY_MAX; key++) {
+      if (!has(key) || staged[key]) {
+        continue;
+      }
+      if (!mFlash.read(mActive, mAddress[key], record, 4)) {
+        return false;
+      }
+      uint16_t recordSize = 4 + pad(getSize(record[0]));
+      if (address + recordSize + mBatchSize + 8 > CONFIG_STORE_SECTOR_SIZE ||
+          !mFlash.read(mActive, mAddress[key] + 4, record + 1, recordSize - 4) ||
+          !mFlash.write(next, address, record, recordSize)) {
+        return false;
+      }
+      addresses[key] = address;
+      address += recordSize;
+      count++;
+    }
+    if (!mFlash.write(next, address, mBatch, mBatchSize)) {
+      return false;
+    }
+    for (uint16_t offset=0; offset<mBatchSize; offset+=4+pad(getSize(mBatch[offset / 4]))) {
+      addresses[getKey(mBatch[offset / 4])] = address + offset;
+    }
+    address += mBatchSize;
+    count += mBatchCount;
+    writeRecord(record, CONFIG_KEY_COMMIT, &count, sizeof(count));
+    if (!mFlash.write(next, address, record, 8)) {
+      return false;
+    }
+    address += 8;
+
+    // The new sector is active once its header is written
+    uint32_t header[CONFIG_STORE_HEADER_SIZE / 4] = { CONFIG_STORE_MAGIC, mSequence + 1, ~(mSequence + 1) };
+    if (!mFlash.write(next, 0, header, sizeof(header))) {
+      return false;
+    }
+    mActive = next;
+    mSequence++;
+    mEnd = address;
+    mCompact = false;
+    memcpy(mAddress, addresses, sizeof(mAddress));
+    return true;
+  }
+
+  Flash &mFlash;
+  uint8_t mSectorCount = 0;
+  uint8_t mActive = CONFIG_STORE_SECTOR_NONE;
+  uint32_t mSequence = 0;
+  uint16_t mEnd = CONFIG_STORE_HEADER_SIZE;
+  bool mCompact = false;               // Unusable data after mEnd
+  uint16_t mAddress[CONFIG_KEY_MAX] = {}; // 0 if missing
+  uint32_t mBatch[CONFIG_STORE_BATCH_SIZE / 4] = {};
+  uint16_t mBatchSize = 0;
+  uint32_t mBatchCount = 0;
+};
+
+#ifdef ARDUINO
+#include <Esp.h>
+#include <flash_hal.h>
+
+// Sectors of the filesystem area, unused by the sketches: set "FS" in the flash size
+// menu to 32KB at least for CONFIG_STORE_SECTOR_MAX sectors
+class EspConfigFlash {
+public:
+  uint8_t getSectorCount() const {
+    uint32_t count = FS_PHYS_SIZE / CONFIG_STORE_SECTOR_SIZE;
+    return count < CONFIG_STORE_SECTOR_MAX ? count : CONFIG_STORE_SECTOR_MAX;
+  }
+
+  bool erase(uint8_t sector) {
+    return ESP.flashEraseSector(getAddress(sector) / CONFIG_STORE_SECTOR_SIZE);
+  }
+
+  bool write(uint8_t sector, uint16_t offset, const uint32_t *data, uint16_t size) {
+    return ESP.flashWrite(getAddress(sector) + offset, data, size);
+  }
+
+  bool read(uint8_t sector, uint16_t offset, uint32_t *data, uint16_t size) const {
+    return ESP.flashRead(getAddress(sector) + offset, data, size);
+  }
+
+private:
+  static uint32_t getAddress(uint8_t sector) {
+    return FS_PHYS_ADDR + sector * CONFIG_STORE_SECTOR_SIZE;
+  }
+};
+#endif
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <Arduino.h>
+#include <math.h>
+
+/*
+ * DHT22 reader without busy wait and without disabling the interrupts.
+ *
+ * start() pulls the data line low, loop() releases it after DHT22_START_LOW_US and
+ * an interrupt timestamps each edge of the sensor answer. DHT22_FRAME_US later, loop()
+ * decodes the bits from the high pulse durations.
+ *
+ * Frame: response low and high, then 40 bits (50us low, then 26us high for 0 or 70us
+ * high for 1), then 50us low before the line is released. The bits are decoded from
+ * the last edge, so an edge caught when the line is released by the host is ignored.
+ *
+ * The edges are stored in static members for the interrupt handler, only one reader
+ * can be used.
+ */
+
+constexpr unsigned long DHT22_START_LOW_US = 1100;
+constexpr unsigned long DHT22_FRAME_US = 8000; // Frame is 5ms at most
+constexpr unsigned long DHT22_BIT_ONE_MIN_US = 48;
+constexpr uint8_t DHT22_FRAME_EDGES = 2 + 40*2 + 2;
+constexpr uint8_t DHT22_EDGE_MAX = DHT22_FRAME_EDGES + 2;
+
+class Dht22Reader {
+public:
+  Dht22Reader(uint8_t pin) : mPin(pin) {
+  }
+
+  void begin() {
+    pinMode(mPin, INPUT_PULLUP);
+  }
+
+  // Request a reading, ignored while one is in progress
+  void start() {
+    if (mState != STATE_IDLE) {
+      return;
+    }
+    sEdgeCount = 0;
+    pinMode(mPin, OUTPUT);
+    digitalWrite(mPin, LOW);
+    mStateTime = micros();
+    mState = STATE_START;
+  }
+
+  bool isBusy() const {
+    return mState != STATE_IDLE;
+  }
+
+  // Return true when a reading is finished, valid or not
+  bool loop() {
+    unsigned long currentTime = micros();
+
+    switch (mState) {
+      case STATE_START:
+        if (currentTime - mStateTime < DHT22_START_LOW_US) {
+          return false;
+        }
+        pinMode(mPin, INPUT_PULLUP);
+        attachInterrupt(digitalPinToInterrupt(mPin), onEdge, CHANGE);
+        mStateTime = micros();
+        mState = STATE_RECEIVE;
+        return false;
+      case STATE_RECEIVE:
+        if (currentTime - mStateTime < DHT22_FRAME_US) {
+          return false;
+        }
+        detachInterrupt(digitalPinToInterrupt(mPin));
+        mValid = decode();
+        mState = STATE_IDLE;
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  // Values of the last reading, NAN if it failed
+  float getHumidity() const {
+    return mValid ? mHumidity : NAN;
+  }
+
+  float getTemperature() const {
+    return mValid ? mTemperature : NAN;
+  }
+
+private:
+  enum State {
+    STATE_IDLE,
+    STATE_START,
+    STATE_RECEIVE,
+  };
+
+  static void IRAM_ATTR onEdge() {
+    if (sEdgeCount < DHT22_EDGE_MAX) {
+      sEdges[sEdgeCount] = micros();
+      sEdgeCount = sEdgeCount + 1;
+    }
+  }
+
+  bool decode() {
+    uint8_t count = sEdgeCount;
+    uint8_t data[5] = {};
+
+    if (count < DHT22_FRAME_EDGES - 2) {
+      return false;
+    }
+    // From the end: release rising edge, end low falling edge, then a rising and a falling edge per bit
+    for (uint8_t bit=0; bit<40; bit++) {
+      uint8_t rising = count - 3 - 2*(39 - bit);
+      if (sEdges[rising+1] - sEdges[rising] >= DHT22_BIT_ONE_MIN_US) {
+        data[bit/8] |= 0x80 >> (bit%8);
+      }
+    }
+    if ((uint8_t)(data[0] + data[1] + data[2] + data[3]) != data[4]) {
+      return false;
+    }
+
+    mHumidity = ((data[0] << 8) | data[1]) / 10.;
+    mTemperature = (((data[2] & 0x7F) << 8) | data[3]) / 10.;
+    if (data[2] & 0x80) {
+      mTemperature = -mTemperature;
+    }
+    return true;
+  }
+
+  static inline volatile unsigned long sEdges[DHT22_EDGE_MAX] = {};
+  static inline volatile uint8_t sEdgeCount = 0;
+
+  uint8_t mPin;
+  State mState = STATE_IDLE;
+  unsigned long mStateTime = 0;
+  bool mValid = false;
+  float mHumidity = 0;
+  float mTemperature = 0;
+};
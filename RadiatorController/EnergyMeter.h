@@ -0,0 +1,127 @@
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+#include "PilotWire.h"
+
+/*
+ * Time spent in each pilot wire state and heating energy estimated from it.
+ *
+ * The radiator is assumed to draw its rated power in comfort, comfort -1 and
+ * comfort -2, and nothing in the other states. Its own thermostat cycles below the
+ * comfort temperature, so the energy is an upper bound, close when the room is
+ * regulated by Thermostat.h (eco as soon as the target is reached).
+ *
+ * Only times are counted, the energy is computed from the power when read. The hourly
+ * and daily periods follow the local time once set by NTP, before that the time is
+ * counted in the restored periods.
+ */
+
+struct EnergyCounters {
+  uint32_t stateSeconds[PILOT_WIRE_STATE_COUNT]; // Since the NVM is programmed
+  uint32_t hour;                                 // Unix time / 3600, 0 if unknown
+  uint32_t hourHeatingSeconds;
+  uint32_t day;                                  // Local year * 1000 + day of year, 0 if unknown
+  uint32_t dayHeatingSeconds;
+};
+
+inline bool isPilotWireHeating(PilotWireState state) {
+  return state == PILOT_WIRE_STATE_COMFORT ||
+         state == PILOT_WIRE_STATE_COMFORT_MINUS_1 ||
+         state == PILOT_WIRE_STATE_COMFORT_MINUS_2;
+}
+
+class EnergyMeter {
+public:
+  // Counters read from NVM, a blank EEPROM restarts from zero
+  void begin(const EnergyCounters &counters, uint16_t powerW) {
+    mCounters = counters;
+    if (mCounters.hour == UINT32_MAX || mCounters.day == UINT32_MAX) {
+      mCounters = {};
+    }
+    mPowerW = powerW == UINT16_MAX ? 0 : powerW;
+  }
+
+  // Rated power in W, 0 if unknown
+  void setPower(uint16_t powerW) {
+    mPowerW = powerW;
+  }
+
+  uint16_t getPower() const {
+    return mPowerW;
+  }
+
+  // Count the time since the previous call in the state, return true if the hour or the
+  // day changed: publish the totals of the ended periods, then call startPeriods().
+  // now is the unix time, 0 until set by NTP.
+  bool update(PilotWireState state, unsigned long nowMs, time_t now) {
+    if (mStarted && state < PILOT_WIRE_STATE_COUNT) {
+      mRemainderMs += nowMs - mLastMs;
+      uint32_t seconds = mRemainderMs / 1000;
+      mRemainderMs %= 1000;
+      mCounters.stateSeconds[state] += seconds;
+      if (isPilotWireHeating(state)) {
+        mCounters.hourHeatingSeconds += seconds;
+        mCounters.dayHeatingSeconds += seconds;
+      }
+    }
+    mStarted = true;
+    mLastMs = nowMs;
+
+    if (now == 0) {
+      return false;
+    }
+    // Unknown periods, as after the first start, are the current ones
+    if (mCounters.hour == 0 || mCounters.day == 0) {
+      mCounters.hour = getHour(now);
+      mCounters.day = getDay(now);
+    }
+    return mCounters.hour != getHour(now) || mCounters.day != getDay(now);
+  }
+
+  void startPeriods(time_t now) {
+    if (mCounters.hour != getHour(now)) {
+      mCounters.hour = getHour(now);
+      mCounters.hourHeatingSeconds = 0;
+    }
+    if (mCounters.day != getDay(now)) {
+      mCounters.day = getDay(now);
+      mCounters.dayHeatingSeconds = 0;
+    }
+  }
+
+  float getHourlyKWh() const {
+    return toKWh(mCounters.hourHeatingSeconds);
+  }
+
+  float getDailyKWh() const {
+    return toKWh(mCounters.dayHeatingSeconds);
+  }
+
+  // Saved in NVM
+  const EnergyCounters& getCounters() const {
+    return mCounters;
+  }
+
+private:
+  float toKWh(uint32_t seconds) const {
+    return mPowerW * (seconds / 3600.f) / 1000;
+  }
+
+  static uint32_t getHour(time_t now) {
+    return now / 3600;
+  }
+
+  static uint32_t getDay(time_t now) {
+    struct tm local;
+    localtime_r(&now, &local);
+    return (local.tm_year + 1900) * 1000 + local.tm_yday;
+  }
+
+  EnergyCounters mCounters = {};
+  uint16_t mPowerW = 0;
+  unsigned long mLastMs = 0;
+  uint32_t mRemainderMs = 0;
+  bool mStarted = false;
+};
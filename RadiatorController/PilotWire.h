@@ -0,0 +1,104 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stdint.h>
+
+/*
+ * Pilot wire waveforms, computed on a timer interrupt every PILOT_WIRE_TICK_MS.
+ *
+ * The pilot wire carries no signal for comfort, the full sine for eco, the negative
+ * half for frost protection and the positive half for off. Comfort -1 and -2 are
+ * comfort with the full sine during 3s or 7s at the start of every 300s period.
+ * The timer keeps the timing whatever loop() does (MQTT reconnect, OTA check...).
+ */
+
+constexpr uint32_t PILOT_WIRE_TICK_MS = 10;
+constexpr uint32_t PILOT_WIRE_PERIOD_MS = 300000;
+constexpr uint32_t PILOT_WIRE_COMFORT_MINUS_1_MS = 3000;
+constexpr uint32_t PILOT_WIRE_COMFORT_MINUS_2_MS = 7000;
+
+enum PilotWireState {
+  PILOT_WIRE_STATE_COMFORT,
+  PILOT_WIRE_STATE_ECO,
+  PILOT_WIRE_STATE_FROST_PROTECTION,
+  PILOT_WIRE_STATE_OFF,
+  PILOT_WIRE_STATE_COMFORT_MINUS_1,
+  PILOT_WIRE_STATE_COMFORT_MINUS_2,
+  PILOT_WIRE_STATE_COUNT,
+};
+
+enum PilotWireSignal {
+  PILOT_WIRE_SIGNAL_NONE,
+  PILOT_WIRE_SIGNAL_FULL,
+  PILOT_WIRE_SIGNAL_NEGATIVE,
+  PILOT_WIRE_SIGNAL_POSITIVE,
+};
+
+class PilotWireScheduler {
+public:
+  // Called with interrupts disabled, the waveform restarts at the beginning of its period
+  void setState(PilotWireState state) {
+    mState = state;
+    mTick = 0;
+  }
+
+  PilotWireState getState() const {
+    return mState;
+  }
+
+  // Called by the timer interrupt, return the signal to output until the next tick
+  PilotWireSignal IRAM_ATTR tick(unsigned long nowUs) {
+    if (mTicked) {
+      long jitter = (long)(nowUs - mLastTickUs) - (long)(PILOT_WIRE_TICK_MS * 1000);
+      unsigned long absJitter = jitter < 0 ? -jitter : jitter;
+      if (absJitter > mJitterMaxUs) {
+        mJitterMaxUs = absJitter;
+      }
+    }
+    mTicked = true;
+    mLastTickUs = nowUs;
+
+    PilotWireSignal signal = getSignal(mState, mTick * PILOT_WIRE_TICK_MS);
+    mTick = (mTick + 1) % (PILOT_WIRE_PERIOD_MS / PILOT_WIRE_TICK_MS);
+    return signal;
+  }
+
+  // Largest difference between the time of two ticks and PILOT_WIRE_TICK_MS, since the last reset
+  unsigned long getJitterMaxUs() const {
+    return mJitterMaxUs;
+  }
+
+  void resetJitter() {
+    mJitterMaxUs = 0;
+  }
+
+  // The signal never changes, the outputs hold without timer tick
+  static bool isSteady(PilotWireState state) {
+    return state != PILOT_WIRE_STATE_COMFORT_MINUS_1 && state != PILOT_WIRE_STATE_COMFORT_MINUS_2;
+  }
+
+  static PilotWireSignal IRAM_ATTR getSignal(PilotWireState state, uint32_t phaseMs) {
+    switch (state) {
+      case PILOT_WIRE_STATE_ECO:
+        return PILOT_WIRE_SIGNAL_FULL;
+      case PILOT_WIRE_STATE_FROST_PROTECTION:
+        return PILOT_WIRE_SIGNAL_NEGATIVE;
+      case PILOT_WIRE_STATE_OFF:
+        return PILOT_WIRE_SIGNAL_POSITIVE;
+      case PILOT_WIRE_STATE_COMFORT_MINUS_1:
+        return phaseMs < PILOT_WIRE_COMFORT_MINUS_1_MS ? PILOT_WIRE_SIGNAL_FULL : PILOT_WIRE_SIGNAL_NONE;
+      case PILOT_WIRE_STATE_COMFORT_MINUS_2:
+        return phaseMs < PILOT_WIRE_COMFORT_MINUS_2_MS ? PILOT_WIRE_SIGNAL_FULL : PILOT_WIRE_SIGNAL_NONE;
+      case PILOT_WIRE_STATE_COMFORT:
+      default:
+        return PILOT_WIRE_SIGNAL_NONE;
+    }
+  }
+
+private:
+  volatile PilotWireState mState = PILOT_WIRE_STATE_FROST_PROTECTION;
+  volatile uint32_t mTick = 0;
+  volatile unsigned long mJitterMaxUs = 0;
+  unsigned long mLastTickUs = 0;
+  bool mTicked = false;
+};
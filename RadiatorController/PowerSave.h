@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Idle mode, the radio and the CPU sleep between the 5s sampling windows.
+ *
+ * With the WiFi modem sleep, the radio is off between the beacons of the listen
+ * interval and the access point keeps the packets meanwhile. loop() then waits in
+ * delay(), where the SDK idles the CPU, or enters the automatic light sleep when
+ * allowed. The wait is split in POWER_SAVE_IDLE_POLL_MS delays and ends as soon as
+ * data waits in the socket, so a command waits at most one listen interval for the
+ * radio, half of the latency bound with one beacon at least, then one poll delay.
+ *
+ * The idle mode is opt-in: without a latency bound in the NVM config, loop() never
+ * waits and the radio stays on.
+ */
+
+constexpr uint16_t POWER_SAVE_LATENCY_DEFAULT_MS = 0;
+constexpr uint16_t POWER_SAVE_IDLE_POLL_MS = 10;
+constexpr uint16_t POWER_SAVE_LATENCY_MAX_MS = 5000; // Well below the MQTT keepalive (15s)
+constexpr float WIFI_BEACON_INTERVAL_MS = 102.4;     // Usual access point setting, with DTIM 1
+constexpr uint8_t WIFI_LISTEN_INTERVAL_MAX = 10;
+
+// 0 disables the idle mode
+inline bool isPowerSaveLatencyValid(long latencyMs) {
+  return latencyMs >= 0 && latencyMs <= POWER_SAVE_LATENCY_MAX_MS;
+}
+
+// Beacons between two radio wake-ups
+inline uint8_t getPowerSaveListenInterval(uint16_t latencyMs) {
+  uint16_t interval = latencyMs / 2 / WIFI_BEACON_INTERVAL_MS;
+  return interval < 1 ? 1 : interval > WIFI_LISTEN_INTERVAL_MAX ? WIFI_LISTEN_INTERVAL_MAX : interval;
+}
+
+// Longest idle wait at the end of loop(), without data in the socket
+inline uint16_t getPowerSaveIdleMs(uint16_t latencyMs) {
+  return latencyMs / 2;
+}
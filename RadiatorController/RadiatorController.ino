@@ -1,11 +1,21 @@
 #include <EEPROM.h>
 #include <ESP8266WiFi.h>
 #include <PubSubClient.h>
-#include <DHT.h>
 
+#include "CommandLatency.h"
 #include "Credentials.h"
+#include "Dht22Reader.h"
+#include "ConfigStore.h"
+#include "EnergyMeter.h"
+#include "NvmConfig.h"
 #include "RadiatorMqtt.h"
 #include "OtaUpdater.h"
+#include "PilotWire.h"
+#include "PowerSave.h"
+#include "SavedState.h"
+#include "SensorFilter.h"
+#include "TelemetryHistory.h"
+#include "Thermostat.h"
 
 // NVM CONFIG
 // Uncomment to write NVM config
@@ -31,65 +41,178 @@
 #define CTRL_ENABLE   LOW
 #define CTRL_DISABLE  HIGH
 
+// Timer1 at 80MHz / 256, 3.2us per count
+#define PILOT_WIRE_TIMER_COUNT (PILOT_WIRE_TICK_MS * 1000 * 10 / 32)
+
 // DHT22
 #define DHT_PIN     PIN_DHT22_DATA
-#define DHT_TYPE    DHT22
+#define DHT_PERIOD_MS 5000
 #define DHT_TAB_MAX 24 // 5*24 = 120s
 #define DHT_VAL_MIN 3
+#define DHT_MEDIAN_SIZE 5 // Up to 2 consecutive glitches are rejected
+#define DHT_TIMEOUT_MS 120000 // Values are dropped without valid reading for 120s
+
+// Sensors publish
+#define SENSOR_TEMPERATURE_DEADBAND 10 // 0.10 Celsius
+#define SENSOR_HUMIDITY_DEADBAND 50 // 0.50 %
+#define SENSOR_HEARTBEAT_MS 600000 // Published at least every 10 min
 
 // Wifi
 #define WIFI_HOSTNAME "%s-radiator" // %s replaced by ROOM_NAME
 
-enum PilotWireState {
-  PILOT_WIRE_STATE_COMFORT,
-  PILOT_WIRE_STATE_ECO,
-  PILOT_WIRE_STATE_FROST_PROTECTION,
-  PILOT_WIRE_STATE_OFF,
-  PILOT_WIRE_STATE_COMFORT_MINUS_1,
-  PILOT_WIRE_STATE_COMFORT_MINUS_2,
-};
+// MQTT
+#define MQTT_RECONNECT_PERIOD_MS 5000
+
+// History kept while the broker is not reachable, 4 KB hold about 16h
+#define TELEMETRY_PERIOD_MS 60000
+
+// Time
+#define NTP_SERVER "pool.ntp.org"
+#define TIME_ZONE "CET-1CEST,M3.5.0,M10.5.0/3" // Local days of the daily energy
+#define TIME_VALID_MIN 1700000000 // Before the first NTP sync the clock starts at 1970
 
-#pragma pack(1)
+// Energy
+#define ENERGY_PUBLISH_PERIOD_MS 300000
+#define RADIATOR_POWER_MAX 5000 // W
+// About 70 checkpoints fit in a sector of the NVM config store, and its sectors are
+// erased in turn: each one is erased every 2 days, 1800 times in 10 years.
+#define ENERGY_CHECKPOINT_PERIOD_MS 300000
+
+// Power save
+#define POWER_SAVE_REPORT_PERIOD_MS 300000
+
+// Remote config
+#define CONFIG_JSON_SIZE 512
+#define SENSOR_OFFSET_MAX 20
+
+// RAM copy of the NVM config, the values of the keys (see NvmConfig.h)
 struct NVMConfig {
   float     sensorTemperatureOffset;
   float     sensorHumidityOffset;
   uint32_t  deviceSerialNumber;
-  char      roomName[32];
+  char      roomName[CONFIG_ROOM_NAME_SIZE];
+  float     thermostatSetpoint;         // Out of range (NAN in a blank EEPROM) to disable the regulation
+  float     thermostatHysteresis;
+  uint16_t  radiatorPower;              // W, 0 (or 0xFFFF in a blank EEPROM) if unknown
+  EnergyCounters energy;                // Checkpoint, see ENERGY_CHECKPOINT_PERIOD_MS
+  uint16_t  powerSaveLatency;           // ms, 0 disables the idle mode, 0xFFFF (blank EEPROM) for the default
+};
+static_assert(sizeof(NVMConfig::energy) == CONFIG_ENERGY_COUNTERS_SIZE, "Energy counters differ from their NVM config key");
+
+// Last state set from Home Assistant, restored at boot (see SavedState.h)
+struct RadiatorState {
+  uint8_t   power;        // enum Power
+  uint8_t   mode;         // enum Mode
+  uint8_t   presetMode;   // enum PresetMode
 };
-static_assert(sizeof(struct NVMConfig) == 4+4+4+32, "EEPROM config structure size is incorrect");
 
 WiFiClient wifiClient;
 PubSubClient client(wifiClient);
 RadiatorMqtt mqtt(client);
-DHT dht(DHT_PIN, DHT_TYPE);
+Dht22Reader dht(DHT_PIN);
+SensorFilter<DHT_MEDIAN_SIZE, DHT_TAB_MAX> temperatureFilter; // x100
+SensorFilter<DHT_MEDIAN_SIZE, DHT_TAB_MAX> humidityFilter; // x100
+PublishDeadband temperatureDeadband(SENSOR_TEMPERATURE_DEADBAND, SENSOR_HEARTBEAT_MS);
+PublishDeadband humidityDeadband(SENSOR_HUMIDITY_DEADBAND, SENSOR_HEARTBEAT_MS);
+Thermostat thermostat;
+PilotWireScheduler pilotWire;
+TelemetryHistory history;
+EnergyMeter energy;
 OtaUpdater ota(DEVICE, VERSION);
+EspConfigFlash configFlash;
+ConfigStore<EspConfigFlash> configStore(configFlash);
+EspRtcMemory rtcMemory;
+SavedState<RadiatorState, EspRtcMemory> savedState(rtcMemory);
 struct NVMConfig config = {};
-enum Power currentPower = POWER_OFF;
+enum Power currentPower = POWER_UNKNOWN;
 enum Mode currentMode = MODE_UNKNOWN;
 enum PresetMode currentPresetMode = PRESET_MODE_UNKNOWN;
+float currentTemperature = NAN; // Filtered, NAN without valid reading
+float currentHumidity = NAN;
+unsigned long loopPeriodMaxMs = 0; // Longest wait of a received command, since the last reading
+CommandLatency commandLatency; // From a power, mode or preset command to the pilot wire output
+WiFiSleepType_t currentSleepType = WIFI_NONE_SLEEP;
 
 #ifdef WRITE_NVM_CONFIG
 void write_nvm_config() {
   Serial.println("WRITE NVM CONFIG:");
 
-  EEPROM.begin(sizeof(NVMConfig));
-
 #ifdef SERIAL_NUMBER
+  uint32_t serialNumber = SERIAL_NUMBER;
   Serial.print(" - SERIAL_NUMBER: ");
-  Serial.println(SERIAL_NUMBER);
-  EEPROM.put(offsetof(NVMConfig, deviceSerialNumber), SERIAL_NUMBER);
+  Serial.println(serialNumber);
+  configStore.set(CONFIG_KEY_DEVICE_SERIAL_NUMBER, serialNumber);
 #endif
 
 #ifdef ROOM_NAME
+  char roomName[32] = ROOM_NAME;
   Serial.print(" - ROOM_NAME: ");
-  Serial.println(ROOM_NAME);
-  EEPROM.put(offsetof(NVMConfig, roomName), ROOM_NAME);
+  Serial.println(roomName);
+  configStore.set(CONFIG_KEY_ROOM_NAME, roomName);
 #endif
 
-  EEPROM.end();
+  configStore.commit();
 }
 #endif
 
+// Config of the firmwares before the NVM config store, the other values as in a blank EEPROM
+void read_eeprom_config() {
+  EepromConfig eeprom;
+  EEPROM.begin(sizeof(eeprom));
+  EEPROM.get(0x00, eeprom);
+  EEPROM.end();
+  memset(&config, 0xFF, sizeof(config));
+  config.sensorTemperatureOffset = eeprom.sensorTemperatureOffset;
+  config.sensorHumidityOffset = eeprom.sensorHumidityOffset;
+  config.deviceSerialNumber = eeprom.deviceSerialNumber;
+  memcpy(config.roomName, eeprom.roomName, sizeof(config.roomName));
+}
+
+// Imported in a single commit, the values of a blank EEPROM keep their meaning. The
+// keys added since then are left missing, they read as in a blank EEPROM. Nothing is
+// written if a key is not staged, the import runs again on the next boot.
+void migrate_config() {
+  Serial.println("Migrate NVM config from EEPROM");
+  read_eeprom_config();
+  bool ok = configStore.set(CONFIG_KEY_SENSOR_TEMPERATURE_OFFSET, config.sensorTemperatureOffset);
+  ok &= configStore.set(CONFIG_KEY_SENSOR_HUMIDITY_OFFSET, config.sensorHumidityOffset);
+  ok &= configStore.set(CONFIG_KEY_DEVICE_SERIAL_NUMBER, config.deviceSerialNumber);
+  ok &= configStore.set(CONFIG_KEY_ROOM_NAME, config.roomName);
+  ok &= configStore.set(CONFIG_KEY_VERSION, CONFIG_VERSION);
+  if (!ok) {
+    configStore.abort();
+  }
+  if (!ok || !configStore.commit()) {
+    Serial.println("Failed to migrate NVM config");
+  }
+}
+
+// A missing key reads as in a blank EEPROM
+void load_config() {
+  memset(&config, 0xFF, sizeof(config));
+  configStore.get(CONFIG_KEY_SENSOR_TEMPERATURE_OFFSET, config.sensorTemperatureOffset);
+  configStore.get(CONFIG_KEY_SENSOR_HUMIDITY_OFFSET, config.sensorHumidityOffset);
+  configStore.get(CONFIG_KEY_DEVICE_SERIAL_NUMBER, config.deviceSerialNumber);
+  configStore.get(CONFIG_KEY_ROOM_NAME, config.roomName);
+  configStore.get(CONFIG_KEY_THERMOSTAT_SETPOINT, config.thermostatSetpoint);
+  configStore.get(CONFIG_KEY_THERMOSTAT_HYSTERESIS, config.thermostatHysteresis);
+  configStore.get(CONFIG_KEY_RADIATOR_POWER, config.radiatorPower);
+  configStore.get(CONFIG_KEY_ENERGY_COUNTERS, config.energy);
+  configStore.get(CONFIG_KEY_POWER_SAVE_LATENCY, config.powerSaveLatency);
+}
+
+// Write one value of the NVM config, the rest is kept
+void save_config(uint8_t key, const void *value, uint8_t size) {
+  if (!configStore.set(key, value, size)) {
+    configStore.abort();
+    Serial.println("Failed to save NVM config");
+    return;
+  }
+  if (!configStore.commit()) {
+    Serial.println("Failed to save NVM config");
+  }
+}
+
 void setup_wifi() {
   delay(10);
 
@@ -118,45 +241,74 @@ void setup_wifi() {
 }
 
 void mqtt_reconnect() {
-  // Loop until we're reconnected
-  while (!client.connected())
-  {
-    Serial.print("Attempting MQTT connection...");
-
-    // Create a random client ID
-    String clientId = "ESP8266Client-Radiator-";
-    clientId += String(config.roomName);
-    clientId += "-";
-    clientId += String(config.deviceSerialNumber);
-
-    // Attempt to connect
-    if (client.connect(clientId.c_str(), MQTT_USERNAME, MQTT_PASSWORD, mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_AVAILABILITY), 1, true, MQTT_PAYLOAD_OFFLINE)) {
-      Serial.println("connected");
-      client.subscribe(MQTT_TOPIC_HOMEASSISTANT_STATUS);
-      client.subscribe(MQTT_TOPIC_OTA_CHECK_UPDATE);
-      client.subscribe(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_POWER_SET));
-      client.subscribe(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_MODE_SET));
-      client.subscribe(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_PRESET_MODE_SET));
-      client.subscribe(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_FIRMWARE_VERSION_GET));
-      client.subscribe(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_SERIAL_NUMBER_GET));
-      client.subscribe(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_TEMPERATURE_OFFSET_SET));
-      client.subscribe(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_HUMIDITY_OFFSET_SET));
-      client.subscribe(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_UPDATE_COMMAND));
-      // Set device online
-      mqtt.publishMessage(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_AVAILABILITY), MQTT_PAYLOAD_ONLINE, true);
-      mqtt.publishMessageSwitchConfig();
-      mqtt.publishMessageClimateConfig();
-      mqtt.publishMessageUpdateConfig();
-      mqtt.publishMessageSensorTemperatureConfig();
-      mqtt.publishMessageSensorHumidityConfig();
-    }
-    else {
-      Serial.print("failed, rc=");
-      Serial.print(client.state());
-      Serial.println(" try again in 5 seconds");
-      // Wait 5 seconds before retrying
-      delay(5000);
-    }
+  static bool firstAttempt = true;
+  static unsigned long lastAttemptMs = 0;
+
+  if (client.connected() || (!firstAttempt && millis() - lastAttemptMs < MQTT_RECONNECT_PERIOD_MS)) {
+    return;
+  }
+  firstAttempt = false;
+  lastAttemptMs = millis();
+
+  Serial.print("Attempting MQTT connection...");
+
+  // Create a random client ID
+  String clientId = "ESP8266Client-Radiator-";
+  clientId += String(config.roomName);
+  clientId += "-";
+  clientId += String(config.deviceSerialNumber);
+
+  // Attempt to connect
+  if (client.connect(clientId.c_str(), MQTT_USERNAME, MQTT_PASSWORD, mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_AVAILABILITY), 1, true, MQTT_PAYLOAD_OFFLINE)) {
+    Serial.println("connected");
+    client.subscribe(MQTT_TOPIC_HOMEASSISTANT_STATUS);
+    client.subscribe(MQTT_TOPIC_OTA_CHECK_UPDATE);
+    client.subscribe(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_POWER_SET));
+    client.subscribe(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_MODE_SET));
+    client.subscribe(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_PRESET_MODE_SET));
+    client.subscribe(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_FIRMWARE_VERSION_GET));
+    client.subscribe(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_SERIAL_NUMBER_GET));
+    client.subscribe(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_TEMPERATURE_OFFSET_SET));
+    client.subscribe(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_HUMIDITY_OFFSET_SET));
+    client.subscribe(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_TARGET_TEMPERATURE_SET));
+    client.subscribe(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_THERMOSTAT_HYSTERESIS_SET));
+    client.subscribe(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_RADIATOR_POWER_SET));
+    client.subscribe(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_POWER_SAVE_LATENCY_SET));
+    client.subscribe(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_CONFIG_SET));
+    client.subscribe(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_UPDATE_COMMAND));
+    // Set device online
+    mqtt.publishMessage(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_AVAILABILITY), MQTT_PAYLOAD_ONLINE, true);
+    mqtt.clearDiscoveryConfigs();
+    publish_discovery();
+    publish_config();
+    // With the states changed while offline
+    mqtt.publishSnapshot();
+  }
+  else {
+    Serial.print("failed, rc=");
+    Serial.print(client.state());
+    Serial.println(" try again in 5 seconds");
+  }
+}
+
+// Only the configs changed since the last send are published
+void publish_discovery() {
+  mqtt.publishMessageSwitchConfig();
+  mqtt.publishMessageClimateConfig();
+  mqtt.publishMessageUpdateConfig();
+  mqtt.publishMessageSensorTemperatureConfig();
+  mqtt.publishMessageSensorHumidityConfig();
+  mqtt.publishMessageSensorPilotWireJitterConfig();
+  mqtt.publishMessageSensorEnergyHourlyConfig();
+  mqtt.publishMessageSensorEnergyDailyConfig();
+  mqtt.publishMessageSensorIdleConfig();
+}
+
+// Home Assistant restarted, the burst is sent after the jitter of the device
+void loop_snapshot() {
+  if (mqtt.isSnapshotDue(millis()) && client.connected()) {
+    publish_discovery();
+    mqtt.publishSnapshot();
   }
 }
 
@@ -173,18 +325,50 @@ void setup_dht() {
 void setup() {
   Serial.begin(115200, SERIAL_8N1, SERIAL_TX_ONLY);
 
+  // Last state first, kept in the RTC memory through a reset or an OTA update: the
+  // radiator doesn't wait for the serial delay, the WiFi and Home Assistant
+  RadiatorState state;
+  const char *stateSource = nullptr;
+  pinMode(PIN_RADIATOR_CTRL_NEG, OUTPUT);
+  pinMode(PIN_RADIATOR_CTRL_POS, OUTPUT);
+  set_pilot_wire_state(PILOT_WIRE_STATE_FROST_PROTECTION);
+  if (savedState.load(state)) {
+    restore_state(state);
+    stateSource = "RTC memory";
+  }
+  setup_pilot_wire();
+  unsigned long stateRestoredMs = millis();
+
   // For serial, don't miss any message
   delay(2000);
 
   Serial.println("----------------");
   Serial.println("Starting...");
 
+  if (configStore.begin()) {
+    if (configStore.getVersion() < CONFIG_VERSION) {
+      migrate_config();
+    }
 #ifdef WRITE_NVM_CONFIG
-  write_nvm_config();
+    write_nvm_config();
 #endif
-  EEPROM.begin(sizeof(NVMConfig));
-  EEPROM.get(0x00, config);
-  EEPROM.end();
+    load_config();
+  }
+  else {
+    // Without FS area in the flash layout, nothing can be saved
+    Serial.println("No flash sector for the NVM config store");
+    read_eeprom_config();
+  }
+
+  // After a power loss, from the flash copy
+  if (!stateSource) {
+    if (configStore.get(CONFIG_KEY_RADIATOR_STATE, state)) {
+      restore_state(state);
+      stateSource = "flash";
+      stateRestoredMs = millis();
+    }
+    savedState.setSaved(get_state());
+  }
 
   if (isnan(config.sensorTemperatureOffset)) {
     config.sensorTemperatureOffset = 0;
@@ -194,60 +378,117 @@ void setup() {
     config.sensorHumidityOffset = 0;
   }
 
+  if (!isPowerSaveLatencyValid(config.powerSaveLatency)) {
+    config.powerSaveLatency = POWER_SAVE_LATENCY_DEFAULT_MS;
+  }
+
+  thermostat.setSetpoint(config.thermostatSetpoint);
+  thermostat.setHysteresis(config.thermostatHysteresis);
+  energy.begin(config.energy, config.radiatorPower);
+  config.energy = energy.getCounters();
+
   Serial.print("Firmware version: ");
   Serial.println(VERSION);
   Serial.print("Temperature offset: ");
   Serial.println(config.sensorTemperatureOffset);
   Serial.print("Humidity offset: ");
   Serial.println(config.sensorHumidityOffset);
+  Serial.print("Thermostat target temperature: ");
+  Serial.println(thermostat.getSetpoint());
+  Serial.print("Thermostat hysteresis: ");
+  Serial.println(thermostat.getHysteresis());
+  Serial.print("Radiator power: ");
+  Serial.println(energy.getPower());
+  Serial.print("Power save latency: ");
+  Serial.println(config.powerSaveLatency);
   Serial.print("Serial number: ");
   Serial.println(config.deviceSerialNumber);
   Serial.print("Room name: ");
   Serial.println(config.roomName);
+  if (stateSource) {
+    Serial.printf("State restored from %s at %lu ms: power %s, mode %s, preset mode %s\n", stateSource, stateRestoredMs,
+                  getMqttPayload(currentPower), getMqttPayload(currentMode), getMqttPayload(currentPresetMode));
+  }
+  else {
+    Serial.println("No state to restore, frost protection until Home Assistant sets it");
+  }
 
   setup_wifi();
+  configTime(TIME_ZONE, NTP_SERVER);
   randomSeed(micros());
   mqtt.setup(config.roomName, config.deviceSerialNumber, VERSION, WiFi.macAddress().c_str());
+  // First states of the snapshot, sent once connected
+  publish_state();
   setup_mqtt();
   setup_dht();
 
   delay(1000);
+}
 
-  pinMode(PIN_RADIATOR_CTRL_NEG, OUTPUT);
-  pinMode(PIN_RADIATOR_CTRL_POS, OUTPUT);
+void IRAM_ATTR pilot_wire_tick() {
+  static int output = -1;
+  PilotWireSignal signal = pilotWire.tick(micros());
 
-  // Off by default
-  set_pilot_wire_state(PILOT_WIRE_STATE_FROST_PROTECTION);
+  if (signal == output) {
+    return;
+  }
+  output = signal;
+  commandLatency.mark(COMMAND_STAGE_OUTPUT);
+  switch (signal) {
+    case PILOT_WIRE_SIGNAL_NONE:
+      digitalWrite(PIN_RADIATOR_CTRL_NEG, CTRL_DISABLE);
+      digitalWrite(PIN_RADIATOR_CTRL_POS, CTRL_DISABLE);
+      break;
+    case PILOT_WIRE_SIGNAL_FULL:
+      digitalWrite(PIN_RADIATOR_CTRL_NEG, CTRL_ENABLE);
+      digitalWrite(PIN_RADIATOR_CTRL_POS, CTRL_ENABLE);
+      break;
+    case PILOT_WIRE_SIGNAL_NEGATIVE:
+      digitalWrite(PIN_RADIATOR_CTRL_NEG, CTRL_ENABLE);
+      digitalWrite(PIN_RADIATOR_CTRL_POS, CTRL_DISABLE);
+      break;
+    case PILOT_WIRE_SIGNAL_POSITIVE:
+      digitalWrite(PIN_RADIATOR_CTRL_NEG, CTRL_DISABLE);
+      digitalWrite(PIN_RADIATOR_CTRL_POS, CTRL_ENABLE);
+      break;
+  }
+}
+
+void setup_pilot_wire() {
+  timer1_attachInterrupt(pilot_wire_tick);
+  timer1_enable(TIM_DIV256, TIM_EDGE, TIM_LOOP);
+  timer1_write(PILOT_WIRE_TIMER_COUNT);
 }
 
 void set_pilot_wire_state(PilotWireState state) {
   switch(state) {
     case PILOT_WIRE_STATE_COMFORT:
       Serial.println("--> Set radiator pilot wire state comfort");
-      digitalWrite(PIN_RADIATOR_CTRL_NEG, CTRL_DISABLE);
-      digitalWrite(PIN_RADIATOR_CTRL_POS, CTRL_DISABLE);
       break;
     case PILOT_WIRE_STATE_ECO:
       Serial.println("--> Set radiator pilot wire state eco");
-      digitalWrite(PIN_RADIATOR_CTRL_NEG, CTRL_ENABLE);
-      digitalWrite(PIN_RADIATOR_CTRL_POS, CTRL_ENABLE);
       break;
     case PILOT_WIRE_STATE_FROST_PROTECTION:
       Serial.println("--> Set radiator pilot wire state frost protection");
-      digitalWrite(PIN_RADIATOR_CTRL_NEG, CTRL_ENABLE);
-      digitalWrite(PIN_RADIATOR_CTRL_POS, CTRL_DISABLE);
       break;
     case PILOT_WIRE_STATE_OFF:
       Serial.println("--> Set radiator pilot wire state off");
-      digitalWrite(PIN_RADIATOR_CTRL_NEG, CTRL_DISABLE);
-      digitalWrite(PIN_RADIATOR_CTRL_POS, CTRL_ENABLE);
       break;
     case PILOT_WIRE_STATE_COMFORT_MINUS_1:
+      Serial.println("--> Set radiator pilot wire state comfort -1");
+      break;
     case PILOT_WIRE_STATE_COMFORT_MINUS_2:
+      Serial.println("--> Set radiator pilot wire state comfort -2");
+      break;
     default:
       Serial.println("ERROR: Radiator pilote wire state is not supported!");
       return;
   }
+  // Applied by the next timer tick
+  noInterrupts();
+  pilotWire.setState(state);
+  commandLatency.mark(COMMAND_STAGE_APPLIED);
+  interrupts();
 }
 
 void set_power(enum Power power) {
@@ -317,32 +558,315 @@ void set_preset_mode(enum PresetMode preset_mode) {
     Serial.println("Radiator is not mode heat/auto, cannot apply preset mode now");
     return;
   }
-  mqtt.publishMessage(ACTION_HEATING);
   switch (preset_mode) {
     case PRESET_MODE_COMFORT:
       Serial.println("Set radiator preset mode comfort");
-      set_pilot_wire_state(PILOT_WIRE_STATE_COMFORT);
+      loop_thermostat(true);
       break;
     case PRESET_MODE_ECO:
       Serial.println("Set radiator preset mode eco");
+      mqtt.publishMessage(ACTION_HEATING);
       set_pilot_wire_state(PILOT_WIRE_STATE_ECO);
       break;
     case PRESET_MODE_AWAY:
       Serial.println("Set radiator preset mode away");
+      mqtt.publishMessage(ACTION_HEATING);
       set_pilot_wire_state(PILOT_WIRE_STATE_FROST_PROTECTION);
       break;
+    case PRESET_MODE_COMFORT_MINUS_1:
+      Serial.println("Set radiator preset mode comfort -1");
+      mqtt.publishMessage(ACTION_HEATING);
+      set_pilot_wire_state(PILOT_WIRE_STATE_COMFORT_MINUS_1);
+      break;
+    case PRESET_MODE_COMFORT_MINUS_2:
+      Serial.println("Set radiator preset mode comfort -2");
+      mqtt.publishMessage(ACTION_HEATING);
+      set_pilot_wire_state(PILOT_WIRE_STATE_COMFORT_MINUS_2);
+      break;
     default:
       Serial.println("ERROR: Radiator mode is not supported!");
       return;
   }
 }
 
+RadiatorState get_state() {
+  RadiatorState state = { (uint8_t)currentPower, (uint8_t)currentMode, (uint8_t)currentPresetMode };
+  return state;
+}
+
+// Pilot wire of the last state, before the network is up: nothing is published, the
+// comfort preset heats until the first reading of the thermostat
+void restore_state(const RadiatorState &state) {
+  currentPower = state.power <= POWER_ON ? (enum Power)state.power : POWER_UNKNOWN;
+  currentMode = state.mode <= MODE_AUTO ? (enum Mode)state.mode : MODE_UNKNOWN;
+  currentPresetMode = state.presetMode <= PRESET_MODE_COMFORT_MINUS_2 ? (enum PresetMode)state.presetMode : PRESET_MODE_UNKNOWN;
+
+  if (currentPower == POWER_OFF || (currentPower == POWER_ON && currentMode == MODE_OFF)) {
+    set_pilot_wire_state(PILOT_WIRE_STATE_OFF);
+    return;
+  }
+  if (currentPower != POWER_ON || (currentMode != MODE_HEAT && currentMode != MODE_AUTO)) {
+    return;
+  }
+  switch (currentPresetMode) {
+    case PRESET_MODE_COMFORT:
+      set_pilot_wire_state(PILOT_WIRE_STATE_COMFORT);
+      break;
+    case PRESET_MODE_ECO:
+      set_pilot_wire_state(PILOT_WIRE_STATE_ECO);
+      break;
+    case PRESET_MODE_AWAY:
+      set_pilot_wire_state(PILOT_WIRE_STATE_FROST_PROTECTION);
+      break;
+    case PRESET_MODE_COMFORT_MINUS_1:
+      set_pilot_wire_state(PILOT_WIRE_STATE_COMFORT_MINUS_1);
+      break;
+    case PRESET_MODE_COMFORT_MINUS_2:
+      set_pilot_wire_state(PILOT_WIRE_STATE_COMFORT_MINUS_2);
+      break;
+    default:
+      break;
+  }
+}
+
+// State restored at boot, the power is left unknown until Home Assistant sets it
+void publish_state() {
+  if (currentPower != POWER_UNKNOWN) {
+    mqtt.publishMessage(currentPower);
+  }
+  mqtt.publishMessage(currentPower != POWER_ON ? MODE_OFF : currentMode);
+  mqtt.publishMessage(currentPresetMode);
+  publish_target_temperature();
+}
+
+// RTC memory on each change, flash copy once the state is settled
+void loop_state() {
+  RadiatorState state = get_state();
+
+  savedState.update(state, millis());
+  if (savedState.isSaveDue(millis())) {
+    Serial.println("Save state");
+    save_config(CONFIG_KEY_RADIATOR_STATE, &state, sizeof(state));
+    savedState.setSaved(state);
+  }
+}
+
+// Comfort preset in heat mode: comfort below the target temperature, eco above
+void loop_thermostat(bool force) {
+  if (currentPower != POWER_ON || currentMode != MODE_HEAT || currentPresetMode != PRESET_MODE_COMFORT) {
+    return;
+  }
+  bool heating = thermostat.isHeating();
+  if (thermostat.update(currentTemperature, millis()) != heating || force) {
+    heating = thermostat.isHeating();
+    Serial.printf("Thermostat %s: temperature=%f, target=%f\n", heating ? "heating" : "idle", currentTemperature, thermostat.getSetpoint());
+    mqtt.publishMessage(heating ? ACTION_HEATING : ACTION_IDLE);
+    set_pilot_wire_state(heating ? PILOT_WIRE_STATE_COMFORT : PILOT_WIRE_STATE_ECO);
+  }
+}
+
+void publish_target_temperature() {
+  if (thermostat.isEnabled()) {
+    mqtt.publishMessage(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_TARGET_TEMPERATURE), thermostat.getSetpoint());
+  }
+}
+
+void set_target_temperature(float setpoint) {
+  thermostat.setSetpoint(setpoint);
+  setpoint = thermostat.getSetpoint();
+  if (setpoint != config.thermostatSetpoint && !(isnan(setpoint) && isnan(config.thermostatSetpoint))) {
+    config.thermostatSetpoint = setpoint;
+    save_config(CONFIG_KEY_THERMOSTAT_SETPOINT, &config.thermostatSetpoint, sizeof(config.thermostatSetpoint));
+    publish_config();
+  }
+  if (!thermostat.isEnabled()) {
+    Serial.println("Thermostat disabled");
+  }
+  publish_target_temperature();
+  loop_thermostat(false);
+}
+
+// Nothing without radiator power, the time counters are still kept
+void publish_energy() {
+  if (energy.getPower() == 0) {
+    return;
+  }
+  mqtt.publishMessageEnergy(energy.getHourlyKWh(), energy.getDailyKWh(), energy.getCounters().stateSeconds);
+}
+
+void save_energy() {
+  if (memcmp(&config.energy, &energy.getCounters(), sizeof(EnergyCounters)) == 0) {
+    return;
+  }
+  Serial.println("Save energy counters");
+  config.energy = energy.getCounters();
+  save_config(CONFIG_KEY_ENERGY_COUNTERS, &config.energy, sizeof(config.energy));
+}
+
+// Used in the MQTT topics and the WiFi hostname
+bool is_room_name_valid(const char *name) {
+  size_t len = strlen(name);
+
+  if (len == 0 || len >= sizeof(config.roomName)) {
+    return false;
+  }
+  for (size_t i=0; i<len; i++) {
+    if (!isalnum(name[i]) && name[i] != '_' && name[i] != '-') {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Offset of the DHT22 readings, from /config or its own topic
+bool is_sensor_offset_valid(float offset) {
+  return fabs(offset) <= SENSOR_OFFSET_MAX;
+}
+
+// Stage a value of the NVM config if it changed, return true if it changed. ok is
+// cleared if the value can't be staged, the batch is then aborted.
+bool stage_config(uint8_t key, const void *value, const void *current, uint8_t size, bool &ok) {
+  if (memcmp(value, current, size) == 0) {
+    return false;
+  }
+  ok &= configStore.set(key, value, size);
+  return true;
+}
+
+void publish_config() {
+  StaticJsonDocument<CONFIG_JSON_SIZE> json;
+  char payload[CONFIG_JSON_SIZE];
+
+  json["serial_number"] = config.deviceSerialNumber;
+  json["room_name"] = config.roomName;
+  json["temperature_offset"] = config.sensorTemperatureOffset;
+  json["humidity_offset"] = config.sensorHumidityOffset;
+  if (thermostat.isEnabled()) {
+    json["target_temperature"] = thermostat.getSetpoint();
+  }
+  else {
+    json["target_temperature"] = (const char*)nullptr;
+  }
+  json["thermostat_hysteresis"] = thermostat.getHysteresis();
+  json["radiator_power"] = energy.getPower();
+  json["power_save_latency"] = config.powerSaveLatency;
+  serializeJson(json, payload, sizeof(payload));
+  mqtt.publishMessage(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_CONFIG), payload, true);
+}
+
+// Apply any keys of /config in a single NVM commit, nothing if a value is invalid.
+// The room name and the serial number are in the MQTT topics, the device restarts.
+void set_config(const byte* payload, unsigned int len) {
+  StaticJsonDocument<CONFIG_JSON_SIZE> json;
+  struct NVMConfig next = config;
+  bool valid = true;
+
+  DeserializationError error = deserializeJson(json, payload, len);
+  if (error) {
+    Serial.print("Config JSON error: ");
+    Serial.println(error.f_str());
+    return;
+  }
+
+  if (json.containsKey("serial_number")) {
+    next.deviceSerialNumber = json["serial_number"].as<uint32_t>();
+    valid &= json["serial_number"].is<uint32_t>() && next.deviceSerialNumber > 0;
+  }
+  if (json.containsKey("room_name")) {
+    const char* name = json["room_name"];
+    valid &= name != nullptr && is_room_name_valid(name);
+    if (valid) {
+      memset(next.roomName, 0, sizeof(next.roomName));
+      strncpy(next.roomName, name, sizeof(next.roomName) - 1);
+    }
+  }
+  if (json.containsKey("temperature_offset")) {
+    next.sensorTemperatureOffset = json["temperature_offset"].as<float>();
+    valid &= json["temperature_offset"].is<float>() && is_sensor_offset_valid(next.sensorTemperatureOffset);
+  }
+  if (json.containsKey("humidity_offset")) {
+    next.sensorHumidityOffset = json["humidity_offset"].as<float>();
+    valid &= json["humidity_offset"].is<float>() && is_sensor_offset_valid(next.sensorHumidityOffset);
+  }
+  if (json.containsKey("target_temperature")) {
+    // null or out of range disables the regulation, as on /target_temperature/set
+    next.thermostatSetpoint = json["target_temperature"].as<float>();
+    valid &= json["target_temperature"].isNull() || json["target_temperature"].is<float>();
+    if (!isThermostatSetpointValid(next.thermostatSetpoint)) {
+      next.thermostatSetpoint = NAN;
+    }
+  }
+  if (json.containsKey("thermostat_hysteresis")) {
+    next.thermostatHysteresis = json["thermostat_hysteresis"].as<float>();
+    valid &= json["thermostat_hysteresis"].is<float>() && isThermostatHysteresisValid(next.thermostatHysteresis);
+  }
+  if (json.containsKey("radiator_power")) {
+    long power = json["radiator_power"].as<long>();
+    valid &= json["radiator_power"].is<long>() && power >= 0 && power <= RADIATOR_POWER_MAX;
+    next.radiatorPower = power;
+  }
+  if (json.containsKey("power_save_latency")) {
+    long latency = json["power_save_latency"].as<long>();
+    valid &= json["power_save_latency"].is<long>() && isPowerSaveLatencyValid(latency);
+    next.powerSaveLatency = latency;
+  }
+  if (!valid) {
+    Serial.println("Invalid config, nothing applied");
+    return;
+  }
+
+  bool staged = true;
+  bool restart = stage_config(CONFIG_KEY_DEVICE_SERIAL_NUMBER, &next.deviceSerialNumber, &config.deviceSerialNumber, sizeof(config.deviceSerialNumber), staged);
+  restart |= stage_config(CONFIG_KEY_ROOM_NAME, next.roomName, config.roomName, sizeof(config.roomName), staged);
+  stage_config(CONFIG_KEY_SENSOR_TEMPERATURE_OFFSET, &next.sensorTemperatureOffset, &config.sensorTemperatureOffset, sizeof(config.sensorTemperatureOffset), staged);
+  stage_config(CONFIG_KEY_SENSOR_HUMIDITY_OFFSET, &next.sensorHumidityOffset, &config.sensorHumidityOffset, sizeof(config.sensorHumidityOffset), staged);
+  bool setpoint = stage_config(CONFIG_KEY_THERMOSTAT_SETPOINT, &next.thermostatSetpoint, &config.thermostatSetpoint, sizeof(config.thermostatSetpoint), staged);
+  bool hysteresis = stage_config(CONFIG_KEY_THERMOSTAT_HYSTERESIS, &next.thermostatHysteresis, &config.thermostatHysteresis, sizeof(config.thermostatHysteresis), staged);
+  bool power = stage_config(CONFIG_KEY_RADIATOR_POWER, &next.radiatorPower, &config.radiatorPower, sizeof(config.radiatorPower), staged);
+  stage_config(CONFIG_KEY_POWER_SAVE_LATENCY, &next.powerSaveLatency, &config.powerSaveLatency, sizeof(config.powerSaveLatency), staged);
+  if (!staged) {
+    configStore.abort();
+    Serial.println("Failed to save NVM config");
+    return;
+  }
+  if (!configStore.commit()) {
+    Serial.println("Failed to save NVM config");
+    return;
+  }
+  config = next;
+
+  if (hysteresis) {
+    thermostat.setHysteresis(config.thermostatHysteresis);
+  }
+  if (setpoint) {
+    thermostat.setSetpoint(config.thermostatSetpoint);
+    publish_target_temperature();
+    loop_thermostat(false);
+  }
+  if (power) {
+    energy.setPower(config.radiatorPower);
+    publish_energy();
+  }
+  publish_config();
+
+  if (restart) {
+    // Retained config of the previous topics cleared, the disconnect flushes it
+    // to the broker before the restart drops the connection
+    mqtt.publishMessage(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_CONFIG), "", true);
+    client.disconnect();
+    save_energy();
+    Serial.println("Restart with the new room name or serial number");
+    ESP.restart();
+  }
+}
+
 void mqtt_callback(char* topic, byte* payload, unsigned int len) {
+  commandLatency.arrival();
   Serial.print("Message arrived [");
   Serial.print(topic);
   Serial.print("] ");
 
-  for (int i=0; i<len; i++) {
+  for (unsigned int i=0; i<len; i++) {
     Serial.print((char)payload[i]);
   }
   Serial.println();
@@ -354,12 +878,15 @@ void mqtt_callback(char* topic, byte* payload, unsigned int len) {
     mqtt.publishMessage(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_SERIAL_NUMBER), String(config.deviceSerialNumber).c_str());
   }
   else if (isTopicEqual(topic, mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_POWER_SET))) {
+    commandLatency.mark(COMMAND_STAGE_DISPATCH);
     set_power(getPowerFromMqttPayload((char*)payload, len));
   }
   else if (isTopicEqual(topic, mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_MODE_SET))) {
+    commandLatency.mark(COMMAND_STAGE_DISPATCH);
     set_mode(getModeFromMqttPayload((char*)payload, len));
   }
   else if (isTopicEqual(topic, mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_PRESET_MODE_SET))) {
+    commandLatency.mark(COMMAND_STAGE_DISPATCH);
     set_preset_mode(getPresetModeFromMqttPayload((char*)payload, len));
   }
   else if (isTopicEqual(topic, mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_TEMPERATURE_OFFSET_SET))) {
@@ -368,16 +895,15 @@ void mqtt_callback(char* topic, byte* payload, unsigned int len) {
     float val;
     memcpy(val_str, payload, len);
     val_str[len] = '\0';
-    val = strtof((char*)payload, &endptr);
+    val = strtof(val_str, &endptr);
     Serial.printf("Set temperature offset to %f\n", val);
-    if ((char*)payload == endptr) {
+    if ((char*)val_str == endptr || !is_sensor_offset_valid(val)) {
       Serial.println("Invalid temperature offset value");
     }
     else if (val != config.sensorTemperatureOffset) {
       config.sensorTemperatureOffset = val;
-      EEPROM.begin(sizeof(NVMConfig));
-      EEPROM.put(offsetof(NVMConfig, sensorTemperatureOffset), config.sensorTemperatureOffset);
-      EEPROM.end();
+      save_config(CONFIG_KEY_SENSOR_TEMPERATURE_OFFSET, &config.sensorTemperatureOffset, sizeof(config.sensorTemperatureOffset));
+      publish_config();
     }
   }
   else if (isTopicEqual(topic, mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_HUMIDITY_OFFSET_SET))) {
@@ -388,22 +914,91 @@ void mqtt_callback(char* topic, byte* payload, unsigned int len) {
     val_str[len] = '\0';
     val = strtof(val_str, &endptr);
     Serial.printf("Set humidity offset to %f\n", val);
-    if ((char*)val_str == endptr) {
+    if ((char*)val_str == endptr || !is_sensor_offset_valid(val)) {
       Serial.println("Invalid humidity offset value");
     }
     else if (val != config.sensorHumidityOffset) {
       config.sensorHumidityOffset = val;
-      EEPROM.begin(sizeof(NVMConfig));
-      EEPROM.put(offsetof(NVMConfig, sensorHumidityOffset), config.sensorHumidityOffset);
-      EEPROM.end();
+      save_config(CONFIG_KEY_SENSOR_HUMIDITY_OFFSET, &config.sensorHumidityOffset, sizeof(config.sensorHumidityOffset));
+      publish_config();
+    }
+  }
+  else if (isTopicEqual(topic, mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_TARGET_TEMPERATURE_SET))) {
+    char *endptr = nullptr;
+    char val_str[len+1];
+    float val;
+    memcpy(val_str, payload, len);
+    val_str[len] = '\0';
+    val = strtof(val_str, &endptr);
+    Serial.printf("Set target temperature to %f\n", val);
+    if ((char*)val_str == endptr) {
+      Serial.println("Invalid target temperature value");
+    }
+    else {
+      set_target_temperature(val);
+    }
+  }
+  else if (isTopicEqual(topic, mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_THERMOSTAT_HYSTERESIS_SET))) {
+    char *endptr = nullptr;
+    char val_str[len+1];
+    float val;
+    memcpy(val_str, payload, len);
+    val_str[len] = '\0';
+    val = strtof(val_str, &endptr);
+    Serial.printf("Set thermostat hysteresis to %f\n", val);
+    if ((char*)val_str == endptr || !isThermostatHysteresisValid(val)) {
+      Serial.println("Invalid thermostat hysteresis value");
+    }
+    else if (val != config.thermostatHysteresis) {
+      thermostat.setHysteresis(val);
+      config.thermostatHysteresis = val;
+      save_config(CONFIG_KEY_THERMOSTAT_HYSTERESIS, &config.thermostatHysteresis, sizeof(config.thermostatHysteresis));
+      publish_config();
+    }
+  }
+  else if (isTopicEqual(topic, mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_RADIATOR_POWER_SET))) {
+    char *endptr = nullptr;
+    char val_str[len+1];
+    long val;
+    memcpy(val_str, payload, len);
+    val_str[len] = '\0';
+    val = strtol(val_str, &endptr, 10);
+    Serial.printf("Set radiator power to %ld W\n", val);
+    if ((char*)val_str == endptr || val < 0 || val > RADIATOR_POWER_MAX) {
+      Serial.println("Invalid radiator power value");
+    }
+    else if (val != config.radiatorPower) {
+      energy.setPower(val);
+      config.radiatorPower = val;
+      save_config(CONFIG_KEY_RADIATOR_POWER, &config.radiatorPower, sizeof(config.radiatorPower));
+      publish_energy();
+      publish_config();
+    }
+  }
+  else if (isTopicEqual(topic, mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_POWER_SAVE_LATENCY_SET))) {
+    char *endptr = nullptr;
+    char val_str[len+1];
+    long val;
+    memcpy(val_str, payload, len);
+    val_str[len] = '\0';
+    val = strtol(val_str, &endptr, 10);
+    Serial.printf("Set power save latency to %ld ms\n", val);
+    if ((char*)val_str == endptr || !isPowerSaveLatencyValid(val)) {
+      Serial.println("Invalid power save latency value");
     }
+    else if (val != config.powerSaveLatency) {
+      config.powerSaveLatency = val;
+      save_config(CONFIG_KEY_POWER_SAVE_LATENCY, &config.powerSaveLatency, sizeof(config.powerSaveLatency));
+      publish_config();
+    }
+  }
+  else if (isTopicEqual(topic, mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_CONFIG_SET))) {
+    set_config(payload, len);
   }
   else if (isTopicEqual(topic, MQTT_TOPIC_HOMEASSISTANT_STATUS)) {
     if (isPayloadEqual<MQTT_PAYLOAD_ONLINE>((char*) payload, len)) {
       Serial.println("Home Assistant is connected");
-      mqtt.publishMessage(currentPower);
-      mqtt.publishMessage(currentPower != POWER_ON ? MODE_OFF : currentMode);
-      mqtt.publishMessage(currentPresetMode);
+      mqtt.scheduleSnapshot(millis(), random(MQTT_SNAPSHOT_JITTER_MAX_MS));
     }
   }
   else if (isTopicEqual(topic, MQTT_TOPIC_OTA_CHECK_UPDATE)) {
@@ -431,6 +1026,7 @@ void mqtt_callback(char* topic, byte* payload, unsigned int len) {
       mqtt.deleteMessageUpdateCommand();
       if (ota.getExpectedVersion() != VERSION) {
         mqtt.publishMessageUpdateState(ota.getExpectedVersion().c_str(), true);
+        save_energy();
         ota.doUpdate();
         mqtt.publishMessageUpdateState(ota.getExpectedVersion().c_str(), false);
       }
@@ -438,65 +1034,202 @@ void mqtt_callback(char* topic, byte* payload, unsigned int len) {
   }
 }
 
-int32_t computeAverage(int16_t val[DHT_TAB_MAX]) {
-  int64_t res = 0;
-  int valid = 0;
-  int i;
-  for (i=0; i<DHT_TAB_MAX; i++) {
-    if (val[i]) {
-      res += val[i];
-      valid++;
-    }
-  }
-  if (valid < DHT_VAL_MIN) {
-    return 0;
-  }
-  return res/valid;
-}
-
 void loop_temp() {
-  static int16_t temperatureTab[DHT_TAB_MAX] = {};
-  static int16_t humidityTab[DHT_TAB_MAX] = {};
-  static int i = 0;
-  float humidity = dht.readHumidity();       // in %
-  float temperature = dht.readTemperature(); // in Celsius
+  static unsigned long lastValidTime = 0;
+  unsigned long currentTime = millis();
+  float humidity = dht.getHumidity();       // in %
+  float temperature = dht.getTemperature(); // in Celsius
+
+  Serial.printf("Loop period max: %lu ms\n", loopPeriodMaxMs);
+  loopPeriodMaxMs = 0;
+  if (commandLatency.getCompleted() > 0) {
+    Serial.printf("Last command latency: dispatch=%u us, applied=%u us, output=%u us\n", commandLatency.getLastUs(COMMAND_STAGE_DISPATCH),
+                  commandLatency.getLastUs(COMMAND_STAGE_APPLIED), commandLatency.getLastUs(COMMAND_STAGE_OUTPUT));
+  }
 
   if (isnan(humidity) || isnan(temperature) || (humidity == 0 && temperature == 0)) {
     Serial.println("Fail to read temperature or humidity from dht22 sensor");
-    humidityTab[i] = 0;
-    temperatureTab[i] = 0;
+    if (currentTime - lastValidTime > DHT_TIMEOUT_MS) {
+      humidityFilter.reset();
+      temperatureFilter.reset();
+    }
   } else {
     humidity += config.sensorHumidityOffset;
     temperature += config.sensorTemperatureOffset;
-    humidityTab[i] = humidity * 100;
-    temperatureTab[i] = temperature * 100.;
+    humidityFilter.add(round(humidity * 100));
+    temperatureFilter.add(round(temperature * 100));
+    lastValidTime = currentTime;
   }
 
-  i = (i + 1) % DHT_TAB_MAX;
+  if (temperatureFilter.getCount() < DHT_VAL_MIN) {
+    currentTemperature = NAN;
+    currentHumidity = NAN;
+    loop_thermostat(false);
+    return;
+  }
 
-  humidity = computeAverage(humidityTab) / 100.;
-  temperature = computeAverage(temperatureTab) / 100.;
+  humidity = humidityFilter.get() / 100.;
+  temperature = temperatureFilter.get() / 100.;
 
-  if (temperature > 0 && temperature < 80 & humidity > 0 && humidity < 100) {
-    mqtt.publishMessage(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_SENSOR_HUMIDITY), humidity);
-    mqtt.publishMessage(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_SENSOR_TEMPERATURE), temperature);
+  if (temperature >= -40 && temperature <= 80 && humidity >= 0 && humidity <= 100) {
+    if (humidityDeadband.check(humidityFilter.get(), currentTime)) {
+      mqtt.publishMessage(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_SENSOR_HUMIDITY), humidity);
+    }
+    if (temperatureDeadband.check(temperatureFilter.get(), currentTime)) {
+      mqtt.publishMessage(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_SENSOR_TEMPERATURE), temperature);
+    }
+    currentTemperature = temperature;
+    currentHumidity = humidity;
   } else {
     Serial.printf("Invalid value: temperature=%f, humidity=%f\n", temperature, humidity);
+    currentTemperature = NAN;
+    currentHumidity = NAN;
+  }
+  loop_thermostat(false);
+}
+
+// Sensors sampled while the broker is not reachable, sent block by block once connected
+void loop_history() {
+  static unsigned long lastTime = 0;
+  static TelemetrySample samples[TELEMETRY_BLOCK_SAMPLE_MAX];
+
+  if (!client.connected()) {
+    time_t now = time(nullptr);
+    if (millis() - lastTime < TELEMETRY_PERIOD_MS || now < TIME_VALID_MIN ||
+        isnan(currentTemperature) || isnan(currentHumidity)) {
+      return;
+    }
+    lastTime = millis();
+    TelemetrySample sample = {
+      (uint32_t)now,
+      (int16_t)lround(currentTemperature * 100),
+      (uint16_t)lround(currentHumidity * 10),
+      (int8_t)(WiFi.status() == WL_CONNECTED ? WiFi.RSSI() : 0),
+    };
+    history.add(sample);
+  }
+  else if (history.getBlockCount() > 0) {
+    uint8_t count = history.readOldestBlock(samples);
+    if (mqtt.publishMessageHistory(samples, count)) {
+      history.dropOldestBlock();
+    }
+  }
+}
+
+// The totals of an ended hour or day are published before the next period starts
+void loop_energy() {
+  static unsigned long lastPublishTime = 0;
+  static unsigned long lastSaveTime = 0;
+  unsigned long currentTime = millis();
+  time_t now = time(nullptr);
+
+  if (energy.update(pilotWire.getState(), currentTime, now >= TIME_VALID_MIN ? now : 0)) {
+    publish_energy();
+    energy.startPeriods(now);
+    lastPublishTime = currentTime;
+  }
+  else if (currentTime - lastPublishTime >= ENERGY_PUBLISH_PERIOD_MS) {
+    publish_energy();
+    lastPublishTime = currentTime;
+  }
+
+  if (currentTime - lastSaveTime >= ENERGY_CHECKPOINT_PERIOD_MS) {
+    save_energy();
+    lastSaveTime = currentTime;
   }
 }
 
+// Largest timer tick jitter, once per waveform period
+void loop_pilot_wire_jitter() {
+  static unsigned long lastTime = millis();
+  unsigned long jitterUs;
+
+  if (millis() - lastTime < PILOT_WIRE_PERIOD_MS) {
+    return;
+  }
+  lastTime = millis();
+
+  noInterrupts();
+  jitterUs = pilotWire.getJitterMaxUs();
+  pilotWire.resetJitter();
+  interrupts();
+  // Ticks stop during the light sleep, only used when the signal is steady
+  if (currentSleepType == WIFI_LIGHT_SLEEP) {
+    return;
+  }
+  mqtt.publishState(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_SENSOR_PILOT_WIRE_JITTER), String(jitterUs).c_str());
+}
+
+// Sleep mode follows the pilot wire state, then the idle wait ends the loop, except
+// while a DHT22 reading or a history backfill is in progress. The wait stops when data
+// arrives in the MQTT socket, client.loop() reads it next.
+void loop_power_save(unsigned long nextDhtMs) {
+  static unsigned long lastReportTime = millis();
+  static unsigned long idleMs = 0;
+  static uint16_t latencyMs = 0;
+  unsigned long currentTime = millis();
+  WiFiSleepType_t sleepType = WIFI_NONE_SLEEP;
+
+  if (config.powerSaveLatency > 0) {
+    sleepType = PilotWireScheduler::isSteady(pilotWire.getState()) ? WIFI_LIGHT_SLEEP : WIFI_MODEM_SLEEP;
+  }
+  if (sleepType != currentSleepType || config.powerSaveLatency != latencyMs) {
+    Serial.printf("Set WiFi sleep mode %d, listen interval %d\n", sleepType, getPowerSaveListenInterval(config.powerSaveLatency));
+    WiFi.setSleepMode(sleepType, getPowerSaveListenInterval(config.powerSaveLatency));
+    if (currentSleepType == WIFI_LIGHT_SLEEP) {
+      noInterrupts();
+      pilotWire.resetJitter();
+      interrupts();
+    }
+    currentSleepType = sleepType;
+    latencyMs = config.powerSaveLatency;
+  }
+
+  if (currentTime - lastReportTime >= POWER_SAVE_REPORT_PERIOD_MS) {
+    mqtt.publishState(mqtt.getRadTopic(MQTT_TOPIC_RAD_SUFFIX_SENSOR_IDLE), String(idleMs * 100 / (currentTime - lastReportTime)).c_str());
+    lastReportTime = currentTime;
+    idleMs = 0;
+  }
+
+  if (config.powerSaveLatency == 0 || dht.isBusy() || (client.connected() && history.getBlockCount() > 0)) {
+    return;
+  }
+  unsigned long waitMs = nextDhtMs < getPowerSaveIdleMs(latencyMs) ? nextDhtMs : getPowerSaveIdleMs(latencyMs);
+  while (millis() - currentTime < waitMs && !wifiClient.available()) {
+    unsigned long leftMs = waitMs - (millis() - currentTime);
+    delay(leftMs < POWER_SAVE_IDLE_POLL_MS ? leftMs : POWER_SAVE_IDLE_POLL_MS);
+  }
+  idleMs += millis() - currentTime;
+}
+
 void loop() {
   static unsigned long lastTime = 0;
+  static unsigned long lastLoopTime = millis();
   unsigned long currentTime = millis();
-  
+
+  // A command received during the previous loop is handled now
+  if (currentTime - lastLoopTime > loopPeriodMaxMs) {
+    loopPeriodMaxMs = currentTime - lastLoopTime;
+  }
+  lastLoopTime = currentTime;
+
   mqtt_reconnect();
   client.loop();
 
-
-  if (currentTime - lastTime > 5000) {
+  // The DHT22 frame is received in background, then decoded by dht.loop()
+  if (currentTime - lastTime > DHT_PERIOD_MS) {
     lastTime = currentTime;
+    dht.start();
+  }
+  if (dht.loop()) {
     loop_temp();
   }
 
-  delay(500);
+  loop_history();
+  loop_energy();
+  loop_state();
+  loop_snapshot();
+  loop_pilot_wire_jitter();
+  currentTime = millis();
+  loop_power_save(currentTime - lastTime < DHT_PERIOD_MS ? DHT_PERIOD_MS - (currentTime - lastTime) : 0);
 }
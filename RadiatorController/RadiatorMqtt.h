@@ -3,6 +3,11 @@
 #include <ArduinoJson.h>
 #include <PubSubClient.h>
 
+#include "EnergyMeter.h"
+#include "MqttSnapshot.h"
+#include "TelemetryHistory.h"
+#include "Thermostat.h"
+
 constexpr size_t MQTT_MSG_TOPIC_MAX_SIZE  = 64;
 constexpr size_t MQTT_MSG_PAYLOAD_MAX_SIZE = 4096;
 
@@ -14,6 +19,10 @@ constexpr const char* MQTT_TOPIC_HOMEASSISTANT_CLIMATE_CONFIG        = "homeassi
 constexpr const char* MQTT_TOPIC_HOMEASSISTANT_UPDATE_CONFIG         = "homeassistant/update/radiator_climate_%s_%d/config"; // %s replaced by ROOM_NAME, %d replaced by SERIAL_NUMBER
 constexpr const char* MQTT_TOPIC_HA_SENSOR_TEMPERATURE_CONFIG        = "homeassistant/sensor/radiator_temperature_%s_%d/config"; // %s replaced by ROOM_NAME, %d replaced by SERIAL_NUMBER
 constexpr const char* MQTT_TOPIC_HA_SENSOR_HUMIDITY_CONFIG           = "homeassistant/sensor/radiator_humidity_%s_%d/config"; // %s replaced by ROOM_NAME, %d replaced by SERIAL_NUMBER
+constexpr const char* MQTT_TOPIC_HA_SENSOR_PILOT_WIRE_JITTER_CONFIG  = "homeassistant/sensor/radiator_pilot_wire_jitter_%s_%d/config"; // %s replaced by ROOM_NAME, %d replaced by SERIAL_NUMBER
+constexpr const char* MQTT_TOPIC_HA_SENSOR_ENERGY_HOURLY_CONFIG      = "homeassistant/sensor/radiator_energy_hourly_%s_%d/config"; // %s replaced by ROOM_NAME, %d replaced by SERIAL_NUMBER
+constexpr const char* MQTT_TOPIC_HA_SENSOR_ENERGY_DAILY_CONFIG       = "homeassistant/sensor/radiator_energy_daily_%s_%d/config"; // %s replaced by ROOM_NAME, %d replaced by SERIAL_NUMBER
+constexpr const char* MQTT_TOPIC_HA_SENSOR_IDLE_CONFIG               = "homeassistant/sensor/radiator_idle_%s_%d/config"; // %s replaced by ROOM_NAME, %d replaced by SERIAL_NUMBER
 // OTA firmware server
 constexpr const char* MQTT_TOPIC_OTA_CHECK_UPDATE                    = "home/ota/check_update";
 
@@ -25,16 +34,21 @@ constexpr const char* MQTT_TOPIC_RAD_SUFFIX_POWER_SET                = "/power/s
 // Home Assistant climate topics
 constexpr const char* MQTT_TOPIC_RAD_SUFFIX_MODE                     = "/mode";                 // ["off", "heat"]
 constexpr const char* MQTT_TOPIC_RAD_SUFFIX_MODE_SET                 = "/mode/set";             // ["off", "heat"]
-constexpr const char* MQTT_TOPIC_RAD_SUFFIX_PRESET_MODE              = "/preset_mode";          // ["comfort", "eco", "away"]
-constexpr const char* MQTT_TOPIC_RAD_SUFFIX_PRESET_MODE_SET          = "/preset_mode/set";      // ["comfort", "eco", "away"]
+constexpr const char* MQTT_TOPIC_RAD_SUFFIX_PRESET_MODE              = "/preset_mode";          // ["comfort", "comfort-1", "comfort-2", "eco", "away"]
+constexpr const char* MQTT_TOPIC_RAD_SUFFIX_PRESET_MODE_SET          = "/preset_mode/set";      // ["comfort", "comfort-1", "comfort-2", "eco", "away"]
 constexpr const char* MQTT_TOPIC_RAD_SUFFIX_AVAILABILITY             = "/availability";         // ["online", "offline"]
 constexpr const char* MQTT_TOPIC_RAD_SUFFIX_ACTION                   = "/action";               // ["off", "heating", "idle"]
+constexpr const char* MQTT_TOPIC_RAD_SUFFIX_TARGET_TEMPERATURE       = "/target_temperature";   // [float]
+constexpr const char* MQTT_TOPIC_RAD_SUFFIX_TARGET_TEMPERATURE_SET   = "/target_temperature/set"; // [float], out of range (e.g. 0) disables the regulation
 // Home Assistant update topics
 constexpr const char* MQTT_TOPIC_RAD_SUFFIX_UPDATE_STATE             = "/update/state";         // {installed_version, in_progress }
 constexpr const char* MQTT_TOPIC_RAD_SUFFIX_UPDATE_COMMAND           = "/update/command";
 // Home Assistant sensors topics
 constexpr const char* MQTT_TOPIC_RAD_SUFFIX_SENSOR_TEMPERATURE       = "/sensor/temperature";   // [float]
 constexpr const char* MQTT_TOPIC_RAD_SUFFIX_SENSOR_HUMIDITY          = "/sensor/humidity";      // [float]
+constexpr const char* MQTT_TOPIC_RAD_SUFFIX_SENSOR_PILOT_WIRE_JITTER = "/sensor/pilot_wire_jitter"; // [int], us
+constexpr const char* MQTT_TOPIC_RAD_SUFFIX_SENSOR_IDLE              = "/sensor/idle";          // [int], % of the time in the idle delay
+constexpr const char* MQTT_TOPIC_RAD_SUFFIX_SENSOR_ENERGY            = "/sensor/energy";        // {"hourly": kWh, "daily": kWh, "<pilot wire state>": s, ...}
 // Custom topics
 constexpr const char* MQTT_TOPIC_RAD_SUFFIX_FIRMWARE_VERSION         = "/firmware_version";
 constexpr const char* MQTT_TOPIC_RAD_SUFFIX_FIRMWARE_VERSION_GET     = "/firmware_version/get";
@@ -42,6 +56,12 @@ constexpr const char* MQTT_TOPIC_RAD_SUFFIX_SERIAL_NUMBER            = "/serial_
 constexpr const char* MQTT_TOPIC_RAD_SUFFIX_SERIAL_NUMBER_GET        = "/serial_number/get";
 constexpr const char* MQTT_TOPIC_RAD_SUFFIX_TEMPERATURE_OFFSET_SET   = "/sensor/temperature_offset/set";
 constexpr const char* MQTT_TOPIC_RAD_SUFFIX_HUMIDITY_OFFSET_SET      = "/sensor/humidity_offset/set";
+constexpr const char* MQTT_TOPIC_RAD_SUFFIX_HISTORY                  = "/history";              // {"samples": [[time (unix, s), temperature, humidity, rssi (null if not connected)], ...]}
+constexpr const char* MQTT_TOPIC_RAD_SUFFIX_THERMOSTAT_HYSTERESIS_SET = "/thermostat/hysteresis/set"; // [float]
+constexpr const char* MQTT_TOPIC_RAD_SUFFIX_RADIATOR_POWER_SET       = "/energy/power/set";     // [int], W, 0 if unknown
+constexpr const char* MQTT_TOPIC_RAD_SUFFIX_POWER_SAVE_LATENCY_SET   = "/power_save/latency/set"; // [int], ms, command latency bound, 0 disables the idle mode
+constexpr const char* MQTT_TOPIC_RAD_SUFFIX_CONFIG                   = "/config";               // {"serial_number", "room_name", "temperature_offset", "humidity_offset", "target_temperature" (null if disabled), "thermostat_hysteresis", "radiator_power", "power_save_latency"}, retained
+constexpr const char* MQTT_TOPIC_RAD_SUFFIX_CONFIG_SET               = "/config/set";           // Any keys of /config, applied at once or not at all
 
 /* MQTT PAYPLOAD */
 // Home Assitant
@@ -70,6 +90,8 @@ enum Mode {
 // Preset mode
 constexpr const char* MQTT_PAYLOAD_PRESET_MODE_UNKNOWN  = "unknown";
 constexpr const char* MQTT_PAYLOAD_PRESET_MODE_COMFORT  = "comfort";
+constexpr const char* MQTT_PAYLOAD_PRESET_MODE_COMFORT_MINUS_1 = "comfort-1";
+constexpr const char* MQTT_PAYLOAD_PRESET_MODE_COMFORT_MINUS_2 = "comfort-2";
 constexpr const char* MQTT_PAYLOAD_PRESET_MODE_ECO      = "eco";
 constexpr const char* MQTT_PAYLOAD_PRESET_MODE_AWAY     = "away";
 enum PresetMode {
@@ -77,6 +99,8 @@ enum PresetMode {
   PRESET_MODE_COMFORT,
   PRESET_MODE_ECO,
   PRESET_MODE_AWAY,
+  PRESET_MODE_COMFORT_MINUS_1,
+  PRESET_MODE_COMFORT_MINUS_2,
 };
 // Action
 constexpr const char* MQTT_PAYLOAD_ACTION_UNKNOWN = "unknown";
@@ -126,6 +150,8 @@ const char* getMqttPayload(enum PresetMode preset_mode) {
     case PRESET_MODE_COMFORT: return MQTT_PAYLOAD_PRESET_MODE_COMFORT;
     case PRESET_MODE_ECO: return MQTT_PAYLOAD_PRESET_MODE_ECO;
     case PRESET_MODE_AWAY: return MQTT_PAYLOAD_PRESET_MODE_AWAY;
+    case PRESET_MODE_COMFORT_MINUS_1: return MQTT_PAYLOAD_PRESET_MODE_COMFORT_MINUS_1;
+    case PRESET_MODE_COMFORT_MINUS_2: return MQTT_PAYLOAD_PRESET_MODE_COMFORT_MINUS_2;
     default: return MQTT_PAYLOAD_PRESET_MODE_UNKNOWN;
   }
 }
@@ -156,6 +182,8 @@ enum PresetMode getPresetModeFromMqttPayload(const char* payload, size_t size) {
   if      (isPayloadEqual<MQTT_PAYLOAD_PRESET_MODE_COMFORT>(payload, size)) return PRESET_MODE_COMFORT;
   else if (isPayloadEqual<MQTT_PAYLOAD_PRESET_MODE_ECO>(payload, size))     return PRESET_MODE_ECO;
   else if (isPayloadEqual<MQTT_PAYLOAD_PRESET_MODE_AWAY>(payload, size))    return PRESET_MODE_AWAY;
+  else if (isPayloadEqual<MQTT_PAYLOAD_PRESET_MODE_COMFORT_MINUS_1>(payload, size)) return PRESET_MODE_COMFORT_MINUS_1;
+  else if (isPayloadEqual<MQTT_PAYLOAD_PRESET_MODE_COMFORT_MINUS_2>(payload, size)) return PRESET_MODE_COMFORT_MINUS_2;
   return PRESET_MODE_UNKNOWN;
 }
 
@@ -197,6 +225,22 @@ public:
     mMqttTopicSensorHumidityConfig = MQTT_TOPIC_HA_SENSOR_HUMIDITY_CONFIG;
     mMqttTopicSensorHumidityConfig.replace("%s", roomName);
     mMqttTopicSensorHumidityConfig.replace("%d", String(serialNumber));
+
+    mMqttTopicSensorPilotWireJitterConfig = MQTT_TOPIC_HA_SENSOR_PILOT_WIRE_JITTER_CONFIG;
+    mMqttTopicSensorPilotWireJitterConfig.replace("%s", roomName);
+    mMqttTopicSensorPilotWireJitterConfig.replace("%d", String(serialNumber));
+
+    mMqttTopicSensorEnergyHourlyConfig = MQTT_TOPIC_HA_SENSOR_ENERGY_HOURLY_CONFIG;
+    mMqttTopicSensorEnergyHourlyConfig.replace("%s", roomName);
+    mMqttTopicSensorEnergyHourlyConfig.replace("%d", String(serialNumber));
+
+    mMqttTopicSensorEnergyDailyConfig = MQTT_TOPIC_HA_SENSOR_ENERGY_DAILY_CONFIG;
+    mMqttTopicSensorEnergyDailyConfig.replace("%s", roomName);
+    mMqttTopicSensorEnergyDailyConfig.replace("%d", String(serialNumber));
+
+    mMqttTopicSensorIdleConfig = MQTT_TOPIC_HA_SENSOR_IDLE_CONFIG;
+    mMqttTopicSensorIdleConfig.replace("%s", roomName);
+    mMqttTopicSensorIdleConfig.replace("%d", String(serialNumber));
   }
 
   char* getRadTopic(const char* topicSuffix) {
@@ -215,25 +259,103 @@ public:
     }
   }
 
+  // Entity state, kept in the snapshot and sent again on reconnect and Home Assistant restart.
+  // Only the states of the switch and the climate modes are retained, not the telemetry.
+  void publishState(const char* topic, const char* payload, bool retain = false) {
+    if (!mSnapshot.setState(topic, payload, retain)) {
+      Serial.print("ERROR: State not kept in the snapshot [");
+      Serial.print(topic);
+      Serial.println("]");
+    }
+    if (mClient.connected()) {
+      publishMessage(topic, payload, retain);
+    }
+  }
+
+  // Discovery config, only sent if it changed since the last send
+  void publishDiscoveryConfig(const char* topic, const char* payload) {
+    if (mSnapshot.isConfigChanged(topic, payload)) {
+      publishMessage(topic, payload, true);
+    }
+  }
+
+  // All the entity states in one burst
+  void publishSnapshot() {
+    Serial.printf("Publish snapshot of %u states\n", mSnapshot.getStateCount());
+    for (uint8_t i=0; i<mSnapshot.getStateCount(); i++) {
+      publishMessage(mSnapshot.getStateTopic(i), mSnapshot.getStatePayload(i), mSnapshot.getStateRetain(i));
+    }
+  }
+
+  // New broker connection, all the discovery configs are sent again
+  void clearDiscoveryConfigs() {
+    mSnapshot.clearConfigs();
+  }
+
+  void scheduleSnapshot(unsigned long nowMs, unsigned long delayMs) {
+    mSnapshot.schedule(nowMs, delayMs);
+  }
+
+  bool isSnapshotDue(unsigned long nowMs) {
+    return mSnapshot.isDue(nowMs);
+  }
+
   void publishMessage(const char* topic, const float value) {
     snprintf (mMsgPayload, MQTT_MSG_PAYLOAD_MAX_SIZE, "%.2f", value);
-    publishMessage(topic, mMsgPayload);
+    publishState(topic, mMsgPayload);
   }
 
   void publishMessage(enum Power power) {
-    publishMessage(getRadTopic(MQTT_TOPIC_RAD_SUFFIX_POWER), getMqttPayload(power));
+    publishState(getRadTopic(MQTT_TOPIC_RAD_SUFFIX_POWER), getMqttPayload(power), true);
   }
 
   void publishMessage(enum Mode mode) {
-    publishMessage(getRadTopic(MQTT_TOPIC_RAD_SUFFIX_MODE), getMqttPayload(mode));
+    publishState(getRadTopic(MQTT_TOPIC_RAD_SUFFIX_MODE), getMqttPayload(mode), true);
   }
 
   void publishMessage(enum PresetMode preset_mode) {
-    publishMessage(getRadTopic(MQTT_TOPIC_RAD_SUFFIX_PRESET_MODE), getMqttPayload(preset_mode));
+    publishState(getRadTopic(MQTT_TOPIC_RAD_SUFFIX_PRESET_MODE), getMqttPayload(preset_mode), true);
   }
 
   void publishMessage(enum Action action) {
-    publishMessage(getRadTopic(MQTT_TOPIC_RAD_SUFFIX_ACTION), getMqttPayload(action));
+    publishState(getRadTopic(MQTT_TOPIC_RAD_SUFFIX_ACTION), getMqttPayload(action));
+  }
+
+  void publishMessageEnergy(float hourlyKWh, float dailyKWh, const uint32_t *stateSeconds) {
+    StaticJsonDocument<256> state;
+    state["hourly"] = roundf(hourlyKWh * 1000) / 1000; // Wh resolution
+    state["daily"] = roundf(dailyKWh * 1000) / 1000;
+    state["comfort"] = stateSeconds[PILOT_WIRE_STATE_COMFORT];
+    state["comfort-1"] = stateSeconds[PILOT_WIRE_STATE_COMFORT_MINUS_1];
+    state["comfort-2"] = stateSeconds[PILOT_WIRE_STATE_COMFORT_MINUS_2];
+    state["eco"] = stateSeconds[PILOT_WIRE_STATE_ECO];
+    state["frost_protection"] = stateSeconds[PILOT_WIRE_STATE_FROST_PROTECTION];
+    state["off"] = stateSeconds[PILOT_WIRE_STATE_OFF];
+    serializeJson(state, mMsgPayload);
+    publishState(getRadTopic(MQTT_TOPIC_RAD_SUFFIX_SENSOR_ENERGY), mMsgPayload);
+  }
+
+  // Return false if the message is not sent, to send it again later
+  bool publishMessageHistory(const TelemetrySample *samples, uint8_t count) {
+    size_t size = snprintf(mMsgPayload, MQTT_MSG_PAYLOAD_MAX_SIZE, "{\"samples\":[");
+    for (uint8_t i=0; i<count && size < MQTT_MSG_PAYLOAD_MAX_SIZE; i++) {
+      size += snprintf(mMsgPayload + size, MQTT_MSG_PAYLOAD_MAX_SIZE - size, "%s[%lu,%.2f,%.1f,", i ? "," : "",
+                       (unsigned long)samples[i].time, samples[i].temperature / 100., samples[i].humidity / 10.);
+      if (size < MQTT_MSG_PAYLOAD_MAX_SIZE) {
+        size += samples[i].rssi ? snprintf(mMsgPayload + size, MQTT_MSG_PAYLOAD_MAX_SIZE - size, "%d]", samples[i].rssi)
+                                : snprintf(mMsgPayload + size, MQTT_MSG_PAYLOAD_MAX_SIZE - size, "null]");
+      }
+    }
+    if (size < MQTT_MSG_PAYLOAD_MAX_SIZE) {
+      size += snprintf(mMsgPayload + size, MQTT_MSG_PAYLOAD_MAX_SIZE - size, "]}");
+    }
+    if (size >= MQTT_MSG_PAYLOAD_MAX_SIZE) {
+      Serial.print("ERROR: Buffer payload is too small, need: ");
+      Serial.println(size);
+      return false;
+    }
+    Serial.printf("Publish message [%s]: %u samples\n", getRadTopic(MQTT_TOPIC_RAD_SUFFIX_HISTORY), count);
+    return mClient.publish(getRadTopic(MQTT_TOPIC_RAD_SUFFIX_HISTORY), mMsgPayload);
   }
 
   void publishMessageSwitchConfig() {
@@ -250,7 +372,7 @@ public:
       Serial.print("ERROR: Buffer payload is too small, need: ");
       Serial.println(size);
     }
-    publishMessage(mMqttTopicSwitchConfig.c_str(), mMsgPayload, true);
+    publishDiscoveryConfig(mMqttTopicSwitchConfig.c_str(), mMsgPayload);
   }
 
   void publishMessageClimateConfig() {
@@ -263,6 +385,8 @@ public:
     modes.add(MQTT_PAYLOAD_MODE_AUTO);
     JsonArray preset_modes = config.createNestedArray("preset_modes");
     preset_modes.add(MQTT_PAYLOAD_PRESET_MODE_COMFORT);
+    preset_modes.add(MQTT_PAYLOAD_PRESET_MODE_COMFORT_MINUS_1);
+    preset_modes.add(MQTT_PAYLOAD_PRESET_MODE_COMFORT_MINUS_2);
     preset_modes.add(MQTT_PAYLOAD_PRESET_MODE_ECO);
     preset_modes.add(MQTT_PAYLOAD_PRESET_MODE_AWAY);
     config["mode_command_topic"] = getRadTopic(MQTT_TOPIC_RAD_SUFFIX_MODE_SET);
@@ -273,6 +397,13 @@ public:
     config["current_humidity_topic"] = getRadTopic(MQTT_TOPIC_RAD_SUFFIX_SENSOR_HUMIDITY);
     config["availability_topic"] = getRadTopic(MQTT_TOPIC_RAD_SUFFIX_AVAILABILITY);
     config["action_topic"] = getRadTopic(MQTT_TOPIC_RAD_SUFFIX_ACTION);
+    config["temperature_command_topic"] = getRadTopic(MQTT_TOPIC_RAD_SUFFIX_TARGET_TEMPERATURE_SET);
+    config["temperature_state_topic"] = getRadTopic(MQTT_TOPIC_RAD_SUFFIX_TARGET_TEMPERATURE);
+    config["temperature_unit"] = "C";
+    config["min_temp"] = THERMOSTAT_SETPOINT_MIN;
+    config["max_temp"] = THERMOSTAT_SETPOINT_MAX;
+    config["temp_step"] = THERMOSTAT_SETPOINT_STEP;
+    config["precision"] = 0.1;
     config["retain"] = true;
     addDeviceJson(config);
     size_t size = serializeJson(config, mMsgPayload);
@@ -280,7 +411,7 @@ public:
       Serial.print("ERROR: Buffer payload is too small, need: ");
       Serial.println(size);
     }
-    publishMessage(mMqttTopicClimateConfig.c_str(), mMsgPayload, true);
+    publishDiscoveryConfig(mMqttTopicClimateConfig.c_str(), mMsgPayload);
   }
 
   void publishMessageUpdateConfig() {
@@ -300,7 +431,7 @@ public:
       Serial.print("ERROR: Buffer payload is too small, need: ");
       Serial.println(size);
     }
-    publishMessage(mMqttTopicUpdateConfig.c_str(), mMsgPayload, true);
+    publishDiscoveryConfig(mMqttTopicUpdateConfig.c_str(), mMsgPayload);
   }
 
   void publishMessageSensorTemperatureConfig() {
@@ -318,7 +449,7 @@ public:
       Serial.print("ERROR: Buffer payload is too small, need: ");
       Serial.println(size);
     }
-    publishMessage(mMqttTopicSensorTemperatureConfig.c_str(), mMsgPayload, true);
+    publishDiscoveryConfig(mMqttTopicSensorTemperatureConfig.c_str(), mMsgPayload);
   }
 
   void publishMessageSensorHumidityConfig() {
@@ -336,7 +467,88 @@ public:
       Serial.print("ERROR: Buffer payload is too small, need: ");
       Serial.println(size);
     }
-    publishMessage(mMqttTopicSensorHumidityConfig.c_str(), mMsgPayload, true);
+    publishDiscoveryConfig(mMqttTopicSensorHumidityConfig.c_str(), mMsgPayload);
+  }
+
+  void publishMessageSensorPilotWireJitterConfig() {
+    StaticJsonDocument<MQTT_MSG_PAYLOAD_MAX_SIZE> config;
+    config["name"] = "Pilot wire jitter";
+    config["unique_id"] = "id_radiator_pilot_wire_jitter_" + mRoomName + "_" + mSerialNumber;
+    config["platform"] = "sensor";
+    config["unit_of_measurement"] = "µs";
+    config["state_class"] = "measurement";
+    config["entity_category"] = MQTT_PAYLOAD_CATEGORY_DIAGNOSTIC;
+    config["state_topic"] = getRadTopic(MQTT_TOPIC_RAD_SUFFIX_SENSOR_PILOT_WIRE_JITTER);
+    config["availability_topic"] = getRadTopic(MQTT_TOPIC_RAD_SUFFIX_AVAILABILITY);
+    addDeviceJson(config);
+    size_t size = serializeJson(config, mMsgPayload);
+    if (size > MQTT_MSG_PAYLOAD_MAX_SIZE) {
+      Serial.print("ERROR: Buffer payload is too small, need: ");
+      Serial.println(size);
+    }
+    publishDiscoveryConfig(mMqttTopicSensorPilotWireJitterConfig.c_str(), mMsgPayload);
+  }
+
+  void publishMessageSensorIdleConfig() {
+    StaticJsonDocument<MQTT_MSG_PAYLOAD_MAX_SIZE> config;
+    config["name"] = "Idle";
+    config["unique_id"] = "id_radiator_idle_" + mRoomName + "_" + mSerialNumber;
+    config["platform"] = "sensor";
+    config["unit_of_measurement"] = "%";
+    config["state_class"] = "measurement";
+    config["entity_category"] = MQTT_PAYLOAD_CATEGORY_DIAGNOSTIC;
+    config["state_topic"] = getRadTopic(MQTT_TOPIC_RAD_SUFFIX_SENSOR_IDLE);
+    config["availability_topic"] = getRadTopic(MQTT_TOPIC_RAD_SUFFIX_AVAILABILITY);
+    addDeviceJson(config);
+    size_t size = serializeJson(config, mMsgPayload);
+    if (size > MQTT_MSG_PAYLOAD_MAX_SIZE) {
+      Serial.print("ERROR: Buffer payload is too small, need: ");
+      Serial.println(size);
+    }
+    publishDiscoveryConfig(mMqttTopicSensorIdleConfig.c_str(), mMsgPayload);
+  }
+
+  // Reset every hour
+  void publishMessageSensorEnergyHourlyConfig() {
+    StaticJsonDocument<MQTT_MSG_PAYLOAD_MAX_SIZE> config;
+    config["name"] = "Energy hourly";
+    config["unique_id"] = "id_radiator_energy_hourly_" + mRoomName + "_" + mSerialNumber;
+    config["platform"] = "sensor";
+    config["device_class"] = "energy";
+    config["unit_of_measurement"] = "kWh";
+    config["state_class"] = "total_increasing";
+    config["state_topic"] = getRadTopic(MQTT_TOPIC_RAD_SUFFIX_SENSOR_ENERGY);
+    config["value_template"] = "{{ value_json.hourly }}";
+    config["availability_topic"] = getRadTopic(MQTT_TOPIC_RAD_SUFFIX_AVAILABILITY);
+    addDeviceJson(config);
+    size_t size = serializeJson(config, mMsgPayload);
+    if (size > MQTT_MSG_PAYLOAD_MAX_SIZE) {
+      Serial.print("ERROR: Buffer payload is too small, need: ");
+      Serial.println(size);
+    }
+    publishDiscoveryConfig(mMqttTopicSensorEnergyHourlyConfig.c_str(), mMsgPayload);
+  }
+
+  // Reset every local day, the pilot wire state times are its attributes
+  void publishMessageSensorEnergyDailyConfig() {
+    StaticJsonDocument<MQTT_MSG_PAYLOAD_MAX_SIZE> config;
+    config["name"] = "Energy daily";
+    config["unique_id"] = "id_radiator_energy_daily_" + mRoomName + "_" + mSerialNumber;
+    config["platform"] = "sensor";
+    config["device_class"] = "energy";
+    config["unit_of_measurement"] = "kWh";
+    config["state_class"] = "total_increasing";
+    config["state_topic"] = getRadTopic(MQTT_TOPIC_RAD_SUFFIX_SENSOR_ENERGY);
+    config["value_template"] = "{{ value_json.daily }}";
+    config["json_attributes_topic"] = getRadTopic(MQTT_TOPIC_RAD_SUFFIX_SENSOR_ENERGY);
+    config["availability_topic"] = getRadTopic(MQTT_TOPIC_RAD_SUFFIX_AVAILABILITY);
+    addDeviceJson(config);
+    size_t size = serializeJson(config, mMsgPayload);
+    if (size > MQTT_MSG_PAYLOAD_MAX_SIZE) {
+      Serial.print("ERROR: Buffer payload is too small, need: ");
+      Serial.println(size);
+    }
+    publishDiscoveryConfig(mMqttTopicSensorEnergyDailyConfig.c_str(), mMsgPayload);
   }
 
   void publishMessageUpdateState(const char* latest_version, bool in_progress = false) {
@@ -349,7 +561,7 @@ public:
       Serial.print("ERROR: Buffer payload is too small, need: ");
       Serial.println(size);
     }
-    publishMessage(getRadTopic(MQTT_TOPIC_RAD_SUFFIX_UPDATE_STATE), mMsgPayload, true);
+    publishState(getRadTopic(MQTT_TOPIC_RAD_SUFFIX_UPDATE_STATE), mMsgPayload, true);
   }
 
   void deleteMessageUpdateCommand() {
@@ -377,7 +589,12 @@ private:
   String mMqttTopicUpdateConfig = "";
   String mMqttTopicSensorTemperatureConfig = "";
   String mMqttTopicSensorHumidityConfig = "";
+  String mMqttTopicSensorPilotWireJitterConfig = "";
+  String mMqttTopicSensorEnergyHourlyConfig = "";
+  String mMqttTopicSensorEnergyDailyConfig = "";
+  String mMqttTopicSensorIdleConfig = "";
   PubSubClient &mClient;
+  MqttSnapshot mSnapshot;
   String mVersion = "";
   String mRoomName = "";
   String mMacWifi = "";
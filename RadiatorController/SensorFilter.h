@@ -0,0 +1,187 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * Sensor filters on fixed point values (x100), independent of the DHT22 driver.
+ *
+ *  - MedianFilter: median of the last N samples, a single glitch never reaches the output.
+ *  - RunningAverage: mean of the last N samples, the sum is updated on each sample.
+ *  - EmaFilter: exponential moving average with a weight of 1/2^shift.
+ *  - SensorFilter: median then mean, the pipeline of the sensors.
+ *  - PublishDeadband: tells when a value moved enough, or the heartbeat elapsed, to be published.
+ *
+ * Invalid readings are not added, so any value, 0 included, is a valid sample.
+ */
+
+template <uint8_t N>
+class MedianFilter {
+public:
+  void add(int16_t value) {
+    mValues[mIndex] = value;
+    mIndex = (mIndex + 1) % N;
+    if (mCount < N) {
+      mCount++;
+    }
+  }
+
+  void reset() {
+    mCount = 0;
+    mIndex = 0;
+  }
+
+  uint8_t getCount() const {
+    return mCount;
+  }
+
+  // Median of the samples received so far, the upper one for an even count
+  int16_t get() const {
+    int16_t sorted[N];
+    for (uint8_t i=0; i<mCount; i++) {
+      int16_t value = mValues[i];
+      uint8_t j = i;
+      while (j > 0 && sorted[j-1] > value) {
+        sorted[j] = sorted[j-1];
+        j--;
+      }
+      sorted[j] = value;
+    }
+    return mCount ? sorted[mCount / 2] : 0;
+  }
+
+private:
+  int16_t mValues[N] = {};
+  uint8_t mIndex = 0;
+  uint8_t mCount = 0;
+};
+
+template <uint8_t N>
+class RunningAverage {
+public:
+  void add(int16_t value) {
+    if (mCount == N) {
+      mSum -= mValues[mIndex];
+    } else {
+      mCount++;
+    }
+    mValues[mIndex] = value;
+    mSum += value;
+    mIndex = (mIndex + 1) % N;
+  }
+
+  void reset() {
+    mSum = 0;
+    mCount = 0;
+    mIndex = 0;
+  }
+
+  uint8_t getCount() const {
+    return mCount;
+  }
+
+  // Rounded to the nearest
+  int16_t get() const {
+    if (mCount == 0) {
+      return 0;
+    }
+    return (mSum >= 0 ? mSum + mCount / 2 : mSum - mCount / 2) / mCount;
+  }
+
+private:
+  int16_t mValues[N] = {};
+  int32_t mSum = 0;
+  uint8_t mIndex = 0;
+  uint8_t mCount = 0;
+};
+
+class EmaFilter {
+public:
+  EmaFilter(uint8_t shift) : mShift(shift) {
+  }
+
+  void add(int16_t value) {
+    int32_t sample = (int32_t)value * 256; // 8 more bits, small steps are not lost
+    if (mCount == 0) {
+      mState = sample;
+    } else {
+      mState += (sample - mState) / (1 << mShift);
+    }
+    if (mCount < UINT8_MAX) {
+      mCount++;
+    }
+  }
+
+  void reset() {
+    mState = 0;
+    mCount = 0;
+  }
+
+  uint8_t getCount() const {
+    return mCount;
+  }
+
+  int16_t get() const {
+    return (mState >= 0 ? mState + 128 : mState - 128) / 256;
+  }
+
+private:
+  uint8_t mShift;
+  int32_t mState = 0;
+  uint8_t mCount = 0;
+};
+
+template <uint8_t MEDIAN, uint8_t AVERAGE>
+class SensorFilter {
+public:
+  void add(int16_t value) {
+    mMedian.add(value);
+    mAverage.add(mMedian.get());
+  }
+
+  void reset() {
+    mMedian.reset();
+    mAverage.reset();
+  }
+
+  uint8_t getCount() const {
+    return mAverage.getCount();
+  }
+
+  int16_t get() const {
+    return mAverage.get();
+  }
+
+private:
+  MedianFilter<MEDIAN> mMedian;
+  RunningAverage<AVERAGE> mAverage;
+};
+
+class PublishDeadband {
+public:
+  PublishDeadband(int16_t threshold, unsigned long heartbeatMs) : mThreshold(threshold), mHeartbeatMs(heartbeatMs) {
+  }
+
+  // Return true if the value has to be published, it becomes the reference
+  bool check(int16_t value, unsigned long nowMs) {
+    if (mPending || abs(value - mLast) >= mThreshold || nowMs - mLastMs >= mHeartbeatMs) {
+      mPending = false;
+      mLast = value;
+      mLastMs = nowMs;
+      return true;
+    }
+    return false;
+  }
+
+  // Publish the next value whatever it is
+  void reset() {
+    mPending = true;
+  }
+
+private:
+  int16_t mThreshold;
+  unsigned long mHeartbeatMs;
+  int16_t mLast = 0;
+  unsigned long mLastMs = 0;
+  bool mPending = true;
+};
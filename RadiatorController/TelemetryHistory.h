@@ -0,0 +1,171 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Samples taken while the broker is not reachable, delta-encoded in RAM.
+ *
+ * The buffer is a ring of TELEMETRY_BLOCK_MAX blocks of TELEMETRY_BLOCK_SIZE bytes.
+ * Each block starts with a key record holding the full sample, then each sample is a
+ * delta record from the previous one. A sample too far from the previous one starts a
+ * new key record. When the ring is full, the oldest block is dropped, so the blocks
+ * can be decoded and sent one by one, oldest first.
+ *
+ * Key record (10 bytes): TELEMETRY_KEY_MARKER, time (uint32), temperature (int16),
+ * humidity (uint16), rssi (int8). Delta record (4 bytes): temperature (int8, never
+ * TELEMETRY_KEY_MARKER), humidity (int8), rssi (int8), time (uint8).
+ * Multi-byte values are little-endian.
+ */
+
+constexpr uint16_t TELEMETRY_BLOCK_SIZE = 256;
+constexpr uint8_t TELEMETRY_BLOCK_MAX = 16;   // 4 KB of RAM
+constexpr uint8_t TELEMETRY_KEY_SIZE = 10;
+constexpr uint8_t TELEMETRY_DELTA_SIZE = 4;
+constexpr uint8_t TELEMETRY_KEY_MARKER = 0x80;
+constexpr uint8_t TELEMETRY_BLOCK_SAMPLE_MAX = 1 + (TELEMETRY_BLOCK_SIZE - TELEMETRY_KEY_SIZE) / TELEMETRY_DELTA_SIZE;
+
+struct TelemetrySample {
+  uint32_t time;        // Unix time in s
+  int16_t temperature;  // x100, Celsius
+  uint16_t humidity;    // x10, %
+  int8_t rssi;          // dBm, 0 if WiFi is not connected
+};
+
+class TelemetryHistory {
+public:
+  void add(const TelemetrySample &sample) {
+    int32_t temperature = sample.temperature - mLast.temperature;
+    int32_t humidity = sample.humidity - mLast.humidity;
+    int32_t rssi = sample.rssi - mLast.rssi;
+    uint32_t time = sample.time - mLast.time;
+    bool delta = mCount > 0 && mBlockUsed[mHead] > 0 &&
+                 temperature > -128 && temperature <= 127 &&
+                 humidity >= -128 && humidity <= 127 &&
+                 rssi >= -128 && rssi <= 127 &&
+                 sample.time >= mLast.time && time <= 255;
+
+    if (delta && mBlockUsed[mHead] + TELEMETRY_DELTA_SIZE <= TELEMETRY_BLOCK_SIZE) {
+      uint8_t *record = mBlocks[mHead] + mBlockUsed[mHead];
+      record[0] = (uint8_t)(int8_t)temperature;
+      record[1] = (uint8_t)(int8_t)humidity;
+      record[2] = (uint8_t)(int8_t)rssi;
+      record[3] = (uint8_t)time;
+      mBlockUsed[mHead] += TELEMETRY_DELTA_SIZE;
+    } else {
+      if (mCount == 0 || mBlockUsed[mHead] + TELEMETRY_KEY_SIZE > TELEMETRY_BLOCK_SIZE) {
+        newBlock();
+      }
+      uint8_t *record = mBlocks[mHead] + mBlockUsed[mHead];
+      record[0] = TELEMETRY_KEY_MARKER;
+      writeLe(record + 1, sample.time, 4);
+      writeLe(record + 5, (uint16_t)sample.temperature, 2);
+      writeLe(record + 7, sample.humidity, 2);
+      record[9] = (uint8_t)sample.rssi;
+      mBlockUsed[mHead] += TELEMETRY_KEY_SIZE;
+    }
+    mLast = sample;
+    mSampleCount++;
+  }
+
+  uint8_t getBlockCount() const {
+    return mCount;
+  }
+
+  uint32_t getSampleCount() const {
+    return mSampleCount;
+  }
+
+  // Bytes used by the records
+  uint32_t getUsedSize() const {
+    uint32_t size = 0;
+    for (uint8_t i=0; i<mCount; i++) {
+      size += mBlockUsed[(mTail + i) % TELEMETRY_BLOCK_MAX];
+    }
+    return size;
+  }
+
+  // Decode the oldest block, samples must hold TELEMETRY_BLOCK_SAMPLE_MAX samples
+  uint8_t readOldestBlock(TelemetrySample *samples) const {
+    const uint8_t *block = mBlocks[mTail];
+    TelemetrySample sample = {};
+    uint8_t count = 0;
+
+    if (mCount == 0) {
+      return 0;
+    }
+    for (uint16_t i=0; i<mBlockUsed[mTail]; ) {
+      if (block[i] == TELEMETRY_KEY_MARKER) {
+        sample.time = readLe(block + i + 1, 4);
+        sample.temperature = (int16_t)readLe(block + i + 5, 2);
+        sample.humidity = readLe(block + i + 7, 2);
+        sample.rssi = (int8_t)block[i + 9];
+        i += TELEMETRY_KEY_SIZE;
+      } else {
+        sample.temperature += (int8_t)block[i];
+        sample.humidity += (int8_t)block[i + 1];
+        sample.rssi += (int8_t)block[i + 2];
+        sample.time += block[i + 3];
+        i += TELEMETRY_DELTA_SIZE;
+      }
+      samples[count++] = sample;
+    }
+    return count;
+  }
+
+  void dropOldestBlock() {
+    if (mCount == 0) {
+      return;
+    }
+    mSampleCount -= countSamples(mTail);
+    mBlockUsed[mTail] = 0;
+    mTail = (mTail + 1) % TELEMETRY_BLOCK_MAX;
+    mCount--;
+  }
+
+  void clear() {
+    while (mCount > 0) {
+      dropOldestBlock();
+    }
+  }
+
+private:
+  void newBlock() {
+    if (mCount == TELEMETRY_BLOCK_MAX) {
+      dropOldestBlock();
+    }
+    mHead = (mTail + mCount) % TELEMETRY_BLOCK_MAX;
+    mBlockUsed[mHead] = 0;
+    mCount++;
+  }
+
+  uint8_t countSamples(uint8_t index) const {
+    uint8_t count = 0;
+    for (uint16_t i=0; i<mBlockUsed[index]; count++) {
+      i += mBlocks[index][i] == TELEMETRY_KEY_MARKER ? TELEMETRY_KEY_SIZE : TELEMETRY_DELTA_SIZE;
+    }
+    return count;
+  }
+
+  static void writeLe(uint8_t *data, uint32_t value, uint8_t size) {
+    for (uint8_t i=0; i<size; i++) {
+      data[i] = value >> (8 * i);
+    }
+  }
+
+  static uint32_t readLe(const uint8_t *data, uint8_t size) {
+    uint32_t value = 0;
+    for (uint8_t i=0; i<size; i++) {
+      value |= (uint32_t)data[i] << (8 * i);
+    }
+    return value;
+  }
+
+  uint8_t mBlocks[TELEMETRY_BLOCK_MAX][TELEMETRY_BLOCK_SIZE] = {};
+  uint16_t mBlockUsed[TELEMETRY_BLOCK_MAX] = {};
+  uint8_t mTail = 0;
+  uint8_t mHead = 0;
+  uint8_t mCount = 0;
+  uint32_t mSampleCount = 0;
+  TelemetrySample mLast = {};
+};
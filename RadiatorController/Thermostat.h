@@ -0,0 +1,84 @@
+#pragma once
+
+#include <math.h>
+
+/*
+ * Hysteresis thermostat for the comfort preset in heat mode.
+ *
+ * The radiator heats (pilot wire comfort) below setpoint - hysteresis and stops
+ * (pilot wire eco) above setpoint + hysteresis. A state is kept at least
+ * THERMOSTAT_MIN_STATE_MS, so a noisy temperature cannot toggle the pilot wire, except
+ * after a setpoint change. Without setpoint, as in a blank EEPROM, or without valid
+ * temperature, the radiator stays in comfort and only its own thermostat regulates.
+ */
+
+constexpr float THERMOSTAT_SETPOINT_MIN = 5;
+constexpr float THERMOSTAT_SETPOINT_MAX = 30;
+constexpr float THERMOSTAT_SETPOINT_STEP = 0.5;
+constexpr float THERMOSTAT_HYSTERESIS_DEFAULT = 0.3;
+constexpr float THERMOSTAT_HYSTERESIS_MAX = 2;
+constexpr unsigned long THERMOSTAT_MIN_STATE_MS = 300000;
+
+inline bool isThermostatSetpointValid(float setpoint) {
+  return setpoint >= THERMOSTAT_SETPOINT_MIN && setpoint <= THERMOSTAT_SETPOINT_MAX;
+}
+
+inline bool isThermostatHysteresisValid(float hysteresis) {
+  return hysteresis >= 0 && hysteresis <= THERMOSTAT_HYSTERESIS_MAX;
+}
+
+class Thermostat {
+public:
+  // NAN disables the regulation
+  void setSetpoint(float setpoint) {
+    mSetpoint = isThermostatSetpointValid(setpoint) ? setpoint : NAN;
+    mLocked = false;
+  }
+
+  float getSetpoint() const {
+    return mSetpoint;
+  }
+
+  void setHysteresis(float hysteresis) {
+    mHysteresis = isThermostatHysteresisValid(hysteresis) ? hysteresis : THERMOSTAT_HYSTERESIS_DEFAULT;
+  }
+
+  float getHysteresis() const {
+    return mHysteresis;
+  }
+
+  bool isEnabled() const {
+    return !isnan(mSetpoint);
+  }
+
+  bool isHeating() const {
+    return mHeating;
+  }
+
+  // Return true if the radiator has to heat
+  bool update(float temperature, unsigned long nowMs) {
+    bool heating = mHeating;
+
+    if (!isEnabled() || isnan(temperature)) {
+      heating = true;
+    } else if (temperature <= mSetpoint - mHysteresis) {
+      heating = true;
+    } else if (temperature >= mSetpoint + mHysteresis) {
+      heating = false;
+    }
+
+    if (heating != mHeating && (!mLocked || nowMs - mLastSwitchMs >= THERMOSTAT_MIN_STATE_MS)) {
+      mHeating = heating;
+      mLastSwitchMs = nowMs;
+      mLocked = true;
+    }
+    return mHeating;
+  }
+
+private:
+  float mSetpoint = NAN;
+  float mHysteresis = THERMOSTAT_HYSTERESIS_DEFAULT;
+  bool mHeating = true;
+  bool mLocked = false;
+  unsigned long mLastSwitchMs = 0;
+};
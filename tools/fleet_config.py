@@ -0,0 +1,160 @@
+#!/bin/python3
+
+import argparse
+import colorama
+import dotenv
+import json
+import math
+import os
+import paho.mqtt.client as mqtt
+import sys
+import threading
+import time
+
+dotenv.load_dotenv("credentials.env")
+colorama.init(autoreset=True)
+
+mqtt_host     = os.getenv("MQTT_BROKER_HOST")
+mqtt_port     = int(os.getenv("MQTT_BROKER_PORT"))
+mqtt_username = os.getenv("MQTT_USERNAME")
+mqtt_password = os.getenv("MQTT_PASSWORD")
+
+CONFIG_SUFFIX     = "/config"
+CONFIG_SET_SUFFIX = "/config/set"
+
+class Device:
+    def __init__(self, prefix, config):
+        self.prefix = prefix
+        self.wanted = config
+        self.current = None
+        self.changes = {}
+        self.done = False
+        # The device restarts with the topics of its new room name
+        room = config.get("room_name")
+        parts = prefix.split("/")
+        if room and len(parts) == 3:
+            parts[1] = room
+        self.new_prefix = "/".join(parts)
+
+    def differs(self, key, value):
+        current = self.current.get(key) if self.current else None
+        if all(isinstance(v, (int, float)) and not isinstance(v, bool) for v in (value, current)):
+            return not math.isclose(value, current, abs_tol=1e-3)
+        return value != current
+
+    def is_applied(self):
+        return self.current is not None and not any(self.differs(k, v) for k, v in self.wanted.items())
+
+def load_fleet(path):
+    with open(path) as f:
+        fleet = json.load(f)
+    defaults = fleet.get("defaults", {})
+    devices = []
+    for item in fleet["devices"]:
+        config = dict(defaults.get(item["prefix"].split("/")[-1], {}))
+        config.update(item["config"])
+        devices.append(Device(item["prefix"], config))
+    return devices
+
+def on_connect(client, userdata, flags, reason_code):
+    if reason_code != 0:
+        print(f"Connection failed: {mqtt.connack_string(reason_code)}")
+        return
+    for device in userdata["devices"]:
+        client.subscribe(device.prefix + CONFIG_SUFFIX, qos=1)
+        if device.new_prefix != device.prefix:
+            client.subscribe(device.new_prefix + CONFIG_SUFFIX, qos=1)
+    userdata["connected"].set()
+
+def on_message(client, userdata, msg):
+    # Empty payload when a device clears the retained config of its previous topics
+    if not msg.payload:
+        return
+    try:
+        config = json.loads(msg.payload)
+    except ValueError:
+        print(colorama.Fore.YELLOW + f"{msg.topic}: invalid JSON")
+        return
+    with userdata["lock"]:
+        for device in userdata["devices"]:
+            if msg.topic in (device.prefix + CONFIG_SUFFIX, device.new_prefix + CONFIG_SUFFIX):
+                device.current = config
+        userdata["lock"].notify_all()
+
+def mqtt_connect(client):
+    client.on_connect = on_connect
+    client.on_message = on_message
+    client.username_pw_set(mqtt_username, mqtt_password)
+    try:
+        client.connect(mqtt_host, mqtt_port, 60)
+    except Exception as e:
+        print(f"Error connecting to MQTT broker: {e}")
+        exit(1)
+
+def wait(userdata, timeout, condition):
+    deadline = time.monotonic() + timeout
+    with userdata["lock"]:
+        while not condition() and time.monotonic() < deadline:
+            userdata["lock"].wait(deadline - time.monotonic())
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Push the NVM config of a fleet of devices over MQTT")
+    parser.add_argument("fleet",          help="Fleet JSON file (see fleet_STUB.json)")
+    parser.add_argument("--read-timeout", type=float, default=3,  help="Wait for the retained configs, in s (default: 3)")
+    parser.add_argument("--timeout",      type=float, default=30, help="Wait for the devices to apply, in s (default: 30)")
+    parser.add_argument("--dry-run",      action="store_true",    help="Only print the changes")
+    args = parser.parse_args()
+
+    userdata = {
+        "devices": load_fleet(args.fleet),
+        "lock": threading.Condition(),
+        "connected": threading.Event(),
+    }
+    devices = userdata["devices"]
+
+    client = mqtt.Client(userdata=userdata)
+    mqtt_connect(client)
+    client.loop_start()
+    if not userdata["connected"].wait(10):
+        print("Error connecting to MQTT broker: timeout")
+        exit(1)
+
+    # Current config of each device, retained on its /config topic
+    wait(userdata, args.read_timeout, lambda: all(d.current is not None for d in devices))
+
+    # Only the changed keys, all the devices at once
+    with userdata["lock"]:
+        for device in devices:
+            device.changes = {k: v for k, v in device.wanted.items() if device.differs(k, v)}
+            if device.current is None:
+                print(colorama.Fore.YELLOW + f"{device.prefix}: no config received, all the keys are sent")
+            if not device.changes:
+                device.done = True
+                print(colorama.Fore.GREEN + f"{device.prefix}: up to date")
+                continue
+            print(f"{device.prefix}: {json.dumps(device.changes)}")
+            if not args.dry_run:
+                device.current = None
+                client.publish(device.prefix + CONFIG_SET_SUFFIX, json.dumps(device.changes), qos=1)
+
+    if args.dry_run:
+        client.loop_stop()
+        exit(0)
+
+    # Each device publishes its config once applied, after a restart for a new room name
+    wait(userdata, args.timeout, lambda: all(d.done or d.is_applied() for d in devices))
+    client.loop_stop()
+
+    failed = 0
+    for device in devices:
+        if device.done:
+            continue
+        if device.is_applied():
+            print(colorama.Fore.GREEN + f"{device.new_prefix}: applied")
+        elif device.current is None:
+            print(colorama.Fore.RED + f"{device.prefix}: no answer, invalid config or device offline")
+            failed += 1
+        else:
+            print(colorama.Fore.RED + f"{device.prefix}: differs {json.dumps(device.current)}")
+            failed += 1
+    sys.exit(1 if failed else 0)